@@ -48,14 +48,14 @@ typedef struct {
 } attr_spec;
 
 /* Container attributes */
-static const attr_spec fixed_dim_attr = {1, 3,
-    {"shape", "stride", "order"},
-    {AttrInt64, AttrInt64, AttrChar}};
-static const attr_spec var_dim_attr = {1, 6,
-   {"shapes", "_nshapes", "offsets", "_noffsets", "bitmap", "_nbitmap"},
-   {AttrInt64List, AttrInt64, AttrInt64List, AttrInt64, AttrInt64List, AttrInt64}};
-
-static const attr_spec tuple_record_attr = {0, 2, {"align", "pack"}, {AttrUint16Opt, AttrUint16Opt}};
+static const attr_spec fixed_dim_attr = {1, 4,
+    {"shape", "stride", "order", "align"},
+    {AttrInt64, AttrInt64, AttrChar, AttrUint16Opt}};
+static const attr_spec var_dim_attr = {1, 7,
+   {"shapes", "_nshapes", "offsets", "_noffsets", "bitmap", "_nbitmap", "align"},
+   {AttrInt64List, AttrInt64, AttrInt64List, AttrInt64, AttrInt64List, AttrInt64, AttrUint16Opt}};
+
+static const attr_spec tuple_record_attr = {0, 3, {"align", "pack", "reorder"}, {AttrUint16Opt, AttrUint16Opt, AttrBool}};
 static const attr_spec field_attr = {0, 2, {"align", "pack"}, {AttrUint16Opt, AttrUint16Opt}};
 
 /* Type constructor attributes */
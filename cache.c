@@ -0,0 +1,426 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "ndtypes.h"
+#include "sync.h"
+
+
+/*****************************************************************************/
+/*                           Typecheck result cache                          */
+/*****************************************************************************/
+
+/*
+ * A bounded map from (signature, arguments) to the result of ndt_typecheck().
+ * Keys are compared structurally.  Entries hold references to the key types
+ * and to the return type, which is shared with the callers.
+ *
+ * The map is a chained hash table combined with a doubly linked list in
+ * order of use.  When the cache is full, the least recently used entry is
+ * evicted.  All operations on the table are serialized by a spin lock; the
+ * typecheck itself runs outside of the lock.
+ */
+
+typedef struct cache_entry {
+    uint64_t hash;
+    const ndt_t *f;
+    const ndt_t *args;
+    const ndt_t *ret;
+    int outer_dims;
+    struct cache_entry *chain;
+    struct cache_entry *prev;
+    struct cache_entry *next;
+} cache_entry_t;
+
+struct ndt_typecheck_cache {
+    ndt_spinlock_t lock;
+    int64_t capacity;
+    int64_t len;
+    size_t mask;
+    cache_entry_t **buckets;
+    cache_entry_t *head;
+    cache_entry_t *tail;
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+};
+
+
+/*****************************************************************************/
+/*                                  Keys                                     */
+/*****************************************************************************/
+
+static inline uint64_t
+mix(uint64_t h, uint64_t x)
+{
+    return (h ^ x) * 1099511628211ULL;
+}
+
+static bool
+same_offsets(const int64_t *a, const uint16_t *aa, const uint16_t *ap,
+             const int64_t *b, const uint16_t *ba, const uint16_t *bp,
+             int64_t n)
+{
+    if (n == 0 || a == NULL || b == NULL) {
+        return a == b || n == 0;
+    }
+
+    return memcmp(a, b, n * sizeof *a) == 0 &&
+           memcmp(aa, ba, n * sizeof *aa) == 0 &&
+           memcmp(ap, bp, n * sizeof *ap) == 0;
+}
+
+static bool
+same_var_dim(const ndt_t *a, const ndt_t *b)
+{
+    const uint8_t *abits = a->Concrete.VarDim.bitmap;
+    const uint8_t *bbits = b->Concrete.VarDim.bitmap;
+    int64_t n = a->Concrete.VarDim.nshapes;
+
+    if (n != b->Concrete.VarDim.nshapes ||
+        a->Concrete.VarDim.itemsize != b->Concrete.VarDim.itemsize ||
+        (abits == NULL) != (bbits == NULL)) {
+        return false;
+    }
+
+    return memcmp(a->Concrete.VarDim.shapes, b->Concrete.VarDim.shapes,
+                  n * sizeof(int32_t)) == 0 &&
+           memcmp(a->Concrete.VarDim.offsets, b->Concrete.VarDim.offsets,
+                  (n+1) * sizeof(int32_t)) == 0 &&
+           (abits == NULL || memcmp(abits, bbits, (n+7)/8) == 0);
+}
+
+/*
+ * ndt_equal() ignores the memory layout.  The return type of a typecheck
+ * may depend on it, so keys must also have the same layout.  'a' and 'b'
+ * are structurally equal.
+ */
+static bool
+same_layout(const ndt_t *a, const ndt_t *b)
+{
+    int64_t i;
+
+    if (a->access != b->access) {
+        return false;
+    }
+
+    if (a->access == Concrete &&
+        (a->data_size != b->data_size || a->data_align != b->data_align)) {
+        return false;
+    }
+
+    switch (a->tag) {
+    case FixedDim:
+        if (a->FixedDim.flags != b->FixedDim.flags) {
+            return false;
+        }
+        if (a->access == Concrete &&
+            (a->Concrete.FixedDim.itemsize != b->Concrete.FixedDim.itemsize ||
+             a->Concrete.FixedDim.stride != b->Concrete.FixedDim.stride ||
+             a->Concrete.FixedDim.offset != b->Concrete.FixedDim.offset)) {
+            return false;
+        }
+        return same_layout(a->FixedDim.type, b->FixedDim.type);
+    case VarDim:
+        if (a->VarDim.flags != b->VarDim.flags) {
+            return false;
+        }
+        if (a->access == Concrete && !same_var_dim(a, b)) {
+            return false;
+        }
+        return same_layout(a->VarDim.type, b->VarDim.type);
+    case SymbolicDim:
+        return a->SymbolicDim.flags == b->SymbolicDim.flags &&
+               same_layout(a->SymbolicDim.type, b->SymbolicDim.type);
+    case EllipsisDim:
+        return a->EllipsisDim.flags == b->EllipsisDim.flags &&
+               same_layout(a->EllipsisDim.type, b->EllipsisDim.type);
+    case Tuple:
+        if (a->access == Concrete &&
+            !same_offsets(a->Concrete.Tuple.offset, a->Concrete.Tuple.align,
+                          a->Concrete.Tuple.pad, b->Concrete.Tuple.offset,
+                          b->Concrete.Tuple.align, b->Concrete.Tuple.pad,
+                          a->Tuple.shape)) {
+            return false;
+        }
+        for (i = 0; i < a->Tuple.shape; i++) {
+            if (!same_layout(a->Tuple.types[i], b->Tuple.types[i])) {
+                return false;
+            }
+        }
+        return true;
+    case Record:
+        if (a->access == Concrete &&
+            !same_offsets(a->Concrete.Record.offset, a->Concrete.Record.align,
+                          a->Concrete.Record.pad, b->Concrete.Record.offset,
+                          b->Concrete.Record.align, b->Concrete.Record.pad,
+                          a->Record.shape)) {
+            return false;
+        }
+        for (i = 0; i < a->Record.shape; i++) {
+            if (!same_layout(a->Record.types[i], b->Record.types[i])) {
+                return false;
+            }
+        }
+        return true;
+    case Function:
+        return same_layout(a->Function.ret, b->Function.ret) &&
+               same_layout(a->Function.pos, b->Function.pos) &&
+               same_layout(a->Function.kwds, b->Function.kwds);
+    case Option:
+        return same_layout(a->Option.type, b->Option.type);
+    case OptionItem:
+        return same_layout(a->OptionItem.type, b->OptionItem.type);
+    case Pointer:
+        return same_layout(a->Pointer.type, b->Pointer.type);
+    case Constr:
+        return same_layout(a->Constr.type, b->Constr.type);
+    default:
+        return true;
+    }
+}
+
+static bool
+key_equal(const ndt_t *a, const ndt_t *b)
+{
+    return a == b || (ndt_equal(a, b) && same_layout(a, b));
+}
+
+
+/*****************************************************************************/
+/*                                  Cache                                    */
+/*****************************************************************************/
+
+/* Create a cache that holds at most 'capacity' results. */
+ndt_typecheck_cache_t *
+ndt_typecheck_cache_new(int64_t capacity, ndt_context_t *ctx)
+{
+    ndt_typecheck_cache_t *cache;
+    size_t nbuckets = 8;
+
+    if (capacity <= 0 || capacity > INT32_MAX) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_typecheck_cache_new: invalid capacity");
+        return NULL;
+    }
+
+    while (nbuckets < (size_t)capacity) {
+        nbuckets *= 2;
+    }
+
+    cache = ndt_alloc(1, sizeof *cache);
+    if (cache == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    cache->buckets = ndt_calloc(nbuckets, sizeof *cache->buckets);
+    if (cache->buckets == NULL) {
+        ndt_free(cache);
+        return ndt_memory_error(ctx);
+    }
+
+    ndt_spin_init(&cache->lock);
+    cache->capacity = capacity;
+    cache->len = 0;
+    cache->mask = nbuckets-1;
+    cache->head = cache->tail = NULL;
+    cache->hits = cache->misses = cache->evictions = 0;
+
+    return cache;
+}
+
+static void
+entry_del(cache_entry_t *e)
+{
+    ndt_del((ndt_t *)e->f);
+    ndt_del((ndt_t *)e->args);
+    ndt_del((ndt_t *)e->ret);
+    ndt_free(e);
+}
+
+void
+ndt_typecheck_cache_del(ndt_typecheck_cache_t *cache)
+{
+    cache_entry_t *e, *next;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    for (e = cache->head; e != NULL; e = next) {
+        next = e->next;
+        entry_del(e);
+    }
+
+    ndt_free(cache->buckets);
+    ndt_free(cache);
+}
+
+static cache_entry_t *
+lookup(const ndt_typecheck_cache_t *cache, uint64_t hash, const ndt_t *f,
+       const ndt_t *args)
+{
+    cache_entry_t *e;
+
+    for (e = cache->buckets[hash & cache->mask]; e != NULL; e = e->chain) {
+        if (e->hash == hash &&
+            key_equal(e->f, f) && key_equal(e->args, args)) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+unlink_lru(ndt_typecheck_cache_t *cache, cache_entry_t *e)
+{
+    if (e->prev) e->prev->next = e->next;
+    else cache->head = e->next;
+
+    if (e->next) e->next->prev = e->prev;
+    else cache->tail = e->prev;
+}
+
+static void
+push_front(ndt_typecheck_cache_t *cache, cache_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head) cache->head->prev = e;
+    else cache->tail = e;
+    cache->head = e;
+}
+
+static void
+unlink_chain(ndt_typecheck_cache_t *cache, cache_entry_t *e)
+{
+    cache_entry_t **p = &cache->buckets[e->hash & cache->mask];
+
+    while (*p != e) {
+        p = &(*p)->chain;
+    }
+    *p = e->chain;
+}
+
+/*
+ * Same as ndt_typecheck(), but results are looked up in 'cache' first.  The
+ * return type may be shared with other callers and must not be modified.
+ * It is released with ndt_del().  Safe to call from several threads.
+ */
+ndt_t *
+ndt_typecheck_cached(ndt_typecheck_cache_t *cache, const ndt_t *f,
+                     const ndt_t *args, int *outer_dims, ndt_context_t *ctx)
+{
+    cache_entry_t *e, *evicted = NULL;
+    const ndt_t *ret;
+    uint64_t hash;
+    int n;
+
+    hash = mix(f->fingerprint, args->fingerprint);
+
+    ndt_spin_lock(&cache->lock);
+    e = lookup(cache, hash, f, args);
+    if (e != NULL) {
+        cache->hits++;
+        unlink_lru(cache, e);
+        push_front(cache, e);
+        *outer_dims = e->outer_dims;
+        ret = ndt_incref(e->ret);
+        ndt_spin_unlock(&cache->lock);
+        return (ndt_t *)ret;
+    }
+    cache->misses++;
+    ndt_spin_unlock(&cache->lock);
+
+    ret = ndt_typecheck(f, args, &n, ctx);
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    e = ndt_alloc(1, sizeof *e);
+    if (e == NULL) {
+        ndt_del((ndt_t *)ret);
+        return ndt_memory_error(ctx);
+    }
+
+    e->hash = hash;
+    e->f = ndt_incref(f);
+    e->args = ndt_incref(args);
+    e->ret = ndt_incref(ret);
+    e->outer_dims = n;
+
+    ndt_spin_lock(&cache->lock);
+    if (lookup(cache, hash, f, args) != NULL) {
+        /* added by another thread in the meantime */
+        evicted = e;
+    }
+    else {
+        e->chain = cache->buckets[hash & cache->mask];
+        cache->buckets[hash & cache->mask] = e;
+        push_front(cache, e);
+        cache->len++;
+
+        if (cache->len > cache->capacity) {
+            evicted = cache->tail;
+            unlink_lru(cache, evicted);
+            unlink_chain(cache, evicted);
+            cache->len--;
+            cache->evictions++;
+        }
+    }
+    ndt_spin_unlock(&cache->lock);
+
+    if (evicted != NULL) {
+        entry_del(evicted);
+    }
+
+    *outer_dims = n;
+    return (ndt_t *)ret;
+}
+
+void
+ndt_typecheck_cache_stats(ndt_typecheck_cache_t *cache,
+                          ndt_cache_stats_t *stats)
+{
+    ndt_spin_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->size = cache->len;
+    ndt_spin_unlock(&cache->lock);
+}
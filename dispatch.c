@@ -0,0 +1,511 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                           Signature dispatch index                        */
+/*****************************************************************************/
+
+/*
+ * Signatures are grouped by arity and then by the dtype tag of their first
+ * argument.  Signatures whose first argument accepts several dtype tags go
+ * to the wildcard bucket.  All signatures are kept in a topological order
+ * of the ndt_more_specific() partial order.  Each bucket is sorted by the
+ * rank in that order, so a lookup merges two buckets in a single pass and
+ * returns the first signature that matches.
+ *
+ * Before the compiled pattern of a signature is run, the number of
+ * dimensions and the dtype tag of every argument are compared with a
+ * precomputed key, which rejects most candidates without matching.
+ */
+
+#define NTAGS (Field+1)
+#define WILDCARD NTAGS
+#define MAX_STACK_ARGS 16
+#define MAX_STACK_SLOTS 32
+
+typedef struct {
+    int ndim;        /* number of dimensions, at least 'ndim' if not exact */
+    bool exact;
+    int tag;         /* dtype tag or -1 for any */
+} arg_key_t;
+
+typedef struct {
+    const ndt_t *sig;
+    ndt_pattern_t *pattern;
+    arg_key_t *keys;
+    int64_t nargs;
+    int rank;        /* position in the specificity order */
+} dispatch_entry_t;
+
+typedef struct {
+    int *ids;
+    int len;
+    int alloc;
+} id_list_t;
+
+typedef struct {
+    id_list_t bucket[NTAGS+1];
+} arity_node_t;
+
+struct ndt_dispatch {
+    dispatch_entry_t *entries;
+    int *order;      /* ids, more specific signatures first */
+    int len;
+    int alloc;
+    arity_node_t **arity;
+    int64_t narity;
+    int maxslots;
+};
+
+
+static bool
+is_wildcard(enum ndt tag)
+{
+    switch (tag) {
+    case AnyKind: case Typevar: case ScalarKind:
+    case SignedKind: case UnsignedKind: case FloatKind: case ComplexKind:
+    case FixedStringKind: case FixedBytesKind:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void
+pattern_key(arg_key_t *key, const ndt_t *p)
+{
+    const ndt_t *dims[NDT_MAX_DIM];
+    const ndt_t *dtype = p;
+    int n = 0, i;
+
+    if (p->tag == AnyKind || p->tag == Typevar) {
+        key->ndim = 0;
+        key->exact = false;
+        key->tag = -1;
+        return;
+    }
+
+    if (ndt_is_array(p)) {
+        n = ndt_const_dims_dtype(dims, &dtype, p);
+    }
+
+    key->ndim = n;
+    key->exact = true;
+    for (i = 0; i < n; i++) {
+        if (dims[i]->tag == EllipsisDim) {
+            key->ndim--;
+            key->exact = false;
+        }
+    }
+
+    key->tag = is_wildcard(dtype->tag) ? -1 : (int)dtype->tag;
+}
+
+static void
+candidate_key(arg_key_t *key, const ndt_t *c)
+{
+    const ndt_t *dims[NDT_MAX_DIM];
+    const ndt_t *dtype = c;
+
+    key->ndim = ndt_is_array(c) ? ndt_const_dims_dtype(dims, &dtype, c) : 0;
+    key->exact = true;
+    key->tag = dtype->tag;
+}
+
+static bool
+keys_match(const dispatch_entry_t *e, const arg_key_t *ckeys)
+{
+    const arg_key_t *k;
+    int64_t i;
+
+    for (i = 0; i < e->nargs; i++) {
+        k = &e->keys[i];
+        if (k->exact ? ckeys[i].ndim != k->ndim : ckeys[i].ndim < k->ndim) {
+            return false;
+        }
+        if (k->tag >= 0 && k->tag != ckeys[i].tag) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Order of candidates: position in the specificity order. */
+static bool
+precedes(const ndt_dispatch_t *d, int a, int b)
+{
+    return d->entries[a].rank < d->entries[b].rank;
+}
+
+/*
+ * Return the position in d->order at which 'sig' is inserted: right before
+ * the first signature that is less specific, otherwise at the end.  This
+ * keeps d->order a topological order, and incomparable signatures stay in
+ * registration order as far as possible.
+ */
+static int
+order_position(const ndt_dispatch_t *d, const ndt_t *sig, ndt_context_t *ctx)
+{
+    int k, n;
+
+    for (k = 0; k < d->len; k++) {
+        n = ndt_more_specific(sig, d->entries[d->order[k]].sig, ctx);
+        if (n < 0) {
+            return -1;
+        }
+        if (n) {
+            break;
+        }
+    }
+
+    return k;
+}
+
+static void
+order_insert(ndt_dispatch_t *d, int k, int id)
+{
+    int i;
+
+    for (i = d->len; i > k; i--) {
+        d->order[i] = d->order[i-1];
+        d->entries[d->order[i]].rank = i;
+    }
+    d->order[k] = id;
+    d->entries[id].rank = k;
+}
+
+static int
+list_reserve(id_list_t *list, ndt_context_t *ctx)
+{
+    int *ids;
+
+    if (list->len == list->alloc) {
+        int alloc = list->alloc == 0 ? 4 : 2 * list->alloc;
+        ids = ndt_realloc(list->ids, alloc, sizeof *ids);
+        if (ids == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        list->ids = ids;
+        list->alloc = alloc;
+    }
+
+    return 0;
+}
+
+static void
+list_insert(const ndt_dispatch_t *d, id_list_t *list, int id)
+{
+    int i;
+
+    assert(list->len < list->alloc);
+
+    for (i = list->len; i > 0 && precedes(d, id, list->ids[i-1]); i--) {
+        list->ids[i] = list->ids[i-1];
+    }
+    list->ids[i] = id;
+    list->len++;
+}
+
+static arity_node_t *
+arity_node(ndt_dispatch_t *d, int64_t nargs, ndt_context_t *ctx)
+{
+    arity_node_t **arity;
+    int64_t i;
+
+    if (nargs >= d->narity) {
+        arity = ndt_realloc(d->arity, nargs+1, sizeof *arity);
+        if (arity == NULL) {
+            return ndt_memory_error(ctx);
+        }
+        for (i = d->narity; i <= nargs; i++) {
+            arity[i] = NULL;
+        }
+        d->arity = arity;
+        d->narity = nargs+1;
+    }
+
+    if (d->arity[nargs] == NULL) {
+        d->arity[nargs] = ndt_calloc(1, sizeof(arity_node_t));
+        if (d->arity[nargs] == NULL) {
+            return ndt_memory_error(ctx);
+        }
+    }
+
+    return d->arity[nargs];
+}
+
+ndt_dispatch_t *
+ndt_dispatch_new(ndt_context_t *ctx)
+{
+    ndt_dispatch_t *d;
+
+    d = ndt_alloc(1, sizeof *d);
+    if (d == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    d->entries = NULL;
+    d->order = NULL;
+    d->len = 0;
+    d->alloc = 0;
+    d->arity = NULL;
+    d->narity = 0;
+    d->maxslots = 0;
+
+    return d;
+}
+
+void
+ndt_dispatch_del(ndt_dispatch_t *d)
+{
+    int64_t i;
+    int k;
+
+    if (d == NULL) {
+        return;
+    }
+
+    for (k = 0; k < d->len; k++) {
+        ndt_pattern_del(d->entries[k].pattern);
+        ndt_free(d->entries[k].keys);
+    }
+    ndt_free(d->entries);
+    ndt_free(d->order);
+
+    for (i = 0; i < d->narity; i++) {
+        if (d->arity[i] != NULL) {
+            for (k = 0; k <= NTAGS; k++) {
+                ndt_free(d->arity[i]->bucket[k].ids);
+            }
+            ndt_free(d->arity[i]);
+        }
+    }
+    ndt_free(d->arity);
+
+    ndt_free(d);
+}
+
+/*
+ * Add the function signature 'sig' and return its index, which is the
+ * number of previously added signatures.  Return -1 on error.
+ */
+int
+ndt_dispatch_add(ndt_dispatch_t *d, const ndt_t *sig, ndt_context_t *ctx)
+{
+    const ndt_t *pos;
+    dispatch_entry_t *e;
+    arity_node_t *node;
+    int *order;
+    int64_t i;
+    int id, b, k;
+
+    if (sig->tag != Function) {
+        ndt_err_format(ctx, NDT_ValueError, "ndt_dispatch_add: expected function type");
+        return -1;
+    }
+
+    pos = sig->Function.pos;
+    node = arity_node(d, pos->Tuple.shape, ctx);
+    if (node == NULL) {
+        return -1;
+    }
+
+    if (d->len == d->alloc) {
+        int alloc = d->alloc == 0 ? 16 : 2 * d->alloc;
+        e = ndt_realloc(d->entries, alloc, sizeof *e);
+        if (e == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        d->entries = e;
+        order = ndt_realloc(d->order, alloc, sizeof *order);
+        if (order == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        d->order = order;
+        d->alloc = alloc;
+    }
+
+    k = order_position(d, sig, ctx);
+    if (k < 0) {
+        return -1;
+    }
+
+    id = d->len;
+    e = &d->entries[id];
+    e->sig = sig;
+    e->nargs = pos->Tuple.shape;
+
+    e->keys = ndt_alloc(e->nargs == 0 ? 1 : e->nargs, sizeof *e->keys);
+    if (e->keys == NULL) {
+        (void)ndt_memory_error(ctx);
+        return -1;
+    }
+
+    for (i = 0; i < e->nargs; i++) {
+        pattern_key(&e->keys[i], pos->Tuple.types[i]);
+    }
+
+    e->pattern = ndt_pattern_compile(pos, ctx);
+    if (e->pattern == NULL) {
+        ndt_free(e->keys);
+        return -1;
+    }
+
+    b = e->nargs > 0 && e->keys[0].tag >= 0 ? e->keys[0].tag : WILDCARD;
+    if (list_reserve(&node->bucket[b], ctx) < 0) {
+        ndt_pattern_del(e->pattern);
+        ndt_free(e->keys);
+        return -1;
+    }
+
+    order_insert(d, k, id);
+    list_insert(d, &node->bucket[b], id);
+
+    if (e->pattern->nslots > d->maxslots) {
+        d->maxslots = e->pattern->nslots;
+    }
+
+    d->len++;
+    return id;
+}
+
+static int
+find(const ndt_dispatch_t *d, const ndt_t *args, const arg_key_t *ckeys,
+     ndt_binding_t *bindings, ndt_context_t *ctx)
+{
+    const arity_node_t *node;
+    const id_list_t *x, *w;
+    const dispatch_entry_t *e;
+    int64_t nargs = args->Tuple.shape;
+    int i = 0, j = 0, id, n;
+
+    if (nargs >= d->narity || d->arity[nargs] == NULL) {
+        return -2;
+    }
+
+    node = d->arity[nargs];
+    x = &node->bucket[nargs > 0 ? ckeys[0].tag : WILDCARD];
+    w = &node->bucket[WILDCARD];
+    if (x == w) {
+        i = x->len;
+    }
+
+    while (i < x->len || j < w->len) {
+        if (j == w->len || (i < x->len && precedes(d, x->ids[i], w->ids[j]))) {
+            id = x->ids[i++];
+        }
+        else {
+            id = w->ids[j++];
+        }
+
+        e = &d->entries[id];
+        if (!keys_match(e, ckeys)) {
+            continue;
+        }
+
+        n = ndt_pattern_match(e->pattern, args, bindings, ctx);
+        if (n != 0) {
+            return n < 0 ? -1 : id;
+        }
+    }
+
+    return -2;
+}
+
+/*
+ * Return the index of the most specific signature whose positional
+ * arguments match the tuple 'args'.  A signature is more specific than
+ * another if its arguments are instances of the other's arguments, see
+ * ndt_more_specific().  Incomparable or equally specific signatures are
+ * tried in registration order where the partial order permits.
+ */
+int
+ndt_dispatch_find(const ndt_dispatch_t *d, const ndt_t *args, ndt_context_t *ctx)
+{
+    arg_key_t stack_keys[MAX_STACK_ARGS];
+    ndt_binding_t stack_bindings[MAX_STACK_SLOTS];
+    arg_key_t *ckeys = stack_keys;
+    ndt_binding_t *bindings = stack_bindings;
+    int64_t nargs, i;
+    int id;
+
+    if (args->tag != Tuple) {
+        ndt_err_format(ctx, NDT_ValueError, "ndt_dispatch_find: expected tuple type");
+        return -1;
+    }
+
+    nargs = args->Tuple.shape;
+    if (nargs > MAX_STACK_ARGS) {
+        ckeys = ndt_alloc(nargs, sizeof *ckeys);
+        if (ckeys == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+    }
+
+    if (d->maxslots > MAX_STACK_SLOTS) {
+        bindings = ndt_alloc(d->maxslots, sizeof *bindings);
+        if (bindings == NULL) {
+            if (ckeys != stack_keys) ndt_free(ckeys);
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < nargs; i++) {
+        candidate_key(&ckeys[i], args->Tuple.types[i]);
+    }
+
+    id = find(d, args, ckeys, bindings, ctx);
+    if (id == -2) {
+        ndt_err_format(ctx, NDT_TypeError, "no matching signature");
+        id = -1;
+    }
+
+    if (ckeys != stack_keys) ndt_free(ckeys);
+    if (bindings != stack_bindings) ndt_free(bindings);
+
+    return id;
+}
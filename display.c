@@ -35,345 +35,906 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <inttypes.h>
-#include <stdarg.h>
-#include <errno.h>
 #include <assert.h>
 #include "ndtypes.h"
+#include "print.h"
+#include "walk.h"
 
 
-#undef buf_t
-typedef struct {
-    size_t count; /* count the required size */
-    size_t size;  /* buffer size (0 for the count phase) */
-    char *cur;    /* buffer data (NULL for the count phase) */
-} buf_t;
+/*
+ * Types are printed by direct recursion up to this nesting level.  Deeper
+ * subtrees are printed by walk(), which does not use the native stack.
+ */
+#define MAX_RECURSION 64
+
+static int datashape(buf_t *buf, const ndt_t *t, int d, int level, ndt_context_t *ctx);
 
 
-static int datashape(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx);
+static int
+variadic_flag(buf_t *buf, enum ndt_variadic flag, ndt_context_t *ctx)
+{
+    if (flag == Variadic) {
+        return buf_puts(buf, "...", ctx);
+    }
 
+    return 0;
+}
 
 static int
-ndt_snprintf(ndt_context_t *ctx, buf_t *buf, const char *fmt, ...)
+comma_variadic_flag(buf_t *buf, enum ndt_variadic flag, int d, ndt_context_t *ctx)
 {
-    va_list ap;
     int n;
 
-    va_start(ap, fmt);
-    errno = 0;
-    n = vsnprintf(buf->cur, buf->size, fmt, ap);
-    va_end(ap);
-    if (buf->cur && n < 0) {
-        if (errno == ENOMEM) {
-            ndt_err_format(ctx, NDT_MemoryError, "out of memory");
+    if (flag == Variadic) {
+        if (d >= 0) {
+            n = buf_puts(buf, ",\n", ctx);
+            if (n < 0) return -1;
+
+            n = buf_indent(buf, d, ctx);
+            if (n < 0) return -1;
+
+            return buf_puts(buf, "...", ctx);
         }
         else {
-            ndt_err_format(ctx, NDT_OSError, "ndt_as_string: output error");
+            return buf_puts(buf, ", ...", ctx);
         }
-        return -1;
     }
 
-    if (buf->cur && (size_t)n >= buf->size) {
-         ndt_err_format(ctx, NDT_ValueError,
-                        "ndt_as_string: insufficient buffer size");
-        return -1;
-    }
+    return 0;
+}
+
+static int
+comma(buf_t *buf, int d, ndt_context_t *ctx)
+{
+    int n;
 
-    buf->count += n;
+    if (d >= 0) {
+        n = buf_puts(buf, ",\n", ctx);
+        if (n < 0) return -1;
 
-    if (buf->cur) {
-        buf->cur += n;
-        buf->size -= n;
+        return buf_indent(buf, d, ctx);
     }
 
-    return 0;
+    return buf_puts(buf, ", ", ctx);
 }
 
+/* Print the 'align', 'pack' and 'reorder' attributes of a tuple or record. */
 static int
-indent(ndt_context_t *ctx, buf_t *buf, int n)
+comma_attributes(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
 {
-    int i;
+    uint16_t align, pack;
+    bool reorder;
+    int n;
 
-    if (n < 0) {
-        return 0;
+    if (t->tag == Tuple) {
+        align = t->Tuple.align;
+        pack = t->Tuple.pack;
+        reorder = t->Tuple.reorder;
+    }
+    else {
+        align = t->Record.align;
+        pack = t->Record.pack;
+        reorder = t->Record.reorder;
     }
 
-    for (i = 0; i < n; i++) {
-        if (ndt_snprintf(ctx, buf, " ") < 0) {
-            return -1;
-        }
+    if (align != 0) {
+        n = comma(buf, d, ctx);
+        if (n < 0) return -1;
+
+        n = buf_printf(buf, ctx, "align=%" PRIu16, align);
+        if (n < 0) return -1;
+    }
+
+    if (pack != 0) {
+        n = comma(buf, d, ctx);
+        if (n < 0) return -1;
+
+        n = buf_printf(buf, ctx, "pack=%" PRIu16, pack);
+        if (n < 0) return -1;
+    }
+
+    if (reorder) {
+        n = comma(buf, d, ctx);
+        if (n < 0) return -1;
+
+        n = buf_puts(buf, "reorder=true", ctx);
+        if (n < 0) return -1;
     }
 
     return 0;
 }
 
 static int
-tuple_fields(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
+value(buf_t *buf, const ndt_memory_t *mem, ndt_context_t *ctx)
 {
-    int64_t i;
     int n;
 
-    assert(t->tag == Tuple);
+    switch (mem->t->tag) {
+    case Bool:
+        return buf_puts(buf, mem->v.Bool ? "true" : "false", ctx);
+    case Int8:
+        return buf_int64(buf, mem->v.Int8, ctx);
+    case Int16:
+        return buf_int64(buf, mem->v.Int16, ctx);
+    case Int32:
+        return buf_int64(buf, mem->v.Int32, ctx);
+    case Int64:
+        return buf_int64(buf, mem->v.Int64, ctx);
+    case Uint8:
+        return buf_uint64(buf, mem->v.Uint8, ctx);
+    case Uint16:
+        return buf_uint64(buf, mem->v.Uint16, ctx);
+    case Uint32:
+        return buf_uint64(buf, mem->v.Uint32, ctx);
+    case Uint64:
+        return buf_uint64(buf, mem->v.Uint64, ctx);
+    case Float32:
+        return buf_printf(buf, ctx, "%g", mem->v.Float32);
+    case Float64:
+        return buf_printf(buf, ctx, "%g", mem->v.Float64);
+    case String:
+        n = buf_puts(buf, "'", ctx);
+        if (n < 0) return -1;
 
-    for (i = 0; i < t->Tuple.shape; i++) {
+        n = buf_puts(buf, mem->v.String, ctx);
+        if (n < 0) return -1;
+
+        return buf_puts(buf, "'", ctx);
+    default:
+        ndt_err_format(ctx, NDT_NotImplementedError,
+                       "unsupported type: '%s'", ndt_tag_as_string(mem->t->tag));
+        return 0;
+    }
+}
+
+static int
+categorical(buf_t *buf, ndt_memory_t *mem, size_t ntypes, int d, int level,
+            ndt_context_t *ctx)
+{
+    size_t i;
+    int n;
+
+    if (ntypes > 0 && buf->depth >= buf->max_depth) {
+        return buf_puts(buf, "...", ctx);
+    }
+
+    buf->depth++;
+    for (i = 0; i < ntypes && !buf->full; i++) {
         if (i >= 1) {
-            n = ndt_snprintf(ctx, buf, ", ");
+            n = buf_puts(buf, ", ", ctx);
             if (n < 0) return -1;
         }
 
-        n = datashape(buf, t->Tuple.types[i], d, ctx);
+        if ((int64_t)i == buf->max_items) {
+            n = buf_puts(buf, "...", ctx);
+            if (n < 0) return -1;
+            break;
+        }
+
+        n = value(buf, &mem[i], ctx);
+        if (n < 0) return -1;
+
+        n = buf_puts(buf, " : ", ctx);
+        if (n < 0) return -1;
+
+        n = datashape(buf, mem[i].t, d, level+1, ctx);
         if (n < 0) return -1;
     }
+    buf->depth--;
 
     return 0;
 }
 
+/* The names of the scalars and kinds, see ndt_tag_as_string(). */
+#define NAME(s) {s, sizeof s - 1}
+static const struct {
+    const char *name;
+    size_t len;
+} scalar_names[] = {
+  [AnyKind] = NAME("Any"),
+  [ScalarKind] = NAME("ScalarKind"),
+  [Void] = NAME("void"), [Bool] = NAME("bool"),
+  [SignedKind] = NAME("SignedKind"),
+  [Int8] = NAME("int8"), [Int16] = NAME("int16"),
+  [Int32] = NAME("int32"), [Int64] = NAME("int64"),
+  [UnsignedKind] = NAME("UnsignedKind"),
+  [Uint8] = NAME("uint8"), [Uint16] = NAME("uint16"),
+  [Uint32] = NAME("uint32"), [Uint64] = NAME("uint64"),
+  [FloatKind] = NAME("FloatKind"),
+  [Float16] = NAME("float16"), [Float32] = NAME("float32"), [Float64] = NAME("float64"),
+  [ComplexKind] = NAME("ComplexKind"),
+  [Complex32] = NAME("complex32"), [Complex64] = NAME("complex64"),
+  [Complex128] = NAME("complex128"),
+  [FixedStringKind] = NAME("FixedStringKind"),
+  [FixedBytesKind] = NAME("FixedBytesKind"),
+  [String] = NAME("string"),
+};
+#undef NAME
+
 static int
-record_fields(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
+dim_option(buf_t *buf, uint32_t flags, ndt_context_t *ctx)
 {
-    int64_t i;
+    if (flags & NDT_Dim_option) {
+        return buf_puts(buf, "?", ctx);
+    }
+
+    return 1;
+}
+
+
+/*****************************************************************************/
+/*                              Printer walk                                 */
+/*****************************************************************************/
+
+/*
+ * Subtrees nested deeper than MAX_RECURSION are printed by walk(), so deep
+ * types do not exhaust the native stack.  The output is the same as that of
+ * the direct printer below.  'pre' prints the separator that precedes a node
+ * in its parent and the beginning of the node, 'post' prints the end of the
+ * node.
+ * The positional and keyword arguments of a function are printed inline and
+ * the keyword arguments always on one line.
+ */
+typedef struct {
+    buf_t *buf;
+    int d;              /* indentation, negative for one line */
+    int flat;           /* inside the keyword arguments of a function */
+    ndt_context_t *ctx;
+} show_t;
+
+static inline int
+indent(const show_t *s)
+{
+    return s->flat > 0 ? INT_MIN : s->d;
+}
+
+/* The arguments of a function have no parentheses or braces. */
+static inline int
+is_inline(const ndt_t *parent, int64_t index)
+{
+    return parent != NULL && parent->tag == Function && index < 2;
+}
+
+/* Print what precedes the 'index'-th child 't' of 'parent'. */
+static int
+separator(show_t *s, const ndt_t *t, const ndt_t *parent, int64_t index)
+{
+    buf_t *buf = s->buf;
+    ndt_context_t *ctx = s->ctx;
+    const ndt_t *pos;
     int n;
 
-    assert(t->tag == Record);
+    switch (parent->tag) {
+    case Tuple:
+        if (index >= 1) {
+            n = buf_puts(buf, ", ", ctx);
+            if (n < 0) return -1;
+        }
 
-    for (i = 0; i < t->Tuple.shape; i++) {
-        if (i >= 1) {
-            if (d >= 0) {
-                n = ndt_snprintf(ctx, buf, ",\n");
+        if (index == buf->max_items) {
+            n = buf_puts(buf, "...", ctx);
+            if (n < 0) return -1;
+            return WalkSkipSiblings;
+        }
+
+        return WalkContinue;
+
+    case Record:
+        if (index >= 1) {
+            if (indent(s) >= 0) {
+                n = buf_puts(buf, ",\n", ctx);
                 if (n < 0) return -1;
 
-                n = indent(ctx, buf, d);
+                n = buf_indent(buf, indent(s), ctx);
                 if (n < 0) return -1;
             }
             else {
-                n = ndt_snprintf(ctx, buf, ", ");
+                n = buf_puts(buf, ", ", ctx);
                 if (n < 0) return -1;
             }
         }
 
-        n = ndt_snprintf(ctx, buf, "%s : ", t->Record.names[i]);
+        if (index == buf->max_items) {
+            n = buf_puts(buf, "...", ctx);
+            if (n < 0) return -1;
+            return WalkSkipSiblings;
+        }
+
+        n = buf_puts(buf, parent->Record.names[index], ctx);
         if (n < 0) return -1;
 
-        n = datashape(buf, t->Record.types[i], d, ctx);
+        n = buf_puts(buf, " : ", ctx);
         if (n < 0) return -1;
-    }
 
-    return 0;
+        return WalkContinue;
+
+    case Function:
+        pos = parent->Function.pos;
+
+        if (index == 1) {
+            if (t->Record.shape > 0 &&
+                (pos->Tuple.flag == Variadic || pos->Tuple.shape > 0)) {
+                n = buf_puts(buf, ", ", ctx);
+                if (n < 0) return -1;
+            }
+        }
+        else if (index == 2) {
+            n = buf_puts(buf, ") -> ", ctx);
+            if (n < 0) return -1;
+        }
+
+        return WalkContinue;
+
+    default:
+        return WalkContinue;
+    }
 }
 
+/* Print the end of a tuple or a record, the fields have been printed. */
 static int
-variadic_flag(buf_t *buf, enum ndt_variadic flag, ndt_context_t *ctx)
+fields_end(show_t *s, const ndt_t *t, int inline_, ndt_context_t *ctx)
 {
-    if (flag == Variadic) {
-        return ndt_snprintf(ctx, buf, "...");
+    buf_t *buf = s->buf;
+    int n;
+
+    if (t->tag == Tuple) {
+        if (t->Tuple.shape > 0) {
+            n = comma_variadic_flag(buf, t->Tuple.flag, INT_MIN, ctx);
+            if (n < 0) return -1;
+
+            n = comma_attributes(buf, t, INT_MIN, ctx);
+        }
+        else {
+            n = variadic_flag(buf, t->Tuple.flag, ctx);
+        }
+        if (n < 0) return -1;
+
+        return inline_ ? 0 : buf_puts(buf, ")", ctx);
     }
 
-    return 0;
+    if (t->Record.shape > 0) {
+        n = comma_variadic_flag(buf, t->Record.flag, indent(s), ctx);
+        if (n < 0) return -1;
+
+        n = comma_attributes(buf, t, indent(s), ctx);
+    }
+    else {
+        n = variadic_flag(buf, t->Record.flag, ctx);
+    }
+    if (n < 0) return -1;
+
+    if (inline_) {
+        s->flat--;
+        return 0;
+    }
+
+    s->d -= 2;
+    if (indent(s) >= 0) {
+        n = buf_puts(buf, "\n", ctx);
+        if (n < 0) return -1;
+        n = buf_indent(buf, indent(s), ctx);
+        if (n < 0) return -1;
+    }
+
+    return buf_puts(buf, "}", ctx);
 }
 
+/* Print the beginning of a tuple or a record. */
 static int
-comma_variadic_flag(buf_t *buf, enum ndt_variadic flag, int d, ndt_context_t *ctx)
+fields_begin(show_t *s, const ndt_t *t, int inline_, ndt_context_t *ctx)
 {
+    buf_t *buf = s->buf;
+    int64_t shape;
     int n;
 
-    if (flag == Variadic) {
-        if (d >= 0) {
-            n = ndt_snprintf(ctx, buf, ",\n");
+    if (t->tag == Tuple) {
+        shape = t->Tuple.shape;
+        if (!inline_) {
+            n = buf_puts(buf, "(", ctx);
+            if (n < 0) return -1;
+        }
+    }
+    else {
+        shape = t->Record.shape;
+        if (inline_) {
+            s->flat++;
+        }
+        else {
+            n = buf_puts(buf, "{", ctx);
+            if (n < 0) return -1;
+
+            if (indent(s) >= 0) {
+                n = buf_puts(buf, "\n", ctx);
+                if (n < 0) return -1;
+                n = buf_indent(buf, indent(s)+2, ctx);
+                if (n < 0) return -1;
+            }
+
+            s->d += 2;
+        }
+    }
+
+    if (shape > 0 && buf->depth >= buf->max_depth) {
+        n = buf_puts(buf, "...", ctx);
+        if (n < 0) return -1;
+
+        n = fields_end(s, t, inline_, ctx);
+        if (n < 0) return -1;
+
+        return WalkSkip;
+    }
+
+    if (shape > 0) {
+        buf->depth++;
+    }
+
+    return WalkContinue;
+}
+
+static inline int
+show_pre(const ndt_t *t, const ndt_t *u, const ndt_t *parent, int64_t index,
+         void *arg)
+{
+    show_t *s = arg;
+    buf_t *buf = s->buf;
+    ndt_context_t *ctx = s->ctx;
+    int n;
+
+    (void)u;
+
+    if (buf->full) {
+        return WalkStop;
+    }
+
+    if (parent != NULL) {
+        n = separator(s, t, parent, index);
+        if (n != WalkContinue) return n;
+    }
+
+    switch (t->tag) {
+        case FixedDim:
+            n = dim_option(buf, t->FixedDim.flags, ctx);
+            if (n < 0) return -1;
+
+            if (t->FixedDim.align != 0) {
+                n = buf_printf(buf, ctx, "fixed(shape=%" PRIi64 ", align=%" PRIu16 ") * ",
+                               t->FixedDim.shape, t->FixedDim.align);
+            }
+            else {
+                n = buf_int64(buf, t->FixedDim.shape, ctx);
+                if (n < 0) return -1;
+
+                n = buf_puts(buf, " * ", ctx);
+            }
+            return n < 0 ? -1 : WalkNoPost;
+
+        case SymbolicDim:
+            n = dim_option(buf, t->SymbolicDim.flags, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, t->SymbolicDim.name, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, " * ", ctx);
+            return n < 0 ? -1 : WalkNoPost;
+
+        case VarDim:
+            n = dim_option(buf, t->VarDim.flags, ctx);
+            if (n < 0) return -1;
+
+            if (t->VarDim.align != 0) {
+                n = buf_printf(buf, ctx, "var(align=%" PRIu16 ") * ", t->VarDim.align);
+            }
+            else {
+                n = buf_puts(buf, "var * ", ctx);
+            }
+            return n < 0 ? -1 : WalkNoPost;
+
+        case EllipsisDim:
+            n = dim_option(buf, t->EllipsisDim.flags, ctx);
+            if (n < 0) return -1;
+
+            if (t->EllipsisDim.name) {
+                n = buf_puts(buf, t->EllipsisDim.name, ctx);
+                if (n < 0) return -1;
+            }
+
+            n = buf_puts(buf, "... * ", ctx);
+            return n < 0 ? -1 : WalkNoPost;
+
+        case Option: case OptionItem:
+            n = buf_puts(buf, "?", ctx);
+            return n < 0 ? -1 : WalkNoPost;
+
+        case Nominal:
+            n = buf_puts(buf, t->Nominal.name, ctx);
+            break;
+
+        case Constr:
+            n = buf_puts(buf, t->Constr.name, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, "(", ctx);
+            return n < 0 ? -1 : WalkContinue;
+
+        case Tuple: case Record:
+            return fields_begin(s, t, is_inline(parent, index), ctx);
+
+        case Function:
+            n = buf_puts(buf, "(", ctx);
+            return n < 0 ? -1 : WalkNoPost;
+
+        case Typevar:
+            n = buf_puts(buf, t->Typevar.name, ctx);
+            break;
+
+        case AnyKind:
+        case ScalarKind:
+        case Void: case Bool:
+        case SignedKind:
+        case Int8: case Int16: case Int32: case Int64:
+        case UnsignedKind:
+        case Uint8: case Uint16: case Uint32: case Uint64:
+        case FloatKind:
+        case Float16: case Float32: case Float64:
+        case ComplexKind:
+        case Complex32: case Complex64: case Complex128:
+        case FixedStringKind:
+        case FixedBytesKind:
+        case String:
+            n = buf_write(buf, scalar_names[t->tag].name, scalar_names[t->tag].len, ctx);
+            break;
+
+        case FixedString:
+            n = buf_puts(buf, "fixed_string(", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->FixedString.size, ctx);
             if (n < 0) return -1;
 
-            n = indent(ctx, buf, d);
+            n = buf_puts(buf, ", ", ctx);
             if (n < 0) return -1;
 
-            return ndt_snprintf(ctx, buf, "...");
+            n = buf_puts(buf, ndt_encoding_as_string(t->FixedString.encoding), ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
+            break;
+
+        case Char:
+            n = buf_puts(buf, "char(", ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ndt_encoding_as_string(t->Char.encoding), ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
+            break;
+
+        case Bytes:
+            n = buf_puts(buf, "bytes(align=", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->Bytes.target_align, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
+            break;
+
+        case FixedBytes:
+            n = buf_puts(buf, "fixed_bytes(size=", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->FixedBytes.size, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ", align=", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->FixedBytes.align, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
+            break;
+
+        case Categorical:
+            n = buf_puts(buf, "categorical(", ctx);
+            if (n < 0) return -1;
+
+            n = categorical(buf, t->Categorical.types, t->Categorical.ntypes,
+                            indent(s), 0, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
+            break;
+
+        case Pointer:
+            n = buf_puts(buf, "pointer(", ctx);
+            return n < 0 ? -1 : WalkContinue;
+
+        default:
+            ndt_err_format(ctx, NDT_ValueError, "invalid tag");
+            return -1;
+    }
+
+    /* leaves have no end */
+    return n < 0 ? -1 : WalkSkip;
+}
+
+static inline int
+show_post(const ndt_t *t, const ndt_t *u, const ndt_t *parent, int64_t index,
+          void *arg)
+{
+    show_t *s = arg;
+    buf_t *buf = s->buf;
+    ndt_context_t *ctx = s->ctx;
+    int n;
+
+    (void)u;
+
+    switch (t->tag) {
+    case Tuple:
+        if (t->Tuple.shape > 0) {
+            buf->depth--;
         }
-        else {
-            return ndt_snprintf(ctx, buf, ", ...");
+        n = fields_end(s, t, is_inline(parent, index), ctx);
+        break;
+    case Record:
+        if (t->Record.shape > 0) {
+            buf->depth--;
         }
+        n = fields_end(s, t, is_inline(parent, index), ctx);
+        break;
+    case Constr: case Pointer:
+        n = buf_puts(buf, ")", ctx);
+        break;
+    default:
+        n = 0;
+        break;
     }
 
-    return 0;
+    return n < 0 ? -1 : WalkContinue;
 }
 
 static int
-value(buf_t *buf, const ndt_memory_t *mem, ndt_context_t *ctx)
+datashape_walk(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
 {
-    switch (mem->t->tag) {
-    case Bool:
-        return ndt_snprintf(ctx, buf, mem->v.Bool ? "true" : "false");
-    case Int8:
-        return ndt_snprintf(ctx, buf, "%" PRIi8, mem->v.Int8);
-    case Int16:
-        return ndt_snprintf(ctx, buf, "%" PRIi16, mem->v.Int16);
-    case Int32:
-        return ndt_snprintf(ctx, buf, "%" PRIi32, mem->v.Int32);
-    case Int64:
-        return ndt_snprintf(ctx, buf, "%" PRIi64, mem->v.Int64);
-    case Uint8:
-        return ndt_snprintf(ctx, buf, "%" PRIu8, mem->v.Uint8);
-    case Uint16:
-        return ndt_snprintf(ctx, buf, "%" PRIu16, mem->v.Uint16);
-    case Uint32:
-        return ndt_snprintf(ctx, buf, "%" PRIu32, mem->v.Uint32);
-    case Uint64:
-        return ndt_snprintf(ctx, buf, "%" PRIu64, mem->v.Uint64);
-    case Float32:
-        return ndt_snprintf(ctx, buf, "%g", mem->v.Float32);
-    case Float64:
-        return ndt_snprintf(ctx, buf, "%g", mem->v.Float64);
-    case String:
-        return ndt_snprintf(ctx, buf, "'%s'", mem->v.String);
-    default:
-        ndt_err_format(ctx, NDT_NotImplementedError,
-                       "unsupported type: '%s'", ndt_tag_as_string(mem->t->tag));
-        return 0;
-    }
+    show_t s = {buf, d, 0, ctx};
+
+    return walk(t, NULL, show_pre, show_post, &s) < 0 ? -1 : 0;
 }
 
+
+/*****************************************************************************/
+/*                             Direct printer                                */
+/*****************************************************************************/
+
 static int
-categorical(buf_t *buf, ndt_memory_t *mem, size_t ntypes, int d, ndt_context_t *ctx)
+tuple_fields(buf_t *buf, const ndt_t *t, int d, int level, ndt_context_t *ctx)
 {
-    size_t i;
+    int64_t i;
     int n;
 
-    for (i = 0; i < ntypes; i++) {
+    assert(t->tag == Tuple);
+
+    if (t->Tuple.shape > 0 && buf->depth >= buf->max_depth) {
+        return buf_puts(buf, "...", ctx);
+    }
+
+    buf->depth++;
+    for (i = 0; i < t->Tuple.shape && !buf->full; i++) {
         if (i >= 1) {
-            n = ndt_snprintf(ctx, buf, ", ");
+            n = buf_puts(buf, ", ", ctx);
             if (n < 0) return -1;
         }
 
-        n = value(buf, &mem[i], ctx);
-        if (n < 0) return -1;
-
-        n = ndt_snprintf(ctx, buf, " : ");
-        if (n < 0) return -1;
+        if (i == buf->max_items) {
+            n = buf_puts(buf, "...", ctx);
+            if (n < 0) return -1;
+            break;
+        }
 
-        n = datashape(buf, mem[i].t, d, ctx);
+        n = datashape(buf, t->Tuple.types[i], d, level+1, ctx);
         if (n < 0) return -1;
     }
+    buf->depth--;
 
     return 0;
 }
 
 static int
-dim_option(buf_t *buf, const ndt_t *t, ndt_context_t *ctx)
+record_fields(buf_t *buf, const ndt_t *t, int d, int level, ndt_context_t *ctx)
 {
-    if (ndt_is_optional(t)) {
-        return ndt_snprintf(ctx, buf, "?");
+    int64_t i;
+    int n;
+
+    assert(t->tag == Record);
+
+    if (t->Record.shape > 0 && buf->depth >= buf->max_depth) {
+        return buf_puts(buf, "...", ctx);
     }
 
-    return 1;
+    buf->depth++;
+    for (i = 0; i < t->Record.shape && !buf->full; i++) {
+        if (i >= 1) {
+            if (d >= 0) {
+                n = buf_puts(buf, ",\n", ctx);
+                if (n < 0) return -1;
+
+                n = buf_indent(buf, d, ctx);
+                if (n < 0) return -1;
+            }
+            else {
+                n = buf_puts(buf, ", ", ctx);
+                if (n < 0) return -1;
+            }
+        }
+
+        if (i == buf->max_items) {
+            n = buf_puts(buf, "...", ctx);
+            if (n < 0) return -1;
+            break;
+        }
+
+        n = buf_puts(buf, t->Record.names[i], ctx);
+        if (n < 0) return -1;
+
+        n = buf_puts(buf, " : ", ctx);
+        if (n < 0) return -1;
+
+        n = datashape(buf, t->Record.types[i], d, level+1, ctx);
+        if (n < 0) return -1;
+    }
+    buf->depth--;
+
+    return 0;
 }
 
 static int
-datashape(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
+datashape(buf_t *buf, const ndt_t *t, int d, int level, ndt_context_t *ctx)
 {
     int n;
 
+    if (level >= MAX_RECURSION) {
+        return datashape_walk(buf, t, d, ctx);
+    }
+
     switch (t->tag) {
         case FixedDim:
-            n = dim_option(buf, t, ctx);
+            n = dim_option(buf, t->FixedDim.flags, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, "%" PRIi64 " * ", t->FixedDim.shape);
+            if (t->FixedDim.align != 0) {
+                n = buf_printf(buf, ctx, "fixed(shape=%" PRIi64 ", align=%" PRIu16 ") * ",
+                               t->FixedDim.shape, t->FixedDim.align);
+            }
+            else {
+                n = buf_int64(buf, t->FixedDim.shape, ctx);
+                if (n < 0) return -1;
+
+                n = buf_puts(buf, " * ", ctx);
+            }
             if (n < 0) return -1;
 
-            n = datashape(buf, t->FixedDim.type, d, ctx);
+            n = datashape(buf, t->FixedDim.type, d, level+1, ctx);
             return n;
 
         case SymbolicDim:
-            n = dim_option(buf, t, ctx);
+            n = dim_option(buf, t->SymbolicDim.flags, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, "%s * ", t->SymbolicDim.name);
+            n = buf_puts(buf, t->SymbolicDim.name, ctx);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->SymbolicDim.type, d, ctx);
+            n = buf_puts(buf, " * ", ctx);
+            if (n < 0) return -1;
+
+            n = datashape(buf, t->SymbolicDim.type, d, level+1, ctx);
             return n;
 
         case VarDim:
-            n = dim_option(buf, t, ctx);
+            n = dim_option(buf, t->VarDim.flags, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, "var * ");
+            if (t->VarDim.align != 0) {
+                n = buf_printf(buf, ctx, "var(align=%" PRIu16 ") * ", t->VarDim.align);
+            }
+            else {
+                n = buf_puts(buf, "var * ", ctx);
+            }
             if (n < 0) return -1;
 
-            n = datashape(buf, t->VarDim.type, d, ctx);
+            n = datashape(buf, t->VarDim.type, d, level+1, ctx);
             return n;
 
         case EllipsisDim:
-            n = dim_option(buf, t, ctx);
+            n = dim_option(buf, t->EllipsisDim.flags, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, "%s... * ",
-                    t->EllipsisDim.name ? t->EllipsisDim.name : "");
+            if (t->EllipsisDim.name) {
+                n = buf_puts(buf, t->EllipsisDim.name, ctx);
+                if (n < 0) return -1;
+            }
+
+            n = buf_puts(buf, "... * ", ctx);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->EllipsisDim.type, d, ctx);
+            n = datashape(buf, t->EllipsisDim.type, d, level+1, ctx);
             return n;
 
         case Option:
-            n = ndt_snprintf(ctx, buf, "?");
+            n = buf_puts(buf, "?", ctx);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->Option.type, d, ctx);
+            n = datashape(buf, t->Option.type, d, level+1, ctx);
             return n;
 
         case OptionItem:
-            n = ndt_snprintf(ctx, buf, "?");
+            n = buf_puts(buf, "?", ctx);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->OptionItem.type, d, ctx);
+            n = datashape(buf, t->OptionItem.type, d, level+1, ctx);
             return n;
 
         case Nominal:
-            n = ndt_snprintf(ctx, buf, "%s", t->Nominal.name);
+            n = buf_puts(buf, t->Nominal.name, ctx);
             return n;
 
         case Constr:
-            n = ndt_snprintf(ctx, buf, "%s(", t->Constr.name);
+            n = buf_puts(buf, t->Constr.name, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, "(", ctx);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->Constr.type, d, ctx);
+            n = datashape(buf, t->Constr.type, d, level+1, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, ")");
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         case Tuple:
-            n = ndt_snprintf(ctx, buf, "(");
+            n = buf_puts(buf, "(", ctx);
             if (n < 0) return -1;
 
             if (t->Tuple.shape > 0) {
-                n = tuple_fields(buf, t, d, ctx);
+                n = tuple_fields(buf, t, d, level, ctx);
                 if (n < 0) return -1;
 
                 n = comma_variadic_flag(buf, t->Tuple.flag, INT_MIN, ctx);
                 if (n < 0) return -1;
+
+                n = comma_attributes(buf, t, INT_MIN, ctx);
+                if (n < 0) return -1;
             }
             else {
                 n = variadic_flag(buf, t->Tuple.flag, ctx);
                 if (n < 0) return -1;
             }
 
-            n = ndt_snprintf(ctx, buf, ")");
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         case Record:
-            n = ndt_snprintf(ctx, buf, "{");
+            n = buf_puts(buf, "{", ctx);
             if (n < 0) return -1;
 
             if (d >= 0) {
-                n = ndt_snprintf(ctx, buf, "\n");
+                n = buf_puts(buf, "\n", ctx);
                 if (n < 0) return -1;
-                n = indent(ctx, buf, d+2);
+                n = buf_indent(buf, d+2, ctx);
                 if (n < 0) return -1;
             }
 
             if (t->Record.shape > 0) {
-                n = record_fields(buf, t, d+2, ctx);
+                n = record_fields(buf, t, d+2, level, ctx);
                 if (n < 0) return -1;
 
                 n = comma_variadic_flag(buf, t->Record.flag, d+2, ctx);
                 if (n < 0) return -1;
+
+                n = comma_attributes(buf, t, d+2, ctx);
+                if (n < 0) return -1;
             }
             else {
                 n = variadic_flag(buf, t->Record.flag, ctx);
@@ -382,24 +943,24 @@ datashape(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
             }
 
             if (d >= 0) {
-                n = ndt_snprintf(ctx, buf, "\n");
+                n = buf_puts(buf, "\n", ctx);
                 if (n < 0) return -1;
-                n = indent(ctx, buf, d);
+                n = buf_indent(buf, d, ctx);
                 if (n < 0) return -1;
             }
 
-            n = ndt_snprintf(ctx, buf, "}");
+            n = buf_puts(buf, "}", ctx);
             return n;
 
         case Function: {
             ndt_t *pos = t->Function.pos;
             ndt_t *kwds = t->Function.kwds;
 
-            n = ndt_snprintf(ctx, buf, "(");
+            n = buf_puts(buf, "(", ctx);
             if (n < 0) return -1;
 
             if (pos->Tuple.shape > 0) {
-                n = tuple_fields(buf, pos, d, ctx);
+                n = tuple_fields(buf, pos, d, level, ctx);
                 if (n < 0) return -1;
 
                 n = comma_variadic_flag(buf, pos->Tuple.flag, INT_MIN, ctx);
@@ -412,11 +973,11 @@ datashape(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
 
             if (kwds->Record.shape > 0) {
                 if (pos->Tuple.flag == Variadic || pos->Tuple.shape > 0) {
-                    n = ndt_snprintf(ctx, buf, ", ");
+                    n = buf_puts(buf, ", ", ctx);
                     if (n < 0) return -1;
                 }
 
-                n = record_fields(buf, kwds, INT_MIN, ctx);
+                n = record_fields(buf, kwds, INT_MIN, level, ctx);
                 if (n < 0) return -1;
 
                 n = comma_variadic_flag(buf, kwds->Record.flag, INT_MIN, ctx);
@@ -427,15 +988,15 @@ datashape(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
                 if (n < 0) return -1;
             }
 
-            n = ndt_snprintf(ctx, buf, ") -> ");
+            n = buf_puts(buf, ") -> ", ctx);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->Function.ret, d, ctx);
+            n = datashape(buf, t->Function.ret, d, level+1, ctx);
             return n;
         }
 
         case Typevar:
-            n = ndt_snprintf(ctx, buf, "%s", t->Typevar.name);
+            n = buf_puts(buf, t->Typevar.name, ctx);
             return n;
 
         case AnyKind:
@@ -452,47 +1013,80 @@ datashape(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
         case FixedStringKind:
         case FixedBytesKind:
         case String:
-            n = ndt_snprintf(ctx, buf, "%s", ndt_tag_as_string(t->tag));
+            n = buf_write(buf, scalar_names[t->tag].name, scalar_names[t->tag].len, ctx);
             return n;
 
         case FixedString:
-            n = ndt_snprintf(ctx, buf, "fixed_string(%zu, %s)",
-                          t->FixedString.size,
-                          ndt_encoding_as_string(t->FixedString.encoding));
+            n = buf_puts(buf, "fixed_string(", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->FixedString.size, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ", ", ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ndt_encoding_as_string(t->FixedString.encoding), ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         case Char:
-            n = ndt_snprintf(ctx, buf, "char(%s)",
-                          ndt_encoding_as_string(t->Char.encoding));
+            n = buf_puts(buf, "char(", ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ndt_encoding_as_string(t->Char.encoding), ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         case Bytes:
-            n = ndt_snprintf(ctx, buf, "bytes(align=%" PRIu8 ")", t->Bytes.target_align);
+            n = buf_puts(buf, "bytes(align=", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->Bytes.target_align, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         case FixedBytes:
-            n = ndt_snprintf(ctx, buf, "fixed_bytes(size=%zu, align=%" PRIu8 ")",
-                          t->FixedBytes.size, t->FixedBytes.align);
+            n = buf_puts(buf, "fixed_bytes(size=", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->FixedBytes.size, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ", align=", ctx);
+            if (n < 0) return -1;
+
+            n = buf_uint64(buf, t->FixedBytes.align, ctx);
+            if (n < 0) return -1;
+
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         case Categorical:
-            n = ndt_snprintf(ctx, buf, "categorical(");
+            n = buf_puts(buf, "categorical(", ctx);
             if (n < 0) return -1;
 
-            n = categorical(buf, t->Categorical.types, t->Categorical.ntypes, d, ctx);
+            n = categorical(buf, t->Categorical.types, t->Categorical.ntypes, d,
+                            level, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, ")");
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         case Pointer:
-            n = ndt_snprintf(ctx, buf, "pointer(");
+            n = buf_puts(buf, "pointer(", ctx);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->Pointer.type, d, ctx);
+            n = datashape(buf, t->Pointer.type, d, level+1, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, ")");
+            n = buf_puts(buf, ")", ctx);
             return n;
 
         default:
@@ -501,60 +1095,77 @@ datashape(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
     }
 }
 
+
 char *
 ndt_as_string(ndt_t *t, ndt_context_t *ctx)
 {
-    buf_t buf = {0, 0, NULL};
-    char *s;
-    size_t count;
+    buf_t buf = BUF_INIT;
 
-    if (datashape(&buf, t, INT_MIN, ctx) < 0) {
+    if (datashape(&buf, t, INT_MIN, 0, ctx) < 0) {
+        buf_clear(&buf);
         return NULL;
     }
 
-    count = buf.count;
-    buf.count = 0;
-    buf.size = count+1;
+    return buf_finish(&buf, ctx);
+}
 
-    buf.cur = s = ndt_alloc(1, count+1);
-    if (buf.cur == NULL) {
-        return ndt_memory_error(ctx);
-    }
+char *
+ndt_indent(ndt_t *t, ndt_context_t *ctx)
+{
+    buf_t buf = BUF_INIT;
 
-    if (datashape(&buf, t, INT_MIN, ctx) < 0) {
-        ndt_free(s);
+    if (datashape(&buf, t, 0, 0, ctx) < 0) {
+        buf_clear(&buf);
         return NULL;
     }
-    s[count] = '\0';
 
-    return s;
+    return buf_finish(&buf, ctx);
 }
 
 char *
-ndt_indent(ndt_t *t, ndt_context_t *ctx)
+ndt_as_string_limited(const ndt_t *t, const ndt_limits_t *limits,
+                      ndt_context_t *ctx)
 {
-    buf_t buf = {0, 0, NULL};
-    char *s;
-    size_t count;
+    buf_t buf = BUF_INIT;
+
+    if (buf_limit(&buf, limits, ctx) < 0) {
+        return NULL;
+    }
 
-    if (datashape(&buf, t, 0, ctx) < 0) {
+    if (datashape(&buf, t, INT_MIN, 0, ctx) < 0) {
+        buf_clear(&buf);
         return NULL;
     }
 
-    count = buf.count;
-    buf.count = 0;
-    buf.size = count+1;
+    return buf_finish(&buf, ctx);
+}
+
+int
+ndt_print(const ndt_t *t, ndt_write_f write, void *arg, ndt_context_t *ctx)
+{
+    char data[PRINT_BUFSIZE];
+    buf_t buf;
 
-    buf.cur = s = ndt_alloc(1, count+1);
-    if (buf.cur == NULL) {
-        return ndt_memory_error(ctx);
+    buf_sink(&buf, data, write, arg);
+
+    if (datashape(&buf, t, INT_MIN, 0, ctx) < 0) {
+        return -1;
     }
 
-    if (datashape(&buf, t, 0, ctx) < 0) {
-        ndt_free(s);
-        return NULL;
+    return buf_flush(&buf, ctx);
+}
+
+int
+ndt_print_indent(const ndt_t *t, ndt_write_f write, void *arg, ndt_context_t *ctx)
+{
+    char data[PRINT_BUFSIZE];
+    buf_t buf;
+
+    buf_sink(&buf, data, write, arg);
+
+    if (datashape(&buf, t, 0, 0, ctx) < 0) {
+        return -1;
     }
-    s[count] = '\0';
 
-    return s;
+    return buf_flush(&buf, ctx);
 }
@@ -36,79 +36,58 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdarg.h>
-#include <errno.h>
 #include <assert.h>
 #include "ndtypes.h"
-
-
-#undef buf_t
-typedef struct {
-    size_t count; /* count the required size */
-    size_t size;  /* buffer size (0 for the count phase) */
-    char *cur;    /* buffer data (NULL for the count phase) */
-} buf_t;
+#include "print.h"
+#include "walk.h"
 
 
 static int datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx);
 
 
 static int
-_snprintf(ndt_context_t *ctx, buf_t *buf, const char *fmt, va_list ap)
+ndt_snprintf(ndt_context_t *ctx, buf_t *buf, const char *fmt, ...)
 {
+    va_list ap;
     int n;
 
-    errno = 0;
-    n = vsnprintf(buf->cur, buf->size, fmt, ap);
-    if (buf->cur && n < 0) {
-        if (errno == ENOMEM) {
-            ndt_err_format(ctx, NDT_MemoryError, "out of memory");
-        }
-        else {
-            ndt_err_format(ctx, NDT_OSError, "ndt_as_string: output error");
-        }
-        return -1;
-    }
-
-    if (buf->cur && (size_t)n >= buf->size) {
-         ndt_err_format(ctx, NDT_ValueError,
-                        "ndt_as_string: insufficient buffer size");
-        return -1;
-    }
-
-    buf->count += n;
-
-    if (buf->cur) {
-        buf->cur += n;
-        buf->size -= n;
-    }
+    va_start(ap, fmt);
+    n = buf_vprintf(buf, ctx, fmt, ap);
+    va_end(ap);
 
-    return 0;
+    return n;
 }
 
 static int
-ndt_snprintf(ndt_context_t *ctx, buf_t *buf, const char *fmt, ...)
+ndt_snprintf_d(ndt_context_t *ctx, buf_t *buf, int d, const char *fmt, ...)
 {
     va_list ap;
     int n;
 
+    n = buf_indent(buf, d, ctx);
+    if (n < 0) return -1;
+
     va_start(ap, fmt);
-    n = _snprintf(ctx, buf, fmt, ap);
+    n = buf_vprintf(buf, ctx, fmt, ap);
     va_end(ap);
 
     return n;
 }
 
+/* Print a list of offsets or shapes. */
 static int
-indent(ndt_context_t *ctx, buf_t *buf, int n)
+int32_list(buf_t *buf, const int32_t *v, int64_t n, ndt_context_t *ctx)
 {
-    int i;
-
-    if (n < 0) {
-        return 0;
-    }
+    int64_t i;
 
-    for (i = 0; i < n; i++) {
-        if (ndt_snprintf(ctx, buf, " ") < 0) {
+    for (i = 0; i < n && !buf->full; i++) {
+        if (i >= 1 && buf_puts(buf, ", ", ctx) < 0) {
+            return -1;
+        }
+        if (i == buf->max_items) {
+            return buf_puts(buf, "...", ctx);
+        }
+        if (buf_int64(buf, v[i], ctx) < 0) {
             return -1;
         }
     }
@@ -116,22 +95,6 @@ indent(ndt_context_t *ctx, buf_t *buf, int n)
     return 0;
 }
 
-static int
-ndt_snprintf_d(ndt_context_t *ctx, buf_t *buf, int d, const char *fmt, ...)
-{
-    va_list ap;
-    int n;
-
-    n = indent(ctx, buf, d);
-    if (n < 0) return -1;
-
-    va_start(ap, fmt);
-    n = _snprintf(ctx, buf, fmt, ap);
-    va_end(ap);
-
-    return n;
-}
-
 static int
 dim_flags(buf_t *buf, const ndt_t *t, ndt_context_t *ctx)
 {
@@ -194,108 +157,69 @@ common_attributes_with_newline(buf_t *buf, const ndt_t *t, int d,
 }
 
 static int
-tuple_fields(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
+variadic_flag(buf_t *buf, enum ndt_variadic flag, int d, ndt_context_t *ctx)
 {
-    int64_t i;
-    int n;
-
-    assert(t->tag == Tuple);
-
-    for (i = 0; i < t->Tuple.shape; i++) {
-        if (i >= 1) {
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
-        }
-
-        n = ndt_snprintf_d(ctx, buf, d, "TupleField(\n");
-        if (n < 0) return -1;
-
-        n = ndt_snprintf_d(ctx, buf, d+2, "type=");
-        if (n < 0) return -1;
+    if (flag == Variadic) {
+        return ndt_snprintf_d(ctx, buf, d, "variadic=true,\n");
+    }
 
-        n = datashape(buf, t->Tuple.types[i], d+5+2, 1, ctx);
-        if (n < 0) return -1;
+    return 0;
+}
 
-        n = ndt_snprintf(ctx, buf, "%s\n", ndt_is_concrete(t) ? "," : "");
+static int
+comma_variadic_flag(buf_t *buf, enum ndt_variadic flag, int d, ndt_context_t *ctx)
+{
+    if (flag == Variadic) {
+        int n = ndt_snprintf(ctx, buf, ",\n");
         if (n < 0) return -1;
 
-        if (ndt_is_concrete(t)) {
-            n = ndt_snprintf_d(ctx, buf, d+2,
-                               "offset=%zu, align=%" PRIu16 ", pad=%" PRIu16 "\n",
-                               t->Concrete.Tuple.offset[i], t->Concrete.Tuple.align[i],
-                               t->Concrete.Tuple.pad[i]);
-            if (n < 0) return -1;
-        }
-
-        n = ndt_snprintf_d(ctx, buf, d, ")");
-        if (n < 0) return -1;
+        return ndt_snprintf_d(ctx, buf, d, "variadic=true");
     }
 
     return 0;
 }
 
+/* Print the 'align', 'pack' and 'reorder' attributes of a tuple or record. */
 static int
-record_fields(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
+comma_attributes(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
 {
-    int64_t i;
+    uint16_t align, pack;
+    bool reorder;
     int n;
 
-    assert(t->tag == Record);
-
-    for (i = 0; i < t->Record.shape; i++) {
-        if (i >= 1) {
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
-        }
-
-        n = ndt_snprintf_d(ctx, buf, d, "RecordField(\n");
-        if (n < 0) return -1;
+    if (t->tag == Tuple) {
+        align = t->Tuple.align;
+        pack = t->Tuple.pack;
+        reorder = t->Tuple.reorder;
+    }
+    else {
+        align = t->Record.align;
+        pack = t->Record.pack;
+        reorder = t->Record.reorder;
+    }
 
-        n = ndt_snprintf_d(ctx, buf, d+2, "name='%s',\n", t->Record.names[i]);
+    if (align != 0) {
+        n = ndt_snprintf(ctx, buf, ",\n");
         if (n < 0) return -1;
 
-        n = ndt_snprintf_d(ctx, buf, d+2, "type=");
+        n = ndt_snprintf_d(ctx, buf, d, "align=%" PRIu16, align);
         if (n < 0) return -1;
+    }
 
-        n = datashape(buf, t->Record.types[i], d+5+2, 1, ctx);
+    if (pack != 0) {
+        n = ndt_snprintf(ctx, buf, ",\n");
         if (n < 0) return -1;
 
-        n = ndt_snprintf(ctx, buf, "%s\n", ndt_is_concrete(t) ? "," : "");
-        if (n < 0) return -1;
-
-        if (ndt_is_concrete(t)) {
-            n = ndt_snprintf_d(ctx, buf, d+2,
-                "offset=%zu, align=%" PRIu16 ", pad=%" PRIu16 "\n",
-                t->Concrete.Record.offset[i], t->Concrete.Record.align[i],
-                t->Concrete.Record.pad[i]);
-            if (n < 0) return -1;
-        }
-
-        n = ndt_snprintf_d(ctx, buf, d, ")");
+        n = ndt_snprintf_d(ctx, buf, d, "pack=%" PRIu16, pack);
         if (n < 0) return -1;
     }
 
-    return 0;
-}
-
-static int
-variadic_flag(buf_t *buf, enum ndt_variadic flag, int d, ndt_context_t *ctx)
-{
-    if (flag == Variadic) {
-        return ndt_snprintf_d(ctx, buf, d, "variadic=true,\n");
-    }
-
-    return 0;
-}
-
-static int
-comma_variadic_flag(buf_t *buf, enum ndt_variadic flag, int d, ndt_context_t *ctx)
-{
-    if (flag == Variadic) {
-        int n = ndt_snprintf(ctx, buf, ",\n");
+    if (reorder) {
+        n = ndt_snprintf(ctx, buf, ",\n");
         if (n < 0) return -1;
 
-        return ndt_snprintf_d(ctx, buf, d, "variadic=true");
+        n = ndt_snprintf_d(ctx, buf, d, "reorder=true");
+        if (n < 0) return -1;
     }
 
     return 0;
@@ -342,12 +266,23 @@ categorical(buf_t *buf, ndt_memory_t *mem, size_t ntypes, int d, ndt_context_t *
     size_t i;
     int n;
 
-    for (i = 0; i < ntypes; i++) {
+    if (ntypes > 0 && buf->depth >= buf->max_depth) {
+        return ndt_snprintf(ctx, buf, "...");
+    }
+
+    buf->depth++;
+    for (i = 0; i < ntypes && !buf->full; i++) {
         if (i >= 1) {
             n = ndt_snprintf(ctx, buf, ", ");
             if (n < 0) return -1;
         }
 
+        if ((int64_t)i == buf->max_items) {
+            n = ndt_snprintf(ctx, buf, "...");
+            if (n < 0) return -1;
+            break;
+        }
+
         n = value(buf, &mem[i], ctx);
         if (n < 0) return -1;
 
@@ -357,6 +292,7 @@ categorical(buf_t *buf, ndt_memory_t *mem, size_t ntypes, int d, ndt_context_t *
         n = datashape(buf, mem[i].t, d, 1, ctx);
         if (n < 0) return -1;
     }
+    buf->depth--;
 
     return 0;
 }
@@ -426,22 +362,160 @@ tag_as_constr(enum ndt tag)
 }
 
 
+/*****************************************************************************/
+/*                              Printer walk                                 */
+/*****************************************************************************/
+
+/*
+ * The type is printed by walk(), so deeply nested types do not exhaust the
+ * native stack.  'pre' prints the field prefix of a node in its parent and
+ * the beginning of the node, 'post' prints the end of the node and the field
+ * suffix.  'd' is the indentation of the current node.
+ */
+typedef struct {
+    buf_t *buf;
+    int d;
+    int cont;           /* the root follows a label */
+    ndt_context_t *ctx;
+} show_t;
+
+/* Indentation of the 'index'-th child relative to 'parent'. */
 static int
-datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
+child_indent(const ndt_t *parent, int64_t index)
+{
+    if (parent == NULL) {
+        return 0;
+    }
+
+    switch (parent->tag) {
+    case Constr: return 5+2;
+    case Tuple: case Record: return 2+5+2;
+    case Function: return index == 1 ? 5+2 : 4+2;
+    default: return 2;
+    }
+}
+
+/* The child follows a label like "type=" on the same line. */
+static int
+child_cont(const show_t *s, const ndt_t *parent)
+{
+    if (parent == NULL) {
+        return s->cont;
+    }
+
+    switch (parent->tag) {
+    case Constr: case Tuple: case Record: case Function: return 1;
+    default: return 0;
+    }
+}
+
+/* Print what precedes the 'index'-th child of 'parent' at indentation 'd'. */
+static int
+field_begin(buf_t *buf, const ndt_t *parent, int64_t index, int d,
+            ndt_context_t *ctx)
 {
     int n;
 
-    switch (t->tag) {
-        case FixedDim:
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "FixedDim(\n");
+    switch (parent->tag) {
+    case Tuple: case Record:
+        if (index >= 1) {
+            n = ndt_snprintf(ctx, buf, ",\n");
             if (n < 0) return -1;
+        }
 
-            n = datashape(buf, t->FixedDim.type, d+2, 0, ctx);
+        if (index == buf->max_items) {
+            n = ndt_snprintf_d(ctx, buf, d+2, "...");
             if (n < 0) return -1;
+            return WalkSkipSiblings;
+        }
 
-            n = ndt_snprintf(ctx, buf, ",\n");
+        if (parent->tag == Tuple) {
+            n = ndt_snprintf_d(ctx, buf, d+2, "TupleField(\n");
+            if (n < 0) return -1;
+        }
+        else {
+            n = ndt_snprintf_d(ctx, buf, d+2, "RecordField(\n");
+            if (n < 0) return -1;
+
+            n = ndt_snprintf_d(ctx, buf, d+4, "name='%s',\n",
+                               parent->Record.names[index]);
+            if (n < 0) return -1;
+        }
+
+        n = ndt_snprintf_d(ctx, buf, d+4, "type=");
+        if (n < 0) return -1;
+
+        return WalkContinue;
+
+    case Function:
+        n = ndt_snprintf_d(ctx, buf, d+2, "%s=",
+                           index == 0 ? "pos" : index == 1 ? "kwds" : "ret");
+        if (n < 0) return -1;
+
+        return WalkContinue;
+
+    default:
+        return WalkContinue;
+    }
+}
+
+/* Print what follows the 'index'-th child of 'parent' at indentation 'd'. */
+static int
+field_end(buf_t *buf, const ndt_t *parent, int64_t index, int d,
+          ndt_context_t *ctx)
+{
+    int n;
+
+    switch (parent->tag) {
+    case Tuple:
+        n = ndt_snprintf(ctx, buf, "%s\n", ndt_is_concrete(parent) ? "," : "");
+        if (n < 0) return -1;
+
+        if (ndt_is_concrete(parent)) {
+            n = ndt_snprintf_d(ctx, buf, d+4,
+                               "offset=%zu, align=%" PRIu16 ", pad=%" PRIu16 "\n",
+                               parent->Concrete.Tuple.offset[index],
+                               parent->Concrete.Tuple.align[index],
+                               parent->Concrete.Tuple.pad[index]);
+            if (n < 0) return -1;
+        }
+
+        return ndt_snprintf_d(ctx, buf, d+2, ")");
+
+    case Record:
+        n = ndt_snprintf(ctx, buf, "%s\n", ndt_is_concrete(parent) ? "," : "");
+        if (n < 0) return -1;
+
+        if (ndt_is_concrete(parent)) {
+            n = ndt_snprintf_d(ctx, buf, d+4,
+                "offset=%zu, align=%" PRIu16 ", pad=%" PRIu16 "\n",
+                parent->Concrete.Record.offset[index],
+                parent->Concrete.Record.align[index],
+                parent->Concrete.Record.pad[index]);
             if (n < 0) return -1;
+        }
+
+        return ndt_snprintf_d(ctx, buf, d+2, ")");
+
+    case Function:
+        return ndt_snprintf(ctx, buf, ",\n");
+
+    case EllipsisDim: case Constr:
+        return ndt_snprintf(ctx, buf, "\n");
+
+    default:
+        return ndt_snprintf(ctx, buf, ",\n");
+    }
+}
+
+/* Print the end of 't' at indentation 'd', the children have been printed. */
+static int
+node_end(buf_t *buf, const ndt_t *t, int d, ndt_context_t *ctx)
+{
+    int n;
 
+    switch (t->tag) {
+        case FixedDim:
             n = ndt_snprintf_d(ctx, buf, d+2, "flags=[");
             if (n < 0) return -1;
 
@@ -459,29 +533,24 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
             }
             else {
                 n = ndt_snprintf(ctx, buf,
-                    ", itemsize=%" PRIi64 ", stride=%zu,\n",
+                    ", itemsize=%" PRIi64 ", stride=%" PRIi64,
                     t->Concrete.FixedDim.itemsize,
                     t->Concrete.FixedDim.stride);
-            }
-            if (n < 0) return -1;
-
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
-
-        case SymbolicDim:
-            assert(ndt_is_abstract(t));
+                if (n < 0) return -1;
 
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "SymbolicDim(\n");
-            if (n < 0) return -1;
+                if (ndt_is_ndarray(t)) {
+                    n = ndt_snprintf(ctx, buf, ", offset=%" PRIi64,
+                                     t->Concrete.FixedDim.offset);
+                    if (n < 0) return -1;
+                }
 
-            n = datashape(buf, t->SymbolicDim.type, d+2, 0, ctx);
+                n = ndt_snprintf(ctx, buf, ",\n");
+            }
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
+            break;
 
+        case SymbolicDim:
             n = ndt_snprintf_d(ctx, buf, d+2, "flags=[");
             if (n < 0) return -1;
 
@@ -494,23 +563,9 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
             n = ndt_snprintf_d(ctx, buf, d+2, "name='%s',\n", t->SymbolicDim.name);
             if (n < 0) return -1;
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
-
-        case VarDim: {
-            int i;
-
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "VarDim(\n");
-            if (n < 0) return -1;
-
-            n = datashape(buf, t->VarDim.type, d+2, 0, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
+            break;
 
+        case VarDim:
             n = ndt_snprintf_d(ctx, buf, d+2, "flags=[");
             if (n < 0) return -1;
 
@@ -524,12 +579,9 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
                 n = ndt_snprintf_d(ctx, buf, d+2, "offsets=[");
                 if (n < 0) return -1;
 
-                for (i = 0; i < t->Concrete.VarDim.nshapes+1; i++) {
-                    n = ndt_snprintf(ctx, buf, "%" PRIi32 "%s",
-                                     t->Concrete.VarDim.offsets[i],
-                                     i==t->Concrete.VarDim.nshapes ? "" : ", ");
-                    if (n < 0) return -1;
-                }
+                n = int32_list(buf, t->Concrete.VarDim.offsets,
+                               t->Concrete.VarDim.nshapes+1, ctx);
+                if (n < 0) return -1;
 
                 n = ndt_snprintf(ctx, buf, "],\n");
                 if (n < 0) return -1;
@@ -537,12 +589,9 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
                 n = ndt_snprintf_d(ctx, buf, d+2, "shapes=[");
                 if (n < 0) return -1;
 
-                for (i = 0; i < t->Concrete.VarDim.nshapes; i++) {
-                    n = ndt_snprintf(ctx, buf, "%" PRIi32 "%s",
-                                     t->Concrete.VarDim.shapes[i],
-                                     i==t->Concrete.VarDim.nshapes-1 ? "" : ", ");
-                    if (n < 0) return -1;
-                }
+                n = int32_list(buf, t->Concrete.VarDim.shapes,
+                               t->Concrete.VarDim.nshapes, ctx);
+                if (n < 0) return -1;
 
                 n = ndt_snprintf(ctx, buf, "],\n");
                 if (n < 0) return -1;
@@ -553,25 +602,9 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
                 if (n < 0) return -1;
             }
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
-        }
+            break;
 
         case EllipsisDim:
-            assert(ndt_is_abstract(t));
-            assert(!ndt_is_optional(t));
-
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "EllipsisDim(\n");
-            if (n < 0) return -1;
-
-            n = datashape(buf, t->EllipsisDim.type, d+2, 0, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf(ctx, buf, "\n");
-            if (n < 0) return -1;
-
             n = ndt_snprintf_d(ctx, buf, d+2, "flags=[");
             if (n < 0) return -1;
 
@@ -581,90 +614,14 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
             n = ndt_snprintf(ctx, buf, "],\n");
             if (n < 0) return -1;
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
-
-        case Option:
-            assert(!ndt_is_optional(t->Option.type));
-
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Option(\n");
-            if (n < 0) return -1;
-
-            n = datashape(buf, t->Option.type, d+2, 0, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
-
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
-
-        case OptionItem:
-            assert(!ndt_is_optional(t->OptionItem.type));
-
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "OptionItem(\n");
-            if (n < 0) return -1;
-
-            n = datashape(buf, t->OptionItem.type, d+2, 0, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
-
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
-
-        case Nominal:
-            assert(ndt_is_concrete(t));
-
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Nominal(\n");
-            if (n < 0) return -1;
-
-            n = ndt_snprintf_d(ctx, buf, d+2, "name='%s',\n", t->Nominal.name);
-            if (n < 0) return -1;
-
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
-
-        case Constr:
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Constr(\n");
-            if (n < 0) return -1;
-
-            n = ndt_snprintf_d(ctx, buf, d+2, "name='%s',\n", t->Constr.name);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf_d(ctx, buf, d+2, "type=");
-            if (n < 0) return -1;
-
-            n = datashape(buf, t->Constr.type, d+5+2, 1, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf(ctx, buf, "\n");
-            if (n < 0) return -1;
-
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf_d(ctx, buf, d, ")");
-            return n;
+            break;
 
         case Tuple:
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Tuple(\n");
-            if (n < 0) return -1;
-
             if (t->Tuple.shape > 0) {
-                n = tuple_fields(buf, t, d+2, ctx);
+                n = comma_variadic_flag(buf, t->Tuple.flag, d+2, ctx);
                 if (n < 0) return -1;
 
-                n = comma_variadic_flag(buf, t->Tuple.flag, d+2, ctx);
+                n = comma_attributes(buf, t, d+2, ctx);
                 if (n < 0) return -1;
 
                 n = ndt_snprintf(ctx, buf, ",\n");
@@ -675,20 +632,14 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
                 if (n < 0) return -1;
             }
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            return ndt_snprintf_d(ctx, buf, d, ")");
+            break;
 
         case Record:
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Record(\n");
-            if (n < 0) return -1;
-
             if (t->Record.shape > 0) {
-                n = record_fields(buf, t, d+2, ctx);
+                n = comma_variadic_flag(buf, t->Record.flag, d+2, ctx);
                 if (n < 0) return -1;
 
-                n = comma_variadic_flag(buf, t->Record.flag, d+2, ctx);
+                n = comma_attributes(buf, t, d+2, ctx);
                 if (n < 0) return -1;
 
                 n = ndt_snprintf(ctx, buf, ",\n");
@@ -697,54 +648,156 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
             else {
                 n = variadic_flag(buf, t->Record.flag, d+2, ctx);
                 if (n < 0) return -1;
-
             }
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
+            break;
 
-            return ndt_snprintf_d(ctx, buf, d, ")");
+        case Option: case OptionItem: case Constr: case Function: case Pointer:
+            break;
 
-        case Function:
+        default:
+            /* leaves are printed by show_pre() */
+            return 0;
+    }
+
+    n = common_attributes_with_newline(buf, t, d+2, ctx);
+    if (n < 0) return -1;
+
+    return ndt_snprintf_d(ctx, buf, d, ")");
+}
+
+static int
+show_post(const ndt_t *t, const ndt_t *u, const ndt_t *parent, int64_t index,
+          void *arg)
+{
+    show_t *s = arg;
+    buf_t *buf = s->buf;
+    ndt_context_t *ctx = s->ctx;
+    int n;
+
+    (void)u;
+
+    if ((t->tag == Tuple && t->Tuple.shape > 0) ||
+        (t->tag == Record && t->Record.shape > 0)) {
+        buf->depth--;
+    }
+
+    n = node_end(buf, t, s->d, ctx);
+    if (n < 0) return -1;
+
+    s->d -= child_indent(parent, index);
+
+    if (parent != NULL) {
+        n = field_end(buf, parent, index, s->d, ctx);
+        if (n < 0) return -1;
+    }
+
+    return WalkContinue;
+}
+
+static int
+show_pre(const ndt_t *t, const ndt_t *u, const ndt_t *parent, int64_t index,
+         void *arg)
+{
+    show_t *s = arg;
+    buf_t *buf = s->buf;
+    ndt_context_t *ctx = s->ctx;
+    int64_t shape;
+    int d, n;
+
+    if (buf->full) {
+        return WalkStop;
+    }
+
+    if (parent != NULL) {
+        n = field_begin(buf, parent, index, s->d, ctx);
+        if (n != WalkContinue) return n;
+    }
+
+    s->d += child_indent(parent, index);
+    d = child_cont(s, parent) ? 0 : s->d;
+
+    switch (t->tag) {
+        case FixedDim:
+            return ndt_snprintf_d(ctx, buf, d, "FixedDim(\n") < 0 ? -1 : WalkContinue;
+
+        case SymbolicDim:
             assert(ndt_is_abstract(t));
+            return ndt_snprintf_d(ctx, buf, d, "SymbolicDim(\n") < 0 ? -1 : WalkContinue;
 
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Function(\n");
-            if (n < 0) return -1;
+        case VarDim:
+            return ndt_snprintf_d(ctx, buf, d, "VarDim(\n") < 0 ? -1 : WalkContinue;
 
-            n = ndt_snprintf_d(ctx, buf, d+2, "pos=");
-            if (n < 0) return -1;
+        case EllipsisDim:
+            assert(ndt_is_abstract(t));
+            assert(!ndt_is_optional(t));
+            return ndt_snprintf_d(ctx, buf, d, "EllipsisDim(\n") < 0 ? -1 : WalkContinue;
 
-            n = datashape(buf, t->Function.pos, d+4+2, 1, ctx);
+        case Option:
+            assert(!ndt_is_optional(t->Option.type));
+            return ndt_snprintf_d(ctx, buf, d, "Option(\n") < 0 ? -1 : WalkContinue;
 
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
+        case OptionItem:
+            assert(!ndt_is_optional(t->OptionItem.type));
+            return ndt_snprintf_d(ctx, buf, d, "OptionItem(\n") < 0 ? -1 : WalkContinue;
 
-            n = ndt_snprintf_d(ctx, buf, d+2, "kwds=");
-            if (n < 0) return -1;
+        case Pointer:
+            return ndt_snprintf_d(ctx, buf, d, "Pointer(\n") < 0 ? -1 : WalkContinue;
 
-            n = datashape(buf, t->Function.kwds, d+5+2, 1, ctx);
+        case Nominal:
+            assert(ndt_is_concrete(t));
 
-            n = ndt_snprintf(ctx, buf, ",\n");
+            n = ndt_snprintf_d(ctx, buf, d, "Nominal(\n");
             if (n < 0) return -1;
 
-            n = ndt_snprintf_d(ctx, buf, d+2, "ret=");
+            n = ndt_snprintf_d(ctx, buf, s->d+2, "name='%s',\n", t->Nominal.name);
             if (n < 0) return -1;
 
-            n = datashape(buf, t->Function.ret, d+4+2, 1, ctx);
+            n = common_attributes_with_newline(buf, t, s->d+2, ctx);
             if (n < 0) return -1;
 
-            n = ndt_snprintf(ctx, buf, ",\n");
+            n = ndt_snprintf_d(ctx, buf, s->d, ")");
+            break;
+
+        case Constr:
+            n = ndt_snprintf_d(ctx, buf, d, "Constr(\n");
             if (n < 0) return -1;
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
+            n = ndt_snprintf_d(ctx, buf, s->d+2, "name='%s',\n", t->Constr.name);
             if (n < 0) return -1;
 
-            return ndt_snprintf_d(ctx, buf, d, ")");
+            n = ndt_snprintf_d(ctx, buf, s->d+2, "type=");
+            break;
+
+        case Tuple: case Record:
+            n = ndt_snprintf_d(ctx, buf, d, t->tag == Tuple ? "Tuple(\n" : "Record(\n");
+            if (n < 0) return -1;
+
+            shape = t->tag == Tuple ? t->Tuple.shape : t->Record.shape;
+            if (shape == 0) {
+                break;
+            }
+
+            if (buf->depth >= buf->max_depth) {
+                n = ndt_snprintf_d(ctx, buf, s->d+2, "...");
+                if (n < 0) return -1;
+
+                buf->depth++;
+                n = show_post(t, u, parent, index, arg);
+                return n < 0 ? -1 : WalkSkip;
+            }
+
+            buf->depth++;
+            break;
+
+        case Function:
+            assert(ndt_is_abstract(t));
+            return ndt_snprintf_d(ctx, buf, d, "Function(\n") < 0 ? -1 : WalkContinue;
 
         case Typevar:
             assert(ndt_is_abstract(t));
 
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Typevar(");
+            n = ndt_snprintf_d(ctx, buf, d, "Typevar(");
             if (n < 0) return -1;
 
             n = ndt_snprintf(ctx, buf, "name='%s', ", t->Typevar.name);
@@ -753,7 +806,8 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
             n = common_attributes(buf, t, 0, ctx);
             if (n < 0) return -1;
 
-            return ndt_snprintf(ctx, buf, ")");
+            n = ndt_snprintf(ctx, buf, ")");
+            break;
 
         case AnyKind: case ScalarKind:
         case Void: case Bool:
@@ -767,100 +821,113 @@ datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
         case Complex32: case Complex64: case Complex128:
         case FixedStringKind: case FixedBytesKind:
         case String: case FixedString: case FixedBytes:
-            assert(ndt_is_concrete(t));
-
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "%s(", tag_as_constr(t->tag));
+            n = ndt_snprintf_d(ctx, buf, d, "%s(", tag_as_constr(t->tag));
             if (n < 0) return -1;
 
             n = common_attributes(buf, t, 0, ctx);
             if (n < 0) return -1;
 
-            return ndt_snprintf(ctx, buf, ")");
+            n = ndt_snprintf(ctx, buf, ")");
+            break;
 
         case Char:
             assert(ndt_is_concrete(t));
 
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Char(%s,\n",
+            n = ndt_snprintf_d(ctx, buf, d, "Char(%s,\n",
                                ndt_encoding_as_string(t->Char.encoding));
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
+            n = common_attributes_with_newline(buf, t, s->d+2, ctx);
             if (n < 0) return -1;
 
-            return ndt_snprintf_d(ctx, buf, d, ")");
+            n = ndt_snprintf_d(ctx, buf, s->d, ")");
+            break;
 
         case Bytes:
             assert(ndt_is_concrete(t));
 
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Bytes(target_align=%,\n", t->Bytes.target_align);
+            n = ndt_snprintf_d(ctx, buf, d, "Bytes(target_align=%,\n", t->Bytes.target_align);
             if (n < 0) return -1;
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
+            n = common_attributes_with_newline(buf, t, s->d+2, ctx);
             if (n < 0) return -1;
 
-            return ndt_snprintf_d(ctx, buf, d, ")");
+            n = ndt_snprintf_d(ctx, buf, s->d, ")");
+            break;
 
         case Categorical:
             assert(ndt_is_concrete(t));
 
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Categorical(");
+            n = ndt_snprintf_d(ctx, buf, d, "Categorical(");
             if (n < 0) return -1;
 
-            n = categorical(buf, t->Categorical.types, t->Categorical.ntypes, d, ctx);
+            n = categorical(buf, t->Categorical.types, t->Categorical.ntypes, s->d, ctx);
             if (n < 0) return -1;
 
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
+            n = common_attributes_with_newline(buf, t, s->d+2, ctx);
             if (n < 0) return -1;
 
             n = ndt_snprintf(ctx, buf, ")");
-            return n;
-
-        case Pointer:
-            n = ndt_snprintf_d(ctx, buf, cont ? 0 : d, "Pointer(\n");
-            if (n < 0) return -1;
-
-            n = datashape(buf, t->Pointer.type, d+2, 0, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf(ctx, buf, ",\n");
-            if (n < 0) return -1;
-
-            n = common_attributes_with_newline(buf, t, d+2, ctx);
-            if (n < 0) return -1;
-
-            n = ndt_snprintf_d(ctx, buf, d, ")");
-            return n;
+            break;
 
         default:
             ndt_err_format(ctx, NDT_ValueError, "invalid tag");
             return -1;
     }
+
+    return n < 0 ? -1 : WalkContinue;
+}
+
+static int
+datashape(buf_t *buf, const ndt_t *t, int d, int cont, ndt_context_t *ctx)
+{
+    show_t s = {buf, d, cont, ctx};
+
+    return walk(t, NULL, show_pre, show_post, &s) < 0 ? -1 : 0;
 }
 
 char *
 ndt_as_string_with_meta(ndt_t *t, ndt_context_t *ctx)
 {
-    buf_t buf = {0, 0, NULL};
-    char *s;
-    size_t count;
+    buf_t buf = BUF_INIT;
 
     if (datashape(&buf, t, 0, 0, ctx) < 0) {
+        buf_clear(&buf);
         return NULL;
     }
 
-    count = buf.count;
-    buf.count = 0;
-    buf.size = count+1;
+    return buf_finish(&buf, ctx);
+}
 
-    buf.cur = s = ndt_alloc(1, count+1);
-    if (buf.cur == NULL) {
-        return ndt_memory_error(ctx);
+char *
+ndt_as_string_with_meta_limited(const ndt_t *t, const ndt_limits_t *limits,
+                                ndt_context_t *ctx)
+{
+    buf_t buf = BUF_INIT;
+
+    if (buf_limit(&buf, limits, ctx) < 0) {
+        return NULL;
     }
 
     if (datashape(&buf, t, 0, 0, ctx) < 0) {
-        ndt_free(s);
+        buf_clear(&buf);
         return NULL;
     }
-    s[count] = '\0';
 
-    return s;
+    return buf_finish(&buf, ctx);
+}
+
+int
+ndt_print_with_meta(const ndt_t *t, ndt_write_f write, void *arg,
+                    ndt_context_t *ctx)
+{
+    char data[PRINT_BUFSIZE];
+    buf_t buf;
+
+    buf_sink(&buf, data, write, arg);
+
+    if (datashape(&buf, t, 0, 0, ctx) < 0) {
+        return -1;
+    }
+
+    return buf_flush(&buf, ctx);
 }
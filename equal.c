@@ -39,57 +39,22 @@
 #include <stdarg.h>
 #include <assert.h>
 #include "ndtypes.h"
+#include "walk.h"
 
 
 /*****************************************************************************/
 /*                          Structural equality                              */
 /*****************************************************************************/
 
-static inline int
-ndt_common_equal(const ndt_t *p, const ndt_t *c)
-{
-    return c->ndim == p->ndim;
-}
-
 static int
-tuple_fields_equal(const ndt_t *p, const ndt_t *c)
+names_equal(const ndt_t *p, const ndt_t *c)
 {
     int64_t i;
 
-    assert(p->tag == Tuple && c->tag == Tuple);
-
-    if (p->Tuple.shape != c->Tuple.shape) {
-        return 0;
-    }
-
-    for (i = 0; i < p->Tuple.shape; i++) {
-        if (!ndt_equal(p->Tuple.types[i], c->Tuple.types[i])) {
-            return 0;
-        }
-    }
-
-    return 1;
-}
-
-static int
-record_fields_equal(const ndt_t *p, const ndt_t *c)
-{
-    int64_t i;
-
-    assert(p->tag == Record && c->tag == Record);
-
-    if (p->Record.shape != c->Record.shape) {
-        return 0;
-    }
-
     for (i = 0; i < p->Record.shape; i++) {
         if (strcmp(p->Record.names[i], c->Record.names[i]) != 0) {
             return 0;
         }
-
-        if (!ndt_equal(p->Record.types[i], c->Record.types[i])) {
-            return 0;
-        }
     }
 
     return 1;
@@ -114,88 +79,93 @@ categorical_equal(ndt_memory_t *p, size_t plen,
     return 1;
 }
 
-int
-ndt_equal(const ndt_t *p, const ndt_t *c)
+static inline int
+option_equal(uint32_t p, uint32_t c)
+{
+    return ((p ^ c) & NDT_Dim_option) == 0;
+}
+
+/*
+ * Compare the attributes of two nodes, the children are compared by the
+ * walk.  Nodes with equal children have the same number of children.
+ */
+static int
+node_equal(const ndt_t *p, const ndt_t *c)
 {
-    if (!ndt_common_equal(p, c)) {
+    if (p->tag != c->tag || p->ndim != c->ndim) {
         return 0;
     }
 
     switch (p->tag) {
-    case AnyKind:
-    case ScalarKind:
-    case SignedKind: case UnsignedKind: case FloatKind: case ComplexKind:
-    case FixedStringKind: case FixedBytesKind:
-    case Void: case Bool:
-    case Int8: case Int16: case Int32: case Int64:
-    case Uint8: case Uint16: case Uint32: case Uint64:
-    case Float16: case Float32: case Float64:
-    case Complex32: case Complex64: case Complex128:
-    case String:
-        return c->tag == p->tag;
     case FixedString:
-        return c->tag == FixedString &&
-               c->FixedString.size == p->FixedString.size &&
+        return c->FixedString.size == p->FixedString.size &&
                c->FixedString.encoding == p->FixedString.encoding;
     case FixedBytes:
-        return c->tag == FixedBytes &&
-               c->FixedBytes.size == p->FixedBytes.size &&
+        return c->FixedBytes.size == p->FixedBytes.size &&
                c->FixedBytes.align == p->FixedBytes.align;
     case Char:
-        return c->tag == Char && c->Char.encoding == p->Char.encoding;
+        return c->Char.encoding == p->Char.encoding;
     case Bytes:
-        return c->tag == Bytes && c->Bytes.target_align == p->Bytes.target_align;
+        return c->Bytes.target_align == p->Bytes.target_align;
     case Categorical:
-        return c->tag == Categorical &&
-               categorical_equal(p->Categorical.types, p->Categorical.ntypes,
+        return categorical_equal(p->Categorical.types, p->Categorical.ntypes,
                                  c->Categorical.types, c->Categorical.ntypes);
-    case Pointer:
-        if (c->tag != Pointer) return 0;
-        return ndt_equal(p->Pointer.type, c->Pointer.type);
     case FixedDim:
-        return c->tag == FixedDim &&
-               ndt_is_optional(c) == ndt_is_optional(p) &&
-               c->FixedDim.shape == p->FixedDim.shape &&
-               ndt_equal(c->FixedDim.type, p->FixedDim.type);
+        return option_equal(p->FixedDim.flags, c->FixedDim.flags) &&
+               c->FixedDim.align == p->FixedDim.align &&
+               c->FixedDim.shape == p->FixedDim.shape;
     case SymbolicDim:
-        return c->tag == SymbolicDim &&
-               ndt_is_optional(c) == ndt_is_optional(p) &&
-               strcmp(c->SymbolicDim.name, p->SymbolicDim.name) == 0 &&
-               ndt_equal(c->SymbolicDim.type, p->SymbolicDim.type);
+        return option_equal(p->SymbolicDim.flags, c->SymbolicDim.flags) &&
+               strcmp(c->SymbolicDim.name, p->SymbolicDim.name) == 0;
     case VarDim:
-        return c->tag == VarDim &&
-               ndt_is_optional(c) == ndt_is_optional(p) &&
-               ndt_equal(c->VarDim.type, p->VarDim.type);
+        return option_equal(p->VarDim.flags, c->VarDim.flags) &&
+               c->VarDim.align == p->VarDim.align;
     case EllipsisDim:
-        return c->tag == EllipsisDim &&
-               ndt_is_optional(c) == ndt_is_optional(p) &&
-               ndt_equal(c->EllipsisDim.type, p->EllipsisDim.type);
+        return option_equal(p->EllipsisDim.flags, c->EllipsisDim.flags);
     case Tuple:
-        if (c->tag != Tuple || c->Tuple.flag != p->Tuple.flag) return 0;
-        return tuple_fields_equal(p, c);
+        return c->Tuple.flag == p->Tuple.flag && c->Tuple.shape == p->Tuple.shape &&
+               c->Tuple.reorder == p->Tuple.reorder &&
+               c->Tuple.align == p->Tuple.align && c->Tuple.pack == p->Tuple.pack;
     case Record:
-        if (c->tag != Record || c->Tuple.flag != p->Tuple.flag) return 0;
-        return record_fields_equal(p, c);
-    case Function:
-        return c->tag == Function &&
-               ndt_equal(p->Function.ret, c->Function.ret) &&
-               ndt_equal(p->Function.pos, c->Function.pos) &&
-               ndt_equal(p->Function.kwds, c->Function.kwds);
+        return c->Record.flag == p->Record.flag && c->Record.shape == p->Record.shape &&
+               c->Record.reorder == p->Record.reorder &&
+               c->Record.align == p->Record.align && c->Record.pack == p->Record.pack &&
+               names_equal(p, c);
     case Typevar:
-        return c->tag == Typevar && strcmp(c->Typevar.name, p->Typevar.name) == 0;
-    case Option:
-        return c->tag == Option && ndt_equal(p->Option.type, c->Option.type);
-    case OptionItem:
-        return c->tag == OptionItem && ndt_equal(p->OptionItem.type, c->OptionItem.type);
+        return strcmp(c->Typevar.name, p->Typevar.name) == 0;
     case Nominal:
-        /* Assume that the type has been created through ndt_nominal(), in
-           which case the name is guaranteed to be unique and present in the
-           typedef table. */
-        return c->tag == Nominal && strcmp(p->Nominal.name, c->Nominal.name) == 0;
+        /* Nominal types are equal if they are bound to the same definition.
+           The names of definitions in different namespaces may clash. */
+        return p->Nominal.type == c->Nominal.type &&
+               strcmp(p->Nominal.name, c->Nominal.name) == 0;
     case Constr:
-        return c->tag == Constr && strcmp(p->Constr.name, c->Constr.name) == 0 &&
-               ndt_equal(p->Constr.type, c->Constr.type);
-    default: /* NOT REACHED */
-        abort();
+        return strcmp(p->Constr.name, c->Constr.name) == 0;
+    default:
+        return 1;
+    }
+}
+
+static int
+equal_pre(const ndt_t *p, const ndt_t *c, const ndt_t *parent, int64_t index,
+          void *arg)
+{
+    (void)parent;
+    (void)index;
+    (void)arg;
+
+    if (p == c) {
+        return WalkSkip;
+    }
+
+    if (p->fingerprint != c->fingerprint || !node_equal(p, c)) {
+        return WalkStop;
     }
+
+    return WalkContinue;
+}
+
+int
+ndt_equal(const ndt_t *p, const ndt_t *c)
+{
+    return walk(p, c, equal_pre, NULL, NULL) == WalkContinue;
 }
@@ -0,0 +1,334 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                             Memory footprint                              */
+/*****************************************************************************/
+
+typedef struct {
+    ndt_footprint_t acc;
+    ndt_footprint_f f;
+    void *arg;
+    ndt_context_t *ctx;
+} footprint_state_t;
+
+static inline bool
+add_to(int64_t *r, int64_t a)
+{
+    if ((a > 0 && *r > INT64_MAX - a) || (a < 0 && *r < INT64_MIN - a)) {
+        return false;
+    }
+
+    *r += a;
+    return true;
+}
+
+static inline bool
+mul_i64(int64_t *r, int64_t a, int64_t b)
+{
+    if (a != 0 && (b > INT64_MAX / a || b < INT64_MIN / a)) {
+        return false;
+    }
+
+    *r = a * b;
+    return true;
+}
+
+static int
+overflow(ndt_context_t *ctx)
+{
+    ndt_err_format(ctx, NDT_ValueError, "ndt_footprint: size overflows int64");
+    return -1;
+}
+
+static int
+add_items(int64_t *field, int64_t count, int64_t size, ndt_context_t *ctx)
+{
+    int64_t n;
+
+    if (!mul_i64(&n, count, size) || !add_to(field, n)) {
+        return overflow(ctx);
+    }
+
+    return 0;
+}
+
+static void
+subtract(ndt_footprint_t *r, const ndt_footprint_t *a, const ndt_footprint_t *b)
+{
+    r->data = a->data - b->data;
+    r->padding = a->padding - b->padding;
+    r->meta = a->meta - b->meta;
+    r->indirect = a->indirect - b->indirect;
+    r->nvarlen = a->nvarlen - b->nvarlen;
+    r->total = r->data + r->padding + r->meta + r->indirect;
+}
+
+static int footprint(footprint_state_t *s, const ndt_t *t, int64_t count);
+
+/*
+ * The targets of pointers are separate allocations.  Their complete
+ * footprint is counted as indirect memory of the pointer.
+ */
+static int
+pointer_target(footprint_state_t *s, const ndt_t *t, int64_t count)
+{
+    ndt_footprint_t saved = s->acc;
+    ndt_footprint_t target;
+
+    s->acc.data = s->acc.padding = s->acc.meta = s->acc.indirect = 0;
+    s->acc.nvarlen = 0;
+
+    if (footprint(s, t, count) < 0) {
+        return -1;
+    }
+
+    target = s->acc;
+    saved.exact = saved.exact && target.exact;
+    s->acc = saved;
+
+    if (!add_to(&s->acc.indirect, target.data) ||
+        !add_to(&s->acc.indirect, target.padding) ||
+        !add_to(&s->acc.indirect, target.meta) ||
+        !add_to(&s->acc.indirect, target.indirect) ||
+        !add_to(&s->acc.nvarlen, target.nvarlen)) {
+        return overflow(s->ctx);
+    }
+
+    return 0;
+}
+
+/*
+ * Add the footprint of 'count' instances of 't' to the accumulator.  The
+ * metadata of dimensions exists once per dimension, so it is not
+ * multiplied by 'count'.
+ */
+static int
+footprint(footprint_state_t *s, const ndt_t *t, int64_t count)
+{
+    ndt_footprint_t *acc = &s->acc;
+    ndt_footprint_t start = *acc;
+    ndt_footprint_t sub;
+    ndt_context_t *ctx = s->ctx;
+    const ndt_t *u;
+    int64_t n, used, expected;
+    int64_t i;
+    int ret = 0;
+
+    acc->exact = true;
+
+    if (ndt_is_concrete(t) &&
+        (t->tag == FixedDim || t->tag == VarDim) &&
+        !add_to(&acc->meta, t->meta_size)) {
+        return overflow(ctx);
+    }
+
+    switch (t->tag) {
+    case FixedDim:
+        if (!mul_i64(&n, count, t->FixedDim.shape)) {
+            return overflow(ctx);
+        }
+        ret = footprint(s, t->FixedDim.type, n);
+        break;
+
+    case SymbolicDim:
+        /* Symbolic dimensions count as shape 1. */
+        acc->exact = false;
+        ret = footprint(s, t->SymbolicDim.type, count);
+        break;
+
+    case EllipsisDim:
+        acc->exact = false;
+        ret = footprint(s, t->EllipsisDim.type, count);
+        break;
+
+    case VarDim:
+        u = t->VarDim.type;
+        if (ndt_is_abstract(t)) {
+            acc->exact = false;
+            ret = footprint(s, u, count);
+        }
+        else if (u->tag == VarDim) {
+            ret = footprint(s, u, count);
+        }
+        else {
+            n = t->Concrete.VarDim.offsets[t->Concrete.VarDim.nshapes];
+            if (!mul_i64(&n, count, n)) {
+                return overflow(ctx);
+            }
+            ret = footprint(s, u, n);
+        }
+        break;
+
+    case Tuple:
+        for (i = 0; i < t->Tuple.shape && ret == 0; i++) {
+            ret = footprint(s, t->Tuple.types[i], count);
+        }
+        break;
+
+    case Record:
+        for (i = 0; i < t->Record.shape && ret == 0; i++) {
+            ret = footprint(s, t->Record.types[i], count);
+        }
+        break;
+
+    case Option:
+        if (!add_to(&acc->meta, count/8 + (count%8 != 0))) {
+            return overflow(ctx);
+        }
+        ret = footprint(s, t->Option.type, count);
+        break;
+
+    case OptionItem:
+        if (!add_to(&acc->meta, count/8 + (count%8 != 0))) {
+            return overflow(ctx);
+        }
+        ret = footprint(s, t->OptionItem.type, count);
+        break;
+
+    case Constr:
+        ret = footprint(s, t->Constr.type, count);
+        break;
+
+    case Nominal:
+        ret = footprint(s, t->Nominal.type, count);
+        break;
+
+    case Pointer:
+        ret = add_items(&acc->data, count, t->data_size, ctx);
+        if (ret == 0) {
+            ret = pointer_target(s, t->Pointer.type, count);
+        }
+        break;
+
+    case String: case Bytes:
+        acc->exact = false;
+        if (!add_to(&acc->nvarlen, count)) {
+            return overflow(ctx);
+        }
+        ret = add_items(&acc->data, count, t->data_size, ctx);
+        if (ret == 0) {
+            ret = add_items(&acc->indirect, count, NDT_VARLEN_ESTIMATE, ctx);
+        }
+        break;
+
+    default:
+        if (ndt_is_abstract(t)) {
+            acc->exact = false;
+            break;
+        }
+        ret = add_items(&acc->data, count, t->data_size, ctx);
+        break;
+    }
+
+    if (ret < 0) {
+        return -1;
+    }
+
+    /*
+     * Everything in the data block of 't' that is not covered by items is
+     * padding or unused buffer space.  Arrays with overlapping strides
+     * cover less memory than the sum of their items.
+     */
+    if (ndt_is_concrete(t)) {
+        if (!mul_i64(&expected, count, t->data_size)) {
+            return overflow(ctx);
+        }
+        used = (acc->data - start.data) + (acc->padding - start.padding);
+        if (used < expected) {
+            acc->padding += expected - used;
+        }
+        else {
+            acc->data -= used - expected;
+        }
+    }
+
+    if (s->f != NULL) {
+        subtract(&sub, acc, &start);
+        sub.exact = acc->exact;
+        if (s->f(t, &sub, s->arg) < 0) {
+            ndt_err_format(ctx, NDT_RuntimeError,
+                           "ndt_footprint: callback failed");
+            return -1;
+        }
+    }
+
+    acc->exact = acc->exact && start.exact;
+    return 0;
+}
+
+/*
+ * Compute the memory needed for an instance of 't'.  The report breaks the
+ * total down into item data, padding, dimension metadata and indirect
+ * memory.  If 'f' is not NULL, it is called for each subtree (in postorder)
+ * with the part of the footprint that belongs to all instances of the
+ * subtree.
+ *
+ * Abstract types are accepted: Symbolic dimensions count as shape 1 and
+ * abstract items do not contribute, so the report is the footprint per unit
+ * of each symbolic dimension.  String and bytes payloads are estimated with
+ * NDT_VARLEN_ESTIMATE bytes.  'exact' is false in both cases.
+ */
+int
+ndt_footprint(const ndt_t *t, ndt_footprint_t *report, ndt_footprint_f f,
+              void *arg, ndt_context_t *ctx)
+{
+    footprint_state_t s;
+
+    s.acc.data = s.acc.padding = s.acc.meta = s.acc.indirect = 0;
+    s.acc.nvarlen = s.acc.total = 0;
+    s.acc.exact = true;
+    s.f = f;
+    s.arg = arg;
+    s.ctx = ctx;
+
+    if (footprint(&s, t, 1) < 0) {
+        return -1;
+    }
+
+    if (!add_to(&s.acc.total, s.acc.data) ||
+        !add_to(&s.acc.total, s.acc.padding) ||
+        !add_to(&s.acc.total, s.acc.meta) ||
+        !add_to(&s.acc.total, s.acc.indirect)) {
+        return overflow(ctx);
+    }
+
+    *report = s.acc;
+    return 0;
+}
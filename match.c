@@ -43,12 +43,51 @@
 
 
 static int match_datashape(const ndt_t *, const ndt_t *, symtable_t *, ndt_context_t *);
-static int match_dimensions(const ndt_t *p[], int pshape, const ndt_t *c[], int cshape, symtable_t *tbl, ndt_context_t *ctx);
 
 
+/*
+ * Bindings of an ellipsis are taken from the candidate.  If the candidate is
+ * abstract, they may contain symbolic dimensions and named ellipses, which
+ * are compared by name.
+ */
+static int
+dim_list_equal(const dim_list_t *a, const dim_list_t *b)
+{
+    const ndt_t *s, *t;
+    int i;
+
+    if (a->size != b->size) {
+        return 0;
+    }
+
+    for (i = 0; i < a->size; i++) {
+        s = a->dims[i];
+        t = b->dims[i];
+
+        if (s->tag != t->tag) {
+            return 0;
+        }
+
+        switch (s->tag) {
+        case FixedDim:
+            if (s->FixedDim.shape != t->FixedDim.shape) return 0;
+            break;
+        case SymbolicDim:
+            if (strcmp(s->SymbolicDim.name, t->SymbolicDim.name) != 0) return 0;
+            break;
+        case EllipsisDim:
+            if (strcmp(s->EllipsisDim.name, t->EllipsisDim.name) != 0) return 0;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 1;
+}
+
 static int
-symtable_entry_equal(symtable_entry_t *v, symtable_entry_t *w, symtable_t *tbl,
-                     ndt_context_t *ctx)
+symtable_entry_equal(const symtable_entry_t *v, const symtable_entry_t *w)
 {
     switch (v->tag) {
     case SizeEntry:
@@ -58,17 +97,74 @@ symtable_entry_equal(symtable_entry_t *v, symtable_entry_t *w, symtable_t *tbl,
     case TypeEntry:
         return w->tag == TypeEntry && ndt_equal(v->TypeEntry, w->TypeEntry);
     case DimListEntry:
-        if (w->tag != DimListEntry)
-            return 0;
-
-        return match_dimensions(v->DimListEntry.dims, v->DimListEntry.size,
-                                w->DimListEntry.dims, w->DimListEntry.size,
-                                tbl, ctx);
+        return w->tag == DimListEntry &&
+               dim_list_equal(&v->DimListEntry, &w->DimListEntry);
     default:
         return 0;
     }
 }
 
+static bool
+all_fixed(const dim_list_t *dims)
+{
+    int i;
+
+    for (i = 0; i < dims->size; i++) {
+        if (dims->dims[i]->tag != FixedDim) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Broadcast two bindings of the same ellipsis following the NumPy rules.
+ * The dimension lists are aligned at the end.  Missing dimensions and
+ * dimensions of size 1 are stretched to the size of the other list.  On
+ * success, the binding is replaced by the broadcast dimensions.
+ */
+static int
+broadcast_sym(const char *key, const dim_list_t *a, const dim_list_t *b,
+              symtable_t *tbl, ndt_context_t *ctx)
+{
+    symtable_entry_t u;
+    const ndt_t *x, *y;
+    int size = a->size >= b->size ? a->size : b->size;
+    int i;
+
+    u.tag = DimListEntry;
+    u.DimListEntry.size = size;
+    u.DimListEntry.dims = NULL;
+
+    if (size > 0) {
+        u.DimListEntry.dims = ndt_alloc(size, sizeof *u.DimListEntry.dims);
+        if (u.DimListEntry.dims == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+    }
+
+    for (i = 1; i <= size; i++) {
+        x = i <= a->size ? a->dims[a->size-i] : NULL;
+        y = i <= b->size ? b->dims[b->size-i] : NULL;
+
+        if (x == NULL || (y != NULL && x->FixedDim.shape == 1)) {
+            x = y;
+        }
+        else if (y != NULL && y->FixedDim.shape != 1 &&
+                 y->FixedDim.shape != x->FixedDim.shape) {
+            ndt_free(u.DimListEntry.dims);
+            return 0;
+        }
+
+        u.DimListEntry.dims[size-i] = x;
+    }
+
+    symtable_replace(tbl, key, u);
+    return 1;
+}
+
 static int
 resolve_sym(const char *key, symtable_entry_t w,
             symtable_t *tbl,
@@ -86,7 +182,14 @@ resolve_sym(const char *key, symtable_entry_t w,
         return 1;
     }
 
-    n = symtable_entry_equal(&v, &w, tbl, ctx);
+    if (tbl->broadcast && v.tag == DimListEntry && w.tag == DimListEntry &&
+        all_fixed(&v.DimListEntry) && all_fixed(&w.DimListEntry)) {
+        n = broadcast_sym(key, &v.DimListEntry, &w.DimListEntry, tbl, ctx);
+        symtable_free_entry(w);
+        return n;
+    }
+
+    n = symtable_entry_equal(&v, &w);
     symtable_free_entry(w);
     return n;
 }
@@ -98,7 +201,7 @@ match_dimensions(const ndt_t *p[], int pshape,
 {
     symtable_entry_t v;
     int stride = 1;
-    int i, j, k, tmp;
+    int i, j, k, tmp, first;
     int n;
 
     for (i=0, k=0; i!=pshape && k!=cshape; i+=stride, k+=stride) {
@@ -126,11 +229,19 @@ match_dimensions(const ndt_t *p[], int pshape,
                         return -1;
                     }
 
-                    for (j = k; j != cshape; j+=stride) {
-                        switch(c[k]->tag) {
-                        case FixedDim: case VarDim:
-                            v.DimListEntry.dims[abs(k-j)] = c[j];
+                    /* the dimensions are stored in the order of 'c' */
+                    first = stride > 0 ? k : cshape+1;
+                    for (j = 0; j < size; j++) {
+                        switch(c[first+j]->tag) {
+                        case FixedDim: case VarDim: case SymbolicDim:
+                            v.DimListEntry.dims[j] = c[first+j];
                             break;
+                        case EllipsisDim:
+                            if (c[first+j]->EllipsisDim.name != NULL) {
+                                v.DimListEntry.dims[j] = c[first+j];
+                                break;
+                            }
+                            /* fall through */
                         default:
                             ndt_free(v.DimListEntry.dims);
                             return 0;
@@ -193,96 +304,222 @@ match_dimensions(const ndt_t *p[], int pshape,
 }
 
 static int
-match_tuple_fields(const ndt_t *p, const ndt_t *c, symtable_t *tbl,
-                   ndt_context_t *ctx)
+match_categorical(ndt_memory_t *p, size_t plen,
+                  ndt_memory_t *c, size_t clen)
 {
-    int64_t i;
-    int n;
+    size_t i;
 
-    assert(p->tag == Tuple && c->tag == Tuple);
+    if (plen != clen) {
+        return 0;
+    }
 
-    if (p->Tuple.shape != c->Tuple.shape) {
+    for (i = 0; i < plen; i++) {
+        if (!ndt_memory_equal(&p[i], &c[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Necessary condition for a match that only looks at the summaries: every
+ * exact tag in the pattern must occur in the candidate, and an array pattern
+ * without ellipses has the same number of dimensions as the candidate.
+ * Returns 0 if 'c' cannot match 'p'.
+ */
+int
+ndt_may_match(const ndt_t *p, const ndt_t *c)
+{
+    if (p->tags & ~c->tags & NDT_EXACT_TAGS) {
         return 0;
     }
 
-    for (i = 0; i < p->Tuple.shape; i++) {
-        n = match_datashape(p->Tuple.types[i], c->Tuple.types[i], tbl, ctx);
-        if (n <= 0) return n;
+    if (ndt_is_array(p) && !(p->tags & NDT_TAG_BIT(EllipsisDim)) &&
+        p->ndim != c->ndim) {
+        return 0;
     }
 
     return 1;
 }
 
+/* Keep the dimension arrays out of the frames of match_datashape(). */
+#if defined(__GNUC__)
+  #define NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+  #define NOINLINE __declspec(noinline)
+#else
+  #define NOINLINE
+#endif
+
+/* Match the dimensions of two arrays and return their dtypes. */
+static NOINLINE int
+match_array_dims(const ndt_t *p, const ndt_t *c, const ndt_t **pdtype,
+                 const ndt_t **cdtype, symtable_t *tbl, ndt_context_t *ctx)
+{
+    const ndt_t *pdims[NDT_MAX_DIM];
+    const ndt_t *cdims[NDT_MAX_DIM];
+    size_t pn, cn;
+
+    /* when broadcasting, scalars match an ellipsis with zero dimensions */
+    if (!ndt_is_array(c) && !(tbl->broadcast && p->tag == EllipsisDim)) {
+        return 0;
+    }
+    if (ndt_is_optional(c) != ndt_is_optional(p)) return 0;
+    if (ndt_is_column_major(c) != ndt_is_column_major(p)) return 0;
+
+    pn = ndt_const_dims_dtype(pdims, pdtype, p);
+    cn = ndt_const_dims_dtype(cdims, cdtype, c);
+
+    return match_dimensions(pdims, pn, cdims, cn, tbl, ctx);
+}
+
+/*
+ * The pairs of subtypes that remain to be matched.  The stack does not use
+ * native stack space, so the depth of the types is not limited.
+ */
+#define MATCH_INLINE 64
+
+typedef struct {
+    const ndt_t *p;
+    const ndt_t *c;
+} pair_t;
+
+typedef struct {
+    pair_t *pairs;
+    int64_t len;
+    int64_t alloc;
+    pair_t inline_pairs[MATCH_INLINE];
+} pair_stack_t;
+
 static int
-match_record_fields(const ndt_t *p, const ndt_t *c, symtable_t *tbl,
-                    ndt_context_t *ctx)
+push(pair_stack_t *st, const ndt_t *p, const ndt_t *c, ndt_context_t *ctx)
+{
+    pair_t *pairs;
+
+    if (st->len == st->alloc) {
+        pairs = st->pairs == st->inline_pairs
+                    ? ndt_alloc(2 * st->alloc, sizeof *pairs)
+                    : ndt_realloc(st->pairs, 2 * st->alloc, sizeof *pairs);
+        if (pairs == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        if (st->pairs == st->inline_pairs) {
+            memcpy(pairs, st->inline_pairs, sizeof st->inline_pairs);
+        }
+        st->pairs = pairs;
+        st->alloc *= 2;
+    }
+
+    st->pairs[st->len].p = p;
+    st->pairs[st->len].c = c;
+    st->len++;
+
+    return 1;
+}
+
+/*
+ * Push the fields of two tuples.  The pairs are pushed in reverse order,
+ * so that the fields are matched from left to right.
+ */
+static int
+match_tuple_fields(const ndt_t *p, const ndt_t *c, pair_stack_t *st,
+                   ndt_context_t *ctx)
 {
     int64_t i;
-    int n;
 
-    assert(p->tag == Record && c->tag == Record);
+    assert(p->tag == Tuple && c->tag == Tuple);
 
-    if (p->Record.shape != c->Record.shape) {
+    /* a variadic pattern ignores trailing fields */
+    if (p->Tuple.flag == Variadic ? c->Tuple.shape < p->Tuple.shape :
+        c->Tuple.flag == Variadic || c->Tuple.shape != p->Tuple.shape) {
         return 0;
     }
 
-    for (i = 0; i < p->Record.shape; i++) {
-        n = strcmp(p->Record.names[i], c->Record.names[i]);
-        if (n != 0) return 0;
-
-        n = match_datashape(p->Record.types[i], c->Record.types[i], tbl, ctx);
-        if (n <= 0) return n;
+    for (i = p->Tuple.shape-1; i >= 0; i--) {
+        if (push(st, p->Tuple.types[i], c->Tuple.types[i], ctx) < 0) {
+            return -1;
+        }
     }
 
     return 1;
 }
 
+/* Push the fields of two records, see match_tuple_fields(). */
 static int
-match_categorical(ndt_memory_t *p, size_t plen,
-                  ndt_memory_t *c, size_t clen)
+match_record_fields(const ndt_t *p, const ndt_t *c, pair_stack_t *st,
+                    ndt_context_t *ctx)
 {
-    size_t i;
+    int64_t i, k;
 
-    if (plen != clen) {
+    assert(p->tag == Record && c->tag == Record);
+
+    /* a variadic pattern requires its fields in any position */
+    if (p->Record.flag == Variadic) {
+        for (i = p->Record.shape-1; i >= 0; i--) {
+            k = ndt_record_field(c, p->Record.names[i]);
+            if (k < 0) return 0;
+
+            if (push(st, p->Record.types[i], c->Record.types[k], ctx) < 0) {
+                return -1;
+            }
+        }
+        return 1;
+    }
+
+    if (c->Record.flag == Variadic || p->Record.shape != c->Record.shape) {
         return 0;
     }
 
-    for (i = 0; i < plen; i++) {
-        if (!ndt_memory_equal(&p[i], &c[i])) {
+    for (i = p->Record.shape-1; i >= 0; i--) {
+        if (strcmp(p->Record.names[i], c->Record.names[i]) != 0) {
             return 0;
         }
+
+        if (push(st, p->Record.types[i], c->Record.types[i], ctx) < 0) {
+            return -1;
+        }
     }
 
     return 1;
 }
 
+/* Kinds that only stand for scalars are instances of 'Scalar'. */
+static inline bool
+is_scalar_kind(const ndt_t *t)
+{
+    switch (t->tag) {
+    case ScalarKind: case SignedKind: case UnsignedKind: case FloatKind:
+    case ComplexKind: case FixedStringKind: case FixedBytesKind:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Match two nodes.  Types with a single child are matched in a loop, the
+ * children of tuples, records and functions are pushed onto 'st'.
+ */
 static int
-match_datashape(const ndt_t *p, const ndt_t *c,
-                symtable_t *tbl,
-                ndt_context_t *ctx)
+match_node(const ndt_t *p, const ndt_t *c, pair_stack_t *st, symtable_t *tbl,
+           ndt_context_t *ctx)
 {
-    const ndt_t *pdims[NDT_MAX_DIM];
-    const ndt_t *cdims[NDT_MAX_DIM];
-    const ndt_t *pdtype;
-    const ndt_t *cdtype;
-    size_t pn, cn;
     int n;
 
+again:
+    if (!ndt_may_match(p, c)) {
+        return 0;
+    }
+
     switch (p->tag) {
     case AnyKind:
         return 1;
     case FixedDim: case SymbolicDim: case VarDim: case EllipsisDim:
-        if (!ndt_is_array(c)) return 0;
-        if (ndt_is_optional(c) != ndt_is_optional(p)) return 0;
-        if (ndt_is_column_major(c) != ndt_is_column_major(p)) return 0;
-
-        pn = ndt_const_dims_dtype(pdims, &pdtype, p);
-        cn = ndt_const_dims_dtype(cdims, &cdtype, c);
-
-        n = match_dimensions(pdims, pn, cdims, cn, tbl, ctx);
+        n = match_array_dims(p, c, &p, &c, tbl, ctx);
         if (n <= 0) return n;
-
-        return match_datashape(pdtype, cdtype, tbl, ctx);
+        goto again;
     case Void: case Bool:
     case Int8: case Int16: case Int32: case Int64:
     case Uint8: case Uint16: case Uint32: case Uint64:
@@ -311,7 +548,7 @@ match_datashape(const ndt_t *p, const ndt_t *c,
     case FixedBytesKind:
         return c->tag == FixedBytesKind || c->tag == FixedBytes;
     case ScalarKind:
-        return c->tag == ScalarKind || ndt_is_scalar(c);
+        return is_scalar_kind(c) || ndt_is_scalar(c);
     case Char:
         return c->tag == Char && c->Char.encoding == p->Char.encoding;
     case Bytes:
@@ -322,22 +559,27 @@ match_datashape(const ndt_t *p, const ndt_t *c,
                                  c->Categorical.types, c->Categorical.ntypes);
     case Pointer:
         if (c->tag != Pointer) return 0;
-        return match_datashape(p->Pointer.type, c->Pointer.type, tbl, ctx);
+        p = p->Pointer.type;
+        c = c->Pointer.type;
+        goto again;
     case Tuple:
         if (c->tag != Tuple) return 0;
-        return match_tuple_fields(p, c, tbl, ctx);
+        return match_tuple_fields(p, c, st, ctx);
     case Record:
         if (c->tag != Record) return 0;
-        return match_record_fields(p, c, tbl, ctx);
+        return match_record_fields(p, c, st, ctx);
     case Function:
         if (c->tag != Function) return 0;
-        n = match_datashape(p->Function.ret, c->Function.ret, tbl, ctx);
-        if (n <= 0) return n;
+        /* matched in the order ret, pos, kwds */
+        n = push(st, p->Function.kwds, c->Function.kwds, ctx);
+        if (n < 0) return n;
 
-        n = match_datashape(p->Function.pos, c->Function.pos, tbl, ctx);
-        if (n <= 0) return n;
+        n = push(st, p->Function.pos, c->Function.pos, ctx);
+        if (n < 0) return n;
 
-        return match_datashape(p->Function.kwds, c->Function.kwds, tbl, ctx);
+        p = p->Function.ret;
+        c = c->Function.ret;
+        goto again;
     case Typevar:
         if (c->tag == Typevar) {
             symtable_entry_t entry = { .tag = SymbolEntry,
@@ -351,15 +593,18 @@ match_datashape(const ndt_t *p, const ndt_t *c,
         }
     case Option:
         if (c->tag != Option) return 0;
-        return match_datashape(p->Option.type, c->Option.type, tbl, ctx);
+        p = p->Option.type;
+        c = c->Option.type;
+        goto again;
     case OptionItem:
         if (c->tag != OptionItem) return 0;
-        return match_datashape(p->OptionItem.type, c->OptionItem.type, tbl, ctx);
+        p = p->OptionItem.type;
+        c = c->OptionItem.type;
+        goto again;
     case Nominal:
-        /* Assume that the type has been created through ndt_nominal(), in
-           which case the name is guaranteed to be unique and present in the
-           typedef table. */
-        return c->tag == Nominal && strcmp(p->Nominal.name, c->Nominal.name) == 0;
+        /* the same definition, see ndt_equal() */
+        return c->tag == Nominal && p->Nominal.type == c->Nominal.type &&
+               strcmp(p->Nominal.name, c->Nominal.name) == 0;
     case Constr:
         return c->tag == Constr && strcmp(p->Constr.name, c->Constr.name) == 0 &&
                ndt_equal(p->Constr.type, c->Constr.type);
@@ -368,34 +613,202 @@ match_datashape(const ndt_t *p, const ndt_t *c,
     }
 }
 
+static int
+match_datashape(const ndt_t *p, const ndt_t *c,
+                symtable_t *tbl,
+                ndt_context_t *ctx)
+{
+    pair_stack_t st;
+    int n;
+
+    st.pairs = st.inline_pairs;
+    st.len = 0;
+    st.alloc = MATCH_INLINE;
+
+    n = match_node(p, c, &st, tbl, ctx);
+
+    while (n > 0 && st.len > 0) {
+        st.len--;
+        n = match_node(st.pairs[st.len].p, st.pairs[st.len].c, &st, tbl, ctx);
+    }
+
+    if (st.pairs != st.inline_pairs) {
+        ndt_free(st.pairs);
+    }
+
+    return n;
+}
+
 int
 ndt_match(const ndt_t *p, const ndt_t *c, ndt_context_t *ctx)
 {
-    symtable_t *tbl;
+    symtable_t tbl;
     int ret;
 
-    tbl = symtable_new(ctx);
-    if (tbl == NULL) {
-        return -1;
-    }
-
-    ret = match_datashape(p, c, tbl, ctx);
-    symtable_del(tbl);
+    symtable_init(&tbl);
+    ret = match_datashape(p, c, &tbl, ctx);
+    symtable_clear(&tbl);
     return ret;
 }
 
 
 /**********************************************************************/
-/*                        Experimental section                        */
+/*                            Substitution                            */
 /**********************************************************************/
 
-/* For demonstration: only handles fixed, symbolic, int64 */
+static ndt_t *ndt_substitute(const ndt_t *t, const symtable_t *tbl, ndt_context_t *ctx);
+
+static ndt_t *
+not_found(const char *name, ndt_context_t *ctx)
+{
+    ndt_err_format(ctx, NDT_ValueError,
+        "variable '%s' is not found or has incorrect type", name);
+    return NULL;
+}
+
+/* Wrap 'type' in a copy of the bound dimension 'w'.  'type' is consumed. */
+static ndt_t *
+bound_dim(const ndt_t *w, ndt_t *type, ndt_context_t *ctx)
+{
+    ndt_t *u;
+
+    switch (w->tag) {
+    case FixedDim:
+        u = ndt_fixed_dim(w->FixedDim.shape, type, ndt_order(w), ctx);
+        if (u != NULL && w->FixedDim.align != 0) {
+            u = ndt_aligned_dim(u, w->FixedDim.align, ctx);
+        }
+        return u;
+    case VarDim:
+        return ndt_var_dim_like(w, type, ctx);
+    default:
+        ndt_err_format(ctx, NDT_ValueError,
+            "ellipsis is bound to an abstract dimension");
+        ndt_del(type);
+        return NULL;
+    }
+}
+
+/* 'u' is the unchanged child of 't': share 't' instead. */
+static ndt_t *
+unchanged(const ndt_t *t, ndt_t *u)
+{
+    ndt_del(u);
+    return (ndt_t *)ndt_incref(t);
+}
+
+static uint16_opt_t
+attr_opt(uint16_t value)
+{
+    uint16_opt_t opt = {None, 0};
+
+    if (value != 0) {
+        opt.tag = Some;
+        opt.Some = value;
+    }
+
+    return opt;
+}
+
+/*
+ * Substitute the fields of a tuple or record.  The 'align', 'pack' and
+ * 'reorder' attributes of 't' are applied to the new layout.
+ */
+static ndt_t *
+substitute_fields(const ndt_t *t, const symtable_t *tbl, ndt_context_t *ctx)
+{
+    uint16_opt_t none = {None, 0};
+    uint16_opt_t align, pack;
+    enum ndt_variadic flag;
+    bool reorder;
+    ndt_field_t *fields = NULL;
+    ndt_field_t *field;
+    ndt_t * const *types;
+    char *name = NULL;
+    ndt_t *type;
+    int64_t shape, i;
+    bool same = true;
+
+    if (t->tag == Tuple) {
+        flag = t->Tuple.flag;
+        shape = t->Tuple.shape;
+        types = t->Tuple.types;
+        align = attr_opt(t->Tuple.align);
+        pack = attr_opt(t->Tuple.pack);
+        reorder = t->Tuple.reorder;
+    }
+    else {
+        flag = t->Record.flag;
+        shape = t->Record.shape;
+        types = t->Record.types;
+        align = attr_opt(t->Record.align);
+        pack = attr_opt(t->Record.pack);
+        reorder = t->Record.reorder;
+    }
+
+    if (shape == 0) {
+        return (ndt_t *)ndt_incref(t);
+    }
+
+    fields = ndt_calloc(shape, sizeof *fields);
+    if (fields == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    for (i = 0; i < shape; i++) {
+        type = ndt_substitute(types[i], tbl, ctx);
+        if (type == NULL) {
+            goto error;
+        }
+        same &= type == types[i];
+
+        if (t->tag == Record) {
+            name = ndt_strdup(t->Record.names[i], ctx);
+            if (name == NULL) {
+                ndt_del(type);
+                goto error;
+            }
+        }
+
+        field = ndt_field(name, type, none, none, ctx);
+        if (field == NULL) {
+            goto error;
+        }
+
+        fields[i] = *field;
+        ndt_free(field);
+    }
+
+    if (same) {
+        /* keep the layout of fields without variables */
+        ndt_field_array_del(fields, shape);
+        return (ndt_t *)ndt_incref(t);
+    }
+
+    if (t->tag == Tuple) {
+        return reorder ? ndt_tuple_reorder(flag, fields, shape, align, pack, NULL, ctx)
+                       : ndt_tuple(flag, fields, shape, align, pack, ctx);
+    }
+
+    return reorder ? ndt_record_reorder(flag, fields, shape, align, pack, NULL, ctx)
+                   : ndt_record(flag, fields, shape, align, pack, ctx);
+
+error:
+    ndt_field_array_del(fields, i);
+    return NULL;
+}
+
+/*
+ * Replace the type variables in 't' by their bindings in 'tbl'.  Bound
+ * types and subtrees without variables are shared with the result, the
+ * nodes above them are rebuilt.
+ */
 static ndt_t *
 ndt_substitute(const ndt_t *t, const symtable_t *tbl, ndt_context_t *ctx)
 {
     symtable_entry_t v;
-    const ndt_t *w;
-    ndt_t *u;
+    ndt_t *u, *ret, *pos, *kwds;
+    char *name;
     int i;
 
     switch (t->tag) {
@@ -404,30 +817,45 @@ ndt_substitute(const ndt_t *t, const symtable_t *tbl, ndt_context_t *ctx)
         if (u == NULL) {
             return NULL;
         }
-
-        assert(ndt_is_concrete(u));
+        if (u == t->FixedDim.type) {
+            return unchanged(t, u);
+        }
 
         return ndt_fixed_dim(t->FixedDim.shape, u, ndt_order(u), ctx);
 
     case SymbolicDim:
         v = symtable_find(tbl, t->SymbolicDim.name);
+        if (v.tag != SizeEntry) {
+            return not_found(t->SymbolicDim.name, ctx);
+        }
 
-        switch (v.tag) {
-        case SizeEntry:
-            u = ndt_substitute(t->SymbolicDim.type, tbl, ctx);
-            if (u == NULL) {
-                return NULL;
-            }
-
-            assert(ndt_is_concrete(u));
+        u = ndt_substitute(t->SymbolicDim.type, tbl, ctx);
+        if (u == NULL) {
+            return NULL;
+        }
 
-            return ndt_fixed_dim(v.SizeEntry, u, ndt_order(u), ctx);
+        return ndt_fixed_dim(v.SizeEntry, u, ndt_order(u), ctx);
 
-        default:
-            ndt_err_format(ctx, NDT_ValueError,
-                "variable is not found or has incorrect type");
+    case VarDim:
+        u = ndt_substitute(t->VarDim.type, tbl, ctx);
+        if (u == NULL) {
             return NULL;
         }
+        if (u == t->VarDim.type) {
+            return unchanged(t, u);
+        }
+
+        if (ndt_is_concrete(t)) {
+            return ndt_var_dim_like(t, u, ctx);
+        }
+
+        /* the shapes of an unbound var dimension are not known */
+        u = ndt_var_dim(u, false, Void, 0, NULL, NULL, NULL, ctx);
+        if (u != NULL && ndt_is_optional(t)) {
+            u = ndt_dim_option(u, ctx);
+        }
+
+        return u;
 
     case EllipsisDim:
         if (t->EllipsisDim.name == NULL) {
@@ -436,109 +864,167 @@ ndt_substitute(const ndt_t *t, const symtable_t *tbl, ndt_context_t *ctx)
             return NULL;
         }
 
-        u = ndt_substitute(t->EllipsisDim.type, tbl, ctx);
-        if (u == NULL) {
-            return NULL;
+        v = symtable_find(tbl, t->EllipsisDim.name);
+        if (v.tag != DimListEntry) {
+            return not_found(t->EllipsisDim.name, ctx);
         }
 
-        v = symtable_find(tbl, t->EllipsisDim.name);
+        u = ndt_substitute(t->EllipsisDim.type, tbl, ctx);
 
-        switch (v.tag) {
-        case DimListEntry:
-            for (i = 0; i < v.DimListEntry.size; i++) {
-                w = v.DimListEntry.dims[i];
-                switch (w->tag) {
-                case FixedDim:
+        for (i = v.DimListEntry.size-1; i >= 0 && u != NULL; i--) {
+            u = bound_dim(v.DimListEntry.dims[i], u, ctx);
+        }
 
-                    assert(ndt_is_concrete(w));
+        return u;
 
-                    u = ndt_fixed_dim(w->FixedDim.shape, u, ndt_order(w), ctx);
-                    if (u == NULL) {
-                        return NULL;
-                    }
+    case Typevar:
+        v = symtable_find(tbl, t->Typevar.name);
+        if (v.tag != TypeEntry) {
+            return not_found(t->Typevar.name, ctx);
+        }
 
-                    break;
-               default:
-                   ndt_err_format(ctx, NDT_NotImplementedError,
-                       "substitution not implemented for this type");
-                   ndt_del(u);
-                   return NULL;
-                }
-            }
+        return (ndt_t *)ndt_incref(v.TypeEntry);
 
-            return u;
+    case Tuple: case Record:
+        return substitute_fields(t, tbl, ctx);
 
-        default:
-            ndt_err_format(ctx, NDT_ValueError,
-                "variable is not found or has incorrect type");
+    case Function:
+        ret = ndt_substitute(t->Function.ret, tbl, ctx);
+        if (ret == NULL) {
             return NULL;
         }
 
-    case Typevar:
-        v = symtable_find(tbl, t->Typevar.name);
-        switch (v.tag) {
-        case TypeEntry:
-            return ndt_substitute(v.TypeEntry, tbl, ctx);
+        pos = ndt_substitute(t->Function.pos, tbl, ctx);
+        if (pos == NULL) {
+            ndt_del(ret);
+            return NULL;
+        }
 
-        default:
-            ndt_err_format(ctx, NDT_ValueError,
-                "variable is not found or has incorrect type");
+        kwds = ndt_substitute(t->Function.kwds, tbl, ctx);
+        if (kwds == NULL) {
+            ndt_del(ret);
+            ndt_del(pos);
             return NULL;
         }
 
+        if (ret == t->Function.ret && pos == t->Function.pos &&
+            kwds == t->Function.kwds) {
+            ndt_del(ret);
+            ndt_del(pos);
+            return unchanged(t, kwds);
+        }
+
+        return ndt_function(ret, pos, kwds, ctx);
+
     case Pointer:
         u = ndt_substitute(t->Pointer.type, tbl, ctx);
         if (u == NULL) {
             return NULL;
         }
+        if (u == t->Pointer.type) {
+            return unchanged(t, u);
+        }
 
         return ndt_pointer(u, ctx);
 
-    case Int64: case Float32: case Float64:
-        return ndt_primitive(t->tag, 'L', ctx);
+    case Option:
+        u = ndt_substitute(t->Option.type, tbl, ctx);
+        if (u == NULL) {
+            return NULL;
+        }
+        if (u == t->Option.type) {
+            return unchanged(t, u);
+        }
 
-    default:
-        ndt_err_format(ctx, NDT_NotImplementedError,
-            "substitution not implemented for this type");
+        return ndt_option(u, ctx);
+
+    case OptionItem:
+        u = ndt_substitute(t->OptionItem.type, tbl, ctx);
+        if (u == NULL) {
+            return NULL;
+        }
+        if (u == t->OptionItem.type) {
+            return unchanged(t, u);
+        }
+
+        return ndt_item_option(u, ctx);
+
+    case Constr:
+        u = ndt_substitute(t->Constr.type, tbl, ctx);
+        if (u == NULL) {
+            return NULL;
+        }
+        if (u == t->Constr.type) {
+            return unchanged(t, u);
+        }
+
+        name = ndt_strdup(t->Constr.name, ctx);
+        if (name == NULL) {
+            ndt_del(u);
+            return NULL;
+        }
+
+        return ndt_constr(name, u, ctx);
+
+    case AnyKind: case ScalarKind: case SignedKind: case UnsignedKind:
+    case FloatKind: case ComplexKind: case FixedStringKind: case FixedBytesKind:
+        /* a kind in the return type is not bound by any argument */
+        ndt_err_format(ctx, NDT_ValueError,
+            "cannot infer a concrete return type for '%s'", ndt_tag_as_string(t->tag));
         return NULL;
+
+    default:
+        /* scalars and nominal types do not contain variables */
+        return (ndt_t *)ndt_incref(t);
     }
 }
 
-/*
- * Check the concrete function arguments 'args' against the function
- * signature 'f'.  On success, infer and return the concrete return
- * type.
- */
-ndt_t *
-ndt_typecheck(const ndt_t *f, const ndt_t *args, int *outer_dims, ndt_context_t *ctx)
+/* Name of the ellipsis that supplies the outer dimensions of 't'. */
+static const char *
+outer_name(const ndt_t *t)
 {
-    symtable_t *tbl;
-    ndt_t *return_type, *t;
-    int ret;
+    if (t->tag == Pointer) t = t->Pointer.type;
+
+    return t->tag == EllipsisDim ? t->EllipsisDim.name : NULL;
+}
 
+static int
+check_signature(const ndt_t *f, ndt_context_t *ctx)
+{
     if (f->tag != Function) {
         ndt_err_format(ctx, NDT_RuntimeError, "expected function type");
-        return NULL;
+        return -1;
     }
 
     if (f->Function.kwds->Record.shape != 0) {
         ndt_err_format(ctx, NDT_NotImplementedError, "kwargs not implemented");
-        return NULL;
+        return -1;
     }
 
+    return 0;
+}
+
+/*
+ * Typecheck 'args' against the valid signature 'f'.  If 'broadcast' is set,
+ * repeated bindings of an ellipsis are broadcast against each other.
+ */
+static ndt_t *
+typecheck_args(const ndt_t *f, const ndt_t *args, int *outer_dims,
+               bool broadcast, symtable_t *tbl, ndt_context_t *ctx)
+{
+    ndt_t *return_type;
+    const char *name;
+    symtable_entry_t v;
+    int ret;
+
     if (!ndt_is_concrete(args)) {
         ndt_err_format(ctx, NDT_RuntimeError, "expected concrete argument types");
         return NULL;
     }
 
-    tbl = symtable_new(ctx);
-    if (tbl == NULL) {
-        return NULL;
-    }
-
+    tbl->broadcast = broadcast;
     ret = match_datashape(f->Function.pos, args, tbl, ctx);
     if (ret <= 0) {
-        symtable_del(tbl);
         return NULL;
     }
 
@@ -546,26 +1032,229 @@ ndt_typecheck(const ndt_t *f, const ndt_t *args, int *outer_dims, ndt_context_t
     *outer_dims = 0;
 
     if (return_type != NULL) {
-        t = f->Function.ret;
-        if (t->tag == Pointer) t = t->Pointer.type;
+        name = outer_name(f->Function.ret);
+        if (name != NULL) {
+            v = symtable_find(tbl, name);
+            if (v.tag == DimListEntry) {
+                *outer_dims = v.DimListEntry.size;
+            }
+        }
+    }
 
-        if (t->tag == EllipsisDim) {
-            const char *name = t->EllipsisDim.name;
+    return return_type;
+}
 
-            if (name != NULL) {
-                symtable_entry_t v = symtable_find(tbl, name);
+static ndt_t *
+typecheck(const ndt_t *f, const ndt_t *args, int *outer_dims, bool broadcast,
+          symtable_t *tbl, ndt_context_t *ctx)
+{
+    if (check_signature(f, ctx) < 0) {
+        return NULL;
+    }
 
-                switch (v.tag) {
-                case DimListEntry:
-                    *outer_dims = v.DimListEntry.size;
-                    break;
-                default:
-                    break;
-                }
+    return typecheck_args(f, args, outer_dims, broadcast, tbl, ctx);
+}
+
+/*
+ * Check the concrete function arguments 'args' against the function
+ * signature 'f'.  On success, infer and return the concrete return
+ * type.  The result stays abstract only for function types and for var
+ * dimensions that are not bound by an argument; kinds like 'Any' in the
+ * return type are a ValueError.  The result may share nodes with 'f' and
+ * 'args'.
+ *
+ * Arguments are matched exactly like ndt_match() and ndt_dispatch_find()
+ * match them: arguments that share a named ellipsis must have the same
+ * outer dimensions.  Use ndt_typecheck_broadcast() for broadcasting.
+ */
+ndt_t *
+ndt_typecheck(const ndt_t *f, const ndt_t *args, int *outer_dims, ndt_context_t *ctx)
+{
+    symtable_t tbl;
+    ndt_t *return_type;
+
+    symtable_init(&tbl);
+    return_type = typecheck(f, args, outer_dims, false, &tbl, ctx);
+    symtable_clear(&tbl);
+
+    return return_type;
+}
+
+/*
+ * Typecheck 'n' argument tuples against the same signature 'f'.  out[i] is
+ * set to the return type for args[i], or to NULL if args[i] does not match.
+ * If 'outer_dims' is not NULL, outer_dims[i] receives the number of outer
+ * dimensions of out[i].
+ *
+ * The signature is checked once and the storage for the bindings is reused
+ * for all argument tuples.  Return the number of matches.  On error, return
+ * -1 and set all entries of 'out' to NULL.
+ *
+ * 'f' is only read, so disjoint slices of a batch can be checked in
+ * parallel, each thread with its own context.
+ */
+int64_t
+ndt_typecheck_batch(const ndt_t *f, const ndt_t *args[], int64_t n,
+                    ndt_t *out[], int outer_dims[], ndt_context_t *ctx)
+{
+    symtable_t tbl;
+    int64_t count = 0;
+    int64_t i;
+    int dims;
+
+    for (i = 0; i < n; i++) {
+        out[i] = NULL;
+    }
+
+    if (check_signature(f, ctx) < 0) {
+        return -1;
+    }
+
+    symtable_init(&tbl);
+
+    for (i = 0; i < n; i++) {
+        dims = 0;
+        out[i] = typecheck_args(f, args[i], &dims, false, &tbl, ctx);
+        symtable_reset(&tbl);
+
+        if (out[i] != NULL) {
+            count++;
+        }
+        else if (ctx->err != NDT_Success) {
+            symtable_clear(&tbl);
+            while (--i >= 0) {
+                ndt_del(out[i]);
+                out[i] = NULL;
+            }
+            return -1;
+        }
+
+        if (outer_dims != NULL) {
+            outer_dims[i] = dims;
+        }
+    }
+
+    symtable_clear(&tbl);
+    return count;
+}
+
+/*
+ * Fill in the strides of one positional argument for the outer loop.  The
+ * dimensions of 'c' that are matched by the ellipsis 'name' in 'p' are
+ * aligned at the end of the outer shape.  Missing and stretched dimensions
+ * get a stride of 0.
+ */
+static void
+loop_strides(int64_t strides[], const ndt_t *p, const ndt_t *c,
+             const char *name, int outer_dims, const int64_t shape[])
+{
+    const ndt_t *pdims[NDT_MAX_DIM];
+    const ndt_t *cdims[NDT_MAX_DIM];
+    const ndt_t *dtype;
+    const ndt_t *dim;
+    int pn, cn, e, size;
+    int d, j;
+
+    for (d = 0; d < outer_dims; d++) {
+        strides[d] = 0;
+    }
+
+    if (p->tag == Pointer && c->tag == Pointer) {
+        p = p->Pointer.type;
+        c = c->Pointer.type;
+    }
+
+    pn = ndt_const_dims_dtype(pdims, &dtype, p);
+    cn = ndt_const_dims_dtype(cdims, &dtype, c);
+
+    for (e = 0; e < pn; e++) {
+        if (pdims[e]->tag == EllipsisDim) {
+            break;
+        }
+    }
+
+    if (e == pn || pdims[e]->EllipsisDim.name == NULL ||
+        strcmp(pdims[e]->EllipsisDim.name, name) != 0) {
+        return;
+    }
+
+    size = cn - (pn-1);
+    for (d = outer_dims-size; d < outer_dims; d++) {
+        j = d - (outer_dims-size);
+        dim = cdims[e+j];
+        if (dim->FixedDim.shape == shape[d]) {
+            strides[d] = dim->Concrete.FixedDim.stride;
+        }
+    }
+}
+
+/*
+ * Same as ndt_typecheck(), but arguments that share a named ellipsis are
+ * broadcast against each other following the NumPy rules, e.g. '2 * 1 * T'
+ * and '3 * T' both match 'Dims... * T' with 'Dims' bound to '2 * 3'.
+ * Scalars match an ellipsis with zero dimensions.
+ *
+ * Also compute the loop over the broadcast outer dimensions.  'shape' receives 'outer_dims' sizes.  Row 'i' of
+ * 'strides' receives the byte strides of positional argument 'i'; it must
+ * have a row for each argument in 'args'.  Arguments that do not take
+ * part in a dimension have a stride of 0.
+ *
+ * The outer dimensions must be fixed.
+ */
+ndt_t *
+ndt_typecheck_broadcast(const ndt_t *f, const ndt_t *args, int *outer_dims,
+                        int64_t shape[NDT_MAX_DIM],
+                        int64_t strides[][NDT_MAX_DIM], ndt_context_t *ctx)
+{
+    symtable_t tbl;
+    symtable_entry_t v;
+    ndt_t *return_type;
+    const ndt_t *pos;
+    const char *name;
+    int64_t i;
+    int d;
+
+    if (args->tag != Tuple) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_typecheck_broadcast: expected tuple arguments");
+        return NULL;
+    }
+
+    symtable_init(&tbl);
+    return_type = typecheck(f, args, outer_dims, true, &tbl, ctx);
+    if (return_type == NULL || *outer_dims == 0) {
+        symtable_clear(&tbl);
+        return return_type;
+    }
+
+    name = outer_name(f->Function.ret);
+    v = symtable_find(&tbl, name);
+    assert(v.tag == DimListEntry);
+
+    for (d = 0; d < *outer_dims; d++) {
+        if (v.DimListEntry.dims[d]->tag != FixedDim) {
+            ndt_err_format(ctx, NDT_NotImplementedError,
+                "ndt_typecheck_broadcast: outer dimensions must be fixed");
+            symtable_clear(&tbl);
+            ndt_del(return_type);
+            return NULL;
+        }
+        shape[d] = v.DimListEntry.dims[d]->FixedDim.shape;
+    }
+
+    pos = f->Function.pos;
+    for (i = 0; i < args->Tuple.shape; i++) {
+        if (i < pos->Tuple.shape) {
+            loop_strides(strides[i], pos->Tuple.types[i], args->Tuple.types[i],
+                         name, *outer_dims, shape);
+        }
+        else {
+            for (d = 0; d < *outer_dims; d++) {
+                strides[i][d] = 0;
             }
         }
     }
 
-    symtable_del(tbl);
+    symtable_clear(&tbl);
     return return_type;
 }
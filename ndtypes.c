@@ -44,6 +44,8 @@
 #include <errno.h>
 #include <assert.h>
 #include "ndtypes.h"
+#include "sync.h"
+#include "walk.h"
 
 
 #undef max
@@ -146,6 +148,17 @@ get_align(uint16_opt_t align, uint16_t default_align, ndt_context_t *ctx)
     }
 }
 
+/*
+ * Value of the 'align' or 'pack' attribute of a tuple or record, 0 if not
+ * given.  Like 'reorder', the attributes are only kept for non-empty and
+ * non-variadic tuples and records, where the grammar accepts them.
+ */
+static inline uint16_t
+fields_attr(uint16_opt_t attr, enum ndt_variadic flag, int64_t shape)
+{
+    return attr.tag == Some && flag == Nonvariadic && shape > 0 ? attr.Some : 0;
+}
+
 static size_t
 round_up(size_t offset, uint16_t align)
 {
@@ -486,6 +499,142 @@ ndt_alignof_encoding(enum ndt_encoding encoding)
     return (uint16_t)ndt_sizeof_encoding(encoding);
 }
 
+/*****************************************************************************/
+/*                             Subtree summaries                             */
+/*****************************************************************************/
+
+static inline uint64_t
+mix(uint64_t h, uint64_t x)
+{
+    return (h ^ x) * 1099511628211ULL;
+}
+
+static uint64_t
+mix_str(uint64_t h, const char *s)
+{
+    for (; *s != '\0'; s++) {
+        h = mix(h, (unsigned char)*s);
+    }
+    return mix(h, 0);
+}
+
+static inline void
+add_child(ndt_t *t, const ndt_t *u)
+{
+    t->tags |= u->tags;
+    t->fingerprint = mix(t->fingerprint, u->fingerprint);
+}
+
+/* Summary of a type without children or parameters. */
+static inline void
+leaf_summary(ndt_t *t)
+{
+    t->tags = NDT_TAG_BIT(t->tag);
+    t->fingerprint = mix(mix(14695981039346656037ULL, (uint64_t)t->tag),
+                         (uint64_t)t->ndim);
+}
+
+/*
+ * Compute the summary of 't' from its own fields and the summaries of its
+ * children.  The fingerprint covers exactly the properties that ndt_equal()
+ * compares, so equal types have equal fingerprints.  Must be called again
+ * if such a property of 't' changes.
+ */
+static void
+summarize(ndt_t *t)
+{
+    int64_t i;
+
+    leaf_summary(t);
+
+    switch (t->tag) {
+    case FixedDim:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->FixedDim.shape);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)ndt_is_optional(t));
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->FixedDim.align);
+        add_child(t, t->FixedDim.type);
+        break;
+    case SymbolicDim:
+        t->fingerprint = mix_str(t->fingerprint, t->SymbolicDim.name);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)ndt_is_optional(t));
+        add_child(t, t->SymbolicDim.type);
+        break;
+    case VarDim:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)ndt_is_optional(t));
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->VarDim.align);
+        add_child(t, t->VarDim.type);
+        break;
+    case EllipsisDim:
+        /* the name is ignored by ndt_equal() */
+        t->fingerprint = mix(t->fingerprint, (uint64_t)ndt_is_optional(t));
+        add_child(t, t->EllipsisDim.type);
+        break;
+    case Tuple:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Tuple.flag);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Tuple.reorder);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Tuple.align);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Tuple.pack);
+        for (i = 0; i < t->Tuple.shape; i++) {
+            add_child(t, t->Tuple.types[i]);
+        }
+        break;
+    case Record:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Record.flag);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Record.reorder);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Record.align);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Record.pack);
+        for (i = 0; i < t->Record.shape; i++) {
+            t->fingerprint = mix_str(t->fingerprint, t->Record.names[i]);
+            add_child(t, t->Record.types[i]);
+        }
+        break;
+    case Function:
+        add_child(t, t->Function.ret);
+        add_child(t, t->Function.pos);
+        add_child(t, t->Function.kwds);
+        break;
+    case Typevar:
+        t->fingerprint = mix_str(t->fingerprint, t->Typevar.name);
+        break;
+    case Option:
+        add_child(t, t->Option.type);
+        break;
+    case OptionItem:
+        add_child(t, t->OptionItem.type);
+        break;
+    case Pointer:
+        add_child(t, t->Pointer.type);
+        break;
+    case Nominal:
+        t->fingerprint = mix_str(t->fingerprint, t->Nominal.name);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)(uintptr_t)t->Nominal.type);
+        break;
+    case Constr:
+        t->fingerprint = mix_str(t->fingerprint, t->Constr.name);
+        add_child(t, t->Constr.type);
+        break;
+    case FixedString:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->FixedString.size);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->FixedString.encoding);
+        break;
+    case FixedBytes:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->FixedBytes.size);
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->FixedBytes.align);
+        break;
+    case Char:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Char.encoding);
+        break;
+    case Bytes:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Bytes.target_align);
+        break;
+    case Categorical:
+        t->fingerprint = mix(t->fingerprint, (uint64_t)t->Categorical.ntypes);
+        break;
+    default:
+        break;
+    }
+}
+
 /******************************************************************************/
 /*                                 Datashape                                  */
 /******************************************************************************/
@@ -504,11 +653,14 @@ ndt_new(enum ndt tag, ndt_context_t *ctx)
     t->access = Abstract;
     t->ndim = 0;
     t->hash = -1;
+    t->refcnt = 0;
 
     t->data_size = -1;
     t->data_align = -1;
     t->meta_size = -1;
 
+    leaf_summary(t);
+
     return t;
 }
 
@@ -526,83 +678,101 @@ ndt_new_extra(enum ndt tag, size_t n, ndt_context_t *ctx)
     t->access = Abstract;
     t->ndim = 0;
     t->hash = -1;
+    t->refcnt = 0;
 
     t->data_size = -1;
     t->data_align = -1;
     t->meta_size = -1;
 
+    leaf_summary(t);
+
     return t;
 }
 
-void
-ndt_del(ndt_t *t)
+/* Release one reference.  Shared subtrees are skipped. */
+static int
+del_pre(const ndt_t *t, const ndt_t *u, const ndt_t *parent, int64_t index,
+        void *arg)
 {
-    if (t == NULL) {
-        return;
+    ndt_t *s = (ndt_t *)t;
+
+    (void)u;
+    (void)parent;
+    (void)index;
+    (void)arg;
+
+    if (ndt_refcnt_load(&s->refcnt) > 0 && ndt_refcnt_decr(&s->refcnt) >= 0) {
+        return WalkSkip;
     }
 
-    switch (t->tag) {
-    case FixedDim:
-        ndt_del(t->FixedDim.type);
-        break;
-    case VarDim:
-        ndt_del(t->VarDim.type);
-        break;
+    return WalkContinue;
+}
+
+/* Free the node after its children. */
+static int
+del_post(const ndt_t *t, const ndt_t *u, const ndt_t *parent, int64_t index,
+         void *arg)
+{
+    ndt_t *s = (ndt_t *)t;
+    int64_t i;
+
+    (void)u;
+    (void)parent;
+    (void)index;
+    (void)arg;
+
+    switch (s->tag) {
     case SymbolicDim:
-        ndt_free(t->SymbolicDim.name);
-        ndt_del(t->SymbolicDim.type);
+        ndt_free(s->SymbolicDim.name);
         break;
     case EllipsisDim:
-        ndt_free(t->EllipsisDim.name);
-        ndt_del(t->EllipsisDim.type);
-        break;
-    case Option:
-        ndt_del(t->Option.type);
-        break;
-    case OptionItem:
-        ndt_del(t->OptionItem.type);
+        ndt_free(s->EllipsisDim.name);
         break;
     case Nominal:
-        ndt_free(t->Nominal.name);
+        ndt_free(s->Nominal.name);
+        ndt_del((ndt_t *)s->Nominal.type);
         break;
     case Constr:
-        ndt_free(t->Constr.name);
-        ndt_del(t->Constr.type);
+        ndt_free(s->Constr.name);
         break;
-    case Tuple: {
-        int64_t i;
-        for (i = 0; i < t->Tuple.shape; i++) {
-            ndt_del(t->Tuple.types[i]);
+    case Record:
+        for (i = 0; i < s->Record.shape; i++) {
+            ndt_free(s->Record.names[i]);
         }
         break;
-    }
-    case Record: {
-        int64_t i;
-        for (i = 0; i < t->Record.shape; i++) {
-            ndt_free(t->Record.names[i]);
-            ndt_del(t->Record.types[i]);
-        }
-        break;
-    }
-    case Function:
-        ndt_del(t->Function.ret);
-        ndt_del(t->Function.pos);
-        ndt_del(t->Function.kwds);
-        break;
     case Typevar:
-        ndt_free(t->Typevar.name);
+        ndt_free(s->Typevar.name);
         break;
     case Categorical:
-        ndt_memory_array_del(t->Categorical.types, t->Categorical.ntypes);
-        break;
-    case Pointer:
-        ndt_del(t->Pointer.type);
+        ndt_memory_array_del(s->Categorical.types, s->Categorical.ntypes);
         break;
     default:
         break;
     }
 
-    ndt_free(t);
+    ndt_free(s);
+    return WalkContinue;
+}
+
+void
+ndt_del(ndt_t *t)
+{
+    if (t == NULL) {
+        return;
+    }
+
+    (void)walk(t, NULL, del_pre, del_post, NULL);
+}
+
+/*
+ * Add an owner to 't'.  Each owner releases its reference with ndt_del(),
+ * the last one frees the type.  Shared types must not be modified.
+ */
+const ndt_t *
+ndt_incref(const ndt_t *t)
+{
+    ndt_refcnt_incr(&((ndt_t *)t)->refcnt);
+    return t;
 }
 
 /* Unoptimized hash function for experimenting. */
@@ -640,23 +810,282 @@ ndt_hash(ndt_t *t, ndt_context_t *ctx)
     return x;
 }
 
-/* XXX Unoptimized copy function for experimenting. Slow and broken for
-   some concrete types. */
+/* Number of bytes in t->extra that are in use. */
+static size_t
+extra_size(const ndt_t *t)
+{
+    int64_t n;
+
+    switch (t->tag) {
+    case VarDim:
+        n = t->Concrete.VarDim.nshapes;
+        if (ndt_is_concrete(t) &&
+            t->Concrete.VarDim.shapes == (const int32_t *)t->extra) {
+            return (2 * n + 1) * sizeof(int32_t) + (n + 7) / 8;
+        }
+        return 0;
+    case Tuple:
+        n = t->Tuple.shape;
+        if (ndt_is_concrete(t)) {
+            return (const char *)(t->Concrete.Tuple.pad + n) - t->extra;
+        }
+        return (const char *)(t->Tuple.types + n) - t->extra;
+    case Record:
+        n = t->Record.shape;
+        return (const char *)(t->Record.index + n) - t->extra;
+    default:
+        return 0;
+    }
+}
+
+#define REBASE(u, t, ptr) ((void *)((u)->extra + ((const char *)(ptr) - (t)->extra)))
+
+static int
+copy_memory(ndt_memory_t *dst, const ndt_memory_t *src, ndt_context_t *ctx)
+{
+    dst->t = ndt_copy(src->t, ctx);
+    if (dst->t == NULL) {
+        return -1;
+    }
+
+    dst->v = src->v;
+    if (src->t->tag == String) {
+        dst->v.String = ndt_strdup(src->v.String, ctx);
+        if (dst->v.String == NULL) {
+            ndt_del(dst->t);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Structural deep copy.  The node and the used part of 'extra' are copied
+ * verbatim, so the copy has exactly the same layout as the original (this
+ * includes attributes like 'align', 'pack' or explicit strides that are
+ * not visible in the string representation).  Child pointers are cleared
+ * before they are copied, so a partial copy can be deleted with ndt_del().
+ */
 ndt_t *
 ndt_copy(const ndt_t *t, ndt_context_t *ctx)
 {
+    size_t size = offsetof(ndt_t, extra) + extra_size(t);
     ndt_t *u;
-    char *s;
+    int64_t i;
 
-    s = ndt_as_string((ndt_t *)t, ctx); /* XXX make arg const */
-    if (s == NULL) {
-        return NULL;
+    u = ndt_alloc(1, size);
+    if (u == NULL) {
+        return ndt_memory_error(ctx);
     }
+    memcpy(u, t, size);
+    u->refcnt = 0;
 
-    u = ndt_from_string(s, ctx);
-    ndt_free(s);
+    switch (t->tag) {
+    case FixedDim:
+        u->FixedDim.type = ndt_copy(t->FixedDim.type, ctx);
+        if (u->FixedDim.type == NULL) goto error;
+        break;
+
+    case VarDim:
+        if (t->Concrete.VarDim.shapes == (const int32_t *)t->extra) {
+            u->Concrete.VarDim.shapes = REBASE(u, t, t->Concrete.VarDim.shapes);
+            u->Concrete.VarDim.offsets = REBASE(u, t, t->Concrete.VarDim.offsets);
+            if (t->Concrete.VarDim.bitmap) {
+                u->Concrete.VarDim.bitmap = REBASE(u, t, t->Concrete.VarDim.bitmap);
+            }
+        }
+        u->VarDim.type = ndt_copy(t->VarDim.type, ctx);
+        if (u->VarDim.type == NULL) goto error;
+        break;
+
+    case SymbolicDim:
+        u->SymbolicDim.name = NULL;
+        u->SymbolicDim.type = ndt_copy(t->SymbolicDim.type, ctx);
+        if (u->SymbolicDim.type == NULL) goto error;
+        u->SymbolicDim.name = ndt_strdup(t->SymbolicDim.name, ctx);
+        if (u->SymbolicDim.name == NULL) goto error;
+        break;
+
+    case EllipsisDim:
+        u->EllipsisDim.name = NULL;
+        u->EllipsisDim.type = ndt_copy(t->EllipsisDim.type, ctx);
+        if (u->EllipsisDim.type == NULL) goto error;
+        if (t->EllipsisDim.name) {
+            u->EllipsisDim.name = ndt_strdup(t->EllipsisDim.name, ctx);
+            if (u->EllipsisDim.name == NULL) goto error;
+        }
+        break;
+
+    case Option:
+        u->Option.type = ndt_copy(t->Option.type, ctx);
+        if (u->Option.type == NULL) goto error;
+        break;
+
+    case OptionItem:
+        u->OptionItem.type = ndt_copy(t->OptionItem.type, ctx);
+        if (u->OptionItem.type == NULL) goto error;
+        break;
+
+    case Nominal:
+        (void)ndt_incref(u->Nominal.type);
+        u->Nominal.name = ndt_strdup(t->Nominal.name, ctx);
+        if (u->Nominal.name == NULL) goto error;
+        break;
+
+    case Constr:
+        u->Constr.name = NULL;
+        u->Constr.type = ndt_copy(t->Constr.type, ctx);
+        if (u->Constr.type == NULL) goto error;
+        u->Constr.name = ndt_strdup(t->Constr.name, ctx);
+        if (u->Constr.name == NULL) goto error;
+        break;
+
+    case Tuple:
+        u->Tuple.types = REBASE(u, t, t->Tuple.types);
+        if (ndt_is_concrete(t)) {
+            u->Concrete.Tuple.offset = REBASE(u, t, t->Concrete.Tuple.offset);
+            u->Concrete.Tuple.align = REBASE(u, t, t->Concrete.Tuple.align);
+            u->Concrete.Tuple.pad = REBASE(u, t, t->Concrete.Tuple.pad);
+        }
+        for (i = 0; i < t->Tuple.shape; i++) {
+            u->Tuple.types[i] = NULL;
+        }
+        for (i = 0; i < t->Tuple.shape; i++) {
+            u->Tuple.types[i] = ndt_copy(t->Tuple.types[i], ctx);
+            if (u->Tuple.types[i] == NULL) goto error;
+        }
+        break;
+
+    case Record:
+        u->Record.names = REBASE(u, t, t->Record.names);
+        u->Record.types = REBASE(u, t, t->Record.types);
+        u->Record.index = REBASE(u, t, t->Record.index);
+        if (ndt_is_concrete(t)) {
+            u->Concrete.Record.offset = REBASE(u, t, t->Concrete.Record.offset);
+            u->Concrete.Record.align = REBASE(u, t, t->Concrete.Record.align);
+            u->Concrete.Record.pad = REBASE(u, t, t->Concrete.Record.pad);
+        }
+        for (i = 0; i < t->Record.shape; i++) {
+            u->Record.names[i] = NULL;
+            u->Record.types[i] = NULL;
+        }
+        for (i = 0; i < t->Record.shape; i++) {
+            u->Record.names[i] = ndt_strdup(t->Record.names[i], ctx);
+            if (u->Record.names[i] == NULL) goto error;
+            u->Record.types[i] = ndt_copy(t->Record.types[i], ctx);
+            if (u->Record.types[i] == NULL) goto error;
+        }
+        break;
+
+    case Function:
+        u->Function.pos = u->Function.kwds = NULL;
+        u->Function.ret = ndt_copy(t->Function.ret, ctx);
+        if (u->Function.ret == NULL) goto error;
+        u->Function.pos = ndt_copy(t->Function.pos, ctx);
+        if (u->Function.pos == NULL) goto error;
+        u->Function.kwds = ndt_copy(t->Function.kwds, ctx);
+        if (u->Function.kwds == NULL) goto error;
+        break;
+
+    case Typevar:
+        u->Typevar.name = ndt_strdup(t->Typevar.name, ctx);
+        if (u->Typevar.name == NULL) goto error;
+        break;
+
+    case Categorical:
+        u->Categorical.ntypes = 0;
+        u->Categorical.types = ndt_alloc(t->Categorical.ntypes, sizeof(ndt_memory_t));
+        if (u->Categorical.types == NULL) {
+            (void)ndt_memory_error(ctx);
+            goto error;
+        }
+        for (i = 0; i < (int64_t)t->Categorical.ntypes; i++) {
+            if (copy_memory(&u->Categorical.types[i],
+                            &t->Categorical.types[i], ctx) < 0) {
+                goto error;
+            }
+            u->Categorical.ntypes++;
+        }
+        break;
+
+    case Pointer:
+        u->Pointer.type = ndt_copy(t->Pointer.type, ctx);
+        if (u->Pointer.type == NULL) goto error;
+        break;
+
+    default:
+        break;
+    }
 
     return u;
+
+error:
+    ndt_del(u);
+    return NULL;
+}
+
+/*
+ * Constructors that consume a dimension and modify it must not change a
+ * type that has other owners (see ndt_incref()).  If 'type' is shared,
+ * return a private copy of the node that shares the children and release
+ * the reference to 'type'.  On error 'type' is not released.
+ */
+static ndt_t *
+unshare_dim(ndt_t *type, ndt_context_t *ctx)
+{
+    size_t size = offsetof(ndt_t, extra) + extra_size(type);
+    ndt_t *t;
+
+    assert(type->tag == FixedDim || type->tag == VarDim);
+
+    if (ndt_refcnt_load(&type->refcnt) == 0) {
+        return type;
+    }
+
+    t = ndt_alloc(1, size);
+    if (t == NULL) {
+        return ndt_memory_error(ctx);
+    }
+    memcpy(t, type, size);
+    t->refcnt = 0;
+    t->hash = -1;
+
+    if (type->tag == FixedDim) {
+        (void)ndt_incref(t->FixedDim.type);
+    }
+    else {
+        if (extra_size(type) > 0) {
+            t->Concrete.VarDim.shapes = REBASE(t, type, type->Concrete.VarDim.shapes);
+            t->Concrete.VarDim.offsets = REBASE(t, type, type->Concrete.VarDim.offsets);
+            if (type->Concrete.VarDim.bitmap) {
+                t->Concrete.VarDim.bitmap = REBASE(t, type, type->Concrete.VarDim.bitmap);
+            }
+        }
+        (void)ndt_incref(t->VarDim.type);
+    }
+
+    ndt_del(type);
+    return t;
+}
+
+/* Unshare the leading fixed dimensions of 'type'.  'type' is consumed. */
+static ndt_t *
+unshare_fixed_dims(ndt_t *type, ndt_context_t *ctx)
+{
+    ndt_t **p;
+    ndt_t *u;
+
+    for (p = &type; (*p)->tag == FixedDim; p = &(*p)->FixedDim.type) {
+        u = unshare_dim(*p, ctx);
+        if (u == NULL) {
+            ndt_del(type);
+            return NULL;
+        }
+        *p = u;
+    }
+
+    return type;
 }
 
 ndt_t *
@@ -813,6 +1242,13 @@ ndt_fixed_dim(int64_t shape, ndt_t *type, char order, ndt_context_t *ctx)
         return NULL;
     }
 
+    if (ndt_is_ndarray(type)) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "fixed dimensions cannot contain strided arrays");
+        ndt_del(type);
+        return NULL;
+    }
+
     flags = ndt_common_flags(type);
     switch (order) {
     case 'C':
@@ -847,6 +1283,7 @@ ndt_fixed_dim(int64_t shape, ndt_t *type, char order, ndt_context_t *ctx)
         return NULL;
     }
     t->FixedDim.flags = flags;
+    t->FixedDim.align = 0;
     t->FixedDim.shape = shape;
     t->FixedDim.type = type;
     t->ndim = type->ndim + 1;
@@ -856,11 +1293,13 @@ ndt_fixed_dim(int64_t shape, ndt_t *type, char order, ndt_context_t *ctx)
     if (t->access == Concrete) {
         t->Concrete.FixedDim.itemsize = type->data_size;
         t->Concrete.FixedDim.stride = type->data_size;
+        t->Concrete.FixedDim.offset = 0;
         t->data_size = shape * type->data_size;
         t->data_align = type->data_align;
         t->meta_size = sizeof(ndt_fixed_dim_meta_t);
     }
 
+    summarize(t);
     return t;
 }
 
@@ -901,6 +1340,7 @@ ndt_symbolic_dim(char *name, ndt_t *type, ndt_context_t *ctx)
     t->SymbolicDim.type = type;
     t->ndim = type->ndim + 1;
 
+    summarize(t);
     return t;
 }
 
@@ -924,6 +1364,13 @@ ndt_var_dim(ndt_t *type, bool copy_meta, enum ndt meta_type, int64_t nshapes,
         return NULL;
     }
 
+    if (ndt_is_ndarray(type)) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "var dimensions cannot contain strided arrays");
+        ndt_del(type);
+        return NULL;
+    }
+
     switch (meta_type) {
     case Int32:
         if (ndt_is_abstract(type)) {
@@ -972,6 +1419,7 @@ ndt_var_dim(ndt_t *type, bool copy_meta, enum ndt meta_type, int64_t nshapes,
         return NULL;
     }
     t->VarDim.flags = ndt_common_flags(type);
+    t->VarDim.align = 0;
     t->VarDim.type = type;
     t->ndim = type->ndim + 1;
     t->access = access;
@@ -982,7 +1430,7 @@ ndt_var_dim(ndt_t *type, bool copy_meta, enum ndt meta_type, int64_t nshapes,
         if (copy_meta) {
             int32_t *_shapes = (int32_t *)t->extra;
             int32_t *_offsets = _shapes + nshapes;
-            char *_bitmap = (char *)_offsets + nshapes * sizeof(int32_t);
+            char *_bitmap = (char *)(_offsets + nshapes + 1);
             int32_t i;
 
             for (i = 0; i < nshapes; i++) {
@@ -1028,54 +1476,339 @@ ndt_var_dim(ndt_t *type, bool copy_meta, enum ndt meta_type, int64_t nshapes,
         t->meta_size = sizeof(ndt_var_dim_meta_t) + extra;
     }
 
+    summarize(t);
     return t;
 }
 
+/*
+ * Create a var dimension with the shapes, offsets, validity bitmap and
+ * alignment of the concrete var dimension 't'.  'type' is the new element
+ * type and is consumed.
+ */
+ndt_t *
+ndt_var_dim_like(const ndt_t *t, ndt_t *type, ndt_context_t *ctx)
+{
+    int64_t n = t->Concrete.VarDim.nshapes;
+    int64_t *shapes, *offsets;
+    ndt_t *u;
+    int64_t i;
+
+    shapes = ndt_alloc(2 * n + 1, sizeof(int64_t));
+    if (shapes == NULL) {
+        ndt_del(type);
+        return ndt_memory_error(ctx);
+    }
+    offsets = shapes + n;
+
+    for (i = 0; i < n; i++) {
+        shapes[i] = t->Concrete.VarDim.shapes[i];
+        offsets[i] = t->Concrete.VarDim.offsets[i];
+    }
+    offsets[n] = t->Concrete.VarDim.offsets[n];
+
+    u = ndt_var_dim(type, true, Int32, n, shapes, offsets,
+                    t->Concrete.VarDim.bitmap, ctx);
+    ndt_free(shapes);
+
+    if (u != NULL && ndt_is_optional(t)) {
+        u = ndt_dim_option(u, ctx);
+    }
+
+    if (u != NULL && t->VarDim.align != 0) {
+        u = ndt_aligned_dim(u, t->VarDim.align, ctx);
+    }
+
+    return u;
+}
+
+ndt_t *
+ndt_ellipsis_dim(char *name, ndt_t *type, ndt_context_t *ctx)
+{
+    ndt_t *t;
+    uint32_t flags;
+
+    if (type->tag == VarDim) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ellipsis dimensions cannot contain variable dimensions");
+        ndt_del(type);
+        return NULL;
+    }
+
+    if (type->ndim > NDT_MAX_DIM) {
+        ndt_err_format(ctx, NDT_ValueError, "ndim > %u", NDT_MAX_DIM);
+        ndt_del(type);
+        return NULL;
+    }
+
+    if (ndt_dim_size(type) != 0) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError,
+                       "var-shapes given for abstract type");
+        ndt_del(type);
+        return NULL;
+    }
+
+    flags = ndt_common_flags(type);
+    if (flags & NDT_Dim_ellipsis) {
+        ndt_err_format(ctx, NDT_ValueError, "more than one ellipsis");
+        ndt_del(type);
+        return NULL;
+    }
+
+    /* abstract type */
+    t = ndt_new(EllipsisDim, ctx);
+    if (t == NULL) {
+        ndt_del(type);
+        return NULL;
+    }
+    t->EllipsisDim.flags = flags | NDT_Dim_ellipsis;
+    t->EllipsisDim.name = name;
+    t->EllipsisDim.type = type;
+    t->ndim = type->ndim + 1;
+
+    summarize(t);
+    return t;
+}
+
+/* Overflow checked arithmetic: return false on overflow. */
+static inline bool
+add_i64(int64_t *r, int64_t a, int64_t b)
+{
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+        return false;
+    }
+
+    *r = a + b;
+    return true;
+}
+
+static inline bool
+mul_i64(int64_t *r, int64_t a, int64_t b)
+{
+    assert(a >= 0);
+
+    if (a != 0) {
+        if (b > 0 && a > INT64_MAX / b) {
+            return false;
+        }
+        if (b < -1 && a > INT64_MIN / b) {
+            return false;
+        }
+    }
+
+    *r = a * b;
+    return true;
+}
+
+/*
+ * Contiguity of the subarray dims[0] ... dims[ndim-1].  Following NumPy,
+ * the strides of dimensions with shape 1 are ignored and empty arrays are
+ * contiguous.
+ */
+static bool
+fixed_is_empty(const ndt_t *dims[], int ndim)
+{
+    int i;
+
+    for (i = 0; i < ndim; i++) {
+        if (dims[i]->FixedDim.shape == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+fixed_is_c_contiguous(const ndt_t *dims[], int ndim, int64_t itemsize)
+{
+    int64_t expected = itemsize;
+    int64_t shape;
+    int i;
+
+    if (fixed_is_empty(dims, ndim)) {
+        return true;
+    }
+
+    for (i = ndim-1; i >= 0; i--) {
+        shape = dims[i]->FixedDim.shape;
+        if (shape != 1 && dims[i]->Concrete.FixedDim.stride != expected) {
+            return false;
+        }
+        if (!mul_i64(&expected, shape, expected)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+fixed_is_f_contiguous(const ndt_t *dims[], int ndim, int64_t itemsize)
+{
+    int64_t expected = itemsize;
+    int64_t shape;
+    int i;
+
+    if (fixed_is_empty(dims, ndim)) {
+        return true;
+    }
+
+    for (i = 0; i < ndim; i++) {
+        shape = dims[i]->FixedDim.shape;
+        if (shape != 1 && dims[i]->Concrete.FixedDim.stride != expected) {
+            return false;
+        }
+        if (!mul_i64(&expected, shape, expected)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Create a strided array from a concrete array with fixed dimensions.
+ * The function consumes 'type' and returns it with the strides and the
+ * array flags set.  Shared dimensions are copied first.
+ *
+ * 'strides' and 'order' are mutually exclusive.  If 'strides' is NULL,
+ * contiguous strides are computed for 'order' (default 'C').  'offset'
+ * is the byte offset of the first element in a buffer of 'bufsize'
+ * bytes.  If 'bufsize' is not given, the minimum size that is required
+ * by the strides is used.
+ *
+ * As in NumPy, every element that can be reached through the strides
+ * must be inside the buffer.
+ */
 ndt_t *
-ndt_ellipsis_dim(char *name, ndt_t *type, ndt_context_t *ctx)
-{
-    ndt_t *t;
+ndt_array(ndt_t *type, int64_t *strides, int64_opt_t offset, int64_opt_t bufsize,
+          char_opt_t order, ndt_context_t *ctx)
+{
+    ndt_t *dims[NDT_MAX_DIM];
+    ndt_t *dtype;
+    int64_t s[NDT_MAX_DIM];
+    int64_t start, low, high, extent;
+    int64_t itemsize;
     uint32_t flags;
+    int ndim, i;
 
-    if (type->tag == VarDim) {
-        ndt_err_format(ctx, NDT_ValueError,
-                       "ellipsis dimensions cannot contain variable dimensions");
+    if (type->tag != FixedDim || ndt_is_abstract(type)) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError,
+            "ndt_array: expected a concrete array with fixed dimensions");
         ndt_del(type);
         return NULL;
     }
 
-    if (type->ndim > NDT_MAX_DIM) {
-        ndt_err_format(ctx, NDT_ValueError, "ndim > %u", NDT_MAX_DIM);
+    if (strides != NULL && order.tag == Some) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError,
+            "ndt_array: 'strides' and 'order' are mutually exclusive");
         ndt_del(type);
         return NULL;
     }
 
-    if (ndt_dim_size(type) != 0) {
-        ndt_err_format(ctx, NDT_InvalidArgumentError,
-                       "var-shapes given for abstract type");
-        ndt_del(type);
+    type = unshare_fixed_dims(type, ctx);
+    if (type == NULL) {
         return NULL;
     }
 
-    flags = ndt_common_flags(type);
-    if (flags & NDT_Dim_ellipsis) {
-        ndt_err_format(ctx, NDT_ValueError, "more than one ellipsis");
+    ndim = ndt_dims_dtype(dims, &dtype, type);
+    itemsize = dtype->data_size;
+
+    if (strides != NULL) {
+        for (i = 0; i < ndim; i++) {
+            s[i] = strides[i];
+        }
+    }
+    else {
+        switch (order.tag == Some ? order.Some : 'C') {
+        case 'C':
+            s[ndim-1] = itemsize;
+            for (i = ndim-2; i >= 0; i--) {
+                s[i] = dims[i+1]->data_size;
+            }
+            break;
+        case 'F':
+            s[0] = itemsize;
+            for (i = 1; i < ndim; i++) {
+                if (!mul_i64(&s[i], dims[i-1]->FixedDim.shape, s[i-1])) {
+                    goto overflow;
+                }
+            }
+            break;
+        default:
+            ndt_err_format(ctx, NDT_ValueError, "order must be 'C' or 'F'");
+            ndt_del(type);
+            return NULL;
+        }
+    }
+
+    start = offset.tag == Some ? offset.Some : 0;
+    if (start < 0) {
+        ndt_err_format(ctx, NDT_ValueError, "ndt_array: negative offset");
         ndt_del(type);
         return NULL;
     }
 
-    /* abstract type */
-    t = ndt_new(EllipsisDim, ctx);
-    if (t == NULL) {
+    /* Lowest and highest byte that can be accessed through the strides. */
+    low = high = start;
+    if (!fixed_is_empty((const ndt_t **)dims, ndim)) {
+        for (i = 0; i < ndim; i++) {
+            if (!mul_i64(&extent, dims[i]->FixedDim.shape-1, s[i])) {
+                goto overflow;
+            }
+            if (extent < 0) {
+                if (!add_i64(&low, low, extent)) {
+                    goto overflow;
+                }
+            }
+            else {
+                if (!add_i64(&high, high, extent)) {
+                    goto overflow;
+                }
+            }
+        }
+        if (!add_i64(&high, high, itemsize)) {
+            goto overflow;
+        }
+    }
+
+    if (bufsize.tag == None) {
+        bufsize.Some = high;
+    }
+
+    if (low < 0 || high > bufsize.Some) {
+        ndt_err_format(ctx, NDT_ValueError,
+            "strides are incompatible with shape and buffer size");
         ndt_del(type);
         return NULL;
     }
-    t->EllipsisDim.flags = flags | NDT_Dim_ellipsis;
-    t->EllipsisDim.name = name;
-    t->EllipsisDim.type = type;
-    t->ndim = type->ndim + 1;
 
-    return t;
+    for (i = 0; i < ndim; i++) {
+        dims[i]->Concrete.FixedDim.stride = s[i];
+        dims[i]->Concrete.FixedDim.offset = 0;
+    }
+
+    for (i = 0; i < ndim; i++) {
+        flags = dims[i]->FixedDim.flags & ~NDT_Contiguous;
+        flags |= NDT_Ndarray;
+        if (fixed_is_c_contiguous((const ndt_t **)dims+i, ndim-i, itemsize)) {
+            flags |= NDT_C_contiguous;
+        }
+        if (fixed_is_f_contiguous((const ndt_t **)dims+i, ndim-i, itemsize)) {
+            flags |= NDT_F_contiguous;
+        }
+        dims[i]->FixedDim.flags = flags;
+    }
+
+    type->Concrete.FixedDim.offset = start;
+    type->data_size = bufsize.Some;
+
+    return type;
+
+overflow:
+    ndt_err_format(ctx, NDT_ValueError, "ndt_array: overflow in strides");
+    ndt_del(type);
+    return NULL;
 }
 
 ndt_t *
@@ -1095,10 +1828,18 @@ ndt_next_dim(ndt_t *a)
 ndt_t *
 ndt_dim_option(ndt_t *type, ndt_context_t *ctx)
 {
+    ndt_t *t;
+
     switch (type->tag) {
     case VarDim:
-        type->VarDim.flags |= NDT_Dim_option;
-        return type;
+        t = unshare_dim(type, ctx);
+        if (t == NULL) {
+            ndt_del(type);
+            return NULL;
+        }
+        t->VarDim.flags |= NDT_Dim_option;
+        summarize(t);
+        return t;
     case FixedDim: case SymbolicDim:
         ndt_err_format(ctx, NDT_NotImplementedError,
             "semantics for optional fixed dimensions need to be defined");
@@ -1116,6 +1857,71 @@ ndt_dim_option(ndt_t *type, ndt_context_t *ctx)
     }
 }
 
+/*
+ * Align the data of the concrete dimension 'type' at 'align' bytes and pad
+ * it to a multiple of 'align'.  Applied to an inner dimension, this aligns
+ * and pads every row of the enclosing dimensions, e.g. to cache line or SIMD
+ * register boundaries.
+ */
+ndt_t *
+ndt_aligned_dim(ndt_t *type, uint16_t align, ndt_context_t *ctx)
+{
+    uint16_t requested;
+    int64_t size;
+    ndt_t *t;
+
+    if (type->tag != FixedDim && type->tag != VarDim) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError, "not a dimension");
+        ndt_del(type);
+        return NULL;
+    }
+
+    if (ndt_is_abstract(type)) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError,
+                       "'align' attribute given for abstract dimension");
+        ndt_del(type);
+        return NULL;
+    }
+
+    if (ndt_is_ndarray(type)) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError,
+                       "'align' attribute given for strided array");
+        ndt_del(type);
+        return NULL;
+    }
+
+    if (!align_ispower2(align, ctx)) {
+        ndt_del(type);
+        return NULL;
+    }
+
+    requested = align;
+    align = max(align, type->data_align);
+    if (!add_i64(&size, type->data_size, align-1)) {
+        ndt_err_format(ctx, NDT_ValueError, "data size too large");
+        ndt_del(type);
+        return NULL;
+    }
+
+    t = unshare_dim(type, ctx);
+    if (t == NULL) {
+        ndt_del(type);
+        return NULL;
+    }
+
+    if (t->tag == FixedDim) {
+        t->FixedDim.align = requested;
+    }
+    else {
+        t->VarDim.align = requested;
+    }
+    t->data_align = align;
+    t->data_size = (size / align) * align;
+
+    summarize(t);
+    return t;
+}
+
 ndt_t *
 ndt_item_option(ndt_t *type, ndt_context_t *ctx)
 {
@@ -1148,6 +1954,7 @@ ndt_item_option(ndt_t *type, ndt_context_t *ctx)
             t->meta_size = 0;
         }
  
+        summarize(t);
         return t;
     }
 }
@@ -1184,6 +1991,7 @@ ndt_option(ndt_t *type, ndt_context_t *ctx)
             t->meta_size = 0;
         }
  
+        summarize(t);
         return t;
     }
 }
@@ -1218,6 +2026,11 @@ ndt_typedef(const char *name, ndt_t *type, ndt_context_t *ctx)
     return 0;
 }
 
+/*
+ * The definition of 'name' is looked up in the namespace of 'ctx' and bound
+ * to the result, so layout, traversal and comparison do not depend on the
+ * namespace that is current later.
+ */
 ndt_t *
 ndt_nominal(char *name, ndt_context_t *ctx)
 {
@@ -1244,12 +2057,14 @@ ndt_nominal(char *name, ndt_context_t *ctx)
         return NULL;
     }
     t->Nominal.name = name;
+    t->Nominal.type = ndt_incref(type);
 
     /* concrete access */
     t->access = type->access;
     t->data_size = type->data_size;
     t->data_align = type->data_align;
 
+    summarize(t);
     return t;
 }
 
@@ -1277,9 +2092,47 @@ ndt_constr(char *name, ndt_t *type, ndt_context_t *ctx)
         t->meta_size = 0;
     }
 
+    summarize(t);
     return t;
 }
 
+/*
+ * Compute the memory order of the fields if 'reorder' is true: A stable
+ * sort by descending alignment.  Since the size of a field is a multiple
+ * of its alignment, this layout has no interior padding.
+ */
+static int64_t *
+field_order(const uint16_t *align, size_t shape, bool reorder,
+            ndt_context_t *ctx)
+{
+    int64_t *order;
+    int64_t tmp;
+    size_t i, k;
+
+    /* ndt_alloc() does not accept nmemb == 0 */
+    order = ndt_alloc(shape == 0 ? 1 : shape, sizeof *order);
+    if (order == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    for (i = 0; i < shape; i++) {
+        order[i] = i;
+    }
+
+    if (reorder) {
+        /* insertion sort, records are usually small */
+        for (i = 1; i < shape; i++) {
+            tmp = order[i];
+            for (k = i; k > 0 && align[order[k-1]] < align[tmp]; k--) {
+                order[k] = order[k-1];
+            }
+            order[k] = tmp;
+        }
+    }
+
+    return order;
+}
+
 /*
  * Initialize the access information of a concrete tuple or record.
  * Assumptions:
@@ -1287,17 +2140,24 @@ ndt_constr(char *name, ndt_t *type, ndt_context_t *ctx)
  *   2) t->access == Concrete
  *   3) 0 <= i < shape ==> fields[i].access == Concrete
  *   4) len(fields) == len(offsets) == len(align) == len(pad) == shape
+ *
+ * The arrays are indexed by the declared field position.  pad[i] is the
+ * padding that follows field i in memory.  If 'reorder' is true, the fields
+ * are laid out in the order that minimizes padding and the number of bytes
+ * saved relative to the declared order is stored in 'saved'.
  */
 static int
 init_concrete_fields(ndt_t *t, int64_t *offsets, uint16_t *align, uint16_t *pad,
                      const ndt_field_t *fields, size_t shape,
                      uint16_opt_t align_attr, uint16_opt_t pack,
-                     ndt_context_t *ctx)
+                     bool reorder, int64_t *saved, ndt_context_t *ctx)
 {
+    int64_t *order;
     size_t offset = 0;
     size_t size = 0;
+    size_t declared = 0;
     uint16_t maxalign;
-    size_t i;
+    size_t i, k;
 
     maxalign = get_align(align_attr, 1, ctx);
     if (maxalign == UINT16_MAX) {
@@ -1326,10 +2186,22 @@ init_concrete_fields(ndt_t *t, int64_t *offsets, uint16_t *align, uint16_t *pad,
 
         maxalign = max(align[i], maxalign);
 
-        if (i > 0) {
+        declared = round_up(declared, align[i]);
+        declared += fields[i].type->data_size;
+    }
+
+    order = field_order(align, shape, reorder, ctx);
+    if (order == NULL) {
+        return -1;
+    }
+
+    for (k = 0; k < shape; k++) {
+        i = order[k];
+
+        if (k > 0) {
             size_t n = offset;
             offset = round_up(offset, align[i]);
-            pad[i-1] = offset - n;
+            pad[order[k-1]] = offset - n;
         }
 
         offsets[i] = offset;
@@ -1339,7 +2211,14 @@ init_concrete_fields(ndt_t *t, int64_t *offsets, uint16_t *align, uint16_t *pad,
     size = round_up(offset, maxalign);
 
     if (shape > 0) {
-        pad[shape-1] = (size - offsets[shape-1]) - fields[shape-1].type->data_size;
+        i = order[shape-1];
+        pad[i] = (size - offsets[i]) - fields[i].type->data_size;
+    }
+
+    ndt_free(order);
+
+    if (saved != NULL) {
+        *saved = round_up(declared, maxalign) - size;
     }
 
     assert(t->access == Concrete);
@@ -1349,9 +2228,10 @@ init_concrete_fields(ndt_t *t, int64_t *offsets, uint16_t *align, uint16_t *pad,
     return 0;
 }
 
-ndt_t *
-ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
-          uint16_opt_t align, uint16_opt_t pack, ndt_context_t *ctx)
+static ndt_t *
+tuple_new(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+          uint16_opt_t align, uint16_opt_t pack, bool reorder, int64_t *saved,
+          ndt_context_t *ctx)
 {
     ndt_t *t;
     size_t offset_offset;
@@ -1362,6 +2242,10 @@ ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
 
     assert((fields == NULL) == (shape == 0));
 
+    if (saved != NULL) {
+        *saved = 0;
+    }
+
     offset_offset = round_up(shape * sizeof(ndt_t *), alignof(int64_t));
     align_offset = offset_offset + shape * sizeof(int64_t);
     pad_offset = align_offset + shape * sizeof(uint16_t);
@@ -1374,6 +2258,9 @@ ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
         return NULL;
     }
     t->Tuple.flag = flag;
+    t->Tuple.reorder = reorder && flag == Nonvariadic && shape > 0;
+    t->Tuple.align = fields_attr(align, flag, shape);
+    t->Tuple.pack = fields_attr(pack, flag, shape);
     t->Tuple.shape = shape;
     t->Tuple.types = (ndt_t **)t->extra;
 
@@ -1397,11 +2284,19 @@ ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
                 return NULL;
             }
         }
+        /* the attributes are applied by ndt_substitute() */
+        if (get_align(align, 1, ctx) == UINT16_MAX ||
+            get_align(pack, 1, ctx) == UINT16_MAX) {
+            ndt_field_array_del(fields, shape);
+            ndt_free(t);
+            return NULL;
+        }
         for (i = 0; i < shape; i++) {
             assert(fields[i].name == NULL);
             t->Tuple.types[i] = fields[i].type;
         }
         ndt_free(fields);
+        summarize(t);
         return t;
     }
     else {
@@ -1413,7 +2308,8 @@ ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
                                  t->Concrete.Tuple.offset,
                                  t->Concrete.Tuple.align,
                                  t->Concrete.Tuple.pad,
-                                 fields, shape, align, pack, ctx) < 0) {
+                                 fields, shape, align, pack, reorder, saved,
+                                 ctx) < 0) {
             ndt_field_array_del(fields, shape);
             ndt_free(t);
             return NULL;
@@ -1423,29 +2319,88 @@ ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
             t->Tuple.types[i] = fields[i].type;
         }
         ndt_free(fields);
+        summarize(t);
         return t;
     }
 }
 
-ndt_t *
-ndt_record(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
-           uint16_opt_t align, uint16_opt_t pack, ndt_context_t *ctx)
+/* Compare field numbers by name, equal names by position. */
+static int
+field_less(char **names, int64_t i, int64_t k)
+{
+    int n = strcmp(names[i], names[k]);
+    return n < 0 || (n == 0 && i < k);
+}
+
+static void
+sift_down(int64_t *index, char **names, int64_t root, int64_t n)
+{
+    int64_t child, tmp;
+
+    while ((child = 2*root + 1) < n) {
+        if (child+1 < n && field_less(names, index[child], index[child+1])) {
+            child++;
+        }
+        if (!field_less(names, index[root], index[child])) {
+            break;
+        }
+        tmp = index[root]; index[root] = index[child]; index[child] = tmp;
+        root = child;
+    }
+}
+
+/*
+ * Sort the field numbers of a record by name.  Heapsort does not need a
+ * temporary buffer, so the constructor cannot fail here.
+ */
+static void
+init_field_index(ndt_t *t)
+{
+    int64_t *index = t->Record.index;
+    char **names = t->Record.names;
+    int64_t n = t->Record.shape;
+    int64_t i, tmp;
+
+    for (i = 0; i < n; i++) {
+        index[i] = i;
+    }
+
+    for (i = n/2 - 1; i >= 0; i--) {
+        sift_down(index, names, i, n);
+    }
+
+    for (i = n-1; i > 0; i--) {
+        tmp = index[0]; index[0] = index[i]; index[i] = tmp;
+        sift_down(index, names, 0, i);
+    }
+}
+
+static ndt_t *
+record_new(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+           uint16_opt_t align, uint16_opt_t pack, bool reorder, int64_t *saved,
+           ndt_context_t *ctx)
 {
     ndt_t *t;
     size_t types_offset;
     size_t offset_offset;
     size_t align_offset;
     size_t pad_offset;
+    size_t index_offset;
     size_t extra;
     int64_t i;
 
     assert((fields == NULL) == (shape == 0));
 
+    if (saved != NULL) {
+        *saved = 0;
+    }
+
     types_offset = round_up(shape * sizeof(char *), alignof(ndt_t *));
     offset_offset = types_offset + round_up(shape * sizeof(ndt_t *), alignof(int64_t));
     align_offset = offset_offset + shape * sizeof(int64_t);
     pad_offset = align_offset + shape * sizeof(uint16_t);
-    extra = pad_offset + shape * sizeof(uint16_t);
+    index_offset = round_up(pad_offset + shape * sizeof(uint16_t), alignof(int64_t));
+    extra = index_offset + shape * sizeof(int64_t);
 
     /* abstract type */
     t = ndt_new_extra(Record, extra, ctx);
@@ -1454,9 +2409,13 @@ ndt_record(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
         return NULL;
     }
     t->Record.flag = flag;
+    t->Record.reorder = reorder && flag == Nonvariadic && shape > 0;
+    t->Record.align = fields_attr(align, flag, shape);
+    t->Record.pack = fields_attr(pack, flag, shape);
     t->Record.shape = shape;
     t->Record.names = (char **)t->extra;
     t->Record.types = (ndt_t **)(t->extra + types_offset);
+    t->Record.index = (int64_t *)(t->extra + index_offset);
 
     /* check concrete access */
     t->access = (flag == Variadic) ? Abstract : Concrete;
@@ -1479,11 +2438,20 @@ ndt_record(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
                 return NULL;
             }
         }
+        /* the attributes are applied by ndt_substitute() */
+        if (get_align(align, 1, ctx) == UINT16_MAX ||
+            get_align(pack, 1, ctx) == UINT16_MAX) {
+            ndt_field_array_del(fields, shape);
+            ndt_free(t);
+            return NULL;
+        }
         for (i = 0; i < shape; i++) {
             t->Record.names[i] = fields[i].name;
             t->Record.types[i] = fields[i].type;
         }
         ndt_free(fields);
+        init_field_index(t);
+        summarize(t);
         return t;
     }
     else {
@@ -1495,7 +2463,8 @@ ndt_record(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
                                  t->Concrete.Record.offset,
                                  t->Concrete.Record.align,
                                  t->Concrete.Record.pad,
-                                 fields, shape, align, pack, ctx) < 0) {
+                                 fields, shape, align, pack, reorder, saved,
+                                 ctx) < 0) {
             /* at this point names and types still belong to the fields */
             ndt_field_array_del(fields, shape);
             ndt_free(t);
@@ -1506,10 +2475,82 @@ ndt_record(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
             t->Record.types[i] = fields[i].type;
         }
         ndt_free(fields);
+        init_field_index(t);
+        summarize(t);
         return t;
     }
 }
 
+ndt_t *
+ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+          uint16_opt_t align, uint16_opt_t pack, ndt_context_t *ctx)
+{
+    return tuple_new(flag, fields, shape, align, pack, false, NULL, ctx);
+}
+
+ndt_t *
+ndt_record(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+           uint16_opt_t align, uint16_opt_t pack, ndt_context_t *ctx)
+{
+    return record_new(flag, fields, shape, align, pack, false, NULL, ctx);
+}
+
+/*
+ * Create a tuple or record whose fields are laid out in the order that
+ * minimizes padding.  Names and types remain in declared order, so the
+ * field offsets map the declared positions to the memory layout.  If
+ * 'saved' is not NULL, it is set to the number of bytes saved relative
+ * to the declared order.  Abstract types only record the 'reorder'
+ * attribute, which has no effect on variadic or empty tuples and records.
+ */
+ndt_t *
+ndt_tuple_reorder(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+                  uint16_opt_t align, uint16_opt_t pack, int64_t *saved,
+                  ndt_context_t *ctx)
+{
+    return tuple_new(flag, fields, shape, align, pack, true, saved, ctx);
+}
+
+ndt_t *
+ndt_record_reorder(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+                   uint16_opt_t align, uint16_opt_t pack, int64_t *saved,
+                   ndt_context_t *ctx)
+{
+    return record_new(flag, fields, shape, align, pack, true, saved, ctx);
+}
+
+/*
+ * Return the number of the field 'name' in the record 't', or -1 if there
+ * is no such field.  The lookup is a binary search in the field index.
+ */
+int64_t
+ndt_record_field(const ndt_t *t, const char *name)
+{
+    const int64_t *index = t->Record.index;
+    int64_t lo = 0, hi = t->Record.shape;
+    int64_t mid;
+    int n;
+
+    assert(t->tag == Record);
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        n = strcmp(t->Record.names[index[mid]], name);
+        if (n < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    if (lo < t->Record.shape && strcmp(t->Record.names[index[lo]], name) == 0) {
+        return index[lo];
+    }
+
+    return -1;
+}
+
 ndt_t *
 ndt_function(ndt_t *ret, ndt_t *pos, ndt_t *kwds, ndt_context_t *ctx)
 {
@@ -1527,6 +2568,7 @@ ndt_function(ndt_t *ret, ndt_t *pos, ndt_t *kwds, ndt_context_t *ctx)
     t->Function.pos = pos;
     t->Function.kwds = kwds;
 
+    summarize(t);
     return t;
 }
 
@@ -1543,6 +2585,7 @@ ndt_typevar(char *name, ndt_context_t *ctx)
     }
     t->Typevar.name = name;
 
+    summarize(t);
     return t;
 }
 
@@ -1750,6 +2793,7 @@ ndt_char(enum ndt_encoding encoding, ndt_context_t *ctx)
     t->data_align = ndt_alignof_encoding(encoding);
     t->meta_size = 0;
 
+    summarize(t);
     return t;
 }
 
@@ -1792,6 +2836,7 @@ ndt_fixed_string(size_t size, enum ndt_encoding encoding, ndt_context_t *ctx)
     t->data_align = ndt_alignof_encoding(encoding);
     t->meta_size = 0;
 
+    summarize(t);
     return t;
 }
 
@@ -1819,6 +2864,7 @@ ndt_bytes(uint16_opt_t target_align, ndt_context_t *ctx)
     t->data_align = alignof(ndt_bytes_t);
     t->meta_size = 0;
 
+    summarize(t);
     return t;
 }
 
@@ -1847,6 +2893,7 @@ ndt_fixed_bytes(size_t size, uint16_opt_t align_attr, ndt_context_t *ctx)
     t->data_align = align;
     t->meta_size = 0;
 
+    summarize(t);
     return t;
 }
 
@@ -1894,6 +2941,7 @@ ndt_categorical(ndt_memory_t *types, size_t ntypes, ndt_context_t *ctx)
     t->data_align = alignof(ndt_memory_t);
     t->meta_size = 0;
 
+    summarize(t);
     return t;
 }
 
@@ -1916,6 +2964,7 @@ ndt_pointer(ndt_t *type, ndt_context_t *ctx)
     t->data_align = alignof(void *);
     t->meta_size = 0;
 
+    summarize(t);
     return t;
 }
 
@@ -2008,22 +3057,64 @@ ndt_is_column_major(const ndt_t *t)
 int
 ndt_is_contiguous(const ndt_t *t)
 {
-    (void)t;
-    return 1;
+    return ndt_is_c_contiguous(t) || ndt_is_f_contiguous(t);
 }
 
+/*
+ * Arrays with fixed dimensions are checked using the strides.  Var
+ * dimensions are always stored in row-major order.  Scalars are both C
+ * and Fortran contiguous.  Abstract types have no memory layout and are
+ * neither.
+ */
 int
 ndt_is_c_contiguous(const ndt_t *t)
 {
-    (void)t;
-    return 1;
+    const ndt_t *dims[NDT_MAX_DIM];
+    const ndt_t *dtype;
+    int ndim;
+
+    if (ndt_is_abstract(t)) {
+        return 0;
+    }
+
+    if (t->tag != FixedDim) {
+        return 1;
+    }
+
+    if (ndt_is_ndarray(t)) {
+        return (t->FixedDim.flags & NDT_C_contiguous) != 0;
+    }
+
+    ndim = ndt_const_dims_dtype(dims, &dtype, t);
+    return fixed_is_c_contiguous(dims, ndim, dtype->data_size);
 }
 
 int
 ndt_is_f_contiguous(const ndt_t *t)
 {
-    (void)t;
-    return 0;
+    const ndt_t *dims[NDT_MAX_DIM];
+    const ndt_t *dtype;
+    int ndim;
+
+    if (ndt_is_abstract(t)) {
+        return 0;
+    }
+
+    switch (t->tag) {
+    case FixedDim:
+        break;
+    case VarDim:
+        return t->ndim == 1;
+    default:
+        return 1;
+    }
+
+    if (ndt_is_ndarray(t)) {
+        return (t->FixedDim.flags & NDT_F_contiguous) != 0;
+    }
+
+    ndim = ndt_const_dims_dtype(dims, &dtype, t);
+    return fixed_is_f_contiguous(dims, ndim, dtype->data_size);
 }
 
 int
@@ -2423,6 +3514,7 @@ ndt_context_new(void)
     ctx->err = NDT_Success;
     ctx->msg = ConstMsg;
     ctx->ConstMsg = "Success";
+    ctx->ns = NULL;
 
     return ctx;
 }
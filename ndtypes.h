@@ -280,6 +280,18 @@ enum ndt {
         /* User1, User2, ... tags for a limited number of user-defined types */
 };
 
+/* Bit for 'tag' in the 'tags' summary of a type (all tags are below 64). */
+#define NDT_TAG_BIT(tag) ((uint64_t)1 << (tag))
+
+/* Tags that a pattern only matches with the same tag in the candidate */
+#define NDT_EXACT_TAGS \
+  (~(NDT_TAG_BIT(AnyKind) | NDT_TAG_BIT(SymbolicDim) |         \
+     NDT_TAG_BIT(EllipsisDim) | NDT_TAG_BIT(Typevar) |         \
+     NDT_TAG_BIT(ScalarKind) | NDT_TAG_BIT(SignedKind) |       \
+     NDT_TAG_BIT(UnsignedKind) | NDT_TAG_BIT(FloatKind) |      \
+     NDT_TAG_BIT(ComplexKind) | NDT_TAG_BIT(FixedStringKind) | \
+     NDT_TAG_BIT(FixedBytesKind)))
+
 enum ndt_alias {
   Size,
   Intptr,
@@ -310,6 +322,10 @@ struct _ndt {
     enum ndt_access access;
     int ndim;
     int64_t hash;
+    int64_t refcnt; /* additional owners, see ndt_incref() */
+    /* Summary of the subtree, filled in by the constructors */
+    uint64_t tags;        /* set of all tags, see NDT_TAG_BIT() */
+    uint64_t fingerprint; /* structural hash, equal types have equal fingerprints */
     /* Undefined if the type is abstract */
     int64_t data_size;
     uint16_t data_align;
@@ -319,6 +335,7 @@ struct _ndt {
     union {
         struct {
             uint32_t flags;
+            uint16_t align; /* 'align' attribute, 0 if not given */
             int64_t shape;
             ndt_t *type;
         } FixedDim;
@@ -331,6 +348,7 @@ struct _ndt {
 
         struct {
             uint32_t flags;
+            uint16_t align; /* 'align' attribute, 0 if not given */
             ndt_t *type;
         } VarDim;
 
@@ -350,6 +368,7 @@ struct _ndt {
 
         struct {
             char *name;
+            const ndt_t *type; /* the definition, shared with the namespace */
         } Nominal;
 
         struct {
@@ -359,15 +378,22 @@ struct _ndt {
 
         struct {
             enum ndt_variadic flag;
+            bool reorder;   /* 'reorder' attribute */
+            uint16_t align; /* 'align' attribute, 0 if not given */
+            uint16_t pack;  /* 'pack' attribute, 0 if not given */
             int64_t shape;
             ndt_t **types;
         } Tuple;
 
         struct {
             enum ndt_variadic flag;
+            bool reorder;   /* 'reorder' attribute */
+            uint16_t align; /* 'align' attribute, 0 if not given */
+            uint16_t pack;  /* 'pack' attribute, 0 if not given */
             int64_t shape;
             char **names;
             ndt_t **types;
+            int64_t *index; /* field numbers in the order of their names */
         } Record;
 
         struct {
@@ -414,6 +440,8 @@ struct _ndt {
             struct {
                 int64_t itemsize;
                 int64_t stride;
+                int64_t offset; /* ndarray: offset of the first element in
+                                   the outermost dimension, 0 elsewhere */
             } FixedDim;
 
             struct {
@@ -490,7 +518,7 @@ struct _ndt_meta {
 #define NDT_Dynamic 0x00000001U
 
 #define NDT_STATIC_CONTEXT(name) \
-    ndt_context_t name = { .flags=0, .err=NDT_Success, .msg=ConstMsg, .ConstMsg="Success" }
+    ndt_context_t name = { .flags=0, .err=NDT_Success, .msg=ConstMsg, .ConstMsg="Success", .ns=NULL }
 
 
 enum ndt_error {
@@ -511,6 +539,9 @@ enum ndt_msg {
   DynamicMsg
 };
 
+/* Typedef namespace, see ndt_namespace_new(). */
+typedef struct ndt_namespace ndt_namespace_t;
+
 typedef struct {
     uint32_t flags;
     enum ndt_error err;
@@ -519,6 +550,7 @@ typedef struct {
         const char *ConstMsg;
         char *DynamicMsg;
     };
+    ndt_namespace_t *ns; /* typedef namespace, NULL for the global one */
 } ndt_context_t;
 
 ndt_context_t *ndt_context_new(void);
@@ -556,6 +588,7 @@ int ndt_is_complex(const ndt_t *t);
 int ndt_is_abstract(const ndt_t *t);
 int ndt_is_scalar(const ndt_t *t);
 int ndt_is_array(const ndt_t *t);
+int ndt_is_ndarray(const ndt_t *t);
 int ndt_is_column_major(const ndt_t *t);
 int ndt_is_contiguous(const ndt_t *t);
 int ndt_is_c_contiguous(const ndt_t *t);
@@ -563,8 +596,18 @@ int ndt_is_f_contiguous(const ndt_t *t);
 int ndt_is_scalar(const ndt_t *t);
 int ndt_is_optional(const ndt_t *t);
 int ndt_equal(const ndt_t *p, const ndt_t *c);
+int ndt_may_match(const ndt_t *p, const ndt_t *c);
 int ndt_match(const ndt_t *p, const ndt_t *c, ndt_context_t *ctx);
 ndt_t *ndt_typecheck(const ndt_t *f, const ndt_t *args, int *outer_dims, ndt_context_t *ctx);
+int64_t ndt_typecheck_batch(const ndt_t *f, const ndt_t *args[], int64_t n,
+                            ndt_t *out[], int outer_dims[], ndt_context_t *ctx);
+ndt_t *ndt_typecheck_broadcast(const ndt_t *f, const ndt_t *args, int *outer_dims,
+                               int64_t shape[NDT_MAX_DIM], int64_t strides[][NDT_MAX_DIM],
+                               ndt_context_t *ctx);
+ndt_t *ndt_unify(const ndt_t *p, const ndt_t *q, ndt_context_t *ctx);
+int ndt_more_specific(const ndt_t *p, const ndt_t *q, ndt_context_t *ctx);
+int ndt_specificity_sort(int64_t order[], const ndt_t *types[], int64_t n,
+                         ndt_context_t *ctx);
 
 ndt_t *ndt_next_dim(ndt_t *a);
 void ndt_set_next_type(ndt_t *a, ndt_t *type);
@@ -598,6 +641,7 @@ void ndt_field_array_del(ndt_field_t *fields, size_t shape);
 ndt_t *ndt_new(enum ndt tag, ndt_context_t *ctx);
 void ndt_del(ndt_t *t);
 int64_t ndt_hash(ndt_t *t, ndt_context_t *ctx);
+const ndt_t *ndt_incref(const ndt_t *t);
 ndt_t *ndt_copy(const ndt_t *t, ndt_context_t *ctx);
 
 /* Typedef for nominal types */
@@ -610,12 +654,14 @@ ndt_t *ndt_symbolic_dim(char *name, ndt_t *type, ndt_context_t *ctx);
 ndt_t *ndt_var_dim(ndt_t *type, bool copy_meta, enum ndt meta_type, int64_t nshapes,
                    const int64_t *shapes, const int64_t *offsets, const uint8_t *bitmap,
                    ndt_context_t *ctx);
+ndt_t *ndt_var_dim_like(const ndt_t *t, ndt_t *type, ndt_context_t *ctx);
 ndt_t *ndt_ellipsis_dim(char *name, ndt_t *type, ndt_context_t *ctx);
 
 ndt_t *ndt_array(ndt_t *type, int64_t *strides, int64_opt_t offset, int64_opt_t bufsize, char_opt_t order, ndt_context_t *ctx);
 ndt_t *ndt_option(ndt_t *type, ndt_context_t *ctx);
 ndt_t *ndt_dim_option(ndt_t *type, ndt_context_t *ctx);
 ndt_t *ndt_item_option(ndt_t *type, ndt_context_t *ctx);
+ndt_t *ndt_aligned_dim(ndt_t *type, uint16_t align, ndt_context_t *ctx);
 ndt_t *ndt_nominal(char *name, ndt_context_t *ctx);
 ndt_t *ndt_constr(char *name, ndt_t *type, ndt_context_t *ctx);
 
@@ -625,6 +671,13 @@ ndt_t *ndt_tuple(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
                  uint16_opt_t align, uint16_opt_t pack, ndt_context_t *ctx);
 ndt_t *ndt_record(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
                   uint16_opt_t align, uint16_opt_t pack, ndt_context_t *ctx);
+ndt_t *ndt_tuple_reorder(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+                         uint16_opt_t align, uint16_opt_t pack, int64_t *saved,
+                         ndt_context_t *ctx);
+ndt_t *ndt_record_reorder(enum ndt_variadic flag, ndt_field_t *fields, int64_t shape,
+                          uint16_opt_t align, uint16_opt_t pack, int64_t *saved,
+                          ndt_context_t *ctx);
+int64_t ndt_record_field(const ndt_t *t, const char *name);
 ndt_t *ndt_function(ndt_t *ret, ndt_t *pos, ndt_t *kwds, ndt_context_t *ctx);
 ndt_t *ndt_typevar(char *name, ndt_context_t *ctx);
 
@@ -680,6 +733,10 @@ void ndt_finalize(void);
 int ndt_typedef_add(const char *name, const ndt_t *type, ndt_context_t *ctx);
 const ndt_t *ndt_typedef_find(const char *name, ndt_context_t *ctx);
 
+ndt_namespace_t *ndt_namespace_new(const ndt_namespace_t *parent, ndt_context_t *ctx);
+void ndt_namespace_del(ndt_namespace_t *ns);
+const ndt_namespace_t *ndt_global_namespace(void);
+
 
 /******************************************************************************/
 /*                                 Printing                                   */
@@ -689,6 +746,242 @@ char *ndt_as_string(ndt_t *t, ndt_context_t *ctx);
 char *ndt_as_string_with_meta(ndt_t *t, ndt_context_t *ctx);
 char *ndt_indent(ndt_t *t, ndt_context_t *ctx);
 
+/*
+ * The streaming printers pass the output in chunks to 'write', which
+ * returns a negative value on error.  ndt_write_file() writes to the
+ * FILE * in 'arg'.
+ */
+typedef int (*ndt_write_f)(const char *s, size_t n, void *arg);
+
+int ndt_print(const ndt_t *t, ndt_write_f write, void *arg, ndt_context_t *ctx);
+int ndt_print_with_meta(const ndt_t *t, ndt_write_f write, void *arg, ndt_context_t *ctx);
+int ndt_print_indent(const ndt_t *t, ndt_write_f write, void *arg, ndt_context_t *ctx);
+int ndt_write_file(const char *s, size_t n, void *arg);
+
+/*
+ * Bounded output for logging huge types.  The output is cut after
+ * 'max_width' bytes, lists of fields, categories, offsets and shapes after
+ * 'max_items' elements, and the members of tuples, records and categoricals
+ * nested deeper than 'max_depth' levels are omitted.  Elided parts are
+ * shown as "...".  Zero means no bound.  Printing stops once the output
+ * has been cut, so the cost depends on the bounds, not on the type.
+ */
+typedef struct {
+    int64_t max_width;
+    int64_t max_items;
+    int max_depth;
+} ndt_limits_t;
+
+char *ndt_as_string_limited(const ndt_t *t, const ndt_limits_t *limits, ndt_context_t *ctx);
+char *ndt_as_string_with_meta_limited(const ndt_t *t, const ndt_limits_t *limits, ndt_context_t *ctx);
+
+
+/******************************************************************************/
+/*                                Addressing                                  */
+/******************************************************************************/
+
+int64_t ndt_offset_of(const ndt_t *t, const int64_t *indices, int n, ndt_context_t *ctx);
+int ndt_offsets_of(const ndt_t *t, const int64_t *indices, int n, int64_t *out, int64_t count, ndt_context_t *ctx);
+
+
+/******************************************************************************/
+/*                              Traversal plans                               */
+/******************************************************************************/
+
+/*
+ * A plan is a flat instruction array for walking a memory block of a
+ * concrete type.  Loops are closed by PlanEndLoop; all offsets are relative
+ * to the base of the enclosing loop element.  A plan borrows the type it was
+ * compiled from and must not outlive it.
+ */
+enum ndt_plan_op {
+  PlanLoop,     /* fixed dimension: 'shape' elements with 'stride' */
+  PlanVarLoop,  /* var dimension 'type', elements of size 'stride' */
+  PlanEndLoop,  /* end of the loop body that starts at 'jump' */
+  PlanVisit,    /* visit item 'type' at 'offset' */
+  PlanPad       /* 'size' bytes of padding at 'offset' */
+};
+
+typedef struct {
+    enum ndt_plan_op op;
+    int64_t jump;
+    int64_t offset;
+    int64_t shape;
+    int64_t stride;
+    int64_t size;
+    const ndt_t *type;
+} ndt_instr_t;
+
+typedef struct {
+    int64_t ninstr;
+    int64_t depth;
+    ndt_instr_t instr[];
+} ndt_plan_t;
+
+/* 't' is NULL for padding.  A negative return value stops the walk. */
+typedef int (*ndt_visit_f)(const ndt_t *t, int64_t offset, int64_t size, void *arg);
+
+ndt_plan_t *ndt_compile_plan(const ndt_t *t, ndt_context_t *ctx);
+void ndt_plan_del(ndt_plan_t *plan);
+int ndt_plan_exec(const ndt_plan_t *plan, int64_t base, ndt_visit_f f, void *arg, ndt_context_t *ctx);
+
+
+/******************************************************************************/
+/*                             Layout transforms                              */
+/******************************************************************************/
+
+/*
+ * Element k of field i is copied from 'src_offset + k * src_stride' to
+ * 'dst_offset + k * dst_stride' for 0 <= k < nitems.  Each copy is
+ * 'itemsize' bytes.
+ */
+typedef struct {
+    int64_t src_offset;
+    int64_t src_stride;
+    int64_t dst_offset;
+    int64_t dst_stride;
+    int64_t itemsize;
+} ndt_field_map_t;
+
+typedef struct {
+    int64_t nitems;
+    int64_t nfields;
+    ndt_field_map_t fields[];
+} ndt_soa_map_t;
+
+ndt_t *ndt_aos_to_soa(const ndt_t *t, ndt_soa_map_t **map, ndt_context_t *ctx);
+ndt_t *ndt_soa_to_aos(const ndt_t *t, ndt_soa_map_t **map, ndt_context_t *ctx);
+void ndt_soa_map_del(ndt_soa_map_t *map);
+ndt_t *ndt_record_project(const ndt_t *t, const char *const names[], int64_t n,
+                          ndt_context_t *ctx);
+
+
+/******************************************************************************/
+/*                              Memory footprint                              */
+/******************************************************************************/
+
+/* Assumed payload size of a string or bytes item. */
+#define NDT_VARLEN_ESTIMATE 16
+
+typedef struct {
+    int64_t data;     /* item data */
+    int64_t padding;  /* alignment padding and unused buffer space */
+    int64_t meta;     /* dimension metadata and validity bitmaps */
+    int64_t indirect; /* pointer targets and string or bytes payloads */
+    int64_t nvarlen;  /* number of string or bytes payloads in 'indirect' */
+    int64_t total;
+    bool exact;       /* false if the type is abstract or has varlen payloads */
+} ndt_footprint_t;
+
+/* Called for each subtree with its share of the footprint. */
+typedef int (*ndt_footprint_f)(const ndt_t *t, const ndt_footprint_t *sub, void *arg);
+
+int ndt_footprint(const ndt_t *t, ndt_footprint_t *report, ndt_footprint_f f, void *arg, ndt_context_t *ctx);
+
+
+/******************************************************************************/
+/*                             Compiled patterns                              */
+/******************************************************************************/
+
+/*
+ * A pattern compiled for repeated matching.  The operations are the nodes of
+ * the pattern in preorder.  A PatDims operation is followed by one PatDim
+ * operation per dimension.  Type variables, symbolic dimensions and named
+ * ellipses are assigned binding slots at compile time.  The pattern borrows
+ * the type it was compiled from and must not outlive it.
+ */
+enum ndt_pattern_op {
+  PatAny,        /* matches anything */
+  PatLeaf,       /* dtype without children, compared with 'type' */
+  PatDims,       /* array with 'n' dimensions, followed by the dtype */
+  PatDim,        /* dimension 'type' with binding slot 'slot' or -1 */
+  PatTuple,      /* tuple with 'n' fields */
+  PatRecord,     /* record with 'n' fields, names are taken from 'type' */
+  PatPointer,
+  PatOption,
+  PatOptionItem,
+  PatFunction,   /* followed by ret, pos and kwds */
+  PatTypevar     /* type variable with binding slot 'slot' */
+};
+
+typedef struct {
+    enum ndt_pattern_op op;
+    int slot;
+    int64_t n;
+    const ndt_t *type;
+} ndt_pattern_instr_t;
+
+typedef struct {
+    int64_t nops;
+    int nslots;
+    const char **names;
+    ndt_pattern_instr_t ops[];
+} ndt_pattern_t;
+
+enum ndt_binding_tag {
+  BindUnbound,
+  BindSize,
+  BindSymbol,
+  BindType,
+  BindDims
+};
+
+/* Bindings are borrowed from the candidate.  'Dims.first' is the outermost
+   of 'Dims.size' consecutive dimensions. */
+typedef struct {
+    enum ndt_binding_tag tag;
+    union {
+        int64_t Size;
+        const char *Symbol;
+        const ndt_t *Type;
+        struct {
+            int size;
+            const ndt_t *first;
+        } Dims;
+    };
+} ndt_binding_t;
+
+ndt_pattern_t *ndt_pattern_compile(const ndt_t *p, ndt_context_t *ctx);
+void ndt_pattern_del(ndt_pattern_t *m);
+int ndt_pattern_slot(const ndt_pattern_t *m, const char *name);
+int ndt_pattern_match(const ndt_pattern_t *m, const ndt_t *c, ndt_binding_t bindings[], ndt_context_t *ctx);
+
+
+/******************************************************************************/
+/*                             Multiple dispatch                              */
+/******************************************************************************/
+
+/*
+ * An index over function signatures.  Signatures are borrowed and must
+ * outlive the index.  Lookups do not modify the index and may run
+ * concurrently, but not concurrently with ndt_dispatch_add().
+ */
+typedef struct ndt_dispatch ndt_dispatch_t;
+
+ndt_dispatch_t *ndt_dispatch_new(ndt_context_t *ctx);
+void ndt_dispatch_del(ndt_dispatch_t *d);
+int ndt_dispatch_add(ndt_dispatch_t *d, const ndt_t *sig, ndt_context_t *ctx);
+int ndt_dispatch_find(const ndt_dispatch_t *d, const ndt_t *args, ndt_context_t *ctx);
+
+
+/******************************************************************************/
+/*                           Typecheck result cache                           */
+/******************************************************************************/
+
+typedef struct ndt_typecheck_cache ndt_typecheck_cache_t;
+
+typedef struct {
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t size;
+} ndt_cache_stats_t;
+
+ndt_typecheck_cache_t *ndt_typecheck_cache_new(int64_t capacity, ndt_context_t *ctx);
+void ndt_typecheck_cache_del(ndt_typecheck_cache_t *cache);
+ndt_t *ndt_typecheck_cached(ndt_typecheck_cache_t *cache, const ndt_t *f, const ndt_t *args, int *outer_dims, ndt_context_t *ctx);
+void ndt_typecheck_cache_stats(ndt_typecheck_cache_t *cache, ndt_cache_stats_t *stats);
+
 
 /******************************************************************************/
 /*                            Memory handling                                 */
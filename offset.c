@@ -0,0 +1,261 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                           Byte offsets of elements                         */
+/*****************************************************************************/
+
+static int64_t
+out_of_bounds(int64_t index, ndt_context_t *ctx)
+{
+    ndt_err_format(ctx, NDT_ValueError, "index out of bounds: %" PRIi64, index);
+    return -1;
+}
+
+static int
+var_row_is_valid(const ndt_t *t, int64_t row)
+{
+    const uint8_t *bitmap = t->Concrete.VarDim.bitmap;
+    return bitmap == NULL || (bitmap[row / 8] & ((uint8_t)1 << (row % 8)));
+}
+
+/*
+ * Follow 'indices' from the root of 't'.  Indices select elements of fixed
+ * and var dimensions and fields of tuples and records.  If fewer indices
+ * than levels are given, the result is the offset of the first element of
+ * the selected subtree.
+ *
+ * Var dimensions are addressed through the row offsets of each level.  The
+ * byte offset is only known after leaving the last var dimension.
+ */
+static int64_t
+offset_of(const ndt_t *t, const int64_t *indices, int n, ndt_context_t *ctx)
+{
+    const ndt_t *next;
+    int64_t offset = 0;
+    int64_t row = 0;
+    int64_t pos;
+    int64_t i;
+    int k = 0;
+
+    if (t->tag == FixedDim) {
+        offset = t->Concrete.FixedDim.offset;
+    }
+
+    while (k < n || t->tag == VarDim) {
+        switch (t->tag) {
+        case FixedDim:
+            i = indices[k++];
+            if (i < 0 || i >= t->FixedDim.shape) {
+                return out_of_bounds(i, ctx);
+            }
+            offset += i * t->Concrete.FixedDim.stride;
+            t = t->FixedDim.type;
+            break;
+
+        case VarDim:
+            next = t->VarDim.type;
+            if (row >= t->Concrete.VarDim.nshapes) {
+                ndt_err_format(ctx, NDT_RuntimeError,
+                               "ndt_offset_of: invalid var dimension");
+                return -1;
+            }
+
+            pos = t->Concrete.VarDim.offsets[row];
+            if (k < n) {
+                i = indices[k++];
+                if (!var_row_is_valid(t, row)) {
+                    ndt_err_format(ctx, NDT_ValueError,
+                                   "ndt_offset_of: missing var dimension");
+                    return -1;
+                }
+                if (i < 0 || i >= t->Concrete.VarDim.shapes[row]) {
+                    return out_of_bounds(i, ctx);
+                }
+                pos += i;
+            }
+
+            if (next->tag == VarDim) {
+                row = pos;
+            }
+            else {
+                offset += pos * t->Concrete.VarDim.itemsize;
+            }
+            t = next;
+            break;
+
+        case Tuple:
+            i = indices[k++];
+            if (i < 0 || i >= t->Tuple.shape) {
+                return out_of_bounds(i, ctx);
+            }
+            offset += t->Concrete.Tuple.offset[i];
+            t = t->Tuple.types[i];
+            break;
+
+        case Record:
+            i = indices[k++];
+            if (i < 0 || i >= t->Record.shape) {
+                return out_of_bounds(i, ctx);
+            }
+            offset += t->Concrete.Record.offset[i];
+            t = t->Record.types[i];
+            break;
+
+        case Option:
+            t = t->Option.type;
+            break;
+
+        case OptionItem:
+            t = t->OptionItem.type;
+            break;
+
+        case Constr:
+            t = t->Constr.type;
+            break;
+
+        case Nominal:
+            t = t->Nominal.type;
+            break;
+
+        case Pointer:
+            ndt_err_format(ctx, NDT_ValueError,
+                           "ndt_offset_of: cannot index through a pointer");
+            return -1;
+
+        default:
+            ndt_err_format(ctx, NDT_ValueError,
+                           "ndt_offset_of: too many indices for type '%s'",
+                           ndt_tag_as_string(t->tag));
+            return -1;
+        }
+    }
+
+    return offset;
+}
+
+static int
+check_args(const ndt_t *t, const int64_t *indices, int n, ndt_context_t *ctx)
+{
+    if (ndt_is_abstract(t)) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_offset_of: type must be concrete");
+        return -1;
+    }
+
+    if (n < 0 || (n > 0 && indices == NULL)) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError,
+                       "ndt_offset_of: invalid indices");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Return the byte offset of the element or subtree that is selected by
+ * the 'n' indices in 'indices', or -1 on error.
+ */
+int64_t
+ndt_offset_of(const ndt_t *t, const int64_t *indices, int n, ndt_context_t *ctx)
+{
+    if (check_args(t, indices, n, ctx) < 0) {
+        return -1;
+    }
+
+    return offset_of(t, indices, n, ctx);
+}
+
+/*
+ * Batched version of ndt_offset_of().  'indices' contains 'count' index
+ * tuples of length 'n' in row-major order.  The offsets are written to
+ * 'out'.
+ *
+ * If all indices select elements of fixed dimensions, the shapes and the
+ * strides are looked up once and each offset is a dot product.
+ */
+int
+ndt_offsets_of(const ndt_t *t, const int64_t *indices, int n, int64_t *out,
+               int64_t count, ndt_context_t *ctx)
+{
+    int64_t shape[NDT_MAX_DIM];
+    int64_t stride[NDT_MAX_DIM];
+    const ndt_t *u;
+    const int64_t *index;
+    int64_t base, offset;
+    int64_t r;
+    int m, k;
+
+    if (check_args(t, indices, n, ctx) < 0) {
+        return -1;
+    }
+
+    for (u = t, m = 0; m < n && u->tag == FixedDim; u = u->FixedDim.type, m++) {
+        shape[m] = u->FixedDim.shape;
+        stride[m] = u->Concrete.FixedDim.stride;
+    }
+
+    if (m < n) {
+        for (r = 0; r < count; r++) {
+            out[r] = offset_of(t, indices + r * n, n, ctx);
+            if (out[r] < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    base = t->tag == FixedDim ? t->Concrete.FixedDim.offset : 0;
+
+    for (r = 0; r < count; r++) {
+        index = indices + r * n;
+        offset = base;
+        for (k = 0; k < n; k++) {
+            if ((uint64_t)index[k] >= (uint64_t)shape[k]) {
+                (void)out_of_bounds(index[k], ctx);
+                return -1;
+            }
+            offset += index[k] * stride[k];
+        }
+        out[r] = offset;
+    }
+
+    return 0;
+}
@@ -95,16 +95,23 @@ mk_fixed_dim_from_attrs(ndt_attr_seq_t *attrs, ndt_t *type, ndt_context_t *ctx)
     int64_t shape;
     int64_t stride = -1;
     char order = 'C';
+    uint16_opt_t align = {None, 0};
+    ndt_t *t;
     int ret;
 
-    ret = ndt_parse_attr(FixedDim, ctx, attrs, &shape, &stride, &order);
+    ret = ndt_parse_attr(FixedDim, ctx, attrs, &shape, &stride, &order, &align);
     ndt_attr_seq_del(attrs);
     if (ret < 0) {
         ndt_del(type);
         return NULL;
     }
 
-    return ndt_fixed_dim(shape, type, order, ctx);
+    t = ndt_fixed_dim(shape, type, order, ctx);
+    if (t == NULL || align.tag == None) {
+        return t;
+    }
+
+    return ndt_aligned_dim(t, align.Some, ctx);
 }
 
 static int64_t *
@@ -158,10 +165,11 @@ mk_var_dim(ndt_attr_seq_t *attrs, ndt_t *type, ndt_context_t *ctx)
         int64_t nshapes = 0;
         int64_t noffsets = 0;
         int64_t nvalid = 0;
+        uint16_opt_t align = {None, 0};
         int ret;
 
         ret = ndt_parse_attr(VarDim, ctx, attrs, &shapes, &nshapes,
-                             &offsets, &noffsets, &valid, &nvalid);
+                             &offsets, &noffsets, &valid, &nvalid, &align);
         ndt_attr_seq_del(attrs);
         if (ret < 0) {
             ndt_del(type);
@@ -212,7 +220,11 @@ mk_var_dim(ndt_attr_seq_t *attrs, ndt_t *type, ndt_context_t *ctx)
         ndt_free(shapes);
         ndt_free(offsets);
         ndt_free(bitmap);
-        return t;
+        if (t == NULL || align.tag == None) {
+            return t;
+        }
+
+        return ndt_aligned_dim(t, align.Some, ctx);
 
     }
     else {
@@ -327,12 +339,13 @@ mk_tuple(enum ndt_variadic flag, ndt_field_seq_t *fields,
 {
     uint16_opt_t align = {None, 0};
     uint16_opt_t pack = {None, 0};
+    bool reorder = false;
     ndt_t *t;
 
     fields = ndt_field_seq_finalize(fields);
 
     if (attrs) {
-        int ret = ndt_parse_attr(Tuple, ctx, attrs, &align, &pack);
+        int ret = ndt_parse_attr(Tuple, ctx, attrs, &align, &pack, &reorder);
         ndt_attr_seq_del(attrs);
 
         if (ret < 0) {
@@ -345,7 +358,12 @@ mk_tuple(enum ndt_variadic flag, ndt_field_seq_t *fields,
         return ndt_tuple(flag, NULL, 0, align, pack, ctx);
     }
 
-    t = ndt_tuple(flag, fields->ptr, fields->len, align, pack, ctx);
+    if (reorder) {
+        t = ndt_tuple_reorder(flag, fields->ptr, fields->len, align, pack, NULL, ctx);
+    }
+    else {
+        t = ndt_tuple(flag, fields->ptr, fields->len, align, pack, ctx);
+    }
     ndt_free(fields);
     return t;
 }
@@ -356,12 +374,13 @@ mk_record(enum ndt_variadic flag, ndt_field_seq_t *fields,
 {
     uint16_opt_t align = {None, 0};
     uint16_opt_t pack = {None, 0};
+    bool reorder = false;
     ndt_t *t;
 
     fields = ndt_field_seq_finalize(fields);
 
     if (attrs) {
-        int ret = ndt_parse_attr(Record, ctx, attrs, &align, &pack);
+        int ret = ndt_parse_attr(Record, ctx, attrs, &align, &pack, &reorder);
         ndt_attr_seq_del(attrs);
 
         if (ret < 0) {
@@ -374,7 +393,12 @@ mk_record(enum ndt_variadic flag, ndt_field_seq_t *fields,
         return ndt_record(flag, NULL, 0, align, pack, ctx);
     }
 
-    t = ndt_record(flag, fields->ptr, fields->len, align, pack, ctx);
+    if (reorder) {
+        t = ndt_record_reorder(flag, fields->ptr, fields->len, align, pack, NULL, ctx);
+    }
+    else {
+        t = ndt_record(flag, fields->ptr, fields->len, align, pack, ctx);
+    }
     ndt_free(fields);
     return t;
 }
@@ -0,0 +1,669 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                             Pattern compiler                              */
+/*****************************************************************************/
+
+typedef struct {
+    ndt_pattern_instr_t *ops;
+    int64_t len;
+    int64_t alloc;
+    const char **names;
+    int nslots;
+    int salloc;
+} pattern_buf_t;
+
+static int64_t
+emit(pattern_buf_t *b, enum ndt_pattern_op op, int slot, int64_t n,
+     const ndt_t *type, ndt_context_t *ctx)
+{
+    ndt_pattern_instr_t *instr;
+
+    if (b->len == b->alloc) {
+        int64_t alloc = b->alloc == 0 ? 16 : 2 * b->alloc;
+        instr = ndt_realloc(b->ops, alloc, sizeof *instr);
+        if (instr == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        b->ops = instr;
+        b->alloc = alloc;
+    }
+
+    instr = &b->ops[b->len];
+    instr->op = op;
+    instr->slot = slot;
+    instr->n = n;
+    instr->type = type;
+
+    return b->len++;
+}
+
+/* Return the binding slot for 'name', allocating a new one if necessary. */
+static int
+slot(pattern_buf_t *b, const char *name, ndt_context_t *ctx)
+{
+    const char **names;
+    int i;
+
+    if (name == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < b->nslots; i++) {
+        if (strcmp(b->names[i], name) == 0) {
+            return i;
+        }
+    }
+
+    if (b->nslots == b->salloc) {
+        int alloc = b->salloc == 0 ? 4 : 2 * b->salloc;
+        names = ndt_realloc(b->names, alloc, sizeof *names);
+        if (names == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -2;
+        }
+        b->names = names;
+        b->salloc = alloc;
+    }
+
+    b->names[b->nslots] = name;
+    return b->nslots++;
+}
+
+static const char *
+dim_name(const ndt_t *t)
+{
+    switch (t->tag) {
+    case SymbolicDim:
+        return t->SymbolicDim.name;
+    case EllipsisDim:
+        return t->EllipsisDim.name;
+    default:
+        return NULL;
+    }
+}
+
+static int
+compile(pattern_buf_t *b, const ndt_t *p, ndt_context_t *ctx)
+{
+    const ndt_t *pdims[NDT_MAX_DIM];
+    const ndt_t *pdtype;
+    int64_t i;
+    int n, k;
+
+    switch (p->tag) {
+    case AnyKind:
+        return emit(b, PatAny, -1, 0, p, ctx) < 0 ? -1 : 0;
+
+    case FixedDim: case SymbolicDim: case VarDim: case EllipsisDim:
+        n = ndt_const_dims_dtype(pdims, &pdtype, p);
+        if (emit(b, PatDims, -1, n, p, ctx) < 0) {
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            k = slot(b, dim_name(pdims[i]), ctx);
+            if (k < -1 || emit(b, PatDim, k, 0, pdims[i], ctx) < 0) {
+                return -1;
+            }
+        }
+        return compile(b, pdtype, ctx);
+
+    case Tuple:
+        if (emit(b, PatTuple, -1, p->Tuple.shape, p, ctx) < 0) {
+            return -1;
+        }
+        for (i = 0; i < p->Tuple.shape; i++) {
+            if (compile(b, p->Tuple.types[i], ctx) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case Record:
+        if (emit(b, PatRecord, -1, p->Record.shape, p, ctx) < 0) {
+            return -1;
+        }
+        for (i = 0; i < p->Record.shape; i++) {
+            if (compile(b, p->Record.types[i], ctx) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case Pointer:
+        if (emit(b, PatPointer, -1, 1, p, ctx) < 0) {
+            return -1;
+        }
+        return compile(b, p->Pointer.type, ctx);
+
+    case Option:
+        if (emit(b, PatOption, -1, 1, p, ctx) < 0) {
+            return -1;
+        }
+        return compile(b, p->Option.type, ctx);
+
+    case OptionItem:
+        if (emit(b, PatOptionItem, -1, 1, p, ctx) < 0) {
+            return -1;
+        }
+        return compile(b, p->OptionItem.type, ctx);
+
+    case Function:
+        if (emit(b, PatFunction, -1, 3, p, ctx) < 0 ||
+            compile(b, p->Function.ret, ctx) < 0 ||
+            compile(b, p->Function.pos, ctx) < 0) {
+            return -1;
+        }
+        return compile(b, p->Function.kwds, ctx);
+
+    case Typevar:
+        k = slot(b, p->Typevar.name, ctx);
+        if (k < 0 || emit(b, PatTypevar, k, 0, p, ctx) < 0) {
+            return -1;
+        }
+        return 0;
+
+    default:
+        return emit(b, PatLeaf, -1, 0, p, ctx) < 0 ? -1 : 0;
+    }
+}
+
+/*
+ * Compile the pattern 'p'.  The result borrows 'p' and the names of its
+ * type variables and symbolic dimensions.
+ */
+ndt_pattern_t *
+ndt_pattern_compile(const ndt_t *p, ndt_context_t *ctx)
+{
+    pattern_buf_t b = {NULL, 0, 0, NULL, 0, 0};
+    ndt_pattern_t *m;
+
+    if (compile(&b, p, ctx) < 0) {
+        ndt_free(b.ops);
+        ndt_free(b.names);
+        return NULL;
+    }
+
+    m = ndt_alloc(1, offsetof(ndt_pattern_t, ops) + b.len * sizeof(ndt_pattern_instr_t));
+    if (m == NULL) {
+        ndt_free(b.ops);
+        ndt_free(b.names);
+        return ndt_memory_error(ctx);
+    }
+
+    m->nops = b.len;
+    m->nslots = b.nslots;
+    m->names = b.names;
+    memcpy(m->ops, b.ops, b.len * sizeof(ndt_pattern_instr_t));
+    ndt_free(b.ops);
+
+    return m;
+}
+
+void
+ndt_pattern_del(ndt_pattern_t *m)
+{
+    if (m != NULL) {
+        ndt_free(m->names);
+        ndt_free(m);
+    }
+}
+
+/* Return the binding slot of 'name' or -1 if the pattern does not use it. */
+int
+ndt_pattern_slot(const ndt_pattern_t *m, const char *name)
+{
+    int i;
+
+    for (i = 0; i < m->nslots; i++) {
+        if (strcmp(m->names[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/*****************************************************************************/
+/*                                  Matcher                                  */
+/*****************************************************************************/
+
+static const ndt_t *
+next_dim(const ndt_t *t)
+{
+    switch (t->tag) {
+    case FixedDim: return t->FixedDim.type;
+    case VarDim: return t->VarDim.type;
+    case SymbolicDim: return t->SymbolicDim.type;
+    case EllipsisDim: return t->EllipsisDim.type;
+    default: /* NOT REACHED */ abort();
+    }
+}
+
+static int
+dims_equal(const ndt_binding_t *v, const ndt_binding_t *w)
+{
+    const ndt_t *s = v->Dims.first;
+    const ndt_t *t = w->Dims.first;
+    int i;
+
+    if (v->Dims.size != w->Dims.size) {
+        return 0;
+    }
+
+    for (i = 0; i < v->Dims.size; i++) {
+        if (s->tag != t->tag) {
+            return 0;
+        }
+        if (s->tag == FixedDim && s->FixedDim.shape != t->FixedDim.shape) {
+            return 0;
+        }
+        if (s->tag == SymbolicDim &&
+            strcmp(s->SymbolicDim.name, t->SymbolicDim.name) != 0) {
+            return 0;
+        }
+        if (s->tag == EllipsisDim &&
+            strcmp(s->EllipsisDim.name, t->EllipsisDim.name) != 0) {
+            return 0;
+        }
+        s = next_dim(s);
+        t = next_dim(t);
+    }
+
+    return 1;
+}
+
+static int
+binding_equal(const ndt_binding_t *v, const ndt_binding_t *w)
+{
+    if (v->tag != w->tag) {
+        return 0;
+    }
+
+    switch (v->tag) {
+    case BindSize:
+        return v->Size == w->Size;
+    case BindSymbol:
+        return strcmp(v->Symbol, w->Symbol) == 0;
+    case BindType:
+        return ndt_equal(v->Type, w->Type);
+    case BindDims:
+        return dims_equal(v, w);
+    default:
+        return 0;
+    }
+}
+
+/* Bind slot 'k' or compare with the existing binding. */
+static int
+bind(ndt_binding_t b[], int k, ndt_binding_t w)
+{
+    if (b[k].tag == BindUnbound) {
+        b[k] = w;
+        return 1;
+    }
+
+    return binding_equal(&b[k], &w);
+}
+
+/*
+ * Same algorithm as match_dimensions() in match.c.  The pattern dimensions
+ * are the PatDim operations 'p', the bindings go to fixed slots.
+ */
+static int
+match_dims(const ndt_pattern_instr_t p[], int pshape,
+           const ndt_t *c[], int cshape, ndt_binding_t b[])
+{
+    ndt_binding_t v;
+    int stride = 1;
+    int i, j, k, tmp, first;
+    int n;
+
+    for (i=0, k=0; i!=pshape && k!=cshape; i+=stride, k+=stride) {
+        const ndt_t *t = p[i].type;
+
+        switch (t->tag) {
+        case EllipsisDim:
+            if (i == pshape-stride) {
+                if (p[i].slot >= 0) {
+                    int size = abs(cshape-k);
+
+                    if (size == 1 && c[k]->tag == EllipsisDim) {
+                        if (c[k]->EllipsisDim.name != NULL) {
+                            v.tag = BindSymbol;
+                            v.Symbol = c[k]->EllipsisDim.name;
+                            return bind(b, p[i].slot, v);
+                        }
+                        return 0;
+                    }
+
+                    first = stride == 1 ? k : cshape+1;
+                    for (j = 0; j < size; j++) {
+                        switch (c[first+j]->tag) {
+                        case FixedDim: case VarDim: case SymbolicDim:
+                            break;
+                        case EllipsisDim:
+                            if (c[first+j]->EllipsisDim.name != NULL) {
+                                break;
+                            }
+                            /* fall through */
+                        default:
+                            return 0;
+                        }
+                    }
+
+                    v.tag = BindDims;
+                    v.Dims.size = size;
+                    v.Dims.first = c[first];
+                    return bind(b, p[i].slot, v);
+                }
+
+                return 1;
+            }
+
+            tmp = pshape; pshape = i-1; i = tmp;
+            tmp = cshape; cshape = k-1; k = tmp;
+            stride = -1;
+            break;
+
+        case FixedDim:
+            if (c[k]->tag == FixedDim && t->FixedDim.shape == c[k]->FixedDim.shape)
+                break;
+            return 0;
+        case SymbolicDim:
+            switch (c[k]->tag) {
+            case FixedDim:
+                v.tag = BindSize;
+                v.Size = c[k]->FixedDim.shape;
+                break;
+            case SymbolicDim:
+                v.tag = BindSymbol;
+                v.Symbol = c[k]->SymbolicDim.name;
+                break;
+            default:
+                return 0;
+            }
+            n = bind(b, p[i].slot, v);
+            if (n == 1)
+                break;
+            return n;
+        case VarDim:
+            if (c[k]->tag == VarDim)
+                break;
+            return 0;
+        default: /* NOT REACHED */
+            abort();
+        }
+    }
+
+    if (k == cshape && pshape != i && p[i].type->tag == EllipsisDim) {
+        if (p[i].slot >= 0) {
+            v.tag = BindDims;
+            v.Dims.size = 0;
+            v.Dims.first = NULL;
+            return bind(b, p[i].slot, v);
+        }
+       return 1;
+    }
+
+    return i == pshape && k == cshape;
+}
+
+static int
+match_categorical(ndt_memory_t *p, size_t plen,
+                  ndt_memory_t *c, size_t clen)
+{
+    size_t i;
+
+    if (plen != clen) {
+        return 0;
+    }
+
+    for (i = 0; i < plen; i++) {
+        if (!ndt_memory_equal(&p[i], &c[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Kinds that only stand for scalars are instances of 'Scalar'. */
+static inline int
+is_scalar_kind(const ndt_t *t)
+{
+    switch (t->tag) {
+    case ScalarKind: case SignedKind: case UnsignedKind: case FloatKind:
+    case ComplexKind: case FixedStringKind: case FixedBytesKind:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Leaf cases of match_datashape() in match.c. */
+static int
+match_leaf(const ndt_t *p, const ndt_t *c)
+{
+    switch (p->tag) {
+    case Void: case Bool:
+    case Int8: case Int16: case Int32: case Int64:
+    case Uint8: case Uint16: case Uint32: case Uint64:
+    case Float16: case Float32: case Float64:
+    case Complex32: case Complex64: case Complex128:
+    case String:
+        return p->tag == c->tag;
+    case FixedString:
+        return c->tag == FixedString &&
+               p->FixedString.size == c->FixedString.size &&
+               p->FixedString.encoding == c->FixedString.encoding;
+    case FixedBytes:
+        return c->tag == FixedBytes &&
+               p->FixedBytes.size == c->FixedBytes.size &&
+               p->FixedBytes.align == c->FixedBytes.align;
+    case SignedKind:
+        return c->tag == SignedKind || ndt_is_signed(c);
+    case UnsignedKind:
+        return c->tag == UnsignedKind || ndt_is_unsigned(c);
+    case FloatKind:
+        return c->tag == FloatKind || ndt_is_float(c);
+    case ComplexKind:
+        return c->tag == ComplexKind || ndt_is_complex(c);
+    case FixedStringKind:
+        return c->tag == FixedStringKind || c->tag == FixedString;
+    case FixedBytesKind:
+        return c->tag == FixedBytesKind || c->tag == FixedBytes;
+    case ScalarKind:
+        return is_scalar_kind(c) || ndt_is_scalar(c);
+    case Char:
+        return c->tag == Char && c->Char.encoding == p->Char.encoding;
+    case Bytes:
+        return c->tag == Bytes && p->Bytes.target_align == c->Bytes.target_align;
+    case Categorical:
+        return c->tag == Categorical &&
+               match_categorical(p->Categorical.types, p->Categorical.ntypes,
+                                 c->Categorical.types, c->Categorical.ntypes);
+    case Nominal:
+        return c->tag == Nominal && strcmp(p->Nominal.name, c->Nominal.name) == 0;
+    case Constr:
+        return c->tag == Constr && strcmp(p->Constr.name, c->Constr.name) == 0 &&
+               ndt_equal(p->Constr.type, c->Constr.type);
+    default: /* NOT REACHED */
+        abort();
+    }
+}
+
+/* Match the subpattern at '*pc' and advance '*pc' past it. */
+static int
+exec(const ndt_pattern_instr_t ops[], int64_t *pc, const ndt_t *c,
+     ndt_binding_t b[])
+{
+    const ndt_pattern_instr_t *instr = &ops[*pc];
+    const ndt_t *p = instr->type;
+    int64_t i, k;
+    int n;
+
+    *pc += instr->op == PatDims ? 1 + instr->n : 1;
+
+    switch (instr->op) {
+    case PatAny:
+        return 1;
+
+    case PatLeaf:
+        return match_leaf(p, c);
+
+    case PatDims: {
+        const ndt_t *cdims[NDT_MAX_DIM];
+        const ndt_t *cdtype;
+        int cn;
+
+        if (!ndt_is_array(c)) return 0;
+        if (ndt_is_optional(c) != ndt_is_optional(p)) return 0;
+        if (ndt_is_column_major(c) != ndt_is_column_major(p)) return 0;
+
+        cn = ndt_const_dims_dtype(cdims, &cdtype, c);
+        n = match_dims(instr+1, (int)instr->n, cdims, cn, b);
+        if (n <= 0) return n;
+
+        return exec(ops, pc, cdtype, b);
+    }
+
+    case PatTuple:
+        if (c->tag != Tuple) return 0;
+        if (p->Tuple.flag == Variadic ? c->Tuple.shape < instr->n :
+            c->Tuple.flag == Variadic || c->Tuple.shape != instr->n) {
+            return 0;
+        }
+        for (i = 0; i < instr->n; i++) {
+            n = exec(ops, pc, c->Tuple.types[i], b);
+            if (n <= 0) return n;
+        }
+        return 1;
+
+    case PatRecord:
+        if (c->tag != Record) return 0;
+        if (p->Record.flag == Variadic) {
+            for (i = 0; i < instr->n; i++) {
+                k = ndt_record_field(c, p->Record.names[i]);
+                if (k < 0) return 0;
+                n = exec(ops, pc, c->Record.types[k], b);
+                if (n <= 0) return n;
+            }
+            return 1;
+        }
+        if (c->Record.flag == Variadic || c->Record.shape != instr->n) return 0;
+        for (i = 0; i < instr->n; i++) {
+            if (strcmp(p->Record.names[i], c->Record.names[i]) != 0) return 0;
+            n = exec(ops, pc, c->Record.types[i], b);
+            if (n <= 0) return n;
+        }
+        return 1;
+
+    case PatPointer:
+        if (c->tag != Pointer) return 0;
+        return exec(ops, pc, c->Pointer.type, b);
+
+    case PatOption:
+        if (c->tag != Option) return 0;
+        return exec(ops, pc, c->Option.type, b);
+
+    case PatOptionItem:
+        if (c->tag != OptionItem) return 0;
+        return exec(ops, pc, c->OptionItem.type, b);
+
+    case PatFunction:
+        if (c->tag != Function) return 0;
+        n = exec(ops, pc, c->Function.ret, b);
+        if (n <= 0) return n;
+        n = exec(ops, pc, c->Function.pos, b);
+        if (n <= 0) return n;
+        return exec(ops, pc, c->Function.kwds, b);
+
+    case PatTypevar: {
+        ndt_binding_t v;
+        if (c->tag == Typevar) {
+            v.tag = BindSymbol;
+            v.Symbol = c->Typevar.name;
+        }
+        else {
+            v.tag = BindType;
+            v.Type = c;
+        }
+        return bind(b, instr->slot, v);
+    }
+
+    default: /* NOT REACHED */
+        abort();
+    }
+}
+
+/*
+ * Match 'c' against the compiled pattern 'm'.  'bindings' must have room for
+ * 'm->nslots' entries and may be NULL if the pattern has no slots.  On a
+ * match, the bindings are filled in and 1 is returned.  Otherwise, the
+ * contents of 'bindings' are unspecified and 0 is returned.  No memory is
+ * allocated.
+ */
+int
+ndt_pattern_match(const ndt_pattern_t *m, const ndt_t *c,
+                  ndt_binding_t bindings[], ndt_context_t *ctx)
+{
+    int64_t pc = 0;
+    int i;
+
+    if (m->nslots > 0 && bindings == NULL) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError,
+                       "ndt_pattern_match: missing bindings");
+        return -1;
+    }
+
+    for (i = 0; i < m->nslots; i++) {
+        bindings[i].tag = BindUnbound;
+    }
+
+    if (!ndt_may_match(m->ops[0].type, c)) {
+        return 0;
+    }
+
+    return exec(m->ops, &pc, c, bindings);
+}
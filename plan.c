@@ -0,0 +1,408 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                               Plan compiler                               */
+/*****************************************************************************/
+
+typedef struct {
+    ndt_instr_t *instr;
+    int64_t len;
+    int64_t alloc;
+    int64_t depth;
+} plan_buf_t;
+
+static int64_t
+emit(plan_buf_t *b, enum ndt_plan_op op, int64_t offset, int64_t shape,
+     int64_t stride, int64_t size, const ndt_t *type, ndt_context_t *ctx)
+{
+    ndt_instr_t *instr;
+
+    if (b->len == b->alloc) {
+        int64_t alloc = b->alloc == 0 ? 16 : 2 * b->alloc;
+        instr = ndt_realloc(b->instr, alloc, sizeof *instr);
+        if (instr == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        b->instr = instr;
+        b->alloc = alloc;
+    }
+
+    instr = &b->instr[b->len];
+    instr->op = op;
+    instr->jump = -1;
+    instr->offset = offset;
+    instr->shape = shape;
+    instr->stride = stride;
+    instr->size = size;
+    instr->type = type;
+
+    return b->len++;
+}
+
+/*
+ * Dimensions with an 'align' attribute are padded at the end.  Var dimensions
+ * share a single data block, so the padding is determined by the outermost
+ * one.  Return the end of the elements and set 'pad' to the number of bytes
+ * that follow.
+ */
+static int64_t
+dim_data_end(const ndt_t *t, int64_t *pad)
+{
+    const ndt_t *u = t;
+    int64_t end;
+
+    if (t->tag == FixedDim) {
+        end = t->FixedDim.shape * t->Concrete.FixedDim.stride;
+        *pad = ndt_is_ndarray(t) ? 0 : t->data_size - end;
+        return end;
+    }
+
+    while (u->VarDim.type->tag == VarDim) {
+        u = u->VarDim.type;
+    }
+
+    end = u->Concrete.VarDim.offsets[u->Concrete.VarDim.nshapes] *
+          u->Concrete.VarDim.itemsize;
+    *pad = t->data_size - end;
+    return end;
+}
+
+static int
+compile(plan_buf_t *b, const ndt_t *t, int64_t offset, int64_t depth,
+        ndt_context_t *ctx)
+{
+    int64_t pad;
+    const ndt_t *u;
+    int64_t shape, stride;
+    int64_t start, end;
+    int64_t i;
+
+    switch (t->tag) {
+    case FixedDim:
+        shape = t->FixedDim.shape;
+        stride = t->Concrete.FixedDim.stride;
+        u = t->FixedDim.type;
+
+        /* Fuse contiguous loops. */
+        while (u->tag == FixedDim &&
+               stride == u->FixedDim.shape * u->Concrete.FixedDim.stride) {
+            shape *= u->FixedDim.shape;
+            stride = u->Concrete.FixedDim.stride;
+            u = u->FixedDim.type;
+        }
+
+        start = emit(b, PlanLoop, offset + t->Concrete.FixedDim.offset,
+                     shape, stride, 0, t, ctx);
+        if (start < 0) {
+            return -1;
+        }
+        goto loop_body;
+
+    case VarDim:
+        u = t->VarDim.type;
+        start = emit(b, PlanVarLoop, offset, 0, t->Concrete.VarDim.itemsize, 0,
+                     t, ctx);
+        if (start < 0) {
+            return -1;
+        }
+
+    loop_body:
+        if (depth + 1 > b->depth) {
+            b->depth = depth + 1;
+        }
+        if (compile(b, u, 0, depth+1, ctx) < 0) {
+            return -1;
+        }
+        end = emit(b, PlanEndLoop, 0, 0, 0, 0, t, ctx);
+        if (end < 0) {
+            return -1;
+        }
+        b->instr[end].jump = start + 1;
+        b->instr[start].jump = end + 1;
+
+        /* nested var dimensions are part of the outermost one */
+        if (t->tag == VarDim && depth > 0) {
+            return 0;
+        }
+        end = dim_data_end(t, &pad);
+        if (pad > 0 &&
+            emit(b, PlanPad, offset + end, 0, 0, pad, NULL, ctx) < 0) {
+            return -1;
+        }
+        return 0;
+
+    case Tuple:
+        for (i = 0; i < t->Tuple.shape; i++) {
+            u = t->Tuple.types[i];
+            if (compile(b, u, offset + t->Concrete.Tuple.offset[i], depth, ctx) < 0) {
+                return -1;
+            }
+            if (t->Concrete.Tuple.pad[i] > 0 &&
+                emit(b, PlanPad,
+                     offset + t->Concrete.Tuple.offset[i] + u->data_size,
+                     0, 0, t->Concrete.Tuple.pad[i], NULL, ctx) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case Record:
+        for (i = 0; i < t->Record.shape; i++) {
+            u = t->Record.types[i];
+            if (compile(b, u, offset + t->Concrete.Record.offset[i], depth, ctx) < 0) {
+                return -1;
+            }
+            if (t->Concrete.Record.pad[i] > 0 &&
+                emit(b, PlanPad,
+                     offset + t->Concrete.Record.offset[i] + u->data_size,
+                     0, 0, t->Concrete.Record.pad[i], NULL, ctx) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case Option:
+        return compile(b, t->Option.type, offset, depth, ctx);
+
+    case OptionItem:
+        return compile(b, t->OptionItem.type, offset, depth, ctx);
+
+    case Constr:
+        return compile(b, t->Constr.type, offset, depth, ctx);
+
+    case Nominal:
+        return compile(b, t->Nominal.type, offset, depth, ctx);
+
+    default:
+        return emit(b, PlanVisit, offset, 0, 0, t->data_size, t, ctx) < 0 ? -1 : 0;
+    }
+}
+
+/*
+ * Compile a concrete type into a flat instruction array.  Contiguous fixed
+ * dimensions are fused into a single loop.  Option, constructor and nominal
+ * types are transparent, all other types that are not dimensions, tuples or
+ * records are visited as items.
+ */
+ndt_plan_t *
+ndt_compile_plan(const ndt_t *t, ndt_context_t *ctx)
+{
+    plan_buf_t b = {NULL, 0, 0, 0};
+    ndt_plan_t *plan;
+
+    if (ndt_is_abstract(t)) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_compile_plan: type must be concrete");
+        return NULL;
+    }
+
+    if (compile(&b, t, 0, 0, ctx) < 0) {
+        ndt_free(b.instr);
+        return NULL;
+    }
+
+    plan = ndt_alloc(1, offsetof(ndt_plan_t, instr) + b.len * sizeof(ndt_instr_t));
+    if (plan == NULL) {
+        ndt_free(b.instr);
+        return ndt_memory_error(ctx);
+    }
+
+    plan->ninstr = b.len;
+    plan->depth = b.depth;
+    if (b.len > 0) {
+        memcpy(plan->instr, b.instr, b.len * sizeof(ndt_instr_t));
+    }
+    ndt_free(b.instr);
+
+    return plan;
+}
+
+void
+ndt_plan_del(ndt_plan_t *plan)
+{
+    ndt_free(plan);
+}
+
+
+/*****************************************************************************/
+/*                                Interpreter                                */
+/*****************************************************************************/
+
+typedef struct {
+    int64_t remaining; /* remaining iterations */
+    int64_t stride;    /* 0: the loop advances the row of a var dimension */
+    int64_t base;      /* saved base of the enclosing element */
+    int64_t row;       /* saved row of the enclosing var dimension */
+} frame_t;
+
+/*
+ * Execute 'plan' for a memory block at 'base'.  'f' is called with the
+ * absolute offset of each item and of each padding region.
+ *
+ * Fixed dimensions and var dimensions of items advance the base by the
+ * stride.  Var dimensions that contain other var dimensions advance the
+ * row that is used by the inner var dimension.
+ */
+int
+ndt_plan_exec(const ndt_plan_t *plan, int64_t base, ndt_visit_f f, void *arg,
+              ndt_context_t *ctx)
+{
+    frame_t stack[NDT_MAX_DIM];
+    frame_t *frames = stack;
+    frame_t *top = frames - 1;
+    const ndt_instr_t *instr = plan->instr;
+    const ndt_instr_t *end = plan->instr + plan->ninstr;
+    const ndt_t *var;
+    int64_t row = 0;
+    int64_t lo, n;
+    int ret = -1;
+
+    if (plan->depth > NDT_MAX_DIM) {
+        frames = ndt_alloc(plan->depth, sizeof *frames);
+        if (frames == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        top = frames - 1;
+    }
+
+    while (instr < end) {
+        switch (instr->op) {
+        case PlanVisit:
+            if (f(instr->type, base + instr->offset, instr->size, arg) < 0) {
+                goto out;
+            }
+            instr++;
+            break;
+
+        case PlanPad:
+            if (f(NULL, base + instr->offset, instr->size, arg) < 0) {
+                goto out;
+            }
+            instr++;
+            break;
+
+        case PlanLoop:
+            if (instr->shape == 0) {
+                instr = plan->instr + instr->jump;
+                break;
+            }
+            if (instr[1].op == PlanVisit && instr[2].op == PlanEndLoop) {
+                /* innermost loop over items */
+                const ndt_instr_t *item = instr + 1;
+                int64_t offset = base + instr->offset + item->offset;
+                for (n = 0; n < instr->shape; n++) {
+                    if (f(item->type, offset, item->size, arg) < 0) {
+                        goto out;
+                    }
+                    offset += instr->stride;
+                }
+                instr += 3;
+                break;
+            }
+            top++;
+            top->remaining = instr->shape;
+            top->stride = instr->stride;
+            top->base = base;
+            top->row = row;
+            base += instr->offset;
+            instr++;
+            break;
+
+        case PlanVarLoop:
+            var = instr->type;
+            if (row >= var->Concrete.VarDim.nshapes) {
+                ndt_err_format(ctx, NDT_RuntimeError,
+                               "ndt_plan_exec: invalid var dimension");
+                goto out;
+            }
+            lo = var->Concrete.VarDim.offsets[row];
+            n = var->Concrete.VarDim.shapes[row];
+            if (n == 0 || (var->Concrete.VarDim.bitmap &&
+                !(var->Concrete.VarDim.bitmap[row / 8] & ((uint8_t)1 << (row % 8))))) {
+                instr = plan->instr + instr->jump;
+                break;
+            }
+            top++;
+            top->remaining = n;
+            top->base = base;
+            top->row = row;
+            if (var->VarDim.type->tag == VarDim) {
+                top->stride = 0;
+                row = lo;
+            }
+            else {
+                top->stride = instr->stride;
+                base += instr->offset + lo * instr->stride;
+            }
+            instr++;
+            break;
+
+        case PlanEndLoop:
+            if (--top->remaining > 0) {
+                if (top->stride == 0) {
+                    row++;
+                }
+                else {
+                    base += top->stride;
+                }
+                instr = plan->instr + instr->jump;
+            }
+            else {
+                base = top->base;
+                row = top->row;
+                top--;
+                instr++;
+            }
+            break;
+        }
+    }
+
+    ret = 0;
+
+out:
+    if (frames != stack) {
+        ndt_free(frames);
+    }
+    return ret;
+}
@@ -0,0 +1,437 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include "ndtypes.h"
+#include "print.h"
+
+
+/*****************************************************************************/
+/*                          Output buffer for printers                       */
+/*****************************************************************************/
+
+#define BUF_MIN 256
+
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* Make room for 'n' more bytes and the terminating NUL. */
+static int
+buf_grow(buf_t *buf, size_t n, ndt_context_t *ctx)
+{
+    size_t alloc = buf->alloc < BUF_MIN ? BUF_MIN : buf->alloc;
+    char *data;
+
+    if (n >= SIZE_MAX - buf->len) {
+        (void)ndt_memory_error(ctx);
+        return -1;
+    }
+
+    while (alloc - buf->len <= n) {
+        if (alloc > SIZE_MAX / 2) {
+            alloc = buf->len + n + 1;
+            break;
+        }
+        alloc *= 2;
+    }
+
+    data = ndt_realloc(buf->data, alloc, 1);
+    if (data == NULL) {
+        (void)ndt_memory_error(ctx);
+        return -1;
+    }
+
+    buf->data = data;
+    buf->alloc = alloc;
+    buf->end = buf->limit < alloc - 1 ? buf->limit + 1 : alloc;
+
+    return 0;
+}
+
+/* Stream the output to 'write' through 'data'. */
+void
+buf_sink(buf_t *buf, char *data, ndt_write_f write, void *arg)
+{
+    buf_t init = BUF_INIT;
+
+    *buf = init;
+    buf->data = data;
+    buf->alloc = buf->end = PRINT_BUFSIZE;
+    buf->write = write;
+    buf->arg = arg;
+}
+
+/* Bound the output, zero members of 'limits' mean no bound. */
+int
+buf_limit(buf_t *buf, const ndt_limits_t *limits, ndt_context_t *ctx)
+{
+    if ((limits->max_width != 0 && limits->max_width < 3) ||
+        limits->max_items < 0 || limits->max_depth < 0) {
+        ndt_err_format(ctx, NDT_InvalidArgumentError, "invalid print limits");
+        return -1;
+    }
+
+    if (limits->max_width > 0 && (uint64_t)limits->max_width < SIZE_MAX) {
+        buf->limit = (size_t)limits->max_width;
+    }
+    if (limits->max_items > 0) {
+        buf->max_items = limits->max_items;
+    }
+    if (limits->max_depth > 0) {
+        buf->max_depth = limits->max_depth;
+    }
+
+    return 0;
+}
+
+static int
+sink_write(buf_t *buf, const char *s, size_t n, ndt_context_t *ctx)
+{
+    if (buf->write(s, n, buf->arg) < 0) {
+        ndt_err_format(ctx, NDT_OSError, "ndt_print: write error");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Pass the buffered output to the sink. */
+int
+buf_flush(buf_t *buf, ndt_context_t *ctx)
+{
+    size_t len = buf->len;
+
+    if (buf->write == NULL || len == 0) {
+        return 0;
+    }
+
+    buf->len = 0;
+    return sink_write(buf, buf->data, len, ctx);
+}
+
+/*
+ * Make room for 'n' more bytes and the terminating NUL.  The fixed buffer
+ * of a sink is flushed instead, which may leave less room.
+ */
+static int
+buf_reserve(buf_t *buf, size_t n, ndt_context_t *ctx)
+{
+    if (buf->write == NULL) {
+        return buf_grow(buf, n, ctx);
+    }
+
+    return buf_flush(buf, ctx);
+}
+
+/* Replace the last bytes of the output by an ellipsis and drop the rest. */
+static int
+buf_cut(buf_t *buf)
+{
+    memcpy(buf->data + buf->len - 3, "...", 3);
+    buf->end = buf->len;
+    buf->full = 1;
+
+    return 0;
+}
+
+/* Append 'n' bytes if the buffer is full or the output must be cut. */
+int
+buf_write_slow(buf_t *buf, const char *s, size_t n, ndt_context_t *ctx)
+{
+    int cut = 0;
+
+    if (buf->full) {
+        return 0;
+    }
+
+    if (n > buf->limit - buf->len) {
+        n = buf->limit - buf->len;
+        cut = 1;
+    }
+
+    if (buf->alloc - buf->len <= n) {
+        if (buf_reserve(buf, n, ctx) < 0) {
+            return -1;
+        }
+        if (buf->alloc - buf->len <= n) {
+            return sink_write(buf, s, n, ctx);
+        }
+    }
+
+    memcpy(buf->data + buf->len, s, n);
+    buf->len += n;
+
+    return cut ? buf_cut(buf) : 0;
+}
+
+/* Append 'n' spaces, nothing if 'n' is negative. */
+int
+buf_indent(buf_t *buf, int n, ndt_context_t *ctx)
+{
+    int cut = 0;
+    size_t k, m;
+
+    if (n <= 0 || buf->full) {
+        return 0;
+    }
+
+    m = (size_t)n;
+    if (m > buf->limit - buf->len) {
+        m = buf->limit - buf->len;
+        cut = 1;
+    }
+
+    for (; m > 0; m -= k) {
+        if (buf->alloc - buf->len <= m && buf_reserve(buf, m, ctx) < 0) {
+            return -1;
+        }
+
+        k = buf->alloc - buf->len - 1;
+        if (k > m) {
+            k = m;
+        }
+
+        memset(buf->data + buf->len, ' ', k);
+        buf->len += k;
+    }
+
+    return cut ? buf_cut(buf) : 0;
+}
+
+/* Format 'v' backwards from 'end', two digits at a time. */
+static char *
+format_uint64(char *end, uint64_t v)
+{
+    char *p = end;
+    unsigned int k;
+
+    while (v >= 100) {
+        k = (unsigned int)(v % 100) * 2;
+        v /= 100;
+        *--p = digit_pairs[k+1];
+        *--p = digit_pairs[k];
+    }
+
+    if (v >= 10) {
+        k = (unsigned int)v * 2;
+        *--p = digit_pairs[k+1];
+        *--p = digit_pairs[k];
+    }
+    else {
+        *--p = (char)('0' + v);
+    }
+
+    return p;
+}
+
+int
+buf_uint64(buf_t *buf, uint64_t v, ndt_context_t *ctx)
+{
+    char s[20];
+    char *p = format_uint64(s + sizeof s, v);
+
+    return buf_write(buf, p, (size_t)(s + sizeof s - p), ctx);
+}
+
+int
+buf_int64(buf_t *buf, int64_t v, ndt_context_t *ctx)
+{
+    char s[21];
+    char *p;
+
+    if (v < 0) {
+        p = format_uint64(s + sizeof s, -(uint64_t)v);
+        *--p = '-';
+    }
+    else {
+        p = format_uint64(s + sizeof s, (uint64_t)v);
+    }
+
+    return buf_write(buf, p, (size_t)(s + sizeof s - p), ctx);
+}
+
+static int
+format_error(ndt_context_t *ctx)
+{
+    if (errno == ENOMEM) {
+        ndt_err_format(ctx, NDT_MemoryError, "out of memory");
+    }
+    else {
+        ndt_err_format(ctx, NDT_OSError, "ndt_as_string: output error");
+    }
+
+    return -1;
+}
+
+/* Format output that does not fit into the fixed buffer of a sink. */
+static int
+sink_vprintf(buf_t *buf, size_t size, ndt_context_t *ctx, const char *fmt,
+             va_list ap)
+{
+    char *s;
+    int n;
+
+    s = ndt_alloc(size, 1);
+    if (s == NULL) {
+        (void)ndt_memory_error(ctx);
+        return -1;
+    }
+
+    errno = 0;
+    n = vsnprintf(s, size, fmt, ap);
+    if (n < 0) {
+        ndt_free(s);
+        return format_error(ctx);
+    }
+
+    n = sink_write(buf, s, (size_t)n, ctx);
+    ndt_free(s);
+
+    return n;
+}
+
+int
+buf_vprintf(buf_t *buf, ndt_context_t *ctx, const char *fmt, va_list ap)
+{
+    va_list aq;
+    int n;
+
+    if (buf->full) {
+        return 0;
+    }
+
+    if (buf->alloc - buf->len <= 1 && buf_reserve(buf, 1, ctx) < 0) {
+        return -1;
+    }
+
+    va_copy(aq, ap);
+    errno = 0;
+    n = vsnprintf(buf->data + buf->len, buf->alloc - buf->len, fmt, aq);
+    va_end(aq);
+
+    if (n >= 0 && (size_t)n >= buf->alloc - buf->len) {
+        if (buf_reserve(buf, (size_t)n, ctx) < 0) {
+            return -1;
+        }
+        if ((size_t)n >= buf->alloc - buf->len) {
+            return sink_vprintf(buf, (size_t)n + 1, ctx, fmt, ap);
+        }
+        errno = 0;
+        n = vsnprintf(buf->data + buf->len, buf->alloc - buf->len, fmt, ap);
+    }
+
+    if (n < 0) {
+        return format_error(ctx);
+    }
+
+    if ((size_t)n > buf->limit - buf->len) {
+        buf->len = buf->limit;
+        return buf_cut(buf);
+    }
+
+    buf->len += (size_t)n;
+
+    return 0;
+}
+
+int
+buf_printf(buf_t *buf, ndt_context_t *ctx, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = buf_vprintf(buf, ctx, fmt, ap);
+    va_end(ap);
+
+    return n;
+}
+
+/* Terminate the output and return it.  The buffer is reset. */
+char *
+buf_finish(buf_t *buf, ndt_context_t *ctx)
+{
+    char *s;
+
+    if (buf->alloc - buf->len < 1 && buf_grow(buf, 0, ctx) < 0) {
+        buf_clear(buf);
+        return NULL;
+    }
+
+    s = buf->data;
+    s[buf->len] = '\0';
+
+    buf->data = NULL;
+    buf->len = buf->alloc = buf->end = 0;
+
+    return s;
+}
+
+void
+buf_clear(buf_t *buf)
+{
+    ndt_free(buf->data);
+    buf->data = NULL;
+    buf->len = buf->alloc = buf->end = 0;
+}
+
+
+/*****************************************************************************/
+/*                                  Sinks                                    */
+/*****************************************************************************/
+
+int
+ndt_write_file(const char *s, size_t n, void *arg)
+{
+    FILE *fp = arg;
+
+    if (fwrite(s, 1, n, fp) != n) {
+        return -1;
+    }
+
+    return 0;
+}
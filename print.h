@@ -0,0 +1,115 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef PRINT_H
+#define PRINT_H
+
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <string.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                          Output buffer for printers                       */
+/*****************************************************************************/
+
+/*
+ * The printers write once into a buffer that grows geometrically.  Literals
+ * and names are copied with memcpy, integers are formatted directly and
+ * only floating point values go through vsnprintf.  The buffer always has
+ * room for a terminating NUL.
+ *
+ * If 'write' is set, 'data' is a fixed buffer of PRINT_BUFSIZE bytes that
+ * is passed to 'write' whenever it is full.
+ *
+ * Output beyond 'limit' is dropped and the last three bytes that fit are
+ * replaced by "...".  Writes that reach 'end', the smaller of the size and
+ * the limit, take the slow path.  The printers stop walking the type once
+ * the buffer is 'full'.  Limits are only set for buffers without a sink.
+ */
+typedef struct {
+    char *data;        /* output */
+    size_t len;        /* number of bytes written */
+    size_t alloc;      /* size of 'data' */
+    ndt_write_f write; /* sink or NULL */
+    void *arg;
+    size_t end;        /* end of the fast path */
+    size_t limit;      /* maximum number of bytes */
+    int full;          /* the output has been cut */
+    int64_t max_items; /* maximum number of list elements */
+    int max_depth;     /* maximum nesting depth */
+    int depth;         /* current nesting depth */
+} buf_t;
+
+#define BUF_INIT {NULL, 0, 0, NULL, NULL, 0, SIZE_MAX, 0, INT64_MAX, INT_MAX, 0}
+
+#define PRINT_BUFSIZE 4096
+
+void buf_sink(buf_t *buf, char *data, ndt_write_f write, void *arg);
+int buf_limit(buf_t *buf, const ndt_limits_t *limits, ndt_context_t *ctx);
+int buf_flush(buf_t *buf, ndt_context_t *ctx);
+int buf_write_slow(buf_t *buf, const char *s, size_t n, ndt_context_t *ctx);
+int buf_indent(buf_t *buf, int n, ndt_context_t *ctx);
+int buf_int64(buf_t *buf, int64_t v, ndt_context_t *ctx);
+int buf_uint64(buf_t *buf, uint64_t v, ndt_context_t *ctx);
+int buf_vprintf(buf_t *buf, ndt_context_t *ctx, const char *fmt, va_list ap);
+int buf_printf(buf_t *buf, ndt_context_t *ctx, const char *fmt, ...);
+char *buf_finish(buf_t *buf, ndt_context_t *ctx);
+void buf_clear(buf_t *buf);
+
+/* Append 'n' bytes. */
+static inline int
+buf_write(buf_t *buf, const char *s, size_t n, ndt_context_t *ctx)
+{
+    if (buf->end - buf->len <= n) {
+        return buf_write_slow(buf, s, n, ctx);
+    }
+
+    memcpy(buf->data + buf->len, s, n);
+    buf->len += n;
+
+    return 0;
+}
+
+/* Append a string.  For literals the length is known at compile time. */
+static inline int
+buf_puts(buf_t *buf, const char *s, ndt_context_t *ctx)
+{
+    return buf_write(buf, s, strlen(s), ctx);
+}
+
+
+#endif /* PRINT_H */
@@ -0,0 +1,460 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "symtable.h"
+
+
+/*****************************************************************************/
+/*                           Specificity ordering                            */
+/*****************************************************************************/
+
+/*
+ * 'p' is at least as specific as 'q' if 'p' is an instance of 'q': the
+ * variables of 'q' can be bound such that 'q' becomes 'p'.  The variables of
+ * 'p' are treated as constants.  Kinds follow the hierarchy in enum ndt,
+ * e.g. int64 is an instance of Signed, Signed of Scalar and Scalar of Any.
+ * Fixed dimensions are instances of symbolic dimensions, and any sequence
+ * of dimensions is an instance of an ellipsis.
+ */
+
+static int instance(const ndt_t *p, const ndt_t *q, symtable_t *tbl,
+                    ndt_context_t *ctx);
+
+/* Parent of 'tag' in the kind hierarchy. */
+static enum ndt
+kind_parent(enum ndt tag)
+{
+    switch (tag) {
+    case Int8: case Int16: case Int32: case Int64:
+        return SignedKind;
+    case Uint8: case Uint16: case Uint32: case Uint64:
+        return UnsignedKind;
+    case Float16: case Float32: case Float64:
+        return FloatKind;
+    case Complex32: case Complex64: case Complex128:
+        return ComplexKind;
+    case FixedString:
+        return FixedStringKind;
+    case FixedBytes:
+        return FixedBytesKind;
+    case SignedKind: case UnsignedKind: case FloatKind: case ComplexKind:
+    case FixedStringKind: case FixedBytesKind:
+    case Void: case Bool: case String:
+        return ScalarKind;
+    default:
+        return AnyKind;
+    }
+}
+
+static int
+below_kind(enum ndt tag, enum ndt kind)
+{
+    while (tag != kind && tag != AnyKind) {
+        tag = kind_parent(tag);
+    }
+
+    return tag == kind;
+}
+
+static int
+dim_equal(const ndt_t *s, const ndt_t *t)
+{
+    if (s->tag != t->tag || ndt_is_optional(s) != ndt_is_optional(t)) {
+        return 0;
+    }
+
+    switch (s->tag) {
+    case FixedDim:
+        return s->FixedDim.shape == t->FixedDim.shape;
+    case SymbolicDim:
+        return strcmp(s->SymbolicDim.name, t->SymbolicDim.name) == 0;
+    case EllipsisDim:
+        return s->EllipsisDim.name != NULL && t->EllipsisDim.name != NULL &&
+               strcmp(s->EllipsisDim.name, t->EllipsisDim.name) == 0;
+    default:
+        return 1;
+    }
+}
+
+static int
+entry_equal(const symtable_entry_t *v, const symtable_entry_t *w)
+{
+    int i;
+
+    if (v->tag != w->tag) {
+        return 0;
+    }
+
+    switch (v->tag) {
+    case SizeEntry:
+        return v->SizeEntry == w->SizeEntry;
+    case SymbolEntry:
+        return strcmp(v->SymbolEntry, w->SymbolEntry) == 0;
+    case TypeEntry:
+        return ndt_equal(v->TypeEntry, w->TypeEntry);
+    case DimListEntry:
+        if (v->DimListEntry.size != w->DimListEntry.size) {
+            return 0;
+        }
+        for (i = 0; i < v->DimListEntry.size; i++) {
+            if (!dim_equal(v->DimListEntry.dims[i], w->DimListEntry.dims[i])) {
+                return 0;
+            }
+        }
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Bind the variable 'key' of 'q' or compare with its binding. */
+static int
+bind(const char *key, symtable_entry_t w, symtable_t *tbl, ndt_context_t *ctx)
+{
+    symtable_entry_t v;
+    int n;
+
+    v = symtable_find(tbl, key);
+    if (v.tag == Unbound) {
+        if (symtable_add(tbl, key, w, ctx) < 0) {
+            symtable_free_entry(w);
+            return -1;
+        }
+        return 1;
+    }
+
+    n = entry_equal(&v, &w);
+    symtable_free_entry(w);
+    return n;
+}
+
+static int
+instance_dim(const ndt_t *p, const ndt_t *q, symtable_t *tbl, ndt_context_t *ctx)
+{
+    symtable_entry_t w;
+
+    if (ndt_is_optional(p) != ndt_is_optional(q)) {
+        return 0;
+    }
+
+    switch (q->tag) {
+    case FixedDim:
+        return p->tag == FixedDim && p->FixedDim.shape == q->FixedDim.shape;
+    case VarDim:
+        return p->tag == VarDim;
+    case SymbolicDim:
+        switch (p->tag) {
+        case FixedDim:
+            w.tag = SizeEntry;
+            w.SizeEntry = p->FixedDim.shape;
+            break;
+        case SymbolicDim:
+            w.tag = SymbolEntry;
+            w.SymbolEntry = p->SymbolicDim.name;
+            break;
+        default:
+            return 0;
+        }
+        return bind(q->SymbolicDim.name, w, tbl, ctx);
+    default:
+        return 0;
+    }
+}
+
+static int
+find_ellipsis(const ndt_t *dims[], int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (dims[i]->tag == EllipsisDim) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int
+instance_dims(const ndt_t *p[], int pn, const ndt_t *q[], int qn,
+              symtable_t *tbl, ndt_context_t *ctx)
+{
+    symtable_entry_t w;
+    int ep = find_ellipsis(p, pn);
+    int eq = find_ellipsis(q, qn);
+    int post, size, i, n;
+
+    if (eq < 0) {
+        if (ep >= 0 || pn != qn) {
+            return 0;
+        }
+        for (i = 0; i < qn; i++) {
+            n = instance_dim(p[i], q[i], tbl, ctx);
+            if (n <= 0) return n;
+        }
+        return 1;
+    }
+
+    /* the ellipsis of 'q' must cover the ellipsis of 'p' */
+    post = qn - eq - 1;
+    if (pn < eq + post || (ep >= 0 && (ep < eq || pn - ep - 1 < post))) {
+        return 0;
+    }
+
+    for (i = 0; i < eq; i++) {
+        n = instance_dim(p[i], q[i], tbl, ctx);
+        if (n <= 0) return n;
+    }
+
+    for (i = 1; i <= post; i++) {
+        n = instance_dim(p[pn-i], q[qn-i], tbl, ctx);
+        if (n <= 0) return n;
+    }
+
+    if (q[eq]->EllipsisDim.name == NULL) {
+        return 1;
+    }
+
+    size = pn - eq - post;
+    w.tag = DimListEntry;
+    w.DimListEntry.size = size;
+    w.DimListEntry.dims = NULL;
+
+    if (size > 0) {
+        w.DimListEntry.dims = ndt_alloc(size, sizeof *w.DimListEntry.dims);
+        if (w.DimListEntry.dims == NULL) {
+            (void)ndt_memory_error(ctx);
+            return -1;
+        }
+        memcpy(w.DimListEntry.dims, p+eq, size * sizeof *w.DimListEntry.dims);
+    }
+
+    return bind(q[eq]->EllipsisDim.name, w, tbl, ctx);
+}
+
+/*
+ * A variadic tuple stands for all tuples that start with its fields, a
+ * variadic record for all records that contain its fields.
+ */
+static int
+instance_fields(const ndt_t *p, const ndt_t *q, symtable_t *tbl, ndt_context_t *ctx)
+{
+    int64_t i, k;
+    int n;
+
+    if (p->tag == Tuple) {
+        if (q->Tuple.flag == Variadic ? p->Tuple.shape < q->Tuple.shape :
+            p->Tuple.flag == Variadic || p->Tuple.shape != q->Tuple.shape) {
+            return 0;
+        }
+        for (i = 0; i < q->Tuple.shape; i++) {
+            n = instance(p->Tuple.types[i], q->Tuple.types[i], tbl, ctx);
+            if (n <= 0) return n;
+        }
+        return 1;
+    }
+
+    if (q->Record.flag == Variadic) {
+        for (i = 0; i < q->Record.shape; i++) {
+            k = ndt_record_field(p, q->Record.names[i]);
+            if (k < 0) return 0;
+            n = instance(p->Record.types[k], q->Record.types[i], tbl, ctx);
+            if (n <= 0) return n;
+        }
+        return 1;
+    }
+
+    if (p->Record.flag == Variadic || p->Record.shape != q->Record.shape) {
+        return 0;
+    }
+    for (i = 0; i < q->Record.shape; i++) {
+        if (strcmp(p->Record.names[i], q->Record.names[i]) != 0) {
+            return 0;
+        }
+        n = instance(p->Record.types[i], q->Record.types[i], tbl, ctx);
+        if (n <= 0) return n;
+    }
+    return 1;
+}
+
+static int
+instance(const ndt_t *p, const ndt_t *q, symtable_t *tbl, ndt_context_t *ctx)
+{
+    const ndt_t *pdims[NDT_MAX_DIM];
+    const ndt_t *qdims[NDT_MAX_DIM];
+    const ndt_t *pdtype;
+    const ndt_t *qdtype;
+    symtable_entry_t w;
+    int pn, qn, n;
+
+    switch (q->tag) {
+    case AnyKind:
+        return 1;
+
+    case Typevar:
+        if (p->tag == Typevar) {
+            w.tag = SymbolEntry;
+            w.SymbolEntry = p->Typevar.name;
+        }
+        else {
+            w.tag = TypeEntry;
+            w.TypeEntry = p;
+        }
+        return bind(q->Typevar.name, w, tbl, ctx);
+
+    case ScalarKind:
+    case SignedKind: case UnsignedKind: case FloatKind: case ComplexKind:
+    case FixedStringKind: case FixedBytesKind:
+        return below_kind(p->tag, q->tag);
+
+    case FixedDim: case SymbolicDim: case VarDim: case EllipsisDim:
+        if (!ndt_is_array(p) ||
+            ndt_is_column_major(p) != ndt_is_column_major(q)) {
+            return 0;
+        }
+
+        pn = ndt_const_dims_dtype(pdims, &pdtype, p);
+        qn = ndt_const_dims_dtype(qdims, &qdtype, q);
+
+        n = instance_dims(pdims, pn, qdims, qn, tbl, ctx);
+        if (n <= 0) return n;
+
+        return instance(pdtype, qdtype, tbl, ctx);
+
+    default:
+        break;
+    }
+
+    if (p->tag != q->tag) {
+        return 0;
+    }
+
+    switch (q->tag) {
+    case Tuple: case Record:
+        return instance_fields(p, q, tbl, ctx);
+    case Function:
+        n = instance(p->Function.ret, q->Function.ret, tbl, ctx);
+        if (n <= 0) return n;
+        n = instance(p->Function.pos, q->Function.pos, tbl, ctx);
+        if (n <= 0) return n;
+        return instance(p->Function.kwds, q->Function.kwds, tbl, ctx);
+    case Option:
+        return instance(p->Option.type, q->Option.type, tbl, ctx);
+    case OptionItem:
+        return instance(p->OptionItem.type, q->OptionItem.type, tbl, ctx);
+    case Pointer:
+        return instance(p->Pointer.type, q->Pointer.type, tbl, ctx);
+    case Constr:
+        if (strcmp(p->Constr.name, q->Constr.name) != 0) return 0;
+        return instance(p->Constr.type, q->Constr.type, tbl, ctx);
+    default:
+        return ndt_equal(p, q);
+    }
+}
+
+static int
+is_instance(const ndt_t *p, const ndt_t *q, ndt_context_t *ctx)
+{
+    symtable_t tbl;
+    int n;
+
+    symtable_init(&tbl);
+    n = instance(p, q, &tbl, ctx);
+    symtable_clear(&tbl);
+
+    return n;
+}
+
+/*
+ * Return 1 if 'p' is strictly more specific than 'q', i.e. every type that
+ * matches 'p' also matches 'q', but not the other way round.  Return 0 if
+ * 'p' is less specific, equally specific or incomparable, and -1 on error.
+ * For two function signatures, the positional arguments are compared.
+ */
+int
+ndt_more_specific(const ndt_t *p, const ndt_t *q, ndt_context_t *ctx)
+{
+    int n;
+
+    if (p->tag == Function && q->tag == Function) {
+        p = p->Function.pos;
+        q = q->Function.pos;
+    }
+
+    n = is_instance(p, q, ctx);
+    if (n <= 0) {
+        return n;
+    }
+
+    n = is_instance(q, p, ctx);
+    return n < 0 ? -1 : !n;
+}
+
+/*
+ * Topological sort of 'types' by ndt_more_specific().  'order' receives a
+ * permutation of 0..n-1 in which every type precedes all types that are
+ * less specific.  Each type is inserted right before the first type that
+ * is less specific, so the order of incomparable types follows 'types' as
+ * far as possible.
+ */
+int
+ndt_specificity_sort(int64_t order[], const ndt_t *types[], int64_t n,
+                     ndt_context_t *ctx)
+{
+    int64_t i, k, j;
+    int r;
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < i; k++) {
+            r = ndt_more_specific(types[i], types[order[k]], ctx);
+            if (r < 0) {
+                return -1;
+            }
+            if (r) {
+                break;
+            }
+        }
+
+        for (j = i; j > k; j--) {
+            order[j] = order[j-1];
+        }
+        order[k] = i;
+    }
+
+    return 0;
+}
@@ -32,10 +32,14 @@
 
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <limits.h>
 #include <stddef.h>
+#include <assert.h>
 #include "ndtypes.h"
 #include "symtable.h"
+#include "sync.h"
 
 
 /*****************************************************************************/
@@ -64,121 +68,321 @@ init_charmap(void)
 
 
 /*****************************************************************************/
-/*                            Global typedef map                             */
+/*                             Typedef namespaces                            */
 /*****************************************************************************/
 
-typedef struct typedef_trie {
+/*
+ * Each namespace is an open-addressing hash table of pointers to entries.
+ * Readers never lock: they load the current table and probe it.  Entries
+ * are immutable once published and are only removed with the namespace.
+ *
+ * Writers are serialized by a mutex, since a writer may allocate and rehash
+ * while it holds the lock.  A new entry is published with a release store
+ * into an empty slot.  When the table is half full, the entries are copied
+ * into a table of twice the size, which is then published.  Readers may
+ * still be probing the old table, so retired tables are only freed with the
+ * namespace.  Their combined size is less than that of the current table.
+ *
+ * Lookups that fail in a namespace continue in its parent.  The global
+ * namespace is used if the context does not specify one.
+ */
+
+typedef struct {
+    uint64_t hash;
     const ndt_t *value;
-    struct typedef_trie *next[];
-} typedef_trie_t;
+    char key[];
+} typedef_entry_t;
+
+typedef struct typedef_table {
+    size_t mask;
+    size_t len;
+    struct typedef_table *retired;
+    ndt_atomic_ptr_t slots[];
+} typedef_table_t;
+
+struct ndt_namespace {
+    ndt_atomic_ptr_t table;
+    ndt_mutex_t lock; /* serializes writers */
+    const ndt_namespace_t *parent;
+};
 
-static typedef_trie_t *typedef_map = NULL;
+static ndt_namespace_t typedef_map = { NULL, NDT_MUTEX_INIT, NULL };
 
-static typedef_trie_t *
-typedef_trie_new(ndt_context_t *ctx)
+#define TYPEDEF_TABLE_MINSIZE 16
+
+static uint64_t
+hash_key(const char *key)
 {
-    typedef_trie_t *t;
-    int i;
+    const unsigned char *cp;
+    uint64_t h = 14695981039346656037ULL;
 
-    t = ndt_alloc(1, offsetof(typedef_trie_t, next) + ALPHABET_LEN * (sizeof t));
+    for (cp = (const unsigned char *)key; *cp != '\0'; cp++) {
+        h = (h ^ *cp) * 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static int
+check_key(const char *key, ndt_context_t *ctx)
+{
+    const unsigned char *cp;
+
+    for (cp = (const unsigned char *)key; *cp != '\0'; cp++) {
+        if (code[*cp] == UCHAR_MAX) {
+            ndt_err_format(ctx, NDT_ValueError,
+                           "invalid character in typedef: '%c'", *cp);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static typedef_table_t *
+typedef_table_new(size_t size, ndt_context_t *ctx)
+{
+    typedef_table_t *t;
+    size_t i;
+
+    t = ndt_alloc(1, offsetof(typedef_table_t, slots) + size * sizeof t->slots[0]);
     if (t == NULL) {
         return ndt_memory_error(ctx);
     }
 
-    t->value = NULL;
+    t->mask = size-1;
+    t->len = 0;
+    t->retired = NULL;
 
-    for (i = 0; i < ALPHABET_LEN; i++) {
-        t->next[i] = NULL;
+    for (i = 0; i < size; i++) {
+        ndt_atomic_init(&t->slots[i], NULL);
     }
 
     return t;
 }
 
 static void
-typedef_trie_del(typedef_trie_t *t)
+typedef_table_del(typedef_table_t *t)
 {
-    int i;
+    typedef_table_t *next;
+    typedef_entry_t *e;
+    size_t i;
 
     if (t == NULL) {
         return;
     }
 
-    ndt_del((ndt_t *)t->value);
+    for (i = 0; i <= t->mask; i++) {
+        e = ndt_load_relaxed(&t->slots[i]);
+        if (e != NULL) {
+            ndt_del((ndt_t *)e->value);
+            ndt_free(e);
+        }
+    }
 
-    for (i = 0; i < ALPHABET_LEN; i++) {
-        typedef_trie_del(t->next[i]);
+    /* retired tables share the entries */
+    for (; t != NULL; t = next) {
+        next = t->retired;
+        ndt_free(t);
     }
+}
 
-    ndt_free(t);
+/* Return the slot of 'key' or the empty slot where it would be inserted. */
+static ndt_atomic_ptr_t *
+typedef_table_slot(typedef_table_t *t, const char *key, uint64_t hash,
+                   typedef_entry_t **found)
+{
+    typedef_entry_t *e;
+    size_t i = hash & t->mask;
+
+    while (1) {
+        e = ndt_load_acquire(&t->slots[i]);
+        if (e == NULL || (e->hash == hash && strcmp(e->key, key) == 0)) {
+            *found = e;
+            return &t->slots[i];
+        }
+        i = (i + 1) & t->mask;
+    }
 }
 
-int
-ndt_typedef_add(const char *key, const ndt_t *value, ndt_context_t *ctx)
+static typedef_table_t *
+typedef_table_grow(ndt_namespace_t *ns, typedef_table_t *t, ndt_context_t *ctx)
 {
-    typedef_trie_t *t = typedef_map;
-    const unsigned char *cp;
-    int i;
+    typedef_table_t *u;
+    typedef_entry_t *e, *found;
+    size_t i;
 
-    for (cp = (const unsigned char *)key; *cp != '\0'; cp++) {
-        i = code[*cp];
-        if (i == UCHAR_MAX) {
-            ndt_err_format(ctx, NDT_ValueError,
-                           "invalid character in typedef: '%c'", *cp);
-            return -1;
+    if (t == NULL) {
+        u = typedef_table_new(TYPEDEF_TABLE_MINSIZE, ctx);
+        if (u != NULL) {
+            ndt_store_release(&ns->table, u);
         }
+        return u;
+    }
 
-        if (t->next[i] == NULL) {
-            typedef_trie_t *u = typedef_trie_new(ctx);
-            if (u == NULL) {
-                return -1;
-            }
-            t->next[i] = u;
-            t = u;
-        }
-        else {
-            t = t->next[i];
+    u = typedef_table_new(2 * (t->mask+1), ctx);
+    if (u == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i <= t->mask; i++) {
+        e = ndt_load_relaxed(&t->slots[i]);
+        if (e != NULL) {
+            ndt_store_relaxed(typedef_table_slot(u, e->key, e->hash, &found), e);
         }
     }
 
-    if (t->value) {
+    u->len = t->len;
+    u->retired = t;
+    ndt_store_release(&ns->table, u);
+
+    return u;
+}
+
+static const typedef_entry_t *
+namespace_lookup(const ndt_namespace_t *ns, const char *key, uint64_t hash)
+{
+    typedef_table_t *t;
+    typedef_entry_t *found;
+
+    t = ndt_load_acquire((ndt_atomic_ptr_t *)&ns->table);
+    if (t == NULL) {
+        return NULL;
+    }
+
+    (void)typedef_table_slot(t, key, hash, &found);
+    return found;
+}
+
+/*
+ * Create an empty namespace.  Lookups that fail continue in 'parent', which
+ * may be NULL and must outlive the new namespace.  Use ndt_global_namespace()
+ * as 'parent' to see the process-wide typedefs.
+ */
+ndt_namespace_t *
+ndt_namespace_new(const ndt_namespace_t *parent, ndt_context_t *ctx)
+{
+    ndt_namespace_t *ns;
+
+    ns = ndt_alloc(1, sizeof *ns);
+    if (ns == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    if (ndt_mutex_init(&ns->lock) != 0) {
+        ndt_free(ns);
+        return ndt_memory_error(ctx);
+    }
+    ndt_atomic_init(&ns->table, NULL);
+    ns->parent = parent;
+
+    return ns;
+}
+
+/*
+ * Delete a namespace and all of its typedefs.  Not thread-safe: no other
+ * thread may use the namespace.  Nominal types that were created in the
+ * namespace keep their definitions alive and remain valid.
+ */
+void
+ndt_namespace_del(ndt_namespace_t *ns)
+{
+    if (ns == NULL) {
+        return;
+    }
+
+    typedef_table_del(ndt_load_relaxed(&ns->table));
+    ndt_mutex_destroy(&ns->lock);
+    ndt_free(ns);
+}
+
+/* The process-wide namespace that is used if ctx->ns is NULL. */
+const ndt_namespace_t *
+ndt_global_namespace(void)
+{
+    return &typedef_map;
+}
+
+/* Add a typedef to the namespace of 'ctx'. */
+int
+ndt_typedef_add(const char *key, const ndt_t *value, ndt_context_t *ctx)
+{
+    ndt_namespace_t *ns = ctx->ns != NULL ? ctx->ns : &typedef_map;
+    ndt_atomic_ptr_t *slot;
+    typedef_table_t *t;
+    typedef_entry_t *e, *found;
+    uint64_t hash;
+    size_t len;
+
+    if (check_key(key, ctx) < 0) {
+        return -1;
+    }
+
+    len = strlen(key);
+    hash = hash_key(key);
+
+    e = ndt_alloc(1, offsetof(typedef_entry_t, key) + len + 1);
+    if (e == NULL) {
+        (void)ndt_memory_error(ctx);
+        return -1;
+    }
+    e->hash = hash;
+    e->value = value;
+    memcpy(e->key, key, len+1);
+
+    ndt_mutex_lock(&ns->lock);
+
+    if (namespace_lookup(ns, key, hash) != NULL) {
+        ndt_mutex_unlock(&ns->lock);
+        ndt_free(e);
         ndt_err_format(ctx, NDT_ValueError, "duplicate typedef '%s'", key);
         return -1;
     }
 
-    t->value = value;
+    t = ndt_load_relaxed(&ns->table);
+    if (t == NULL || 2 * (t->len+1) > t->mask+1) {
+        t = typedef_table_grow(ns, t, ctx);
+        if (t == NULL) {
+            ndt_mutex_unlock(&ns->lock);
+            ndt_free(e);
+            return -1;
+        }
+    }
+
+    slot = typedef_table_slot(t, key, hash, &found);
+    ndt_store_release(slot, e);
+    t->len++;
+
+    ndt_mutex_unlock(&ns->lock);
     return 0;
 }
 
+/*
+ * Look up a typedef in the namespace of 'ctx' and its parents.  Lock-free;
+ * safe to call while other threads add typedefs.
+ */
 const ndt_t *
 ndt_typedef_find(const char *key, ndt_context_t *ctx)
 {
-    typedef_trie_t *t = typedef_map;
-    const unsigned char *cp;
-    int i;
+    const ndt_namespace_t *ns;
+    const typedef_entry_t *e;
+    uint64_t hash;
 
-    for (cp = (const unsigned char *)key; *cp != '\0'; cp++) {
-        i = code[*cp];
-        if (i == UCHAR_MAX) {
-            ndt_err_format(ctx, NDT_ValueError,
-                           "invalid character in typedef: '%c'", *cp);
-            return NULL;
-        }
-
-        if (t->next[i] == NULL) {
-            ndt_err_format(ctx, NDT_ValueError,
-                           "missing typedef for key '%s'", key);
-            return NULL;
-        }
-        t = t->next[i];
+    if (check_key(key, ctx) < 0) {
+        return NULL;
     }
 
-    if (t->value == NULL) {
-        ndt_err_format(ctx, NDT_RuntimeError,
-                       "missing typedef for key '%s'", key);
-        return NULL;
+    hash = hash_key(key);
+
+    for (ns = ctx->ns != NULL ? ctx->ns : &typedef_map; ns != NULL; ns = ns->parent) {
+        e = namespace_lookup(ns, key, hash);
+        if (e != NULL) {
+            return e->value;
+        }
     }
 
-    return t->value;
+    ndt_err_format(ctx, NDT_ValueError, "missing typedef for key '%s'", key);
+    return NULL;
 }
 
 
@@ -189,21 +393,19 @@ ndt_typedef_find(const char *key, ndt_context_t *ctx)
 int
 ndt_init(ndt_context_t *ctx)
 {
-    init_charmap();
+    (void)ctx;
 
-    typedef_map = typedef_trie_new(ctx);
-    if (typedef_map == NULL) {
-        return -1;
-    }
+    init_charmap();
 
     return 0;
 }
 
+/* Not thread-safe: no other thread may use the global namespace. */
 void
 ndt_finalize(void)
 {
-    typedef_trie_del(typedef_map);
-    typedef_map = NULL;
+    typedef_table_del(ndt_load_relaxed(&typedef_map.table));
+    ndt_store_relaxed(&typedef_map.table, NULL);
 }
 
 
@@ -211,24 +413,13 @@ ndt_finalize(void)
 /*                        Symbol tables for matching                         */
 /*****************************************************************************/
 
-symtable_t *
-symtable_new(ndt_context_t *ctx)
+void
+symtable_init(symtable_t *t)
 {
-    symtable_t *t;
-    int i;
-
-    t = ndt_alloc(1, offsetof(symtable_t, next) + ALPHABET_LEN * (sizeof t));
-    if (t == NULL) {
-        return ndt_memory_error(ctx);
-    }
-
-    t->entry.tag = Unbound;
-
-    for (i = 0; i < ALPHABET_LEN; i++) {
-        t->next[i] = NULL;
-    }
-
-    return t;
+    t->len = 0;
+    t->cap = 0;
+    t->table = NULL;
+    t->broadcast = false;
 }
 
 void
@@ -243,79 +434,171 @@ symtable_free_entry(symtable_entry_t entry)
     }
 }
 
+/* Free all entries.  The table can be reused after symtable_init(). */
 void
-symtable_del(symtable_t *t)
+symtable_clear(symtable_t *t)
 {
     int i;
 
-    if (t == NULL) {
-        return;
+    if (t->cap == 0) {
+        for (i = 0; i < t->len; i++) {
+            symtable_free_entry(t->items[i].entry);
+        }
+    }
+    else {
+        for (i = 0; i < t->cap; i++) {
+            if (t->table[i].key != NULL) {
+                symtable_free_entry(t->table[i].entry);
+            }
+        }
+        ndt_free(t->table);
     }
 
-    for (i = 0; i < ALPHABET_LEN; i++) {
-        symtable_del(t->next[i]);
+    symtable_init(t);
+}
+
+/* Return the slot of 'key' or the empty slot where it would be inserted. */
+static symtable_item_t *
+symtable_slot(symtable_item_t *table, int cap, const char *key)
+{
+    uint64_t i = hash_key(key) & (uint64_t)(cap-1);
+
+    while (table[i].key != NULL && strcmp(table[i].key, key) != 0) {
+        i = (i + 1) & (uint64_t)(cap-1);
     }
 
-    symtable_free_entry(t->entry);
-    ndt_free(t);
+    return &table[i];
 }
 
-int
-symtable_add(symtable_t *t, const char *key, const symtable_entry_t entry,
-             ndt_context_t *ctx)
+static int
+symtable_resize(symtable_t *t, int cap, ndt_context_t *ctx)
 {
-    const unsigned char *cp;
-    int i;
+    symtable_item_t *table, *old;
+    int n, i;
 
-    for (cp = (const unsigned char *)key; *cp != '\0'; cp++) {
-        i = code[*cp];
-        if (i == UCHAR_MAX) {
-            ndt_err_format(ctx, NDT_ValueError,
-                           "invalid character in symbol: '%c'", *cp);
-            return -1;
+    table = ndt_alloc(cap, sizeof *table);
+    if (table == NULL) {
+        (void)ndt_memory_error(ctx);
+        return -1;
+    }
+
+    for (i = 0; i < cap; i++) {
+        table[i].key = NULL;
+    }
+
+    if (t->cap == 0) {
+        old = t->items;
+        n = t->len;
+    }
+    else {
+        old = t->table;
+        n = t->cap;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (old[i].key != NULL) {
+            *symtable_slot(table, cap, old[i].key) = old[i];
         }
+    }
 
-        if (t->next[i] == NULL) {
-            symtable_t *u = symtable_new(ctx);
-            if (u == NULL) {
-                return -1;
+    if (t->cap != 0) {
+        ndt_free(t->table);
+    }
+
+    t->table = table;
+    t->cap = cap;
+    return 0;
+}
+
+static symtable_item_t *
+symtable_lookup(const symtable_t *t, const char *key)
+{
+    symtable_item_t *item;
+    int i;
+
+    if (t->cap == 0) {
+        for (i = 0; i < t->len; i++) {
+            if (strcmp(t->items[i].key, key) == 0) {
+                return (symtable_item_t *)&t->items[i];
             }
-            t->next[i] = u;
-            t = u;
-        }
-        else {
-            t = t->next[i];
         }
+        return NULL;
     }
 
-    if (t->entry.tag != Unbound) {
+    item = symtable_slot(t->table, t->cap, key);
+    return item->key == NULL ? NULL : item;
+}
+
+int
+symtable_add(symtable_t *t, const char *key, const symtable_entry_t entry,
+             ndt_context_t *ctx)
+{
+    symtable_item_t *item;
+
+    if (symtable_lookup(t, key) != NULL) {
         ndt_err_format(ctx, NDT_ValueError, "duplicate binding for '%s'", key);
         return -1;
     }
 
-    t->entry = entry;
+    if (t->cap == 0 && t->len < SYMTABLE_INLINE) {
+        item = &t->items[t->len];
+    }
+    else {
+        if (2 * (t->len + 1) > t->cap) {
+            if (symtable_resize(t, t->cap == 0 ? 4 * SYMTABLE_INLINE : 2 * t->cap,
+                                ctx) < 0) {
+                return -1;
+            }
+        }
+        item = symtable_slot(t->table, t->cap, key);
+    }
+
+    item->key = key;
+    item->entry = entry;
+    t->len++;
     return 0;
 }
 
-symtable_entry_t
-symtable_find(const symtable_t *t, const char *key)
+/* Remove all bindings, but keep the storage for the next match. */
+void
+symtable_reset(symtable_t *t)
 {
-    symtable_entry_t unbound = { .tag=Unbound };
-    const unsigned char *cp;
     int i;
 
-    for (cp = (const unsigned char *)key; *cp != '\0'; cp++) {
-        i = code[*cp];
-        if (i == UCHAR_MAX) {
-            return unbound; /* NOT REACHED */
+    if (t->cap == 0) {
+        for (i = 0; i < t->len; i++) {
+            symtable_free_entry(t->items[i].entry);
         }
-
-        if (t->next[i] == NULL) {
-            return unbound;
+    }
+    else {
+        for (i = 0; i < t->cap; i++) {
+            if (t->table[i].key != NULL) {
+                symtable_free_entry(t->table[i].entry);
+                t->table[i].key = NULL;
+            }
         }
-        t = t->next[i];
     }
 
-    return t->entry;
+    t->len = 0;
+}
+
+/* Replace the existing binding for 'key'.  The old entry is freed. */
+void
+symtable_replace(symtable_t *t, const char *key, const symtable_entry_t entry)
+{
+    symtable_item_t *item = symtable_lookup(t, key);
+
+    assert(item != NULL);
+    symtable_free_entry(item->entry);
+    item->entry = entry;
 }
 
+symtable_entry_t
+symtable_find(const symtable_t *t, const char *key)
+{
+    symtable_entry_t unbound = { .tag=Unbound };
+    const symtable_item_t *item;
+
+    item = symtable_lookup(t, key);
+    return item == NULL ? unbound : item->entry;
+}
@@ -62,17 +62,38 @@ typedef struct {
   };
 } symtable_entry_t;
 
-typedef struct symtable {
+/* Number of bindings that are stored without allocating. */
+#define SYMTABLE_INLINE 8
+
+typedef struct {
+    const char *key;
     symtable_entry_t entry;
-    struct symtable *next[];
+} symtable_item_t;
+
+/*
+ * Small tables are searched linearly in 'items'.  Once more than
+ * SYMTABLE_INLINE bindings are added, all bindings move to an
+ * open-addressing hash table with 'cap' slots.  Keys are borrowed and
+ * must outlive the table.
+ *
+ * If 'broadcast' is set, repeated bindings of an ellipsis are broadcast
+ * against each other instead of being compared for equality.
+ */
+typedef struct symtable {
+    int len;
+    int cap;
+    bool broadcast;
+    symtable_item_t *table;
+    symtable_item_t items[SYMTABLE_INLINE];
 } symtable_t;
 
-symtable_t *symtable_new(ndt_context_t *ctx);
+void symtable_init(symtable_t *t);
+void symtable_clear(symtable_t *t);
+void symtable_reset(symtable_t *t);
 void symtable_free_entry(symtable_entry_t entry);
-void symtable_del(symtable_t *t);
 int symtable_add(symtable_t *t, const char *key, const symtable_entry_t entry,
                  ndt_context_t *ctx);
+void symtable_replace(symtable_t *t, const char *key, const symtable_entry_t entry);
 symtable_entry_t symtable_find(const symtable_t *t, const char *key);
 
-
 #endif /* SYMTABLE_H */
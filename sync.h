@@ -0,0 +1,166 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SYNC_H
+#define SYNC_H
+
+
+/*****************************************************************************/
+/*      Atomic pointers, locks, mutexes and reference counts (internal)      */
+/*****************************************************************************/
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+
+/* Volatile accesses of aligned pointers are atomic.  The ordering is added
+   with explicit barriers, so that it does not depend on /volatile:ms, which
+   is not the default on ARM. */
+#if defined(_M_IX86) || defined(_M_X64)
+  /* x86 does not reorder loads with loads or stores with stores */
+  #define ndt_barrier() _ReadWriteBarrier()
+#elif defined(_M_ARM64)
+  #define ndt_barrier() __dmb(_ARM64_BARRIER_ISH)
+#else
+  #define ndt_barrier() __dmb(_ARM_BARRIER_ISH)
+#endif
+
+typedef void * volatile ndt_atomic_ptr_t;
+typedef long volatile ndt_spinlock_t;
+
+#define NDT_SPINLOCK_INIT 0
+#define ndt_spin_init(lock) (*(lock) = 0)
+#define ndt_atomic_init(p, v) (*(p) = (v))
+#define ndt_load_relaxed(p) (*(p))
+#define ndt_store_relaxed(p, v) (*(p) = (v))
+
+static __inline void *
+ndt_load_acquire(ndt_atomic_ptr_t *p)
+{
+    void *v = *p;
+    ndt_barrier();
+    return v;
+}
+
+static __inline void
+ndt_store_release(ndt_atomic_ptr_t *p, void *v)
+{
+    ndt_barrier();
+    *p = v;
+}
+
+static __inline void
+ndt_spin_lock(ndt_spinlock_t *lock)
+{
+    while (_InterlockedExchange(lock, 1) != 0)
+        ; /* spin */
+}
+
+static __inline void
+ndt_spin_unlock(ndt_spinlock_t *lock)
+{
+    (void)_InterlockedExchange(lock, 0);
+}
+
+static __inline int64_t
+ndt_refcnt_load(const int64_t *p)
+{
+    int64_t v = __iso_volatile_load64((const volatile __int64 *)p);
+    ndt_barrier();
+    return v;
+}
+
+#define ndt_refcnt_incr(p) ((void)_InterlockedIncrement64(p))
+#define ndt_refcnt_decr(p) _InterlockedDecrement64(p)
+#else
+#include <stdatomic.h>
+
+typedef _Atomic(void *) ndt_atomic_ptr_t;
+typedef atomic_flag ndt_spinlock_t;
+
+#define NDT_SPINLOCK_INIT ATOMIC_FLAG_INIT
+#define ndt_spin_init(lock) atomic_flag_clear(lock)
+#define ndt_atomic_init(p, v) atomic_init(p, v)
+#define ndt_load_relaxed(p) atomic_load_explicit(p, memory_order_relaxed)
+#define ndt_load_acquire(p) atomic_load_explicit(p, memory_order_acquire)
+#define ndt_store_relaxed(p, v) atomic_store_explicit(p, v, memory_order_relaxed)
+#define ndt_store_release(p, v) atomic_store_explicit(p, v, memory_order_release)
+
+static inline void
+ndt_spin_lock(ndt_spinlock_t *lock)
+{
+    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire))
+        ; /* spin */
+}
+
+static inline void
+ndt_spin_unlock(ndt_spinlock_t *lock)
+{
+    atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+/* Reference counts are plain int64_t fields of the public ndt_t, so they
+   use the compiler builtins instead of C11 atomics. */
+#define ndt_refcnt_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ndt_refcnt_incr(p) ((void)__atomic_add_fetch(p, 1, __ATOMIC_RELAXED))
+#define ndt_refcnt_decr(p) __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL)
+#endif
+
+/* Mutexes for writers that may hold the lock for a long time, e.g. while
+   allocating.  ndt_mutex_init() returns 0 on success. */
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+  #define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+typedef SRWLOCK ndt_mutex_t;
+
+#define NDT_MUTEX_INIT SRWLOCK_INIT
+#define ndt_mutex_init(m) (InitializeSRWLock(m), 0)
+#define ndt_mutex_destroy(m) ((void)(m))
+#define ndt_mutex_lock(m) AcquireSRWLockExclusive(m)
+#define ndt_mutex_unlock(m) ReleaseSRWLockExclusive(m)
+#else
+#include <pthread.h>
+
+typedef pthread_mutex_t ndt_mutex_t;
+
+#define NDT_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define ndt_mutex_init(m) pthread_mutex_init(m, NULL)
+#define ndt_mutex_destroy(m) ((void)pthread_mutex_destroy(m))
+#define ndt_mutex_lock(m) ((void)pthread_mutex_lock(m))
+#define ndt_mutex_unlock(m) ((void)pthread_mutex_unlock(m))
+#endif
+
+
+#endif /* SYNC_H */
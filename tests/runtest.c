@@ -562,6 +562,257 @@ test_typedef_error(void)
     return 0;
 }
 
+static int
+test_typedef_growth(void)
+{
+    ndt_context_t *ctx;
+    const ndt_t *u;
+    ndt_t *t;
+    char name[32];
+    int i, k;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    /* grow the table several times while checking earlier entries */
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof name, "growth_%d_t", i);
+
+        for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+            ndt_err_clear(ctx);
+
+            t = ndt_from_string(i % 2 ? "int64" : "(int8, float64)", ctx);
+            if (t == NULL) {
+                ndt_context_del(ctx);
+                return -1;
+            }
+
+            ndt_set_alloc_fail();
+            (void)ndt_typedef(name, t, ctx);
+            ndt_set_alloc();
+
+            if (ctx->err != NDT_MemoryError) {
+                break;
+            }
+        }
+
+        if (ctx->err != NDT_Success) {
+            fprintf(stderr, "test_typedef_growth: FAIL: could not add \"%s\"\n", name);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        for (k = 0; k <= i; k += 37) {
+            snprintf(name, sizeof name, "growth_%d_t", k);
+            u = ndt_typedef_find(name, ctx);
+            if (u == NULL || u->tag != (k % 2 ? Int64 : Tuple)) {
+                fprintf(stderr, "test_typedef_growth: FAIL: lookup of \"%s\"\n", name);
+                ndt_context_del(ctx);
+                return -1;
+            }
+        }
+    }
+
+    fprintf(stderr, "test_typedef_growth (1 test case)\n");
+
+    ndt_context_del(ctx);
+    return 0;
+}
+
+static int
+add_typedef(const char *name, const char *type, ndt_context_t *ctx)
+{
+    ndt_t *t;
+
+    t = ndt_from_string(type, ctx);
+    if (t == NULL) {
+        return -1;
+    }
+
+    return ndt_typedef(name, t, ctx);
+}
+
+/* Parse 'input' and check the resolved dtype.  AnyKind means that the name
+   must not resolve. */
+static int
+check_nominal(const char *input, enum ndt tag, ndt_context_t *ctx)
+{
+    const ndt_t *u;
+    ndt_t *t;
+    int ret;
+
+    t = ndt_from_string(input, ctx);
+    if (t == NULL) {
+        ndt_err_clear(ctx);
+        return tag == AnyKind ? 0 : -1;
+    }
+
+    u = t->FixedDim.type->Nominal.type;
+    ret = u->tag == tag ? 0 : -1;
+    ndt_del(t);
+    return ret;
+}
+
+static int
+test_typedef_namespace(void)
+{
+    NDT_STATIC_CONTEXT(sctx);
+    const int64_t indices[2] = {1, 1};
+    ndt_namespace_t *builtins = NULL, *a = NULL, *b = NULL, *c = NULL;
+    ndt_t *ta = NULL, *ta2 = NULL, *tb = NULL;
+    ndt_context_t *ctx;
+    int ret = -1;
+
+    if (sctx.ns != NULL) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: static context namespace\n");
+        return -1;
+    }
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        builtins = ndt_namespace_new(NULL, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+    }
+    if (builtins == NULL) {
+        goto out;
+    }
+
+    a = ndt_namespace_new(builtins, ctx);
+    b = ndt_namespace_new(builtins, ctx);
+    if (a == NULL || b == NULL) {
+        goto out;
+    }
+
+    ctx->ns = builtins;
+    if (add_typedef("shared_t", "(float64, float64)", ctx) < 0) {
+        goto out;
+    }
+
+    /* the same name in two tenants */
+    ctx->ns = a;
+    if (add_typedef("item_t", "int64", ctx) < 0 ||
+        add_typedef("shared_t", "int8", ctx) < 0 ||
+        add_typedef("pair_t", "{x: int8, y: int16}", ctx) < 0 ||
+        add_typedef("same_t", "int64", ctx) < 0) {
+        goto out;
+    }
+    ctx->ns = b;
+    if (add_typedef("item_t", "{x: float32}", ctx) < 0 ||
+        add_typedef("pair_t", "{x: int64, y: int16}", ctx) < 0 ||
+        add_typedef("same_t", "int64", ctx) < 0) {
+        goto out;
+    }
+    if (add_typedef("item_t", "int8", ctx) == 0 || ctx->err != NDT_ValueError) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: duplicate in namespace\n");
+        goto error;
+    }
+    ndt_err_clear(ctx);
+
+    ctx->ns = a;
+    if (check_nominal("2 * item_t", Int64, ctx) < 0 ||
+        check_nominal("2 * shared_t", Int8, ctx) < 0) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: lookup in tenant a\n");
+        goto error;
+    }
+
+    ctx->ns = b;
+    if (check_nominal("2 * item_t", Record, ctx) < 0 ||
+        check_nominal("2 * shared_t", Tuple, ctx) < 0) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: lookup in tenant b\n");
+        goto error;
+    }
+
+    /* parents do not see their children, the global map is separate */
+    ctx->ns = builtins;
+    if (check_nominal("2 * item_t", AnyKind, ctx) < 0 ||
+        check_nominal("2 * defined_t", AnyKind, ctx) < 0) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: lookup in builtins\n");
+        goto error;
+    }
+    ctx->ns = NULL;
+    if (check_nominal("2 * shared_t", AnyKind, ctx) < 0) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: lookup in global namespace\n");
+        goto error;
+    }
+
+    /* nominal types are bound to the definition of their namespace */
+    ctx->ns = a;
+    ta = ndt_from_string("2 * pair_t", ctx);
+    ta2 = ndt_from_string("same_t", ctx);
+    ctx->ns = b;
+    tb = ndt_from_string("same_t", ctx);
+    if (ta == NULL || ta2 == NULL || tb == NULL) {
+        goto out;
+    }
+    if (ndt_offset_of(ta, indices, 2, ctx) != 6) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: layout of tenant a\n");
+        goto error;
+    }
+    if (ndt_equal(ta2, tb)) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: same name in tenants is equal\n");
+        goto error;
+    }
+
+    /* dropping a tenant does not affect the others or its nominal types */
+    ndt_namespace_del(a);
+    a = NULL;
+    ctx->ns = b;
+    if (check_nominal("2 * item_t", Record, ctx) < 0) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: lookup after delete\n");
+        goto error;
+    }
+    ctx->ns = NULL;
+    if (ndt_offset_of(ta, indices, 2, ctx) != 6) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: layout after delete\n");
+        goto error;
+    }
+
+    /* chaining to the global namespace */
+    c = ndt_namespace_new(ndt_global_namespace(), ctx);
+    if (c == NULL) {
+        goto out;
+    }
+    ctx->ns = c;
+    if (check_nominal("2 * defined_t", Record, ctx) < 0) {
+        fprintf(stderr, "test_typedef_namespace: FAIL: lookup in global parent\n");
+        goto error;
+    }
+    ctx->ns = NULL;
+
+    fprintf(stderr, "test_typedef_namespace (1 test case)\n");
+    ret = 0;
+    goto error;
+
+out:
+    ndt_err_fprint(stderr, ctx);
+error:
+    ctx->ns = NULL;
+    ndt_del(ta);
+    ndt_del(ta2);
+    ndt_del(tb);
+    ndt_namespace_del(a);
+    ndt_namespace_del(b);
+    ndt_namespace_del(c);
+    ndt_namespace_del(builtins);
+    ndt_context_del(ctx);
+    return ret;
+}
+
 static int
 test_equal(void)
 {
@@ -682,6 +933,16 @@ test_match(void)
             return -1;
         }
 
+        if (ret == 1 && !ndt_may_match(p, c)) {
+            ndt_del(p);
+            ndt_del(c);
+            ndt_context_del(ctx);
+            fprintf(stderr, "test_match: FAIL: ndt_may_match rejects a match\n");
+            fprintf(stderr, "test_match: FAIL: pattern: \"%s\"\n", t->pattern);
+            fprintf(stderr, "test_match: FAIL: candidate: \"%s\"\n", t->candidate);
+            return -1;
+        }
+
         ndt_del(p);
         ndt_del(c);
         count++;
@@ -775,7 +1036,9 @@ test_typecheck(void)
             return -1;
         }
 
-        if (!ndt_equal(return_type, expected) || outer_dims != t->outer_dims) {
+        if (!ndt_equal(return_type, expected) || outer_dims != t->outer_dims ||
+            ndt_is_concrete(return_type) != ndt_is_concrete(expected) ||
+            return_type->data_size != expected->data_size) {
             ndt_del(f);
             ndt_del(args);
             ndt_del(return_type);
@@ -800,6 +1063,322 @@ test_typecheck(void)
     return 0;
 }
 
+#define MAX_BATCH 64
+
+/* Check each signature of typecheck_tests against all of its arguments. */
+static int
+test_typecheck_batch(void)
+{
+    const ndt_t *args[MAX_BATCH];
+    ndt_t *out[MAX_BATCH];
+    int outer_dims[MAX_BATCH];
+    int index[MAX_BATCH];
+    const typecheck_testcase_t *t, *u;
+    ndt_context_t *ctx;
+    ndt_t *f = NULL;
+    ndt_t *expected;
+    int64_t count, n = 0;
+    int ncases = 0;
+    int i, k;
+    int ret = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (t = typecheck_tests; t->signature != NULL; t++) {
+        for (u = typecheck_tests; u != t; u++) {
+            if (strcmp(u->signature, t->signature) == 0) break;
+        }
+        if (u != t) {
+            continue;
+        }
+
+        f = ndt_from_string(t->signature, ctx);
+        if (f == NULL) {
+            fprintf(stderr, "test_typecheck_batch: FAIL: could not parse \"%s\"\n", t->signature);
+            goto out;
+        }
+
+        /* collect the arguments for this signature */
+        n = 0;
+        for (u = t; u->signature != NULL && n < MAX_BATCH; u++) {
+            if (strcmp(u->signature, t->signature) != 0) {
+                continue;
+            }
+            args[n] = ndt_from_string(u->args, ctx);
+            if (args[n] == NULL) {
+                fprintf(stderr, "test_typecheck_batch: FAIL: could not parse \"%s\"\n", u->args);
+                goto out;
+            }
+            /* a batch fails as a whole if any argument tuple raises */
+            expected = ndt_typecheck(f, args[n], &k, ctx);
+            if (expected == NULL && ctx->err != NDT_Success) {
+                ndt_err_clear(ctx);
+                ndt_del((ndt_t *)args[n]);
+                continue;
+            }
+            ndt_del(expected);
+            index[n++] = (int)(u - typecheck_tests);
+        }
+
+        for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+            ndt_err_clear(ctx);
+
+            ndt_set_alloc_fail();
+            count = ndt_typecheck_batch(f, args, n, out, outer_dims, ctx);
+            ndt_set_alloc();
+
+            if (ctx->err != NDT_MemoryError) {
+                break;
+            }
+
+            for (i = 0; i < n; i++) {
+                if (count != -1 || out[i] != NULL) {
+                    fprintf(stderr, "test_typecheck_batch: FAIL: expect NULL after MemoryError\n");
+                    goto out;
+                }
+            }
+        }
+
+        if (count < 0) {
+            fprintf(stderr, "test_typecheck_batch: FAIL: unexpected error\n");
+            goto out;
+        }
+
+        for (i = 0; i < n; i++) {
+            u = &typecheck_tests[index[i]];
+            if (!!out[i] != !!u->expected) {
+                fprintf(stderr, "test_typecheck_batch: FAIL: \"%s\"\n", u->args);
+                goto out_results;
+            }
+            if (out[i] == NULL) {
+                continue;
+            }
+
+            expected = ndt_from_string(u->expected, ctx);
+            if (expected == NULL) {
+                goto out_results;
+            }
+            k = ndt_equal(out[i], expected) && outer_dims[i] == u->outer_dims;
+            ndt_del(expected);
+            if (!k) {
+                fprintf(stderr, "test_typecheck_batch: FAIL: expected \"%s\"\n", u->expected);
+                goto out_results;
+            }
+            count--;
+            ncases++;
+        }
+
+        if (count != 0) {
+            fprintf(stderr, "test_typecheck_batch: FAIL: wrong number of matches\n");
+            goto out_results;
+        }
+
+        for (i = 0; i < n; i++) {
+            ndt_del(out[i]);
+            ndt_del((ndt_t *)args[i]);
+        }
+        ndt_del(f);
+        f = NULL;
+        n = 0;
+    }
+
+    /* an error in one argument tuple fails the whole batch */
+    f = ndt_from_string("(T) -> T", ctx);
+    args[0] = ndt_from_string("(int64)", ctx);
+    args[1] = ndt_from_string("(T)", ctx);
+    n = 2;
+    if (f == NULL || args[0] == NULL || args[1] == NULL) {
+        goto out;
+    }
+
+    count = ndt_typecheck_batch(f, args, n, out, NULL, ctx);
+    if (count != -1 || ctx->err != NDT_RuntimeError ||
+        out[0] != NULL || out[1] != NULL) {
+        fprintf(stderr, "test_typecheck_batch: FAIL: expected RuntimeError\n");
+        goto out;
+    }
+    ndt_err_clear(ctx);
+    ncases++;
+
+    fprintf(stderr, "test_typecheck_batch (%d test cases)\n", ncases);
+    ret = 0;
+    goto out;
+
+out_results:
+    for (i = 0; i < n; i++) {
+        ndt_del(out[i]);
+    }
+out:
+    for (i = 0; i < n; i++) {
+        ndt_del((ndt_t *)args[i]);
+    }
+    ndt_del(f);
+    ndt_context_del(ctx);
+    return ret;
+}
+
+static int
+test_typecheck_shared(void)
+{
+    const char *sig = "(T, N * U) -> (T, N * U, {a: int8, b: int64, align=16})";
+    const char *expected = "(10 * int64, 3 * float32, {a : int8, b : int64, align=16})";
+    ndt_context_t *ctx;
+    ndt_t *f, *args, *ret;
+    char *s;
+    int outer_dims;
+    int res = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    f = ndt_from_string(sig, ctx);
+    args = ndt_from_string("(10 * int64, 3 * float32)", ctx);
+    if (f == NULL || args == NULL) {
+        fprintf(stderr, "test_typecheck_shared: FAIL: could not parse input\n");
+        ndt_del(f);
+        ndt_context_del(ctx);
+        return -1;
+    }
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        ret = ndt_typecheck(f, args, &outer_dims, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+    }
+
+    if (ret == NULL) {
+        fprintf(stderr, "test_typecheck_shared: FAIL: typecheck failed\n");
+        ndt_del(f);
+        ndt_del(args);
+        ndt_context_del(ctx);
+        return -1;
+    }
+
+    /* bound types and subtrees without variables are not copied */
+    if (ret->Tuple.types[0] != args->Tuple.types[0] ||
+        ret->Tuple.types[1]->FixedDim.type != args->Tuple.types[1]->FixedDim.type ||
+        ret->Tuple.types[2] != f->Function.ret->Tuple.types[2]) {
+        fprintf(stderr, "test_typecheck_shared: FAIL: expected shared subtrees\n");
+        goto out;
+    }
+
+    /* the shared subtrees outlive the signature and the arguments */
+    ndt_del(f);
+    ndt_del(args);
+    f = args = NULL;
+
+    s = ndt_as_string(ret, ctx);
+    if (s == NULL || strcmp(s, expected) != 0) {
+        fprintf(stderr, "test_typecheck_shared: FAIL: got \"%s\"\n", s);
+        ndt_free(s);
+        goto out;
+    }
+    ndt_free(s);
+
+    fprintf(stderr, "test_typecheck_shared (1 test case)\n");
+    res = 0;
+
+out:
+    ndt_del(ret);
+    ndt_del(f);
+    ndt_del(args);
+    ndt_context_del(ctx);
+    return res;
+}
+
+/*
+ * The result of ndt_typecheck() may share nodes with the arguments.  Passing
+ * it to a constructor that modifies dimensions must not change the arguments.
+ */
+static int
+test_typecheck_shared_array(void)
+{
+    const int64_opt_t none = {None, 0};
+    const char_opt_t order = {Some, 'F'};
+    ndt_context_t *ctx;
+    ndt_t *f, *args, *ret, *t = NULL;
+    int outer_dims;
+    int res = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    f = ndt_from_string("(T) -> T", ctx);
+    args = ndt_from_string("(2 * 3 * int64)", ctx);
+    if (f == NULL || args == NULL) {
+        fprintf(stderr, "test_typecheck_shared_array: FAIL: could not parse input\n");
+        goto out;
+    }
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ret = ndt_typecheck(f, args, &outer_dims, ctx);
+        if (ret == NULL) {
+            fprintf(stderr, "test_typecheck_shared_array: FAIL: typecheck failed\n");
+            goto out;
+        }
+
+        ndt_set_alloc_fail();
+        t = ndt_array(ret, NULL, none, none, order, ctx);
+        ndt_set_alloc();
+
+        if (args->Tuple.types[0]->Concrete.FixedDim.stride != 24 ||
+            args->Tuple.types[0]->FixedDim.type->Concrete.FixedDim.stride != 8 ||
+            !ndt_is_c_contiguous(args->Tuple.types[0])) {
+            fprintf(stderr, "test_typecheck_shared_array: FAIL: arguments modified\n");
+            goto out;
+        }
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (t != NULL) {
+            fprintf(stderr, "test_typecheck_shared_array: FAIL: expect NULL after MemoryError\n");
+            goto out;
+        }
+    }
+
+    if (t == NULL) {
+        fprintf(stderr, "test_typecheck_shared_array: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    if (t->Concrete.FixedDim.stride != 8 ||
+        t->FixedDim.type->Concrete.FixedDim.stride != 16 ||
+        !ndt_is_f_contiguous(t)) {
+        fprintf(stderr, "test_typecheck_shared_array: FAIL: expected Fortran order\n");
+        goto out;
+    }
+
+    fprintf(stderr, "test_typecheck_shared_array (1 test case)\n");
+    res = 0;
+
+out:
+    ndt_del(t);
+    ndt_del(f);
+    ndt_del(args);
+    ndt_context_del(ctx);
+    return res;
+}
+
 static int
 test_static_context(void)
 {
@@ -1037,21 +1616,114 @@ test_copy(void)
     return 0;
 }
 
+static int
+test_fingerprint(void)
+{
+    NDT_STATIC_CONTEXT(ctx);
+    const char **c;
+    ndt_t *t, *u, *v;
+    char *s;
+    int count = 0;
+
+    for (c = parse_roundtrip_tests; *c != NULL; c++) {
+        ndt_err_clear(&ctx);
+
+        t = ndt_from_string(*c, &ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_fingerprint: FAIL: from_string: \"%s\"\n", *c);
+            ndt_context_del(&ctx);
+            return -1;
+        }
+
+        s = ndt_as_string(t, &ctx);
+        if (s == NULL) {
+            fprintf(stderr, "test_fingerprint: FAIL: as_string: \"%s\"\n", *c);
+            ndt_del(t);
+            ndt_context_del(&ctx);
+            return -1;
+        }
+
+        u = ndt_from_string(s, &ctx);
+        ndt_free(s);
+        if (u == NULL) {
+            fprintf(stderr, "test_fingerprint: FAIL: roundtrip: \"%s\"\n", *c);
+            ndt_del(t);
+            ndt_context_del(&ctx);
+            return -1;
+        }
+
+        v = ndt_copy(t, &ctx);
+        if (v == NULL) {
+            fprintf(stderr, "test_fingerprint: FAIL: copy: \"%s\"\n", *c);
+            ndt_del(t);
+            ndt_del(u);
+            ndt_context_del(&ctx);
+            return -1;
+        }
+
+        if (!(t->tags & NDT_TAG_BIT(t->tag)) ||
+            t->fingerprint != u->fingerprint || t->tags != u->tags ||
+            t->fingerprint != v->fingerprint || t->tags != v->tags ||
+            !ndt_may_match(t, u)) {
+            fprintf(stderr, "test_fingerprint: FAIL: summary differs: \"%s\"\n", *c);
+            ndt_del(t);
+            ndt_del(u);
+            ndt_del(v);
+            ndt_context_del(&ctx);
+            return -1;
+        }
+
+        ndt_del(t);
+        ndt_del(u);
+        ndt_del(v);
+        count++;
+    }
+
+    ndt_context_del(&ctx);
+    fprintf(stderr, "test_fingerprint (%d test cases)\n", count);
+
+    return 0;
+}
+
 
 static int (*tests[])(void) = {
   test_parse,
   test_parse_error,
   test_parse_roundtrip,
   test_indent,
+  test_print,
+  test_print_limited,
   test_typedef,
   test_typedef_duplicates,
   test_typedef_error,
+  test_typedef_growth,
+  test_typedef_namespace,
   test_equal,
   test_match,
   test_typecheck,
+  test_typecheck_shared,
+  test_typecheck_shared_array,
+  test_typecheck_batch,
   test_static_context,
   test_hash,
   test_copy,
+  test_fingerprint,
+  test_ndarray,
+  test_dim_align,
+  test_offset,
+  test_plan,
+  test_record_reorder,
+  test_record_field,
+  test_record_nested,
+  test_transform,
+  test_record_project,
+  test_footprint,
+  test_pattern,
+  test_dispatch,
+  test_cache,
+  test_broadcast,
+  test_unify,
+  test_specificity,
 #ifdef __GNUC__
   test_struct_align_pack,
   test_array,
@@ -68,6 +68,24 @@ extern const typecheck_testcase_t typecheck_tests[];
 
 int test_struct_align_pack(void);
 int test_array(void);
+int test_ndarray(void);
+int test_dim_align(void);
+int test_offset(void);
+int test_plan(void);
+int test_record_reorder(void);
+int test_record_field(void);
+int test_record_nested(void);
+int test_transform(void);
+int test_record_project(void);
+int test_footprint(void);
+int test_pattern(void);
+int test_dispatch(void);
+int test_cache(void);
+int test_broadcast(void);
+int test_unify(void);
+int test_specificity(void);
+int test_print(void);
+int test_print_limited(void);
 
 
 #endif /* TEST_H */
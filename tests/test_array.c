@@ -108,3 +108,425 @@ test_array(void)
 #endif
 
 
+
+
+/*********************************************************************/
+/*                           strided arrays                          */
+/*********************************************************************/
+
+typedef struct {
+    const char *type;
+    int has_strides;
+    int64_t strides[3]; /* given or expected strides */
+    int64_t offset;     /* -1: not given */
+    int64_t bufsize;    /* -1: not given */
+    char order;         /* 0: not given */
+    int valid;
+    int c_contiguous;
+    int f_contiguous;
+    int64_t data_size;
+} ndarray_testcase_t;
+
+static const ndarray_testcase_t ndarray_tests[] = {
+  /* default order */
+  { "2 * 3 * int64", 0, {24, 8}, -1, -1, 0, 1, 1, 0, 48 },
+  { "2 * 3 * int64", 0, {24, 8}, -1, -1, 'C', 1, 1, 0, 48 },
+  { "2 * 3 * int64", 0, {8, 16}, -1, -1, 'F', 1, 0, 1, 48 },
+  { "3 * int64", 0, {8}, -1, -1, 0, 1, 1, 1, 24 },
+
+  /* transpose */
+  { "3 * 2 * int64", 1, {8, 24}, -1, -1, 0, 1, 0, 1, 48 },
+
+  /* slices */
+  { "5 * int64", 1, {16}, -1, 80, 0, 1, 0, 0, 80 },
+  { "5 * int64", 1, {16}, -1, -1, 0, 1, 0, 0, 72 },
+  { "2 * 2 * int64", 1, {48, 8}, 8, 96, 0, 1, 0, 0, 96 },
+
+  /* strides of dimensions with shape 1 are ignored */
+  { "1 * 3 * int64", 1, {100, 8}, -1, -1, 0, 1, 1, 1, 24 },
+
+  /* negative strides */
+  { "2 * uint8", 1, {-4}, 4, 10, 0, 1, 0, 0, 10 },
+  { "2 * uint8", 1, {-4}, 3, 10, 0, 0, 0, 0, 0 },
+  { "2 * uint8", 1, {-4}, -1, -1, 0, 0, 0, 0, 0 },
+
+  /* empty arrays */
+  { "0 * int64", 1, {-8}, -1, -1, 0, 1, 1, 1, 0 },
+
+  /* invalid arguments */
+  { "2 * 3 * int64", 0, {0}, -1, 40, 0, 0, 0, 0, 0 },
+  { "2 * 3 * int64", 1, {24, 8}, -1, -1, 'C', 0, 0, 0, 0 },
+  { "2 * 3 * int64", 0, {0}, -1, -1, 'A', 0, 0, 0, 0 },
+  { "2 * 3 * int64", 0, {0}, -5, -1, 0, 0, 0, 0, 0 },
+  { "2 * int64", 1, {INT64_MAX}, -1, -1, 0, 0, 0, 0, 0 },
+  { "N * int64", 0, {0}, -1, -1, 0, 0, 0, 0, 0 },
+  { "{a: int64}", 0, {0}, -1, -1, 0, 0, 0, 0, 0 },
+};
+
+static const char *abstract_layout_tests[] = {
+  "N * int64",
+  "2 * T",
+  "var * T",
+  "Dims... * int64",
+  "(T, int64)",
+};
+
+int
+test_ndarray(void)
+{
+    ndt_context_t *ctx;
+    const ndarray_testcase_t *tc;
+    size_t ntests = sizeof ndarray_tests / sizeof ndarray_tests[0];
+    size_t nabstract;
+    int64_opt_t offset, bufsize;
+    char_opt_t order;
+    int64_t strides[3];
+    ndt_t *t, *u;
+    size_t i;
+    int k;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &ndarray_tests[i];
+
+        t = ndt_from_string(tc->type, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_ndarray: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        for (k = 0; k < 3; k++) {
+            strides[k] = tc->strides[k];
+        }
+        offset.tag = tc->offset == -1 ? None : Some;
+        offset.Some = tc->offset;
+        bufsize.tag = tc->bufsize == -1 ? None : Some;
+        bufsize.Some = tc->bufsize;
+        order.tag = tc->order == 0 ? None : Some;
+        order.Some = tc->order;
+
+        t = ndt_array(t, tc->has_strides ? strides : NULL, offset, bufsize,
+                      order, ctx);
+
+        if (!tc->valid) {
+            if (t != NULL) {
+                fprintf(stderr, "test_ndarray: FAIL: expected error: \"%s\"\n",
+                        tc->type);
+                ndt_del(t);
+                ndt_context_del(ctx);
+                return -1;
+            }
+            if (ctx->err == NDT_MemoryError) {
+                fprintf(stderr, "test_ndarray: FAIL: unexpected MemoryError\n");
+                ndt_context_del(ctx);
+                return -1;
+            }
+            ndt_err_clear(ctx);
+            continue;
+        }
+
+        if (t == NULL) {
+            fprintf(stderr, "test_ndarray: FAIL: \"%s\": %s\n",
+                    tc->type, ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        for (u = t, k = 0; u->ndim > 0; u = ndt_next_dim(u), k++) {
+            if (!ndt_is_ndarray(u) ||
+                u->Concrete.FixedDim.stride != tc->strides[k]) {
+                fprintf(stderr,
+                    "test_ndarray: FAIL: \"%s\": unexpected stride\n",
+                    tc->type);
+                ndt_del(t);
+                ndt_context_del(ctx);
+                return -1;
+            }
+        }
+
+        if (ndt_is_c_contiguous(t) != tc->c_contiguous ||
+            ndt_is_f_contiguous(t) != tc->f_contiguous ||
+            t->data_size != tc->data_size ||
+            t->Concrete.FixedDim.offset != (tc->offset == -1 ? 0 : tc->offset)) {
+            fprintf(stderr,
+                "test_ndarray: FAIL: \"%s\": unexpected flags or size\n",
+                tc->type);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        /* strided arrays cannot be nested */
+        t = ndt_fixed_dim(2, t, 'A', ctx);
+        if (t != NULL) {
+            fprintf(stderr, "test_ndarray: FAIL: nested strided array\n");
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+        ndt_err_clear(ctx);
+    }
+
+    /* abstract types have no memory layout */
+    nabstract = sizeof abstract_layout_tests / sizeof abstract_layout_tests[0];
+    for (i = 0; i < nabstract; i++) {
+        t = ndt_from_string(abstract_layout_tests[i], ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_ndarray: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        if (ndt_is_contiguous(t) || ndt_is_c_contiguous(t) ||
+            ndt_is_f_contiguous(t)) {
+            fprintf(stderr,
+                "test_ndarray: FAIL: \"%s\": abstract type is contiguous\n",
+                abstract_layout_tests[i]);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+        ndt_del(t);
+    }
+
+    /* the offset is not part of the per-dimension metadata */
+    t = ndt_from_string("2 * 3 * int64", ctx);
+    if (t == NULL) {
+        fprintf(stderr, "test_ndarray: parse: FAIL: %s\n",
+                ndt_context_msg(ctx));
+        ndt_context_del(ctx);
+        return -1;
+    }
+    for (u = t; u->ndim > 0; u = ndt_next_dim(u)) {
+        if (u->meta_size != sizeof(ndt_fixed_dim_meta_t) ||
+            sizeof(ndt_fixed_dim_meta_t) != 2 * sizeof(int64_t)) {
+            fprintf(stderr, "test_ndarray: FAIL: unexpected meta_size\n");
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+    }
+    ndt_del(t);
+
+    fprintf(stderr, "test_ndarray (%zu test cases)\n", ntests);
+
+    ndt_context_del(ctx);
+    return 0;
+}
+
+
+/*********************************************************************/
+/*                         aligned dimensions                        */
+/*********************************************************************/
+
+typedef struct {
+    const char *type;
+    int valid;
+    int64_t data_size;
+    uint16_t data_align;
+    int c_contiguous;
+    int n;
+    int64_t indices[4];
+    int64_t offset;
+} dim_align_testcase_t;
+
+static const dim_align_testcase_t dim_align_tests[] = {
+  /* the dimension is padded */
+  { "fixed(shape=3, align=64) * float32", 1, 64, 64, 1, 1, {2}, 8 },
+  { "fixed(shape=10, align=64) * 3 * float32", 1, 128, 64, 1, 2, {9, 2}, 116 },
+  { "fixed(shape=3, align=1) * int64", 1, 24, 8, 1, 1, {2}, 16 },
+  { "fixed(shape=0, align=64) * int64", 1, 0, 64, 1, 0, {0}, 0 },
+  { "var(shapes=[5], align=64) * int16", 1, 64, 64, 1, 1, {4}, 8 },
+
+  /* rows of the enclosing dimensions are padded */
+  { "10 * fixed(shape=3, align=16) * float32", 1, 160, 16, 0, 2, {9, 2}, 152 },
+  { "2 * 2 * fixed(shape=5, align=8) * int8", 1, 32, 8, 0, 3, {1, 1, 4}, 28 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * fixed(shape=3, align=16) * int8",
+    1, 112, 16, 1, 3, {1, 2, 1}, 81 },
+  { "{a: int8, b: fixed(shape=3, align=32) * int16}", 1, 64, 32, 1, 1, {1}, 32 },
+
+  /* invalid */
+  { "fixed(shape=3, align=3) * int8", 0, 0, 0, 0, 0, {0}, 0 },
+  { "fixed(shape=3, align=0) * int8", 0, 0, 0, 0, 0, {0}, 0 },
+  { "fixed(shape=3, align=64) * T", 0, 0, 0, 0, 0, {0}, 0 },
+  { "fixed(shape=3, align=65536) * int8", 0, 0, 0, 0, 0, {0}, 0 },
+};
+
+/* the 'align' attribute is printed and distinguishes otherwise equal types */
+static const struct {
+    const char *type;
+    const char *repr;
+    int roundtrip;
+} dim_align_repr_tests[] = {
+  { "fixed(shape=3, align=64) * float32", "fixed(shape=3, align=64) * float32", 1 },
+  { "10 * fixed(shape=3, align=16) * float32", "10 * fixed(shape=3, align=16) * float32", 1 },
+  { "fixed(shape=3, align=1) * int64", "fixed(shape=3, align=1) * int64", 1 },
+  { "{a: int8, b: fixed(shape=3, align=32) * int16}", "{a : int8, b : fixed(shape=3, align=32) * int16}", 1 },
+  { "var(shapes=[5], align=64) * int16", "var(align=64) * int16", 0 },
+};
+
+static const struct {
+    const char *a;
+    const char *b;
+} dim_align_unequal_tests[] = {
+  { "10 * fixed(shape=3, align=16) * float32", "10 * 3 * float32" },
+  { "fixed(shape=3, align=64) * float32", "fixed(shape=3, align=32) * float32" },
+  { "fixed(shape=3, align=1) * int64", "3 * int64" },
+  { "var(shapes=[5], align=64) * int16", "var(shapes=[5]) * int16" },
+};
+
+static int
+test_dim_align_repr(ndt_context_t *ctx)
+{
+    size_t nrepr = sizeof dim_align_repr_tests / sizeof dim_align_repr_tests[0];
+    size_t nunequal = sizeof dim_align_unequal_tests / sizeof dim_align_unequal_tests[0];
+    ndt_t *t = NULL, *u = NULL;
+    char *s = NULL;
+    size_t i;
+
+    for (i = 0; i < nrepr; i++) {
+        t = ndt_from_string(dim_align_repr_tests[i].type, ctx);
+        if (t == NULL) {
+            goto error;
+        }
+
+        s = ndt_as_string(t, ctx);
+        if (s == NULL) {
+            goto error;
+        }
+
+        if (strcmp(s, dim_align_repr_tests[i].repr) != 0) {
+            fprintf(stderr, "test_dim_align: FAIL: expected \"%s\", got \"%s\"\n",
+                    dim_align_repr_tests[i].repr, s);
+            goto error;
+        }
+
+        if (dim_align_repr_tests[i].roundtrip) {
+            u = ndt_from_string(s, ctx);
+            if (u == NULL) {
+                goto error;
+            }
+
+            if (!ndt_equal(t, u) || t->data_size != u->data_size ||
+                t->data_align != u->data_align) {
+                fprintf(stderr, "test_dim_align: FAIL: \"%s\": roundtrip\n", s);
+                goto error;
+            }
+            ndt_del(u);
+            u = NULL;
+        }
+
+        ndt_free(s);
+        ndt_del(t);
+        s = NULL;
+        t = NULL;
+    }
+
+    for (i = 0; i < nunequal; i++) {
+        t = ndt_from_string(dim_align_unequal_tests[i].a, ctx);
+        u = ndt_from_string(dim_align_unequal_tests[i].b, ctx);
+        if (t == NULL || u == NULL) {
+            goto error;
+        }
+
+        if (ndt_equal(t, u) || ndt_hash(t, ctx) == ndt_hash(u, ctx)) {
+            fprintf(stderr, "test_dim_align: FAIL: \"%s\" == \"%s\"\n",
+                    dim_align_unequal_tests[i].a, dim_align_unequal_tests[i].b);
+            goto error;
+        }
+
+        ndt_del(t);
+        ndt_del(u);
+        t = u = NULL;
+    }
+
+    return (int)(nrepr + nunequal);
+
+error:
+    if (ctx->err != NDT_Success) {
+        fprintf(stderr, "test_dim_align: FAIL: %s\n", ndt_context_msg(ctx));
+    }
+    ndt_free(s);
+    ndt_del(t);
+    ndt_del(u);
+    return -1;
+}
+
+int
+test_dim_align(void)
+{
+    ndt_context_t *ctx;
+    const dim_align_testcase_t *tc;
+    size_t ntests = sizeof dim_align_tests / sizeof dim_align_tests[0];
+    ndt_t *t;
+    size_t i;
+    int n;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &dim_align_tests[i];
+
+        t = ndt_from_string(tc->type, ctx);
+        if (!tc->valid) {
+            if (t != NULL) {
+                fprintf(stderr, "test_dim_align: FAIL: expected error: \"%s\"\n",
+                        tc->type);
+                ndt_del(t);
+                ndt_context_del(ctx);
+                return -1;
+            }
+            if (ctx->err == NDT_MemoryError) {
+                fprintf(stderr, "test_dim_align: FAIL: unexpected MemoryError\n");
+                ndt_context_del(ctx);
+                return -1;
+            }
+            ndt_err_clear(ctx);
+            continue;
+        }
+
+        if (t == NULL) {
+            fprintf(stderr, "test_dim_align: FAIL: \"%s\": %s\n",
+                    tc->type, ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        if (t->data_size != tc->data_size ||
+            t->data_align != tc->data_align ||
+            ndt_is_c_contiguous(t) != tc->c_contiguous ||
+            ndt_offset_of(t, tc->indices, tc->n, ctx) != tc->offset) {
+            fprintf(stderr,
+                "test_dim_align: FAIL: \"%s\": unexpected layout\n",
+                tc->type);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        ndt_del(t);
+    }
+
+    n = test_dim_align_repr(ctx);
+    if (n < 0) {
+        ndt_context_del(ctx);
+        return -1;
+    }
+
+    fprintf(stderr, "test_dim_align (%zu test cases)\n", ntests + (size_t)n);
+
+    ndt_context_del(ctx);
+    return 0;
+}
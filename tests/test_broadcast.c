@@ -0,0 +1,193 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                       broadcast outer loops                       */
+/*********************************************************************/
+
+#define MAX_ARGS 3
+
+typedef struct {
+    const char *signature;
+    const char *args;
+    int outer_dims;
+    int64_t shape[4];
+    int64_t strides[MAX_ARGS][4];
+} broadcast_testcase_t;
+
+static const broadcast_testcase_t broadcast_tests[] = {
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(2 * 1 * float64, 3 * float64)",
+    2, {2, 3}, {{8, 0}, {0, 8}} },
+
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(2 * 3 * float64, float64)",
+    2, {2, 3}, {{24, 8}, {0, 0}} },
+
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(4 * 1 * 3 * int64, 2 * 1 * int64)",
+    3, {4, 2, 3}, {{24, 0, 8}, {0, 8, 0}} },
+
+  { "(Dims... * M * N * T, Dims... * N * P * T) -> Dims... * M * P * T",
+    "(5 * 1 * 2 * 3 * float32, 4 * 3 * 10 * float32)",
+    2, {5, 4}, {{24, 0}, {0, 120}} },
+
+  { "(Dims... * T, T, Dims... * T) -> Dims... * T",
+    "(3 * int64, int64, 2 * 1 * int64)",
+    2, {2, 3}, {{0, 8}, {0, 0}, {8, 0}} },
+
+  { "(pointer(Dims... * T)) -> Dims... * T",
+    "(pointer(2 * 5 * float64))",
+    2, {2, 5}, {{40, 8}} },
+
+  { "(Dims... * M * T) -> M * T",
+    "(2 * 3 * float64)",
+    0, {0}, {{0}} },
+
+  { NULL, NULL, 0, {0}, {{0}} }
+};
+
+static int
+check_loop(const broadcast_testcase_t *t, int outer_dims,
+           int64_t shape[NDT_MAX_DIM], int64_t strides[][NDT_MAX_DIM],
+           int nargs)
+{
+    int i, d;
+
+    if (outer_dims != t->outer_dims) {
+        fprintf(stderr, "test_broadcast: FAIL: outer_dims: expected %d, got %d\n",
+                t->outer_dims, outer_dims);
+        return -1;
+    }
+
+    for (d = 0; d < outer_dims; d++) {
+        if (shape[d] != t->shape[d]) {
+            fprintf(stderr, "test_broadcast: FAIL: shape[%d]: expected %" PRIi64
+                    ", got %" PRIi64 "\n", d, t->shape[d], shape[d]);
+            return -1;
+        }
+        for (i = 0; i < nargs; i++) {
+            if (strides[i][d] != t->strides[i][d]) {
+                fprintf(stderr, "test_broadcast: FAIL: strides[%d][%d]: expected %"
+                        PRIi64 ", got %" PRIi64 "\n", i, d, t->strides[i][d],
+                        strides[i][d]);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int
+test_broadcast(void)
+{
+    static int64_t strides[MAX_ARGS][NDT_MAX_DIM];
+    int64_t shape[NDT_MAX_DIM];
+    const broadcast_testcase_t *t;
+    ndt_context_t *ctx;
+    ndt_t *f = NULL, *args = NULL, *ret = NULL;
+    int outer_dims;
+    int count = 0;
+    int res = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (t = broadcast_tests; t->signature != NULL; t++, count++) {
+        f = ndt_from_string(t->signature, ctx);
+        args = ndt_from_string(t->args, ctx);
+        if (f == NULL || args == NULL) {
+            fprintf(stderr, "test_broadcast: FAIL: could not parse \"%s\"\n", t->args);
+            goto out;
+        }
+
+        for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+            ndt_err_clear(ctx);
+
+            ndt_set_alloc_fail();
+            ret = ndt_typecheck_broadcast(f, args, &outer_dims, shape, strides, ctx);
+            ndt_set_alloc();
+
+            if (ctx->err != NDT_MemoryError) {
+                break;
+            }
+
+            if (ret != NULL) {
+                fprintf(stderr, "test_broadcast: FAIL: expect NULL after MemoryError\n");
+                goto out;
+            }
+        }
+
+        if (ret == NULL) {
+            fprintf(stderr, "test_broadcast: FAIL: \"%s\" with \"%s\"\n",
+                    t->signature, t->args);
+            goto out;
+        }
+
+        if (check_loop(t, outer_dims, shape, strides, (int)args->Tuple.shape) < 0) {
+            fprintf(stderr, "test_broadcast: FAIL: \"%s\" with \"%s\"\n",
+                    t->signature, t->args);
+            goto out;
+        }
+
+        ndt_del(ret);
+        ndt_del(args);
+        ndt_del(f);
+        ret = args = f = NULL;
+    }
+
+    fprintf(stderr, "test_broadcast (%d test cases)\n", count);
+    res = 0;
+
+out:
+    ndt_del(ret);
+    ndt_del(args);
+    ndt_del(f);
+    ndt_context_del(ctx);
+    return res;
+}
@@ -0,0 +1,372 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                       typecheck result cache                      */
+/*********************************************************************/
+
+static int
+check_stats(ndt_typecheck_cache_t *cache, int64_t hits, int64_t misses,
+            int64_t evictions, int64_t size)
+{
+    ndt_cache_stats_t stats;
+
+    ndt_typecheck_cache_stats(cache, &stats);
+
+    if (stats.hits != hits || stats.misses != misses ||
+        stats.evictions != evictions || stats.size != size) {
+        fprintf(stderr,
+            "test_cache: FAIL: stats: hits=%" PRIi64 " misses=%" PRIi64
+            " evictions=%" PRIi64 " size=%" PRIi64 "\n",
+            stats.hits, stats.misses, stats.evictions, stats.size);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Run the typecheck tests through 'cache'.  The types are parsed again on
+ * each call, so hits are found by structural comparison.  Return the number
+ * of successful typechecks or -1 on failure.
+ */
+static int
+run_typecheck_tests(ndt_typecheck_cache_t *cache, ndt_context_t *ctx)
+{
+    const typecheck_testcase_t *t;
+    ndt_t *f, *args, *ret, *expected;
+    int outer_dims;
+    int n = 0;
+
+    for (t = typecheck_tests; t->signature != NULL; t++) {
+        f = ndt_from_string(t->signature, ctx);
+        if (f == NULL) {
+            fprintf(stderr, "test_cache: FAIL: could not parse \"%s\"\n", t->signature);
+            return -1;
+        }
+
+        args = ndt_from_string(t->args, ctx);
+        if (args == NULL) {
+            ndt_del(f);
+            fprintf(stderr, "test_cache: FAIL: could not parse \"%s\"\n", t->args);
+            return -1;
+        }
+
+        ret = ndt_typecheck_cached(cache, f, args, &outer_dims, ctx);
+        ndt_del(f);
+        ndt_del(args);
+        ndt_err_clear(ctx);
+
+        if (!!ret != !!t->expected) {
+            ndt_del(ret);
+            fprintf(stderr, "test_cache: FAIL: \"%s\" with \"%s\"\n", t->signature, t->args);
+            return -1;
+        }
+
+        if (ret == NULL) {
+            continue;
+        }
+
+        expected = ndt_from_string(t->expected, ctx);
+        if (expected == NULL) {
+            ndt_del(ret);
+            fprintf(stderr, "test_cache: FAIL: could not parse \"%s\"\n", t->expected);
+            return -1;
+        }
+
+        if (!ndt_equal(ret, expected) || outer_dims != t->outer_dims) {
+            ndt_del(ret);
+            ndt_del(expected);
+            fprintf(stderr, "test_cache: FAIL: expected \"%s\"\n", t->expected);
+            return -1;
+        }
+
+        ndt_del(ret);
+        ndt_del(expected);
+        n++;
+    }
+
+    return n;
+}
+
+static int
+test_lru(ndt_context_t *ctx)
+{
+    const char *sig = "(Dims... * T) -> Dims... * T";
+    const char *argv[] = { "(2 * int64)", "(2 * float64)", "(2 * int64)", "(3 * float32)", "(2 * float64)" };
+    ndt_typecheck_cache_t *cache;
+    ndt_t *f = NULL, *args[5] = {NULL};
+    ndt_t *ret[5] = {NULL};
+    int outer_dims;
+    int i, res = -1;
+
+    cache = ndt_typecheck_cache_new(2, ctx);
+    if (cache == NULL) {
+        return -1;
+    }
+
+    f = ndt_from_string(sig, ctx);
+    if (f == NULL) {
+        goto out;
+    }
+
+    for (i = 0; i < 5; i++) {
+        args[i] = ndt_from_string(argv[i], ctx);
+        if (args[i] == NULL) {
+            goto out;
+        }
+    }
+
+    /* int64 and float64 miss; int64 hits and becomes the most recent entry;
+       float32 evicts float64, which misses again and evicts int64. */
+    for (i = 0; i < 5; i++) {
+        ret[i] = ndt_typecheck_cached(cache, f, args[i], &outer_dims, ctx);
+        if (ret[i] == NULL) {
+            goto out;
+        }
+    }
+
+    if (check_stats(cache, 1, 4, 2, 2) < 0) {
+        goto out;
+    }
+
+    if (ret[2] != ret[0] || ret[4] == ret[1]) {
+        fprintf(stderr, "test_cache: FAIL: unexpected result sharing\n");
+        goto out;
+    }
+
+    /* Results remain valid after their entries have been evicted. */
+    ndt_typecheck_cache_del(cache);
+    cache = NULL;
+
+    for (i = 0; i < 5; i++) {
+        if (!ndt_equal(ret[i], args[i]->Tuple.types[0])) {
+            fprintf(stderr, "test_cache: FAIL: invalid result after eviction\n");
+            goto out;
+        }
+    }
+
+    res = 0;
+
+out:
+    ndt_typecheck_cache_del(cache);
+    for (i = 0; i < 5; i++) {
+        ndt_del(ret[i]);
+        ndt_del(args[i]);
+    }
+    ndt_del(f);
+    return res;
+}
+
+/* Cached results are shared: modifying constructors must copy them. */
+static int
+test_shared_result(ndt_context_t *ctx)
+{
+    const int64_opt_t none = {None, 0};
+    const char_opt_t order = {Some, 'F'};
+    ndt_typecheck_cache_t *cache;
+    ndt_t *f = NULL, *args = NULL;
+    ndt_t *ret = NULL, *t = NULL;
+    int outer_dims;
+    int res = -1;
+
+    cache = ndt_typecheck_cache_new(2, ctx);
+    if (cache == NULL) {
+        return -1;
+    }
+
+    f = ndt_from_string("(T) -> T", ctx);
+    args = ndt_from_string("(2 * 3 * int64)", ctx);
+    if (f == NULL || args == NULL) {
+        goto out;
+    }
+
+    t = ndt_typecheck_cached(cache, f, args, &outer_dims, ctx);
+    if (t == NULL) {
+        goto out;
+    }
+
+    t = ndt_array(t, NULL, none, none, order, ctx);
+    if (t == NULL) {
+        goto out;
+    }
+
+    ret = ndt_typecheck_cached(cache, f, args, &outer_dims, ctx);
+    if (ret == NULL || check_stats(cache, 1, 1, 0, 1) < 0) {
+        goto out;
+    }
+
+    if (!ndt_is_f_contiguous(t) || !ndt_is_c_contiguous(ret) ||
+        !ndt_is_c_contiguous(args->Tuple.types[0]) ||
+        ret->Concrete.FixedDim.stride != 24) {
+        fprintf(stderr, "test_cache: FAIL: shared result modified\n");
+        goto out;
+    }
+
+    res = 0;
+
+out:
+    ndt_typecheck_cache_del(cache);
+    ndt_del(ret);
+    ndt_del(t);
+    ndt_del(f);
+    ndt_del(args);
+    return res;
+}
+
+int
+test_cache(void)
+{
+    ndt_typecheck_cache_t *cache = NULL;
+    ndt_cache_stats_t stats;
+    ndt_context_t *ctx;
+    ndt_t *f = NULL, *args = NULL, *ret;
+    int outer_dims;
+    int n, m, ntests, count = 0;
+    int res = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    if (ndt_typecheck_cache_new(0, ctx) != NULL || ctx->err != NDT_ValueError) {
+        fprintf(stderr, "test_cache: FAIL: expected ValueError\n");
+        goto out;
+    }
+    ndt_err_clear(ctx);
+    count++;
+
+    cache = ndt_typecheck_cache_new(1024, ctx);
+    if (cache == NULL) {
+        goto out;
+    }
+
+    /* the first pass fills the cache, the second pass only hits */
+    n = run_typecheck_tests(cache, ctx);
+    if (n < 0) {
+        goto out;
+    }
+    ndt_typecheck_cache_stats(cache, &stats);
+
+    m = run_typecheck_tests(cache, ctx);
+    if (m != n) {
+        goto out;
+    }
+
+    for (ntests = 0; typecheck_tests[ntests].signature != NULL; ntests++);
+
+    /* failed typechecks are not cached */
+    if (check_stats(cache, stats.hits + n, stats.misses + (ntests-n), 0,
+                    stats.size) < 0) {
+        goto out;
+    }
+    count += ntests;
+
+    if (test_lru(ctx) < 0) {
+        goto out;
+    }
+    count++;
+
+    if (test_shared_result(ctx) < 0) {
+        goto out;
+    }
+    count++;
+
+    ndt_typecheck_cache_del(cache);
+    cache = NULL;
+
+    f = ndt_from_string("(N * T, N * T) -> N * T", ctx);
+    args = ndt_from_string("(10 * float64, 10 * float64)", ctx);
+    if (f == NULL || args == NULL) {
+        goto out;
+    }
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        cache = ndt_typecheck_cache_new(4, ctx);
+        ret = NULL;
+        if (cache != NULL) {
+            ret = ndt_typecheck_cached(cache, f, args, &outer_dims, ctx);
+            if (ret != NULL) {
+                ndt_del(ret);
+                ret = ndt_typecheck_cached(cache, f, args, &outer_dims, ctx);
+            }
+        }
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (ret != NULL) {
+            fprintf(stderr, "test_cache: FAIL: expect NULL after MemoryError\n");
+            goto out;
+        }
+
+        ndt_typecheck_cache_del(cache);
+        cache = NULL;
+    }
+
+    if (ret == NULL || check_stats(cache, 1, 1, 0, 1) < 0) {
+        ndt_del(ret);
+        fprintf(stderr, "test_cache: FAIL: alloc failure\n");
+        goto out;
+    }
+    ndt_del(ret);
+    count++;
+
+    fprintf(stderr, "test_cache (%d test cases)\n", count);
+    res = 0;
+
+out:
+    ndt_typecheck_cache_del(cache);
+    ndt_del(f);
+    ndt_del(args);
+    ndt_context_del(ctx);
+    return res;
+}
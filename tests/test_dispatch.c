@@ -0,0 +1,280 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                         multiple dispatch                         */
+/*********************************************************************/
+
+static const char *signatures[] = {
+  "(... * float64, ... * float64) -> ... * float64",
+  "(N * float64, N * float64) -> float64",
+  "(... * T, ... * T) -> ... * T",
+  "(int64, int64) -> int64",
+  "(N * M * T, M * P * T) -> N * P * T",
+  "(... * int64) -> ... * int64",
+  "(T) -> T",
+  "(... * Signed) -> ... * int64",
+  "() -> int64",
+  NULL
+};
+
+typedef struct {
+    const char *args;
+    int expected;
+} dispatch_testcase_t;
+
+static const dispatch_testcase_t dispatch_tests[] = {
+  { "(2 * float64, 2 * float64)", 1 },
+  { "(2 * 3 * float64, 2 * 3 * float64)", 0 },
+  { "(2 * 3 * float32, 3 * 4 * float32)", 4 },
+  { "(2 * 3 * float32, 2 * 4 * float32)", 2 },
+  { "(int64, int64)", 3 },
+  { "(int64, float64)", -1 },
+  { "(10 * int64)", 5 },
+  { "(10 * int8)", 7 },
+  { "({a: int64})", 6 },
+  { "()", 8 },
+  { "(int64, int64, int64)", -1 },
+  { NULL, 0 }
+};
+
+/* ndt_typecheck() and ndt_dispatch_find() must accept the same arguments */
+static const char *agree_signatures[] = {
+  "(Dims... * T, Dims... * T) -> Dims... * T",
+  "(Dims... * int64, Dims... * int64) -> Dims... * int64",
+  "(Dims... * M * N * T, Dims... * N * P * T) -> Dims... * M * P * T",
+  "(Dims... * T, T) -> Dims... * T",
+  NULL
+};
+
+static const char *agree_args[] = {
+  "(2 * 3 * int64, 2 * 3 * int64)",
+  "(2 * 3 * int64, 3 * int64)",
+  "(2 * 1 * int64, 3 * int64)",
+  "(2 * 3 * int64, int64)",
+  "(int64, int64)",
+  "(5 * 2 * 3 * float64, 5 * 3 * 4 * float64)",
+  "(5 * 2 * 3 * float64, 3 * 4 * float64)",
+  "(2 * 3 * float64, 2 * 3 * int64)",
+  NULL
+};
+
+/*
+ * Return 1 if the single signature 'sig' matches 'args' both in
+ * ndt_typecheck() and in ndt_dispatch_find(), 0 if it matches in
+ * neither and -1 if they disagree or on error.
+ */
+static int
+agree(const ndt_t *sig, const ndt_t *args, ndt_context_t *ctx)
+{
+    ndt_dispatch_t *d;
+    ndt_t *ret;
+    int outer_dims;
+    int id;
+
+    d = ndt_dispatch_new(ctx);
+    if (d == NULL || ndt_dispatch_add(d, sig, ctx) != 0) {
+        ndt_dispatch_del(d);
+        return -1;
+    }
+
+    id = ndt_dispatch_find(d, args, ctx);
+    ndt_dispatch_del(d);
+    if (id < 0 && ctx->err != NDT_TypeError) {
+        return -1;
+    }
+    ndt_err_clear(ctx);
+
+    ret = ndt_typecheck(sig, args, &outer_dims, ctx);
+    if (ret == NULL && ctx->err == NDT_MemoryError) {
+        return -1;
+    }
+    ndt_err_clear(ctx);
+    ndt_del(ret);
+
+    if ((id == 0) != (ret != NULL)) {
+        return -1;
+    }
+
+    return id == 0;
+}
+
+static int
+build(ndt_dispatch_t **d, ndt_t *sigs[], ndt_context_t *ctx)
+{
+    int i, id;
+
+    *d = ndt_dispatch_new(ctx);
+    if (*d == NULL) {
+        return -1;
+    }
+
+    for (i = 0; signatures[i] != NULL; i++) {
+        id = ndt_dispatch_add(*d, sigs[i], ctx);
+        if (id != i) {
+            if (id >= 0) {
+                ndt_err_format(ctx, NDT_RuntimeError, "unexpected index");
+            }
+            ndt_dispatch_del(*d);
+            *d = NULL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+test_dispatch(void)
+{
+    ndt_t *sigs[sizeof signatures / sizeof signatures[0]] = {NULL};
+    const dispatch_testcase_t *t;
+    ndt_dispatch_t *d = NULL;
+    ndt_context_t *ctx;
+    ndt_t *args;
+    int ret = -1;
+    int i, id, count = 0;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; signatures[i] != NULL; i++) {
+        sigs[i] = ndt_from_string(signatures[i], ctx);
+        if (sigs[i] == NULL) {
+            fprintf(stderr, "test_dispatch: FAIL: could not parse \"%s\"\n", signatures[i]);
+            goto out;
+        }
+    }
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        (void)build(&d, sigs, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (d != NULL) {
+            fprintf(stderr, "test_dispatch: FAIL: expect NULL after MemoryError\n");
+            goto out;
+        }
+    }
+
+    if (d == NULL) {
+        fprintf(stderr, "test_dispatch: FAIL: could not build the index\n");
+        goto out;
+    }
+
+    for (t = dispatch_tests; t->args != NULL; t++, count++) {
+        args = ndt_from_string(t->args, ctx);
+        if (args == NULL) {
+            fprintf(stderr, "test_dispatch: FAIL: could not parse \"%s\"\n", t->args);
+            goto out;
+        }
+
+        id = ndt_dispatch_find(d, args, ctx);
+        if (id != t->expected ||
+            (id < 0 && ctx->err != NDT_TypeError) ||
+            (id >= 0 && ndt_match(sigs[id]->Function.pos, args, ctx) != 1)) {
+            fprintf(stderr, "test_dispatch: FAIL: \"%s\": expected %d, got %d\n",
+                    t->args, t->expected, id);
+            ndt_del(args);
+            goto out;
+        }
+
+        ndt_err_clear(ctx);
+        ndt_del(args);
+    }
+
+    /* the arguments must be a tuple */
+    if (ndt_dispatch_find(d, sigs[3]->Function.ret, ctx) != -1 ||
+        ctx->err != NDT_ValueError) {
+        fprintf(stderr, "test_dispatch: FAIL: expected ValueError\n");
+        goto out;
+    }
+    ndt_err_clear(ctx);
+    count++;
+
+    for (i = 0; agree_signatures[i] != NULL; i++) {
+        ndt_t *sig = ndt_from_string(agree_signatures[i], ctx);
+        const char **a;
+
+        if (sig == NULL) {
+            fprintf(stderr, "test_dispatch: FAIL: could not parse \"%s\"\n",
+                    agree_signatures[i]);
+            goto out;
+        }
+
+        for (a = agree_args; *a != NULL; a++, count++) {
+            args = ndt_from_string(*a, ctx);
+            if (args == NULL || agree(sig, args, ctx) < 0) {
+                fprintf(stderr, "test_dispatch: FAIL: ndt_typecheck and "
+                        "ndt_dispatch_find disagree: \"%s\" with \"%s\"\n",
+                        agree_signatures[i], *a);
+                ndt_del(args);
+                ndt_del(sig);
+                goto out;
+            }
+            ndt_del(args);
+        }
+
+        ndt_del(sig);
+    }
+
+    fprintf(stderr, "test_dispatch (%d test cases)\n", count);
+    ret = 0;
+
+out:
+    ndt_dispatch_del(d);
+    for (i = 0; signatures[i] != NULL; i++) {
+        ndt_del(sigs[i]);
+    }
+    ndt_context_del(ctx);
+    return ret;
+}
@@ -0,0 +1,229 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+
+
+/*********************************************************************/
+/*                          memory footprint                         */
+/*********************************************************************/
+
+#define FIXED_META ((int64_t)sizeof(ndt_fixed_dim_meta_t))
+#define VAR_META(n) ((int64_t)sizeof(ndt_var_dim_meta_t) + (2*(n)+1)*4 + ((n)+7)/8)
+
+typedef struct {
+    const char *type;
+    int64_t data;
+    int64_t padding;
+    int64_t meta;
+    int64_t indirect;
+    int64_t nvarlen;
+    bool exact;
+} footprint_testcase_t;
+
+static const footprint_testcase_t footprint_tests[] = {
+  { "int64", 8, 0, 0, 0, 0, true },
+  { "10 * int64", 80, 0, FIXED_META, 0, 0, true },
+  { "2 * 3 * int64", 48, 0, 2*FIXED_META, 0, 0, true },
+  { "{a: int8, b: int64, c: int8}", 10, 14, 0, 0, 0, true },
+  { "10 * {a: int8, b: int64}", 90, 70, FIXED_META, 0, 0, true },
+  { "{a: int8, b: int64, c: int8, reorder=true}", 10, 6, 0, 0, 0, true },
+
+  /* validity bitmaps */
+  { "?int64", 8, 0, 1, 0, 0, true },
+  { "10 * ?int64", 80, 0, FIXED_META+2, 0, 0, true },
+
+  /* var dimensions share the data, each has its own offsets */
+  { "var(shapes=[2]) * var(shapes=[3,4]) * int64", 56, 0, VAR_META(1)+VAR_META(2), 0, 0, true },
+  { "var(shapes=[2]) * var(shapes=[3,4], bitmap=[1,0]) * int32", 28, 0, VAR_META(1)+VAR_META(2), 0, 0, true },
+
+  /* aligned dimensions */
+  { "fixed(shape=3, align=64) * int8", 3, 61, FIXED_META, 0, 0, true },
+  { "10 * fixed(shape=3, align=16) * float32", 120, 40, 2*FIXED_META, 0, 0, true },
+
+  /* indirect memory */
+  { "pointer(int64)", 8, 0, 0, 8, 0, true },
+  { "2 * pointer(3 * int32)", 16, 0, FIXED_META, 24+FIXED_META, 0, true },
+  { "3 * string", 48, 0, FIXED_META, 3*NDT_VARLEN_ESTIMATE, 3, false },
+  { "bytes", 16, 0, 0, NDT_VARLEN_ESTIMATE, 1, false },
+
+  /* partially concrete types */
+  { "N * int64", 8, 0, 0, 0, 0, false },
+  { "N * {a: int8, b: T}", 1, 0, 0, 0, 0, false },
+  { "Any", 0, 0, 0, 0, 0, false },
+};
+
+typedef struct {
+    const ndt_t *root;
+    ndt_footprint_t root_sub;
+    int64_t leaf_data;
+    int64_t nodes;
+} visit_t;
+
+static int
+visit(const ndt_t *t, const ndt_footprint_t *sub, void *arg)
+{
+    visit_t *v = (visit_t *)arg;
+
+    if (sub->total != sub->data + sub->padding + sub->meta + sub->indirect) {
+        return -1;
+    }
+
+    switch (t->tag) {
+    case FixedDim: case VarDim: case SymbolicDim: case Tuple: case Record:
+    case Option: case OptionItem: case Constr: case Nominal: case Pointer:
+        break;
+    default:
+        v->leaf_data += sub->data;
+        break;
+    }
+
+    v->nodes++;
+    if (t == v->root) {
+        v->root_sub = *sub;
+    }
+
+    return 0;
+}
+
+static int
+check_overlapping_strides(ndt_context_t *ctx)
+{
+    int64_opt_t none = {None, 0};
+    char_opt_t order = {None, 0};
+    int64_t strides[1] = {0};
+    ndt_footprint_t r;
+    ndt_t *t;
+    int ret = -1;
+
+    t = ndt_from_string("3 * int64", ctx);
+    if (t == NULL) {
+        return -1;
+    }
+
+    t = ndt_array(t, strides, none, none, order, ctx);
+    if (t == NULL) {
+        return -1;
+    }
+
+    /* one item is broadcast */
+    if (ndt_footprint(t, &r, NULL, NULL, ctx) == 0 &&
+        r.data == 8 && r.padding == 0 && r.total == 8 + FIXED_META) {
+        ret = 0;
+    }
+
+    ndt_del(t);
+    return ret;
+}
+
+int
+test_footprint(void)
+{
+    ndt_context_t *ctx;
+    const footprint_testcase_t *tc;
+    size_t ntests = sizeof footprint_tests / sizeof footprint_tests[0];
+    ndt_footprint_t r;
+    visit_t v;
+    ndt_t *t;
+    size_t i;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &footprint_tests[i];
+
+        t = ndt_from_string(tc->type, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_footprint: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        memset(&v, 0, sizeof v);
+        v.root = t;
+
+        if (ndt_footprint(t, &r, visit, &v, ctx) < 0) {
+            fprintf(stderr, "test_footprint: FAIL: \"%s\": %s\n",
+                    tc->type, ndt_context_msg(ctx));
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        if (r.data != tc->data || r.padding != tc->padding ||
+            r.meta != tc->meta || r.indirect != tc->indirect ||
+            r.nvarlen != tc->nvarlen || r.exact != tc->exact ||
+            r.total != r.data + r.padding + r.meta + r.indirect ||
+            (ndt_is_concrete(t) && r.data + r.padding != t->data_size)) {
+            fprintf(stderr, "test_footprint: FAIL: \"%s\": unexpected report\n",
+                    tc->type);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        /* the root subtree covers everything, leaves own the data */
+        if (v.nodes == 0 || v.root_sub.total != r.total ||
+            v.root_sub.exact != r.exact ||
+            (tc->indirect == 0 && v.leaf_data != r.data)) {
+            fprintf(stderr, "test_footprint: FAIL: \"%s\": unexpected subtrees\n",
+                    tc->type);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        ndt_del(t);
+    }
+
+    if (check_overlapping_strides(ctx) < 0) {
+        fprintf(stderr, "test_footprint: FAIL: overlapping strides\n");
+        ndt_context_del(ctx);
+        return -1;
+    }
+
+    fprintf(stderr, "test_footprint (%zu test cases)\n", ntests + 1);
+
+    ndt_context_del(ctx);
+    return 0;
+}
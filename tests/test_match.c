@@ -172,6 +172,46 @@ const match_testcase_t match_tests[] = {
     "?uint64",
     1 },
 
+  { "Scalar",
+    "Float",
+    1 },
+
+  { "Scalar",
+    "FixedString",
+    1 },
+
+  { "Float",
+    "Scalar",
+    0 },
+
+  { "Dims... * int64",
+    "N * int64",
+    1 },
+
+  { "Dims... * int64",
+    "2 * D... * int64",
+    1 },
+
+  { "Dims... * int64",
+    "2 * ... * int64",
+    0 },
+
+  { "2 * Dims... * T",
+    "2 * D... * 3 * int64",
+    1 },
+
+  { "(Dims... * T, Dims... * T)",
+    "(2 * D... * int64, 2 * D... * int64)",
+    1 },
+
+  { "(Dims... * T, Dims... * T)",
+    "(2 * D... * int64, 2 * E... * int64)",
+    0 },
+
+  { "(Dims... * T, Dims... * T)",
+    "(N * D... * int64, M * D... * int64)",
+    0 },
+
   { "10 * void",
     "10 * void",
     1 },
@@ -2872,6 +2912,73 @@ const match_testcase_t match_tests[] = {
   { "(Dims... * M * N * T, Dims... * N * P * T)",
     "(2 * 3 * int64, 2 * 10 * int64)", 0 },
 
+  /* more bindings than fit in the inline part of the symbol table */
+  { "A * B * C * D * E * F * G * H * I * J * K * T",
+    "1 * 2 * 3 * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 11 * int64", 1 },
+
+  { "A * B * C * D * E * F * G * H * I * J * A * T",
+    "1 * 2 * 3 * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 1 * int64", 1 },
+
+  { "A * B * C * D * E * F * G * H * I * J * A * T",
+    "1 * 2 * 3 * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 2 * int64", 0 },
+
+  { "(A * B * C * D * E * F * G * H * I * J * K * T, K * J * S)",
+    "(1 * 2 * 3 * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 11 * int64, 11 * 10 * float32)", 1 },
+
+  { "(A * B * C * D * E * F * G * H * I * J * K * T, K * J * T)",
+    "(1 * 2 * 3 * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 11 * int64, 11 * 10 * float32)", 0 },
+
+  /* variadic tuples match trailing fields */
+  { "(int64, ...)",
+    "(int64, float64, int8)", 1 },
+
+  { "(int64, ...)",
+    "(float64, int64)", 0 },
+
+  { "(int64, float64, ...)",
+    "(int64)", 0 },
+
+  { "(T, T, ...)",
+    "(10 * int8, 10 * int8, float32)", 1 },
+
+  { "(int64)",
+    "(int64, ...)", 0 },
+
+  { "(int64, ...)",
+    "(int64, float64, ...)", 1 },
+
+  /* variadic records match a subset of named fields in any position */
+  { "{a : int64, ...}",
+    "{b : float64, a : int64}", 1 },
+
+  { "{a : int64, ...}",
+    "{b : float64, c : int64}", 0 },
+
+  { "{c : T, a : T, ...}",
+    "{a : int64, b : float64, c : int64}", 1 },
+
+  { "{c : T, a : T, ...}",
+    "{a : int64, b : float64, c : int32}", 0 },
+
+  { "10 * {id : int64, ...}",
+    "10 * {x : float32, y : float32, id : int64}", 1 },
+
+  { "N * {id : Signed, ...}",
+    "10 * {x : float32, y : float32, id : uint64}", 0 },
+
+  { "{...}",
+    "{a : int64}", 1 },
+
+  { "{b : int64, ...}",
+    "{a : int64, b : int64, ...}", 1 },
+
+  { "{a : int64}",
+    "{a : int64, ...}", 0 },
+
+  /* non-variadic records compare names by position */
+  { "{a : int64, b : int8}",
+    "{b : int8, a : int64}", 0 },
+
 #if 0
   /* ndarray */
   { "[10 * 2 * int64, style='ndarray']",
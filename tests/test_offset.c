@@ -0,0 +1,200 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+
+
+/*********************************************************************/
+/*                       byte offsets of elements                     */
+/*********************************************************************/
+
+typedef struct {
+    const char *type;
+    int n;
+    int64_t indices[4];
+    int64_t expected; /* -1: error */
+} offset_testcase_t;
+
+static const offset_testcase_t offset_tests[] = {
+  /* fixed dimensions */
+  { "2 * 3 * int64", 2, {1, 2}, 40 },
+  { "2 * 3 * int64", 1, {1}, 24 },
+  { "2 * 3 * int64", 0, {0}, 0 },
+  { "2 * 3 * int64", 2, {2, 0}, -1 },
+  { "2 * 3 * int64", 2, {0, 3}, -1 },
+  { "2 * 3 * int64", 2, {-1, 0}, -1 },
+  { "2 * 3 * int64", 3, {0, 0, 0}, -1 },
+
+  /* records and tuples */
+  { "{a: int8, b: int64}", 1, {1}, 8 },
+  { "{a: int8, b: int64, pack=1}", 1, {1}, 1 },
+  { "3 * {a: int8, b: 2 * int32}", 3, {2, 1, 1}, 32 },
+  { "3 * {a: int8, b: 2 * int32}", 2, {2, 1}, 28 },
+  { "(int8, ?float64)", 1, {1}, 8 },
+  { "(int8, float64)", 1, {2}, -1 },
+
+  /* var dimensions */
+  { "var(shapes=[2]) * var(shapes=[3,4]) * int64", 2, {1, 2}, 40 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * int64", 2, {1, 3}, 48 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * int64", 2, {0, 3}, -1 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * int64", 1, {1}, 24 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * int64", 0, {0}, 0 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * 2 * int32", 3, {1, 2, 1}, 44 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * {a: int8, b: int32}", 3, {1, 0, 1}, 28 },
+  { "var(shapes=[2]) * var(shapes=[1,2], bitmap=[1,0]) * int64", 2, {0, 0}, 0 },
+  { "var(shapes=[2]) * var(shapes=[1,2], bitmap=[1,0]) * int64", 2, {1, 0}, -1 },
+
+  /* invalid */
+  { "N * int64", 1, {0}, -1 },
+  { "string", 1, {0}, -1 },
+};
+
+int
+test_offset(void)
+{
+    ndt_context_t *ctx;
+    const offset_testcase_t *tc;
+    size_t ntests = sizeof offset_tests / sizeof offset_tests[0];
+    int64_t indices[4*5*2];
+    int64_t out[4*5];
+    int64_t offset;
+    int64_opt_t none = {None, 0};
+    char_opt_t order = {Some, 'F'};
+    ndt_t *t;
+    size_t i;
+    int64_t k;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &offset_tests[i];
+
+        t = ndt_from_string(tc->type, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_offset: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        offset = ndt_offset_of(t, tc->indices, tc->n, ctx);
+        if (offset != tc->expected) {
+            fprintf(stderr,
+                "test_offset: FAIL: \"%s\": expected %" PRIi64 ", got %" PRIi64 "\n",
+                tc->type, tc->expected, offset);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        if (offset < 0) {
+            if (ctx->err == NDT_Success || ctx->err == NDT_MemoryError) {
+                fprintf(stderr, "test_offset: FAIL: \"%s\": missing error\n",
+                        tc->type);
+                ndt_del(t);
+                ndt_context_del(ctx);
+                return -1;
+            }
+            ndt_err_clear(ctx);
+        }
+
+        ndt_del(t);
+    }
+
+    /* batched offsets, C and Fortran order */
+    for (k = 0; k < 20; k++) {
+        indices[2*k] = k / 5;
+        indices[2*k+1] = k % 5;
+    }
+
+    t = ndt_from_string("4 * 5 * int32", ctx);
+    if (t == NULL) {
+        fprintf(stderr, "test_offset: parse: FAIL: %s\n", ndt_context_msg(ctx));
+        ndt_context_del(ctx);
+        return -1;
+    }
+
+    if (ndt_offsets_of(t, indices, 2, out, 20, ctx) < 0) {
+        goto error;
+    }
+    for (k = 0; k < 20; k++) {
+        if (out[k] != 4 * k) {
+            goto error;
+        }
+    }
+
+    t = ndt_array(t, NULL, none, none, order, ctx);
+    if (t == NULL) {
+        fprintf(stderr, "test_offset: FAIL: %s\n", ndt_context_msg(ctx));
+        ndt_context_del(ctx);
+        return -1;
+    }
+
+    if (ndt_offsets_of(t, indices, 2, out, 20, ctx) < 0) {
+        goto error;
+    }
+    for (k = 0; k < 20; k++) {
+        if (out[k] != ndt_offset_of(t, indices+2*k, 2, ctx) ||
+            out[k] != 4 * (indices[2*k] + 4 * indices[2*k+1])) {
+            goto error;
+        }
+    }
+
+    indices[2*19] = 4;
+    if (ndt_offsets_of(t, indices, 2, out, 20, ctx) != -1) {
+        goto error;
+    }
+    ndt_err_clear(ctx);
+
+    fprintf(stderr, "test_offset (%zu test cases)\n", ntests + 3);
+
+    ndt_del(t);
+    ndt_context_del(ctx);
+    return 0;
+
+error:
+    fprintf(stderr, "test_offset: batched offsets: FAIL\n");
+    ndt_del(t);
+    ndt_context_del(ctx);
+    return -1;
+}
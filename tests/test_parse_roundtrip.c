@@ -135,6 +135,10 @@ const char *parse_roundtrip_tests[] = {
   "categorical(-176354404 : int32, 10 : int64)",
   "10 * categorical(-176354404 : int32, 10 : int64, 10 : float32)",
   "categorical(-176354404 : int32, 10 : int64, 10 : float32)",
+  "categorical(-9223372036854775808 : int64, 9223372036854775807 : int64)",
+  "categorical(0 : uint8, 99 : uint16, 100 : uint32, 18446744073709551615 : uint64)",
+  "categorical(-1 : int8, -10 : int16, -99 : int32, -100 : int64)",
+  "9223372036854775807 * Any",
   "10 * categorical(500601201 : int64)",
   "categorical(500601201 : int64)",
   "10 * categorical(10 : int64, 500601201 : int64)",
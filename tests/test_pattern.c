@@ -0,0 +1,272 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                         compiled patterns                         */
+/*********************************************************************/
+
+typedef struct {
+    const char *pattern;
+    const char *candidate;
+    const char *name;
+    const char *binding;
+} binding_testcase_t;
+
+static const binding_testcase_t binding_tests[] = {
+  { "N * M * T", "2 * 3 * int64", "N", "2" },
+  { "N * M * T", "2 * 3 * int64", "M", "3" },
+  { "N * M * T", "2 * 3 * int64", "T", "int64" },
+  { "N * N * T", "A * A * {a: int8}", "N", "symbol A" },
+  { "N * N * T", "A * A * {a: int8}", "T", "{a : int8}" },
+  { "T", "U", "T", "symbol U" },
+  { "Dims... * float64", "2 * 3 * float64", "Dims", "dims 2 * 3" },
+  { "Dims... * N * float64", "5 * float64", "Dims", "dims" },
+  { "Dims... * float64", "var * var * float64", "Dims", "dims var * var" },
+  { "N * Dims... * M * T", "10 * 2 * 3 * 4 * int8", "Dims", "dims 2 * 3" },
+  { "N * Dims... * M * T", "10 * 2 * 3 * 4 * int8", "M", "4" },
+  { "Dims... * N * T", "2 * 3 * int8", "Dims", "dims 2" },
+  { "Dims... * T", "Other... * int8", "Dims", "symbol Other" },
+  { "(N * T, M * T) -> N * M * T", "(2 * float32, 3 * float32) -> 2 * 3 * float32", "T", "float32" },
+  { "(N * T, M * T) -> N * M * T", "(2 * float32, 3 * float32) -> 2 * 3 * float32", "M", "3" },
+  { "{x: T, y: T}", "{x: 10 * int64, y: 10 * int64}", "T", "10 * int64" },
+  { NULL, NULL, NULL, NULL }
+};
+
+static int
+binding_as_string(char *buf, size_t len, const ndt_binding_t *v,
+                  ndt_context_t *ctx)
+{
+    const ndt_t *t;
+    char *s;
+    size_t n;
+    int i;
+
+    switch (v->tag) {
+    case BindUnbound:
+        snprintf(buf, len, "unbound");
+        return 0;
+    case BindSize:
+        snprintf(buf, len, "%" PRIi64, v->Size);
+        return 0;
+    case BindSymbol:
+        snprintf(buf, len, "symbol %s", v->Symbol);
+        return 0;
+    case BindType:
+        s = ndt_as_string((ndt_t *)v->Type, ctx);
+        if (s == NULL) {
+            return -1;
+        }
+        snprintf(buf, len, "%s", s);
+        ndt_free(s);
+        return 0;
+    case BindDims:
+        snprintf(buf, len, "dims");
+        for (i = 0, t = v->Dims.first; i < v->Dims.size; i++) {
+            n = strlen(buf);
+            if (t->tag == FixedDim) {
+                snprintf(buf+n, len-n, "%s%" PRIi64, i ? " * " : " ",
+                         t->FixedDim.shape);
+                t = t->FixedDim.type;
+            }
+            else {
+                snprintf(buf+n, len-n, "%svar", i ? " * " : " ");
+                t = t->VarDim.type;
+            }
+        }
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static int
+compile_with_alloc_fail(ndt_pattern_t **m, const ndt_t *p, ndt_context_t *ctx)
+{
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        *m = ndt_pattern_compile(p, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (*m != NULL) {
+            fprintf(stderr, "test_pattern: FAIL: expect NULL after MemoryError\n");
+            return -1;
+        }
+    }
+
+    return *m == NULL ? -1 : 0;
+}
+
+static int
+check_match_tests(ndt_context_t *ctx)
+{
+    ndt_binding_t bindings[16];
+    const match_testcase_t *t;
+    ndt_pattern_t *m;
+    ndt_t *p, *c;
+    int ret;
+
+    for (t = match_tests; t->pattern != NULL; t++) {
+        p = ndt_from_string(t->pattern, ctx);
+        if (p == NULL) {
+            fprintf(stderr, "test_pattern: FAIL: could not parse \"%s\"\n", t->pattern);
+            return -1;
+        }
+
+        c = ndt_from_string(t->candidate, ctx);
+        if (c == NULL) {
+            fprintf(stderr, "test_pattern: FAIL: could not parse \"%s\"\n", t->candidate);
+            ndt_del(p);
+            return -1;
+        }
+
+        if (compile_with_alloc_fail(&m, p, ctx) < 0) {
+            fprintf(stderr, "test_pattern: FAIL: could not compile \"%s\"\n", t->pattern);
+            ndt_del(p);
+            ndt_del(c);
+            return -1;
+        }
+
+        if (m->nslots > 16) {
+            fprintf(stderr, "test_pattern: FAIL: too many slots in \"%s\"\n", t->pattern);
+            ndt_pattern_del(m);
+            ndt_del(p);
+            ndt_del(c);
+            return -1;
+        }
+
+        ret = ndt_pattern_match(m, c, bindings, ctx);
+        if (ret != t->expected || ret != ndt_match(p, c, ctx)) {
+            fprintf(stderr, "test_pattern: FAIL: match \"%s\" \"%s\"\n",
+                    t->pattern, t->candidate);
+            fprintf(stderr, "test_pattern: FAIL: expected %d, got %d\n", t->expected, ret);
+            ndt_pattern_del(m);
+            ndt_del(p);
+            ndt_del(c);
+            return -1;
+        }
+
+        ndt_pattern_del(m);
+        ndt_del(p);
+        ndt_del(c);
+    }
+
+    return t - match_tests;
+}
+
+int
+test_pattern(void)
+{
+    ndt_binding_t bindings[16];
+    const binding_testcase_t *t;
+    ndt_context_t *ctx;
+    ndt_pattern_t *m;
+    ndt_t *p, *c;
+    char buf[128];
+    int count, k;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    count = check_match_tests(ctx);
+    if (count < 0) {
+        ndt_context_del(ctx);
+        return -1;
+    }
+
+    for (t = binding_tests; t->pattern != NULL; t++, count++) {
+        p = ndt_from_string(t->pattern, ctx);
+        if (p == NULL) {
+            fprintf(stderr, "test_pattern: FAIL: could not parse \"%s\"\n", t->pattern);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        c = ndt_from_string(t->candidate, ctx);
+        if (c == NULL) {
+            fprintf(stderr, "test_pattern: FAIL: could not parse \"%s\"\n", t->candidate);
+            ndt_del(p);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        m = ndt_pattern_compile(p, ctx);
+        if (m == NULL) {
+            ndt_del(p);
+            ndt_del(c);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        k = ndt_pattern_slot(m, t->name);
+        if (k < 0 || ndt_pattern_match(m, c, bindings, ctx) != 1 ||
+            binding_as_string(buf, sizeof buf, &bindings[k], ctx) < 0 ||
+            strcmp(buf, t->binding) != 0) {
+            fprintf(stderr, "test_pattern: FAIL: \"%s\" \"%s\": %s: expected \"%s\", got \"%s\"\n",
+                    t->pattern, t->candidate, t->name, t->binding, k < 0 ? "" : buf);
+            ndt_pattern_del(m);
+            ndt_del(p);
+            ndt_del(c);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        ndt_pattern_del(m);
+        ndt_del(p);
+        ndt_del(c);
+    }
+
+    fprintf(stderr, "test_pattern (%d test cases)\n", count);
+
+    ndt_context_del(ctx);
+    return 0;
+}
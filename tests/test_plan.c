@@ -0,0 +1,306 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                          traversal plans                          */
+/*********************************************************************/
+
+#define MAX_VISITS 1024
+
+typedef struct {
+    int64_t n;
+    const ndt_t *type[MAX_VISITS];
+    int64_t offset[MAX_VISITS];
+    int64_t size[MAX_VISITS];
+} visits_t;
+
+static int
+record_visit(const ndt_t *t, int64_t offset, int64_t size, void *arg)
+{
+    visits_t *v = (visits_t *)arg;
+
+    if (v->n == MAX_VISITS) {
+        return -1;
+    }
+
+    v->type[v->n] = t;
+    v->offset[v->n] = offset;
+    v->size[v->n] = size;
+    v->n++;
+
+    return 0;
+}
+
+/* Recursive reference walker */
+static int
+walk(const ndt_t *t, int64_t base, int64_t row, visits_t *v)
+{
+    const ndt_t *u;
+    int64_t lo, n, i;
+
+    switch (t->tag) {
+    case FixedDim:
+        base += t->Concrete.FixedDim.offset;
+        for (i = 0; i < t->FixedDim.shape; i++) {
+            if (walk(t->FixedDim.type, base + i * t->Concrete.FixedDim.stride,
+                     row, v) < 0) {
+                return -1;
+            }
+        }
+        n = t->FixedDim.shape * t->Concrete.FixedDim.stride;
+        if (!ndt_is_ndarray(t) && t->data_size > n) {
+            return record_visit(NULL, base + n, t->data_size - n, v);
+        }
+        return 0;
+
+    case VarDim:
+        u = t->VarDim.type;
+        lo = t->Concrete.VarDim.offsets[row];
+        n = t->Concrete.VarDim.shapes[row];
+        if (t->Concrete.VarDim.bitmap &&
+            !(t->Concrete.VarDim.bitmap[row / 8] & (1 << (row % 8)))) {
+            n = 0;
+        }
+        for (i = lo; i < lo + n; i++) {
+            if (u->tag == VarDim) {
+                if (walk(u, base, i, v) < 0) return -1;
+            }
+            else {
+                if (walk(u, base + i * t->Concrete.VarDim.itemsize, 0, v) < 0) {
+                    return -1;
+                }
+            }
+        }
+        return 0;
+
+    case Tuple:
+        for (i = 0; i < t->Tuple.shape; i++) {
+            u = t->Tuple.types[i];
+            if (walk(u, base + t->Concrete.Tuple.offset[i], row, v) < 0) {
+                return -1;
+            }
+            if (t->Concrete.Tuple.pad[i] > 0 &&
+                record_visit(NULL, base + t->Concrete.Tuple.offset[i] + u->data_size,
+                             t->Concrete.Tuple.pad[i], v) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case Record:
+        for (i = 0; i < t->Record.shape; i++) {
+            u = t->Record.types[i];
+            if (walk(u, base + t->Concrete.Record.offset[i], row, v) < 0) {
+                return -1;
+            }
+            if (t->Concrete.Record.pad[i] > 0 &&
+                record_visit(NULL, base + t->Concrete.Record.offset[i] + u->data_size,
+                             t->Concrete.Record.pad[i], v) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case Option:
+        return walk(t->Option.type, base, row, v);
+
+    default:
+        return record_visit(t, base, t->data_size, v);
+    }
+}
+
+/* Var dimensions are padded once after all rows. */
+static int
+walk_top(const ndt_t *t, int64_t base, visits_t *v)
+{
+    const ndt_t *u = t;
+    int64_t n;
+
+    if (walk(t, base, 0, v) < 0) {
+        return -1;
+    }
+
+    if (t->tag == VarDim) {
+        while (u->VarDim.type->tag == VarDim) {
+            u = u->VarDim.type;
+        }
+        n = u->Concrete.VarDim.offsets[u->Concrete.VarDim.nshapes] *
+            u->Concrete.VarDim.itemsize;
+        if (t->data_size > n) {
+            return record_visit(NULL, base + n, t->data_size - n, v);
+        }
+    }
+
+    return 0;
+}
+
+typedef struct {
+    const char *type;
+    char order;     /* 0: no ndt_array() */
+    int64_t ninstr; /* -1: not checked */
+} plan_testcase_t;
+
+static const plan_testcase_t plan_tests[] = {
+  { "int64", 0, 1 },
+  { "string", 0, 1 },
+  { "2 * 3 * int64", 0, 3 },
+  { "2 * 3 * int64", 'F', 5 },
+  { "0 * int64", 0, 3 },
+  { "2 * 0 * int64", 0, 3 },
+  { "{a: int8, b: int64}", 0, 3 },
+  { "{a: int8, b: int64, c: int8, d: int64, reorder=true}", 0, 5 },
+  { "(int8, int16, ?float64)", 0, 5 },
+  { "3 * {a: int8, b: 2 * int32, c: ?float64}", 0, 9 },
+  { "4 * 2 * 3 * {x: int8, y: 3 * int16}", 0, 7 },
+  { "2 * {a: 3 * {b: 2 * int8, c: int64}}", 0, -1 },
+  { "var(shapes=[2]) * var(shapes=[3,4]) * (int8, int16)", 0, 7 },
+  { "var(shapes=[3]) * var(shapes=[1,0,2], bitmap=[1,1,0]) * 2 * int32", 0, -1 },
+  { "var(shapes=[1]) * var(shapes=[2]) * var(shapes=[1,3]) * float32", 0, 7 },
+  { "fixed(shape=2, align=64) * float32", 0, 4 },
+  { "10 * fixed(shape=3, align=16) * float32", 0, 6 },
+  { "var(shapes=[2], align=64) * var(shapes=[3,4]) * fixed(shape=3, align=16) * int8", 0, 9 },
+};
+
+int
+test_plan(void)
+{
+    ndt_context_t *ctx;
+    const plan_testcase_t *tc;
+    size_t ntests = sizeof plan_tests / sizeof plan_tests[0];
+    static visits_t expected, result;
+    int64_opt_t none = {None, 0};
+    char_opt_t order;
+    ndt_plan_t *plan;
+    ndt_t *t;
+    size_t i;
+    int64_t k;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &plan_tests[i];
+
+        t = ndt_from_string(tc->type, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_plan: parse: FAIL: %s\n", ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        if (tc->order) {
+            order.tag = Some;
+            order.Some = tc->order;
+            t = ndt_array(t, NULL, none, none, order, ctx);
+            if (t == NULL) {
+                fprintf(stderr, "test_plan: FAIL: %s\n", ndt_context_msg(ctx));
+                ndt_context_del(ctx);
+                return -1;
+            }
+        }
+
+        for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+            ndt_err_clear(ctx);
+
+            ndt_set_alloc_fail();
+            plan = ndt_compile_plan(t, ctx);
+            ndt_set_alloc();
+
+            if (ctx->err != NDT_MemoryError) {
+                break;
+            }
+
+            if (plan != NULL) {
+                fprintf(stderr, "test_plan: FAIL: plan != NULL after MemoryError\n");
+                ndt_plan_del(plan);
+                ndt_del(t);
+                ndt_context_del(ctx);
+                return -1;
+            }
+        }
+
+        if (plan == NULL) {
+            fprintf(stderr, "test_plan: FAIL: %s\n", ndt_context_msg(ctx));
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        expected.n = result.n = 0;
+        if (walk_top(t, 8, &expected) < 0 ||
+            ndt_plan_exec(plan, 8, record_visit, &result, ctx) < 0 ||
+            expected.n != result.n ||
+            (tc->ninstr >= 0 && plan->ninstr != tc->ninstr)) {
+            fprintf(stderr, "test_plan: FAIL: \"%s\"\n", tc->type);
+            ndt_plan_del(plan);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        for (k = 0; k < expected.n; k++) {
+            if (expected.type[k] != result.type[k] ||
+                expected.offset[k] != result.offset[k] ||
+                expected.size[k] != result.size[k]) {
+                fprintf(stderr, "test_plan: FAIL: \"%s\": visit %" PRIi64 "\n",
+                        tc->type, k);
+                ndt_plan_del(plan);
+                ndt_del(t);
+                ndt_context_del(ctx);
+                return -1;
+            }
+        }
+
+        ndt_plan_del(plan);
+        ndt_del(t);
+    }
+
+    fprintf(stderr, "test_plan (%zu test cases)\n", ntests);
+
+    ndt_context_del(ctx);
+    return 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                        streaming printers                         */
+/*********************************************************************/
+
+typedef struct {
+    char *data;
+    size_t len;
+    int64_t nchunks;
+    int64_t fail; /* fail on this chunk */
+} output_t;
+
+static int
+collect(const char *s, size_t n, void *arg)
+{
+    output_t *out = arg;
+    char *data;
+
+    if (++out->nchunks == out->fail) {
+        return -1;
+    }
+
+    data = realloc(out->data, out->len + n + 1);
+    if (data == NULL) {
+        return -1;
+    }
+
+    memcpy(data + out->len, s, n);
+    out->data = data;
+    out->len += n;
+    out->data[out->len] = '\0';
+
+    return 0;
+}
+
+typedef int (*print_f)(const ndt_t *, ndt_write_f, void *, ndt_context_t *);
+typedef char *(*as_string_f)(ndt_t *, ndt_context_t *);
+
+/* Compare the streamed output with the string and return the number of chunks. */
+static int64_t
+check(ndt_t *t, print_f print, as_string_f as_string, ndt_context_t *ctx)
+{
+    output_t out = {NULL, 0, 0, 0};
+    char *s;
+    int64_t ret = -1;
+
+    s = as_string(t, ctx);
+    if (s == NULL) {
+        fprintf(stderr, "test_print: FAIL: %s\n", ndt_context_msg(ctx));
+        return -1;
+    }
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+        free(out.data);
+        out.data = NULL;
+        out.len = 0;
+        out.nchunks = 0;
+
+        ndt_set_alloc_fail();
+        ret = print(t, collect, &out, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (ret != -1) {
+            fprintf(stderr, "test_print: FAIL: no error after MemoryError\n");
+            goto out;
+        }
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "test_print: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    if (out.data == NULL || strcmp(out.data, s) != 0) {
+        fprintf(stderr, "test_print: FAIL: expected \"%s\", got \"%s\"\n",
+                s, out.data ? out.data : "");
+        ret = -1;
+        goto out;
+    }
+
+    ret = out.nchunks;
+
+out:
+    free(out.data);
+    ndt_free(s);
+    return ret;
+}
+
+/* A record with a field name of 'n' characters and a ragged array. */
+static ndt_t *
+mk_large(size_t n, ndt_context_t *ctx)
+{
+    char *s;
+    size_t len;
+    ndt_t *t;
+    size_t i;
+
+    s = ndt_alloc(n + 100, 8);
+    if (s == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    len = sprintf(s, "{");
+    memset(s + len, 'x', n);
+    len += n;
+    len += sprintf(s + len, " : int64, b : var(shapes=[%zu]) * var(shapes=[", n);
+    for (i = 0; i < n; i++) {
+        len += sprintf(s + len, "%s%zu", i ? "," : "", i % 7);
+    }
+    sprintf(s + len, "]) * float32}");
+
+    t = ndt_from_string(s, ctx);
+    ndt_free(s);
+    return t;
+}
+
+int
+test_print(void)
+{
+    ndt_context_t *ctx;
+    output_t out = {NULL, 0, 0, 0};
+    const char **c;
+    ndt_t *t = NULL;
+    char *s = NULL;
+    FILE *fp = NULL;
+    char buf[64];
+    int count = 0;
+    int ret = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (c = parse_roundtrip_tests; *c != NULL; c++) {
+        t = ndt_from_string(*c, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_print: FAIL: %s\n", ndt_context_msg(ctx));
+            goto out;
+        }
+
+        if (check(t, ndt_print, ndt_as_string, ctx) != 1 ||
+            check(t, ndt_print_indent, ndt_indent, ctx) < 0 ||
+            (ndt_is_concrete(t) &&
+             check(t, ndt_print_with_meta, ndt_as_string_with_meta, ctx) < 0)) {
+            fprintf(stderr, "test_print: FAIL: \"%s\"\n", *c);
+            goto out;
+        }
+
+        ndt_del(t);
+        t = NULL;
+        count++;
+    }
+
+    /* output and single fields that are larger than the buffer */
+    t = mk_large(10000, ctx);
+    if (t == NULL) {
+        fprintf(stderr, "test_print: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+    if (check(t, ndt_print, ndt_as_string, ctx) < 2 ||
+        check(t, ndt_print_indent, ndt_indent, ctx) < 2 ||
+        check(t, ndt_print_with_meta, ndt_as_string_with_meta, ctx) < 2) {
+        fprintf(stderr, "test_print: FAIL: large output\n");
+        goto out;
+    }
+    count++;
+
+    /* write error */
+    out.fail = 3;
+    if (ndt_print_with_meta(t, collect, &out, ctx) != -1 ||
+        ctx->err != NDT_OSError || out.nchunks != 3) {
+        fprintf(stderr, "test_print: FAIL: expected write error\n");
+        goto out;
+    }
+    ndt_err_clear(ctx);
+    ndt_del(t);
+    t = NULL;
+    count++;
+
+    /* FILE sink */
+    t = ndt_from_string("10 * {a : int64, b : ?string}", ctx);
+    s = t ? ndt_as_string(t, ctx) : NULL;
+    if (s == NULL) {
+        fprintf(stderr, "test_print: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+    fp = tmpfile();
+    if (fp == NULL) {
+        fprintf(stderr, "test_print: FAIL: tmpfile\n");
+        goto out;
+    }
+    if (ndt_print(t, ndt_write_file, fp, ctx) < 0) {
+        fprintf(stderr, "test_print: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+    rewind(fp);
+    if (fgets(buf, sizeof buf, fp) == NULL || strcmp(buf, s) != 0) {
+        fprintf(stderr, "test_print: FAIL: ndt_write_file\n");
+        goto out;
+    }
+    count++;
+
+    fprintf(stderr, "test_print (%d test cases)\n", count);
+    ret = 0;
+
+out:
+    if (fp) fclose(fp);
+    free(out.data);
+    ndt_free(s);
+    if (t) ndt_del(t);
+    ndt_context_del(ctx);
+    return ret;
+}
+
+
+/*********************************************************************/
+/*                          bounded output                           */
+/*********************************************************************/
+
+typedef struct {
+    const char *input;
+    ndt_limits_t limits;
+    const char *expected;
+} limits_testcase_t;
+
+static const limits_testcase_t limits_tests[] = {
+  { "(int8, int16, int32, int64)", {0, 0, 0}, "(int8, int16, int32, int64)" },
+  { "(int8, int16, int32, int64)", {0, 2, 0}, "(int8, int16, ...)" },
+  { "(int8, int16, int32, int64)", {0, 4, 0}, "(int8, int16, int32, int64)" },
+  { "{a : int8, b : int16, c : int32}", {0, 1, 0}, "{a : int8, ...}" },
+  { "categorical(1 : int64, 2 : int64, 3 : int64)", {0, 2, 0},
+    "categorical(1 : int64, 2 : int64, ...)" },
+  { "(int8, int16) -> {a : int8, b : int8}", {0, 1, 0},
+    "(int8, ...) -> {a : int8, ...}" },
+  { "10 * 20 * {a : {b : int8}}", {0, 0, 1}, "10 * 20 * {a : {...}}" },
+  { "10 * 20 * {a : {b : int8}}", {0, 0, 2}, "10 * 20 * {a : {b : int8}}" },
+  { "(int8, (int16)) -> pointer((int32))", {0, 0, 1}, "(int8, (...)) -> pointer((int32))" },
+  { "categorical(1 : int64, 'a' : string)", {0, 0, 1}, "categorical(1 : int64, 'a' : string)" },
+  { "{a : {b : {c : int8}}, d : int8}", {0, 0, 2}, "{a : {b : {...}}, d : int8}" },
+  { "int64", {5, 0, 0}, "int64" },
+  { "int64", {4, 0, 0}, "i..." },
+  { "int64", {3, 0, 0}, "..." },
+  { "10 * {a : int64, b : string}", {12, 0, 0}, "10 * {a :..." },
+  { "10 * {a : int64, b : string}", {16, 1, 0}, "10 * {a : int..." },
+  { "10 * {a : (int64, int8), b : string}", {0, 1, 1}, "10 * {a : (...), ...}" },
+  { NULL, {0, 0, 0}, NULL }
+};
+
+static int
+check_limited(const limits_testcase_t *tc, ndt_context_t *ctx)
+{
+    ndt_t *t;
+    char *s = NULL;
+    int ret = -1;
+
+    t = ndt_from_string(tc->input, ctx);
+    if (t == NULL) {
+        fprintf(stderr, "test_print_limited: FAIL: %s\n", ndt_context_msg(ctx));
+        return -1;
+    }
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        s = ndt_as_string_limited(t, &tc->limits, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (s != NULL) {
+            fprintf(stderr, "test_print_limited: FAIL: s != NULL after MemoryError\n");
+            goto out;
+        }
+    }
+
+    if (s == NULL) {
+        fprintf(stderr, "test_print_limited: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    if (strcmp(s, tc->expected) != 0) {
+        fprintf(stderr, "test_print_limited: FAIL: expected \"%s\", got \"%s\"\n",
+                tc->expected, s);
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    ndt_free(s);
+    ndt_del(t);
+    return ret;
+}
+
+int
+test_print_limited(void)
+{
+    static const ndt_limits_t invalid[] = {{2, 0, 0}, {-1, 0, 0}, {0, -1, 0}, {0, 0, -1}};
+    const limits_testcase_t *tc;
+    ndt_context_t *ctx;
+    ndt_limits_t limits;
+    ndt_t *t = NULL;
+    char *s = NULL;
+    size_t i;
+    int count = 0;
+    int ret = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (tc = limits_tests; tc->input != NULL; tc++) {
+        if (check_limited(tc, ctx) < 0) {
+            goto out;
+        }
+        count++;
+    }
+
+    for (i = 0; i < sizeof invalid / sizeof invalid[0]; i++) {
+        t = ndt_from_string("int64", ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_print_limited: FAIL: %s\n", ndt_context_msg(ctx));
+            goto out;
+        }
+        s = ndt_as_string_limited(t, &invalid[i], ctx);
+        if (s != NULL || ctx->err != NDT_InvalidArgumentError) {
+            fprintf(stderr, "test_print_limited: FAIL: expected InvalidArgumentError\n");
+            goto out;
+        }
+        ndt_err_clear(ctx);
+        ndt_del(t);
+        t = NULL;
+        count++;
+    }
+
+    /* offsets and shapes of a ragged array */
+    t = mk_large(100000, ctx);
+    if (t == NULL) {
+        fprintf(stderr, "test_print_limited: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    limits.max_width = 0;
+    limits.max_items = 3;
+    limits.max_depth = 0;
+    s = ndt_as_string_with_meta_limited(t, &limits, ctx);
+    if (s == NULL || strstr(s, "offsets=[0, 100000]") == NULL ||
+        strstr(s, "offsets=[0, 0, 1, ...]") == NULL ||
+        strstr(s, "shapes=[0, 1, 2, ...]") == NULL || strlen(s) > 110000) {
+        fprintf(stderr, "test_print_limited: FAIL: list elision\n");
+        goto out;
+    }
+    ndt_free(s);
+    count++;
+
+    limits.max_width = 100;
+    limits.max_items = 0;
+    s = ndt_as_string_with_meta_limited(t, &limits, ctx);
+    if (s == NULL || strlen(s) != 100 || strcmp(s + 97, "...") != 0) {
+        fprintf(stderr, "test_print_limited: FAIL: width\n");
+        goto out;
+    }
+    ndt_free(s);
+    s = NULL;
+    ndt_del(t);
+    count++;
+
+    t = ndt_from_string("{a : {b : int8}}", ctx);
+    if (t == NULL) {
+        fprintf(stderr, "test_print_limited: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    limits.max_width = 0;
+    limits.max_depth = 1;
+    s = ndt_as_string_with_meta_limited(t, &limits, ctx);
+    if (s == NULL || strstr(s, "name='a'") == NULL ||
+        strstr(s, "Record(\n") == NULL || strstr(s, "Int8(") != NULL) {
+        fprintf(stderr, "test_print_limited: FAIL: depth\n");
+        goto out;
+    }
+    count++;
+
+    fprintf(stderr, "test_print_limited (%d test cases)\n", count);
+    ret = 0;
+
+out:
+    ndt_free(s);
+    if (t) ndt_del(t);
+    ndt_context_del(ctx);
+    return ret;
+}
@@ -34,12 +34,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdalign.h>
 #include <stddef.h>
 #include <string.h>
 #include <assert.h>
 #include "ndtypes.h"
 #include "test.h"
+#include "alloc_fail.h"
 
 
 /*********************************************************************/
@@ -224,3 +227,502 @@ test_struct_align_pack(void)
 #endif
 
 
+
+
+/*********************************************************************/
+/*                         field reordering                          */
+/*********************************************************************/
+
+typedef struct {
+    const char *type;
+    int64_t data_size;
+    int64_t offset[4];
+    uint16_t pad[4];
+} reorder_testcase_t;
+
+static const reorder_testcase_t reorder_tests[] = {
+  { "{a: int8, b: int64, c: int8, d: int64}", 32, {0, 8, 16, 24}, {7, 0, 7, 0} },
+  { "{a: int8, b: int64, c: int8, d: int64, reorder=false}", 32, {0, 8, 16, 24}, {7, 0, 7, 0} },
+  { "{a: int8, b: int64, c: int8, d: int64, reorder=true}", 24, {16, 0, 17, 8}, {0, 0, 6, 0} },
+  { "(int8, int16, int32, int64, reorder=true)", 16, {14, 12, 8, 0}, {1, 0, 0, 0} },
+  { "{a: int8, b: 3 * int16, c: int32, reorder=true}", 12, {10, 4, 0}, {1, 0, 0} },
+  { "{a: int8, b: int64, pack=1, reorder=true}", 9, {0, 1}, {0, 0} },
+  { "{a: int8 |align=16|, b: int64, reorder=true}", 16, {0, 8}, {7, 0} },
+};
+
+/* printed with ndt_as_string() and ndt_indent() and parsed again */
+static const char *reorder_roundtrip_tests[] = {
+  "{a: int8, b: int64, c: int8, d: int64, reorder=true}",
+  "(int8, int16, int32, int64, reorder=true)",
+  "{a: int8, b: 3 * int16, c: int32, reorder=true}",
+  "{a: int8, b: {x: int8, y: int64, reorder=true}, c: int16, reorder=true}",
+  "10 * (int8, {x: int8, y: int64, reorder=true}, int32)",
+  "{a: int8, b: T, reorder=true}",
+};
+
+/* Check that 'u' has the same layout as 't'. */
+static int
+same_layout(const ndt_t *t, const ndt_t *u)
+{
+    const int64_t *offset_t, *offset_u;
+    int64_t k, shape;
+
+    if (t->tag != u->tag || t->access != u->access) {
+        return 0;
+    }
+
+    if (t->access == Abstract) {
+        return 1;
+    }
+
+    if (t->data_size != u->data_size || t->data_align != u->data_align) {
+        return 0;
+    }
+
+    switch (t->tag) {
+    case FixedDim:
+        return same_layout(t->FixedDim.type, u->FixedDim.type);
+    case Tuple:
+        shape = t->Tuple.shape;
+        offset_t = t->Concrete.Tuple.offset;
+        offset_u = u->Concrete.Tuple.offset;
+        for (k = 0; k < shape; k++) {
+            if (offset_t[k] != offset_u[k] ||
+                !same_layout(t->Tuple.types[k], u->Tuple.types[k])) {
+                return 0;
+            }
+        }
+        return 1;
+    case Record:
+        shape = t->Record.shape;
+        offset_t = t->Concrete.Record.offset;
+        offset_u = u->Concrete.Record.offset;
+        for (k = 0; k < shape; k++) {
+            if (offset_t[k] != offset_u[k] ||
+                !same_layout(t->Record.types[k], u->Record.types[k])) {
+                return 0;
+            }
+        }
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+static int
+reorder_roundtrip(const char *s, ndt_context_t *ctx)
+{
+    ndt_t *t, *u = NULL, *v = NULL;
+    char *c = NULL, *d = NULL;
+    int ret = -1;
+
+    t = ndt_from_string(s, ctx);
+    if (t == NULL) {
+        return -1;
+    }
+
+    c = ndt_as_string(t, ctx);
+    d = ndt_indent(t, ctx);
+    if (c == NULL || d == NULL) {
+        goto out;
+    }
+
+    u = ndt_from_string(c, ctx);
+    v = ndt_from_string(d, ctx);
+    if (u == NULL || v == NULL) {
+        goto out;
+    }
+
+    if (strstr(c, "reorder=true") == NULL ||
+        !ndt_equal(t, u) || !same_layout(t, u) ||
+        !ndt_equal(t, v) || !same_layout(t, v) ||
+        ndt_hash(t, ctx) != ndt_hash(u, ctx)) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    ndt_free(c);
+    ndt_free(d);
+    if (t) ndt_del(t);
+    if (u) ndt_del(u);
+    if (v) ndt_del(v);
+    return ret;
+}
+
+static ndt_field_t *
+mk_fields(ndt_context_t *ctx)
+{
+    const char *names[4] = {"a", "b", "c", "d"};
+    const enum ndt tags[4] = {Int8, Int64, Int8, Int64};
+    uint16_opt_t none = {None, 0};
+    ndt_field_t *fields, *f;
+    char *name;
+    ndt_t *type;
+    int i, k;
+
+    fields = ndt_alloc(4, sizeof *fields);
+    if (fields == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    for (i = 0; i < 4; i++) {
+        name = ndt_strdup(names[i], ctx);
+        type = ndt_primitive(tags[i], 'L', ctx);
+        if (name == NULL || type == NULL) {
+            ndt_free(name);
+            if (type) ndt_del(type);
+            goto error;
+        }
+
+        f = ndt_field(name, type, none, none, ctx);
+        if (f == NULL) {
+            goto error;
+        }
+        fields[i] = *f;
+        ndt_free(f);
+    }
+
+    return fields;
+
+error:
+    for (k = 0; k < i; k++) {
+        ndt_free(fields[k].name);
+        ndt_del(fields[k].type);
+    }
+    ndt_free(fields);
+    return NULL;
+}
+
+int
+test_record_reorder(void)
+{
+    ndt_context_t *ctx;
+    const reorder_testcase_t *tc;
+    size_t ntests = sizeof reorder_tests / sizeof reorder_tests[0];
+    size_t ntests_roundtrip = sizeof reorder_roundtrip_tests /
+                              sizeof reorder_roundtrip_tests[0];
+    uint16_opt_t none = {None, 0};
+    ndt_field_t *fields;
+    int64_t saved;
+    ndt_t *t, *u;
+    size_t i;
+    int64_t k;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &reorder_tests[i];
+
+        t = ndt_from_string(tc->type, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_record_reorder: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        if (t->data_size != tc->data_size) {
+            fprintf(stderr, "test_record_reorder: FAIL: \"%s\": data_size\n",
+                    tc->type);
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        for (k = 0; k < t->Tuple.shape; k++) {
+            const int64_t *offset = t->tag == Tuple ? t->Concrete.Tuple.offset
+                                                    : t->Concrete.Record.offset;
+            const uint16_t *pad = t->tag == Tuple ? t->Concrete.Tuple.pad
+                                                  : t->Concrete.Record.pad;
+            if (offset[k] != tc->offset[k] || pad[k] != tc->pad[k]) {
+                fprintf(stderr,
+                    "test_record_reorder: FAIL: \"%s\": field %" PRIi64 "\n",
+                    tc->type, k);
+                ndt_del(t);
+                ndt_context_del(ctx);
+                return -1;
+            }
+        }
+
+        ndt_del(t);
+    }
+
+    for (i = 0; i < ntests_roundtrip; i++) {
+        if (reorder_roundtrip(reorder_roundtrip_tests[i], ctx) < 0) {
+            fprintf(stderr, "test_record_reorder: FAIL: roundtrip: \"%s\"\n",
+                    reorder_roundtrip_tests[i]);
+            ndt_context_del(ctx);
+            return -1;
+        }
+    }
+
+    /* the attribute is part of the type */
+    t = ndt_from_string("{a: int8, b: int64, reorder=true}", ctx);
+    u = ndt_from_string("{a: int8, b: int64}", ctx);
+    if (t == NULL || u == NULL || ndt_equal(t, u) ||
+        t->fingerprint == u->fingerprint || ndt_hash(t, ctx) == ndt_hash(u, ctx)) {
+        fprintf(stderr, "test_record_reorder: FAIL: reorder=true is ignored\n");
+        if (t) ndt_del(t);
+        if (u) ndt_del(u);
+        ndt_context_del(ctx);
+        return -1;
+    }
+    ndt_del(t);
+    ndt_del(u);
+
+    /* bytes saved */
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        fields = mk_fields(ctx);
+        if (fields == NULL) {
+            fprintf(stderr, "test_record_reorder: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        ndt_set_alloc_fail();
+        t = ndt_record_reorder(Nonvariadic, fields, 4, none, none, &saved, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (t != NULL) {
+            fprintf(stderr, "test_record_reorder: FAIL: t != NULL after MemoryError\n");
+            ndt_del(t);
+            ndt_context_del(ctx);
+            return -1;
+        }
+    }
+
+    if (t == NULL || saved != 8 || t->data_size != 24 ||
+        strcmp(t->Record.names[1], "b") != 0 ||
+        t->Concrete.Record.offset[1] != 0) {
+        fprintf(stderr, "test_record_reorder: FAIL: ndt_record_reorder\n");
+        if (t) ndt_del(t);
+        ndt_context_del(ctx);
+        return -1;
+    }
+    ndt_del(t);
+
+    fprintf(stderr, "test_record_reorder (%zu test cases)\n",
+            ntests + ntests_roundtrip + 2);
+
+    ndt_context_del(ctx);
+    return 0;
+}
+
+
+/*********************************************************************/
+/*                         field name lookup                         */
+/*********************************************************************/
+
+#define NFIELDS 2000
+
+static int
+check_fields(const ndt_t *t)
+{
+    char name[32];
+    int64_t i;
+
+    for (i = 0; i < NFIELDS; i++) {
+        snprintf(name, sizeof name, "f%" PRIi64, (i * 7919) % NFIELDS);
+        if (ndt_record_field(t, name) != i) {
+            fprintf(stderr, "test_record_field: FAIL: field \"%s\"\n", name);
+            return -1;
+        }
+    }
+
+    if (ndt_record_field(t, "") != -1 || ndt_record_field(t, "f") != -1 ||
+        ndt_record_field(t, "f2000") != -1 || ndt_record_field(t, "g") != -1) {
+        fprintf(stderr, "test_record_field: FAIL: missing field\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+test_record_field(void)
+{
+    ndt_context_t *ctx;
+    const char *pattern = "{f1999 : int64, f0 : Signed, f1000 : T, ...}";
+    ndt_t *t = NULL, *u = NULL, *p = NULL;
+    char *s = NULL;
+    size_t len = 0;
+    int64_t i;
+    int ret = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    /* the names are not in sorted order */
+    s = ndt_alloc(NFIELDS, 32);
+    if (s == NULL) {
+        fprintf(stderr, "error: out of memory");
+        goto out;
+    }
+    len += sprintf(s+len, "{");
+    for (i = 0; i < NFIELDS; i++) {
+        len += sprintf(s+len, "%sf%" PRIi64 " : int64", i ? ", " : "",
+                       (i * 7919) % NFIELDS);
+    }
+    sprintf(s+len, "}");
+
+    t = ndt_from_string(s, ctx);
+    u = t ? ndt_copy(t, ctx) : NULL;
+    p = ndt_from_string(pattern, ctx);
+    if (t == NULL || u == NULL || p == NULL) {
+        fprintf(stderr, "test_record_field: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    if (check_fields(t) < 0 || check_fields(u) < 0) {
+        goto out;
+    }
+
+    if (ndt_match(p, t, ctx) != 1) {
+        fprintf(stderr, "test_record_field: FAIL: \"%s\" does not match\n", pattern);
+        goto out;
+    }
+
+    fprintf(stderr, "test_record_field (3 test cases)\n");
+    ret = 0;
+
+out:
+    if (p) ndt_del(p);
+    if (u) ndt_del(u);
+    if (t) ndt_del(t);
+    ndt_free(s);
+    ndt_context_del(ctx);
+    return ret;
+}
+
+
+/*********************************************************************/
+/*                          deep nesting                             */
+/*********************************************************************/
+
+#define NESTING 100000
+
+/* {a : {a : ... {a : int64} ...}} with 'depth' levels */
+static ndt_t *
+mk_nested(int64_t depth, ndt_context_t *ctx)
+{
+    uint16_opt_t none = {None, 0};
+    ndt_field_t *fields, *f;
+    ndt_t *t;
+    char *name;
+    int64_t i;
+
+    t = ndt_primitive(Int64, 'L', ctx);
+    if (t == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < depth; i++) {
+        name = ndt_strdup("a", ctx);
+        if (name == NULL) {
+            ndt_del(t);
+            return NULL;
+        }
+
+        f = ndt_field(name, t, none, none, ctx);
+        if (f == NULL) {
+            return NULL;
+        }
+
+        fields = ndt_alloc(1, sizeof *fields);
+        if (fields == NULL) {
+            ndt_field_del(f);
+            return ndt_memory_error(ctx);
+        }
+        fields[0] = *f;
+        ndt_free(f);
+
+        t = ndt_record(Nonvariadic, fields, 1, none, none, ctx);
+        if (t == NULL) {
+            return NULL;
+        }
+    }
+
+    return t;
+}
+
+int
+test_record_nested(void)
+{
+    ndt_context_t *ctx;
+    const ndt_limits_t limits = {40, 0, 0};
+    ndt_t *t = NULL, *u = NULL, *v = NULL;
+    char *s = NULL, *m = NULL;
+    int ret = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    t = mk_nested(NESTING, ctx);
+    u = t ? mk_nested(NESTING, ctx) : NULL;
+    v = u ? mk_nested(NESTING-1, ctx) : NULL;
+    if (t == NULL || u == NULL || v == NULL) {
+        fprintf(stderr, "test_record_nested: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    if (!ndt_equal(t, u) || ndt_equal(t, v)) {
+        fprintf(stderr, "test_record_nested: FAIL: ndt_equal\n");
+        goto out;
+    }
+
+    if (ndt_match(t, u, ctx) != 1 || ndt_match(t, v, ctx) != 0) {
+        fprintf(stderr, "test_record_nested: FAIL: ndt_match\n");
+        goto out;
+    }
+
+    /* "{a : " and "}" for each level */
+    s = ndt_as_string(t, ctx);
+    if (s == NULL || strlen(s) != 6 * NESTING + strlen("int64") ||
+        strncmp(s, "{a : {a : ", 10) != 0) {
+        fprintf(stderr, "test_record_nested: FAIL: ndt_as_string\n");
+        goto out;
+    }
+
+    if (ndt_hash(t, ctx) == -1) {
+        fprintf(stderr, "test_record_nested: FAIL: ndt_hash\n");
+        goto out;
+    }
+
+    /* the indentation grows with the depth, so only print the beginning */
+    m = ndt_as_string_with_meta_limited(t, &limits, ctx);
+    if (m == NULL || strcmp(m, "Record(\n  RecordField(\n    name='a',\n...") != 0) {
+        fprintf(stderr, "test_record_nested: FAIL: ndt_as_string_with_meta\n");
+        goto out;
+    }
+
+    fprintf(stderr, "test_record_nested (6 test cases)\n");
+    ret = 0;
+
+out:
+    ndt_free(m);
+    ndt_free(s);
+    if (v) ndt_del(v);
+    if (u) ndt_del(u);
+    if (t) ndt_del(t);
+    ndt_context_del(ctx);
+    return ret;
+}
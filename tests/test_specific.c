@@ -0,0 +1,296 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                       specificity ordering                        */
+/*********************************************************************/
+
+typedef struct {
+    const char *p;
+    const char *q;
+    int expected; /* 1 if 'p' is strictly more specific than 'q' */
+} specific_testcase_t;
+
+static const specific_testcase_t specific_tests[] = {
+  /* kind hierarchy */
+  { "int64", "Signed", 1 },
+  { "Signed", "Scalar", 1 },
+  { "Scalar", "Any", 1 },
+  { "int64", "Any", 1 },
+  { "uint8", "Unsigned", 1 },
+  { "float32", "Float", 1 },
+  { "complex128", "Complex", 1 },
+  { "fixed_string(10)", "FixedString", 1 },
+  { "fixed_bytes(size=16)", "FixedBytes", 1 },
+  { "bool", "Scalar", 1 },
+  { "Signed", "int64", 0 },
+  { "int64", "Unsigned", 0 },
+  { "Signed", "Float", 0 },
+  { "int64", "int64", 0 },
+  { "int64", "int32", 0 },
+  { "10 * int64", "Scalar", 0 },
+  { "10 * int64", "Any", 1 },
+
+  /* type variables */
+  { "int64", "T", 1 },
+  { "Signed", "T", 1 },
+  { "T", "Any", 0 },
+  { "Any", "T", 0 },
+  { "T", "U", 0 },
+  { "(T, T)", "(T, U)", 1 },
+  { "(T, U)", "(T, T)", 0 },
+  { "(int64, int64)", "(T, T)", 1 },
+  { "(int64, float64)", "(T, T)", 0 },
+  { "(Signed, Signed)", "(T, T)", 1 },
+  { "(int64, T)", "(T, int64)", 0 },
+
+  /* dimensions */
+  { "10 * int64", "N * int64", 1 },
+  { "N * int64", "10 * int64", 0 },
+  { "N * int64", "M * int64", 0 },
+  { "N * int64", "... * int64", 1 },
+  { "10 * 20 * int64", "... * int64", 1 },
+  { "int64", "... * int64", 0 },
+  { "... * int64", "... * T", 1 },
+  { "10 * N * int64", "... * N * int64", 1 },
+  { "... * N * int64", "... * int64", 1 },
+  { "(N * int64, N * int64)", "(N * int64, M * int64)", 1 },
+  { "(10 * int64, 20 * int64)", "(N * int64, N * int64)", 0 },
+  { "(10 * int64, 10 * int64)", "(N * int64, N * int64)", 1 },
+  { "var * int64", "N * int64", 0 },
+  { "var * int64", "... * int64", 1 },
+  { "?var * int64", "var * int64", 0 },
+  { "?var * int64", "?var * Signed", 1 },
+  { "(10 * int64, 10 * 2 * int64)", "(Dims... * int64, Dims... * 2 * int64)", 1 },
+  { "(10 * int64, 2 * int64)", "(Dims... * int64, Dims... * 2 * int64)", 0 },
+  { "(N * int64, ... * int64)", "(... * int64, N * int64)", 0 },
+
+  /* composite types */
+  { "(int64, float64)", "(Signed, Float)", 1 },
+  { "(int64, float64)", "(Signed, Signed)", 0 },
+  { "(int64, float64)", "(int64, float64, ...)", 1 },
+  { "(int64, float64, ...)", "(int64, float64)", 0 },
+  { "{a: int64}", "{a: Signed}", 1 },
+  { "{a: int64}", "{b: Signed}", 0 },
+  { "{b: int64, a: float32}", "{a: Float, ...}", 1 },
+  { "{a: int64, b: int8, ...}", "{b: Signed, ...}", 1 },
+  { "{a: int64, ...}", "{a: int64, b: int8}", 0 },
+  { "?int64", "?Signed", 1 },
+  { "?int64", "Signed", 0 },
+  { "pointer(int64)", "pointer(T)", 1 },
+  { "Foo(int64)", "Foo(Scalar)", 1 },
+  { "Foo(int64)", "Bar(Scalar)", 0 },
+
+  /* function signatures compare the positional arguments */
+  { "(int64, int64) -> int64", "(T, T) -> T", 1 },
+  { "(N * float64, N * float64) -> float64", "(... * float64, ... * float64) -> ... * float64", 1 },
+  { "(... * Signed) -> ... * int64", "(T) -> T", 1 },
+  { "(T) -> T", "(... * Signed) -> ... * int64", 0 },
+
+  { NULL, NULL, 0 }
+};
+
+/* Signatures of different arity and their expected order. */
+static const char *sort_input[] = {
+  "(T) -> T",
+  "(... * T, ... * T) -> ... * T",
+  "(Any) -> int64",
+  "(... * float64, ... * float64) -> ... * float64",
+  "(... * Signed) -> ... * int64",
+  "(int64, int64) -> int64",
+  "(N * float64, N * float64) -> float64",
+  "(... * int64) -> ... * int64",
+  NULL
+};
+
+static const int64_t sort_expected[] = { 7, 4, 0, 6, 3, 1, 2, 5 };
+
+static int
+check_specific(const ndt_t *p, const ndt_t *q, int expected, ndt_context_t *ctx)
+{
+    int n = -1;
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        n = ndt_more_specific(p, q, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (n != -1) {
+            fprintf(stderr, "test_specificity: FAIL: expect -1 after MemoryError\n");
+            return -1;
+        }
+    }
+
+    if (ctx->err != NDT_Success) {
+        fprintf(stderr, "test_specificity: FAIL: unexpected error: %s\n",
+                ndt_context_msg(ctx));
+        return -1;
+    }
+
+    return n == expected ? 0 : -1;
+}
+
+static int
+test_sort(ndt_context_t *ctx)
+{
+    const ndt_t *types[sizeof sort_input / sizeof sort_input[0]] = {NULL};
+    int64_t order[sizeof sort_input / sizeof sort_input[0]];
+    int64_t n, i;
+    int ret = -1;
+
+    for (n = 0; sort_input[n] != NULL; n++) {
+        types[n] = ndt_from_string(sort_input[n], ctx);
+        if (types[n] == NULL) {
+            fprintf(stderr, "test_specificity: FAIL: could not parse \"%s\"\n",
+                    sort_input[n]);
+            goto out;
+        }
+    }
+
+    if (ndt_specificity_sort(order, types, n, ctx) < 0) {
+        fprintf(stderr, "test_specificity: FAIL: unexpected error: %s\n",
+                ndt_context_msg(ctx));
+        goto out;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (order[i] != sort_expected[i]) {
+            fprintf(stderr, "test_specificity: FAIL: sort: expected %" PRIi64
+                    " at %" PRIi64 ", got %" PRIi64 "\n", sort_expected[i], i,
+                    order[i]);
+            goto out;
+        }
+    }
+
+    ret = 0;
+
+out:
+    for (i = 0; i < n; i++) {
+        ndt_del((ndt_t *)types[i]);
+    }
+    return ret;
+}
+
+int
+test_specificity(void)
+{
+    const specific_testcase_t *t;
+    const match_testcase_t *m;
+    ndt_context_t *ctx;
+    ndt_t *p = NULL, *q = NULL;
+    int count = 0;
+    int res = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (t = specific_tests; t->p != NULL; t++, count++) {
+        p = ndt_from_string(t->p, ctx);
+        q = ndt_from_string(t->q, ctx);
+        if (p == NULL || q == NULL) {
+            fprintf(stderr, "test_specificity: FAIL: could not parse \"%s\"\n", t->p);
+            goto out;
+        }
+
+        if (check_specific(p, q, t->expected, ctx) < 0) {
+            fprintf(stderr, "test_specificity: FAIL: \"%s\" and \"%s\"\n", t->p, t->q);
+            goto out;
+        }
+
+        /* the order is antisymmetric */
+        if (t->expected && check_specific(q, p, 0, ctx) < 0) {
+            fprintf(stderr, "test_specificity: FAIL: \"%s\" and \"%s\"\n", t->q, t->p);
+            goto out;
+        }
+
+        ndt_del(q);
+        ndt_del(p);
+        q = p = NULL;
+    }
+
+    /* a concrete candidate is more specific than an abstract pattern it matches */
+    for (m = match_tests; m->pattern != NULL; m++) {
+        p = ndt_from_string(m->pattern, ctx);
+        q = ndt_from_string(m->candidate, ctx);
+        if (p == NULL || q == NULL) {
+            fprintf(stderr, "test_specificity: FAIL: could not parse \"%s\"\n", m->pattern);
+            goto out;
+        }
+
+        if (m->expected && ndt_is_abstract(p) && ndt_is_concrete(q)) {
+            if (check_specific(q, p, 1, ctx) < 0) {
+                fprintf(stderr, "test_specificity: FAIL: \"%s\" and \"%s\"\n",
+                        m->candidate, m->pattern);
+                goto out;
+            }
+            count++;
+        }
+
+        ndt_del(q);
+        ndt_del(p);
+        q = p = NULL;
+    }
+
+    if (test_sort(ctx) < 0) {
+        goto out;
+    }
+    count++;
+
+    fprintf(stderr, "test_specificity (%d test cases)\n", count);
+    res = 0;
+
+out:
+    ndt_del(q);
+    ndt_del(p);
+    ndt_context_del(ctx);
+    return res;
+}
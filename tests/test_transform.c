@@ -0,0 +1,536 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*               array of structs <-> struct of arrays               */
+/*********************************************************************/
+
+typedef struct {
+    const char *aos;
+    const char *soa;  /* NULL: error */
+    const char *back; /* result of the inverse transform, NULL: error */
+} transform_testcase_t;
+
+static const transform_testcase_t transform_tests[] = {
+  { "10 * {a: int8, b: int64}",
+    "{a: 10 * int8, b: 10 * int64}",
+    "10 * {a: int8, b: int64}" },
+
+  { "2 * 3 * (int8, float32, int16)",
+    "(2 * 3 * int8, 2 * 3 * float32, 2 * 3 * int16)",
+    "2 * 3 * (int8, float32, int16)" },
+
+  { "{a: int8, b: int64}",
+    "{a: int8, b: int64}",
+    "{a: int8, b: int64}" },
+
+  { "0 * {a: int8, b: int64}",
+    "{a: 0 * int8, b: 0 * int64}",
+    "0 * {a: int8, b: int64}" },
+
+  { "2 * {a: int8, b: int64, pack=1}",
+    "{a: 2 * int8, b: 2 * int64}",
+    "2 * {a: int8, b: int64}" },
+
+  { "3 * {a: int8, b: {c: int16, d: float64}}",
+    "{a: 3 * int8, b: 3 * {c: int16, d: float64}}",
+    "3 * {a: int8, b: {c: int16, d: float64}}" },
+
+  { "4 * {a: int8, b: 2 * int32}",
+    "{a: 4 * int8, b: 4 * 2 * int32}",
+    NULL },
+
+  { "var(shapes=[2]) * var(shapes=[3,4]) * {a: int8, b: int32}",
+    "{a: var(shapes=[2]) * var(shapes=[3,4]) * int8, b: var(shapes=[2]) * var(shapes=[3,4]) * int32}",
+    "var(shapes=[2]) * var(shapes=[3,4]) * {a: int8, b: int32}" },
+
+  { "var(shapes=[3]) * 2 * {a: int16, b: complex128}",
+    "{a: var(shapes=[3]) * 2 * int16, b: var(shapes=[3]) * 2 * complex128}",
+    "var(shapes=[3]) * 2 * {a: int16, b: complex128}" },
+
+  { "var(shapes=[2]) * var(shapes=[1,2], bitmap=[1,0]) * {a: int8, b: int32}",
+    "{a: var(shapes=[2]) * var(shapes=[1,2], bitmap=[1,0]) * int8, b: var(shapes=[2]) * var(shapes=[1,2], bitmap=[1,0]) * int32}",
+    "var(shapes=[2]) * var(shapes=[1,2], bitmap=[1,0]) * {a: int8, b: int32}" },
+
+  /* invalid */
+  { "N * {a: int8}", NULL, NULL },
+  { "10 * int64", NULL, NULL },
+  { "10 * {}", NULL, NULL },
+  { "10 * ?{a: int8}", NULL, NULL },
+};
+
+static const char *soa_error_tests[] = {
+  "{a: 3 * int8, b: 2 * int64}",
+  "{a: 3 * int8, b: 3 * 1 * int64}",
+  "{a: var(shapes=[2]) * int8, b: var(shapes=[3]) * int8}",
+  "{a: var(shapes=[2]) * int8, b: 2 * int8}",
+  "{}",
+  "10 * int64",
+  "{a: N * int8}",
+};
+
+static ndt_t *
+transform(const ndt_t *t, bool inverse, ndt_soa_map_t **map, ndt_context_t *ctx)
+{
+    ndt_t *u = NULL;
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        u = inverse ? ndt_soa_to_aos(t, map, ctx) : ndt_aos_to_soa(t, map, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (u != NULL || *map != NULL) {
+            fprintf(stderr, "test_transform: FAIL: result != NULL after MemoryError\n");
+            ndt_del(u);
+            ndt_soa_map_del(*map);
+            *map = NULL;
+            return NULL;
+        }
+    }
+
+    return u;
+}
+
+static void
+copy_items(char *dst, const char *src, const ndt_soa_map_t *map)
+{
+    const ndt_field_map_t *f;
+    int64_t i, k;
+
+    for (i = 0; i < map->nfields; i++) {
+        f = &map->fields[i];
+        for (k = 0; k < map->nitems; k++) {
+            memcpy(dst + f->dst_offset + k * f->dst_stride,
+                   src + f->src_offset + k * f->src_stride, f->itemsize);
+        }
+    }
+}
+
+static int
+map_in_bounds(const ndt_soa_map_t *map, const ndt_t *src, const ndt_t *dst)
+{
+    const ndt_field_map_t *f;
+    int64_t i, last;
+
+    for (i = 0; i < map->nfields; i++) {
+        f = &map->fields[i];
+        if (map->nitems == 0) {
+            continue;
+        }
+        last = map->nitems - 1;
+        if (f->src_offset < 0 || f->dst_offset < 0 ||
+            f->src_offset + last * f->src_stride + f->itemsize > src->data_size ||
+            f->dst_offset + last * f->dst_stride + f->itemsize > dst->data_size) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Move the items of 't' to the struct of arrays layout and back. */
+static int
+check_data(const ndt_t *t, const ndt_t *soa, const ndt_t *back,
+           const ndt_soa_map_t *fwd, const ndt_soa_map_t *inv)
+{
+    char *orig, *cols, *rows;
+    const ndt_field_map_t *f, *g;
+    int64_t i, k;
+    int ret = -1;
+
+    orig = malloc(t->data_size + 1);
+    cols = calloc(soa->data_size + 1, 1);
+    rows = calloc(back->data_size + 1, 1);
+    if (orig == NULL || cols == NULL || rows == NULL) {
+        goto out;
+    }
+
+    for (k = 0; k < t->data_size; k++) {
+        orig[k] = (char)(k * 7 + 1);
+    }
+
+    copy_items(cols, orig, fwd);
+    copy_items(rows, cols, inv);
+
+    for (i = 0; i < fwd->nfields; i++) {
+        f = &fwd->fields[i];
+        g = &inv->fields[i];
+        for (k = 0; k < fwd->nitems; k++) {
+            if (memcmp(orig + f->src_offset + k * f->src_stride,
+                       rows + g->dst_offset + k * g->dst_stride,
+                       f->itemsize) != 0) {
+                goto out;
+            }
+        }
+    }
+
+    ret = 0;
+
+out:
+    free(orig);
+    free(cols);
+    free(rows);
+    return ret;
+}
+
+int
+test_transform(void)
+{
+    ndt_context_t *ctx;
+    const transform_testcase_t *tc;
+    size_t ntests = sizeof transform_tests / sizeof transform_tests[0];
+    size_t nerrors = sizeof soa_error_tests / sizeof soa_error_tests[0];
+    ndt_soa_map_t *fwd = NULL, *inv = NULL;
+    ndt_t *t = NULL, *soa = NULL, *back = NULL, *expected = NULL;
+    size_t i;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &transform_tests[i];
+
+        t = ndt_from_string(tc->aos, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_transform: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        soa = transform(t, false, &fwd, ctx);
+        if (tc->soa == NULL) {
+            if (soa != NULL || fwd != NULL || ctx->err == NDT_Success) {
+                fprintf(stderr, "test_transform: FAIL: \"%s\": expected error\n",
+                        tc->aos);
+                goto error;
+            }
+            ndt_err_clear(ctx);
+            ndt_del(t);
+            continue;
+        }
+
+        if (soa == NULL || fwd == NULL) {
+            fprintf(stderr, "test_transform: FAIL: \"%s\": %s\n",
+                    tc->aos, ndt_context_msg(ctx));
+            goto error;
+        }
+
+        expected = ndt_from_string(tc->soa, ctx);
+        if (expected == NULL || !ndt_equal(soa, expected) ||
+            !map_in_bounds(fwd, t, soa)) {
+            fprintf(stderr, "test_transform: FAIL: \"%s\": unexpected result\n",
+                    tc->aos);
+            goto error;
+        }
+        ndt_del(expected);
+        expected = NULL;
+
+        back = transform(soa, true, &inv, ctx);
+        if (tc->back == NULL) {
+            if (back != NULL || inv != NULL || ctx->err == NDT_Success) {
+                fprintf(stderr, "test_transform: FAIL: \"%s\": expected error\n",
+                        tc->soa);
+                goto error;
+            }
+            ndt_err_clear(ctx);
+        }
+        else {
+            if (back == NULL || inv == NULL) {
+                fprintf(stderr, "test_transform: FAIL: \"%s\": %s\n",
+                        tc->soa, ndt_context_msg(ctx));
+                goto error;
+            }
+
+            expected = ndt_from_string(tc->back, ctx);
+            if (expected == NULL || !ndt_equal(back, expected) ||
+                !map_in_bounds(inv, soa, back) ||
+                inv->nitems != fwd->nitems || inv->nfields != fwd->nfields ||
+                check_data(t, soa, back, fwd, inv) < 0) {
+                fprintf(stderr, "test_transform: FAIL: \"%s\": unexpected inverse\n",
+                        tc->soa);
+                goto error;
+            }
+            ndt_del(expected);
+            expected = NULL;
+        }
+
+        ndt_soa_map_del(fwd);
+        ndt_soa_map_del(inv);
+        ndt_del(t);
+        ndt_del(soa);
+        ndt_del(back);
+        fwd = inv = NULL;
+        t = soa = back = NULL;
+    }
+
+    for (i = 0; i < nerrors; i++) {
+        t = ndt_from_string(soa_error_tests[i], ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_transform: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            ndt_context_del(ctx);
+            return -1;
+        }
+
+        back = transform(t, true, &inv, ctx);
+        if (back != NULL || inv != NULL || ctx->err == NDT_Success) {
+            fprintf(stderr, "test_transform: FAIL: \"%s\": expected error\n",
+                    soa_error_tests[i]);
+            goto error;
+        }
+        ndt_err_clear(ctx);
+        ndt_del(t);
+        t = NULL;
+    }
+
+    fprintf(stderr, "test_transform (%zu test cases)\n", ntests + nerrors);
+
+    ndt_context_del(ctx);
+    return 0;
+
+error:
+    ndt_soa_map_del(fwd);
+    ndt_soa_map_del(inv);
+    ndt_del(t);
+    ndt_del(soa);
+    ndt_del(back);
+    ndt_del(expected);
+    ndt_context_del(ctx);
+    return -1;
+}
+
+
+/*********************************************************************/
+/*                        record projection                          */
+/*********************************************************************/
+
+typedef struct {
+    const char *type;
+    const char *names[3];
+    int64_t n;
+    const char *expected; /* NULL: error */
+    int64_t offset[3];
+    uint16_t pad[3];
+} project_testcase_t;
+
+static const project_testcase_t project_tests[] = {
+  { "{a: int8, b: int64, c: int16, d: float32}", {"c", "a"}, 2,
+    "{c: int16, a: int8}", {16, 0}, {6, 15} },
+  { "{a: int8, b: int64, c: int16, d: float32}", {"d"}, 1,
+    "{d: float32}", {20}, {0} },
+  { "10 * {a: int8, b: int64}", {"b"}, 1,
+    "10 * {b: int64}", {8}, {0} },
+  { "2 * 3 * {x: float64, y: float64, z: float64}", {"z", "x"}, 2,
+    "2 * 3 * {z: float64, x: float64}", {16, 0}, {0, 8} },
+  { "var(shapes=[2]) * var(shapes=[1,3]) * {a: int8, b: int64, c: int8}",
+    {"c", "b"}, 2,
+    "var(shapes=[2]) * var(shapes=[1,3]) * {c: int8, b: int64}", {16, 8}, {7, 0} },
+  { "{a: int8, b: int64, reorder=true}", {"a"}, 1,
+    "{a: int8}", {8}, {7} },
+  { "{a: int8, b: {c: int16, d: int32}}", {"b"}, 1,
+    "{b: {c: int16, d: int32}}", {4}, {0} },
+
+  /* errors */
+  { "{a: int8, b: int64}", {"c"}, 1, NULL, {0}, {0} },
+  { "{a: int8, b: int64}", {"a", "a"}, 2, NULL, {0}, {0} },
+  { "{a: int8, b: int64}", {NULL}, 0, NULL, {0}, {0} },
+  { "10 * (int8, int64)", {"a"}, 1, NULL, {0}, {0} },
+  { "N * {a: int8, b: int64}", {"a"}, 1, NULL, {0}, {0} },
+  { "{a: int8, b: 70000 * int8, c: int8}", {"a", "c"}, 2, NULL, {0}, {0} },
+};
+
+static const ndt_t *
+record_dtype(const ndt_t *t)
+{
+    while (t->tag == FixedDim || t->tag == VarDim) {
+        t = t->tag == FixedDim ? t->FixedDim.type : t->VarDim.type;
+    }
+    return t;
+}
+
+static int
+check_project(const project_testcase_t *tc, const ndt_t *t, const ndt_t *u)
+{
+    const ndt_t *s = record_dtype(t);
+    const ndt_t *r = record_dtype(u);
+    int64_t i, k;
+
+    if (u->data_size != t->data_size || r->data_size != s->data_size ||
+        r->data_align != s->data_align) {
+        return -1;
+    }
+
+    for (i = 0; i < tc->n; i++) {
+        k = ndt_record_field(s, tc->names[i]);
+        if (r->Concrete.Record.offset[i] != tc->offset[i] ||
+            r->Concrete.Record.offset[i] != s->Concrete.Record.offset[k] ||
+            r->Concrete.Record.pad[i] != tc->pad[i] ||
+            r->Record.types[i] != s->Record.types[k]) {
+            return -1;
+        }
+    }
+
+    if (t->tag == FixedDim &&
+        u->Concrete.FixedDim.stride != t->Concrete.FixedDim.stride) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+test_record_project(void)
+{
+    ndt_context_t *ctx;
+    const project_testcase_t *tc;
+    size_t ntests = sizeof project_tests / sizeof project_tests[0];
+    const char *names[] = {"b"};
+    int64_opt_t no_offset = {None, 0};
+    char_opt_t order = {Some, 'F'};
+    ndt_t *t = NULL, *u = NULL, *expected = NULL;
+    size_t i;
+    int ret = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (i = 0; i < ntests; i++) {
+        tc = &project_tests[i];
+
+        t = ndt_from_string(tc->type, ctx);
+        if (t == NULL) {
+            fprintf(stderr, "test_record_project: parse: FAIL: %s\n",
+                    ndt_context_msg(ctx));
+            goto out;
+        }
+
+        for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+            ndt_err_clear(ctx);
+
+            ndt_set_alloc_fail();
+            u = ndt_record_project(t, tc->names, tc->n, ctx);
+            ndt_set_alloc();
+
+            if (ctx->err != NDT_MemoryError) {
+                break;
+            }
+
+            if (u != NULL) {
+                fprintf(stderr, "test_record_project: FAIL: result != NULL after MemoryError\n");
+                goto out;
+            }
+        }
+
+        if (tc->expected == NULL) {
+            if (u != NULL || ctx->err != NDT_ValueError) {
+                fprintf(stderr, "test_record_project: FAIL: \"%s\": expected error\n",
+                        tc->type);
+                goto out;
+            }
+            ndt_err_clear(ctx);
+            ndt_del(t);
+            t = NULL;
+            continue;
+        }
+
+        if (u == NULL) {
+            fprintf(stderr, "test_record_project: FAIL: \"%s\": %s\n",
+                    tc->type, ndt_context_msg(ctx));
+            goto out;
+        }
+
+        expected = ndt_from_string(tc->expected, ctx);
+        if (expected == NULL || !ndt_equal(u, expected) || check_project(tc, t, u) < 0) {
+            fprintf(stderr, "test_record_project: FAIL: \"%s\": unexpected result\n",
+                    tc->type);
+            goto out;
+        }
+
+        ndt_del(expected);
+        ndt_del(u);
+        ndt_del(t);
+        expected = u = t = NULL;
+    }
+
+    /* strided arrays keep their strides */
+    t = ndt_from_string("3 * 2 * {a: int8, b: int64}", ctx);
+    if (t != NULL) {
+        t = ndt_array(t, NULL, no_offset, no_offset, order, ctx);
+    }
+    if (t == NULL) {
+        fprintf(stderr, "test_record_project: FAIL: %s\n", ndt_context_msg(ctx));
+        goto out;
+    }
+
+    u = ndt_record_project(t, names, 1, ctx);
+    if (u == NULL || !ndt_is_ndarray(u) ||
+        u->Concrete.FixedDim.stride != t->Concrete.FixedDim.stride ||
+        u->FixedDim.type->Concrete.FixedDim.stride !=
+        t->FixedDim.type->Concrete.FixedDim.stride) {
+        fprintf(stderr, "test_record_project: FAIL: strided array\n");
+        goto out;
+    }
+
+    fprintf(stderr, "test_record_project (%zu test cases)\n", ntests + 1);
+    ret = 0;
+
+out:
+    ndt_del(expected);
+    ndt_del(u);
+    ndt_del(t);
+    ndt_context_del(ctx);
+    return ret;
+}
@@ -116,5 +116,108 @@ const typecheck_testcase_t typecheck_tests[] = {
     "(pointer(400 * 2 * 3 * int64), pointer(400 * 3 * 10 * int64))",
     "pointer(400 * 2 * 10 * int64)", 1 },
 
+  { "(Dims... * T) -> Dims... * T",
+    "(2 * 3 * int64)",
+    "2 * 3 * int64", 2 },
+
+  /* no broadcasting, see test_broadcast */
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(2 * 3 * float64, 2 * 3 * float64)",
+    "2 * 3 * float64", 2 },
+
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(2 * 1 * float64, 3 * float64)",
+    NULL, 0 },
+
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(2 * 3 * float64, float64)",
+    NULL, 0 },
+
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(2 * float64, 3 * float64)",
+    NULL, 0 },
+
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(2 * float64, 3 * int64)",
+    NULL, 0 },
+
+  { "(Dims... * M * N * T, Dims... * N * P * T) -> Dims... * M * P * T",
+    "(5 * 4 * 2 * 3 * int64, 5 * 4 * 3 * 10 * int64)",
+    "5 * 4 * 2 * 10 * int64", 2 },
+
+  { "(Dims... * M * N * T, Dims... * N * P * T) -> Dims... * M * P * T",
+    "(5 * 1 * 2 * 3 * int64, 4 * 3 * 10 * int64)",
+    NULL, 0 },
+
+  { "(Dims... * M * N * T, Dims... * N * P * T) -> Dims... * M * P * T",
+    "(5 * 2 * 2 * 3 * int64, 4 * 3 * 10 * int64)",
+    NULL, 0 },
+
+  { "(T) -> T",
+    "(int8)",
+    "int8", 0 },
+
+  { "(T, U) -> {a: T, b: ?U}",
+    "(int8, complex64)",
+    "{a: int8, b: ?complex64}", 0 },
+
+  { "(N * T) -> N * ?T",
+    "(3 * uint16)",
+    "3 * ?uint16", 0 },
+
+  { "(N * T) -> N * 2 * {x: T, y: (T, bool)}",
+    "(4 * fixed_string(10))",
+    "4 * 2 * {x: fixed_string(10), y: (fixed_string(10), bool)}", 0 },
+
+  { "(N * T) -> pointer(N * T)",
+    "(3 * string)",
+    "pointer(3 * string)", 0 },
+
+  { "(N * T) -> N * Foo(T)",
+    "(3 * bool)",
+    "3 * Foo(bool)", 0 },
+
+  { "(T) -> (T) -> T",
+    "(int16)",
+    "(int16) -> int16", 0 },
+
+  { "(Dims... * T) -> Dims... * T",
+    "(var(shapes=[2]) * var(shapes=[3,4]) * float64)",
+    "var(shapes=[2]) * var(shapes=[3,4]) * float64", 2 },
+
+  { "(Dims... * T) -> Dims... * (T, int8)",
+    "(var(shapes=[2]) * 3 * float64)",
+    "var(shapes=[2]) * 3 * (float64, int8)", 2 },
+
+  { "(Dims... * T, Dims... * T) -> Dims... * T",
+    "(var(shapes=[2]) * float64, var(shapes=[2]) * float64)",
+    "var(shapes=[2]) * float64", 1 },
+
+  { "(Dims... * T) -> Dims... * (T, int8)",
+    "(var(shapes=[2], align=64) * fixed(shape=3, align=16) * int8)",
+    "var(shapes=[2], align=64) * fixed(shape=3, align=16) * (int8, int8)", 2 },
+
+  /* kinds in the return type are not bound by the arguments */
+  { "(T) -> Any",
+    "(int8)",
+    NULL, 0 },
+
+  { "(N * T) -> N * Float",
+    "(3 * float32)",
+    NULL, 0 },
+
+  /* the layout attributes of the return type are kept */
+  { "(T) -> (T, int8, pack=1)",
+    "(int64)",
+    "(int64, int8, pack=1)", 0 },
+
+  { "(T) -> {a: int8, b: T, align=16}",
+    "(int32)",
+    "{a: int8, b: int32, align=16}", 0 },
+
+  { "(N * T, U) -> N * {a: T, b: U, c: T, reorder=true}",
+    "(3 * int8, int64)",
+    "3 * {a: int8, b: int64, c: int8, reorder=true}", 0 },
+
   { NULL, NULL, 0, 0 }
 };
@@ -0,0 +1,260 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include "ndtypes.h"
+#include "test.h"
+#include "alloc_fail.h"
+
+
+/*********************************************************************/
+/*                           unification                             */
+/*********************************************************************/
+
+typedef struct {
+    const char *p;
+    const char *q;
+    const char *expected; /* NULL if the types do not unify */
+} unify_testcase_t;
+
+static const unify_testcase_t unify_tests[] = {
+  /* leaves and type variables */
+  { "int64", "int64", "int64" },
+  { "int64", "float64", NULL },
+  { "T", "int64", "int64" },
+  { "int64", "T", "int64" },
+  { "T", "U", "T" },
+  { "(T, T)", "(int64, U)", "(int64, int64)" },
+  { "(T, T)", "(int64, float64)", NULL },
+  { "(U, T, T)", "(V, V, int64)", "(int64, int64, int64)" },
+  { "T", "(T, int64)", "(T1, int64)" },
+  { "(T, T)", "(U, (U, int64))", NULL },
+  { "Any", "2 * int64", "2 * int64" },
+  { "T", "2 * int64", "2 * int64" },
+
+  /* kinds */
+  { "Signed", "int32", "int32" },
+  { "Signed", "float64", NULL },
+  { "(T, T)", "(Signed, int16)", "(int16, int16)" },
+  { "(T, T)", "(Scalar, Float)", "(Float, Float)" },
+  { "(Signed, Float)", "(T, T)", NULL },
+  { "FixedString", "fixed_string(10)", "fixed_string(10)" },
+  { "(T, T)", "(Any, U)", "(T, T)" },
+
+  /* symbolic dimensions */
+  { "N * int64", "10 * int64", "10 * int64" },
+  { "N * M * T", "M * 3 * float32", "N * 3 * float32" },
+  { "(N * T, N * T)", "(10 * int64, 20 * int64)", NULL },
+  { "(N * T, M * T)", "(K * int64, K * U)", "(M * int64, M * int64)" },
+  { "(N * T, N * T)", "(10 * int64, M * int64)", "(10 * int64, 10 * int64)" },
+  { "var * T", "var * int64", "var * int64" },
+  { "var * T", "10 * T", NULL },
+  { "N * int64", "int64", NULL },
+
+  /* ellipses */
+  { "Dims... * int64", "2 * 3 * int64", "2 * 3 * int64" },
+  { "... * int64", "2 * 3 * int64", "2 * 3 * int64" },
+  { "Dims... * int64", "int64", NULL },
+  { "Dims... * N * T", "A... * 10 * float64", "Dims... * 10 * float64" },
+  { "2 * Dims... * T", "Rest... * 3 * int64", "2 * Dims... * 3 * int64" },
+  { "(Dims... * T, Dims... * T)", "(2 * 3 * int64, 2 * 3 * int64)",
+    "(2 * 3 * int64, 2 * 3 * int64)" },
+  { "(Dims... * T, Dims... * T)", "(2 * 3 * int64, 3 * int64)", NULL },
+  { "(Dims... * T, Dims... * T)", "(A... * int64, 2 * B... * U)",
+    "(2 * B... * int64, 2 * B... * int64)" },
+  { "(2 * Dims... * T, Dims... * T)", "(A... * 3 * int64, 4 * B... * int64)",
+    "(2 * 4 * Dims... * 3 * int64, 4 * Dims... * 3 * int64)" },
+  { "(Dims... * T, Dims... * T)", "(2 * A... * int64, A... * 3 * int64)", NULL },
+  { "Dims... * int64", "2 * Dims... * T", "2 * Dims1... * int64" },
+  { "(Dims... * T, Dims... * T)", "(N * A... * int64, N * A... * U)",
+    "(N * A... * int64, N * A... * int64)" },
+
+  /* compound types */
+  { "?int64", "?T", "?int64" },
+  { "?T", "int64", NULL },
+  { "pointer(T)", "pointer(float64)", "pointer(float64)" },
+  { "pointer(float64)", "pointer(T)", "pointer(float64)" },
+  { "(pointer(T), T)", "(U, int64)", "(pointer(int64), int64)" },
+  { "{a: T, b: N * int64}", "{a: float32, b: 5 * U}",
+    "{a: float32, b: 5 * int64}" },
+  { "{a: T}", "{b: T}", NULL },
+  { "(T, ...)", "(int64)", "(int64)" },
+  { "(N * T) -> N * T", "(5 * int64) -> R", "(5 * int64) -> 5 * int64" },
+
+  /* variadic tuples and records */
+  { "(T, ...)", "(int8, float64, U)", "(int8, float64, U)" },
+  { "(int64, ...)", "(T, float64, ...)", "(int64, float64, ...)" },
+  { "(int64, float64, ...)", "(T)", NULL },
+  { "{a: T, ...}", "{b: float64, a: int64}", "{b: float64, a: int64}" },
+  { "{a: T, ...}", "{b: float64, c: int64}", NULL },
+  { "{a: int64, ...}", "{b: T, ...}", "{a: int64, b: T, ...}" },
+  { "{a: T, b: T, ...}", "{b: int64, ...}", "{a: int64, b: int64, ...}" },
+  { "{a: T, b: T, ...}", "{b: int64, a: float32, c: int8}", NULL },
+  { "{b: int64, a: float32}", "{a: float32, b: int64}", NULL },
+
+  { NULL, NULL, NULL }
+};
+
+static int
+check_unify(const ndt_t *p, const ndt_t *q, const ndt_t *expected,
+            ndt_context_t *ctx)
+{
+    ndt_t *u = NULL;
+
+    for (alloc_fail = 1; alloc_fail < INT_MAX; alloc_fail++) {
+        ndt_err_clear(ctx);
+
+        ndt_set_alloc_fail();
+        u = ndt_unify(p, q, ctx);
+        ndt_set_alloc();
+
+        if (ctx->err != NDT_MemoryError) {
+            break;
+        }
+
+        if (u != NULL) {
+            fprintf(stderr, "test_unify: FAIL: expect NULL after MemoryError\n");
+            ndt_del(u);
+            return -1;
+        }
+    }
+
+    if (ctx->err != NDT_Success) {
+        fprintf(stderr, "test_unify: FAIL: unexpected error: %s\n",
+                ndt_context_msg(ctx));
+        ndt_del(u);
+        return -1;
+    }
+
+    if ((u == NULL) != (expected == NULL) ||
+        (u != NULL && !ndt_equal(u, expected))) {
+        ndt_del(u);
+        return -1;
+    }
+
+    /* the unifier is an instance of both types */
+    if (u != NULL && (ndt_match(p, u, ctx) != 1 || ndt_match(q, u, ctx) != 1)) {
+        fprintf(stderr, "test_unify: FAIL: unifier does not match both types\n");
+        ndt_del(u);
+        return -1;
+    }
+
+    ndt_del(u);
+    return 0;
+}
+
+int
+test_unify(void)
+{
+    const unify_testcase_t *t;
+    const match_testcase_t *m;
+    ndt_context_t *ctx;
+    ndt_t *p = NULL, *q = NULL, *expected = NULL, *u = NULL;
+    int count = 0;
+    int res = -1;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "error: out of memory");
+        return -1;
+    }
+
+    for (t = unify_tests; t->p != NULL; t++, count++) {
+        p = ndt_from_string(t->p, ctx);
+        q = ndt_from_string(t->q, ctx);
+        if (t->expected != NULL) {
+            expected = ndt_from_string(t->expected, ctx);
+        }
+        if (p == NULL || q == NULL || (t->expected != NULL && expected == NULL)) {
+            fprintf(stderr, "test_unify: FAIL: could not parse \"%s\"\n", t->p);
+            goto out;
+        }
+
+        if (check_unify(p, q, expected, ctx) < 0) {
+            fprintf(stderr, "test_unify: FAIL: \"%s\" with \"%s\"\n", t->p, t->q);
+            goto out;
+        }
+
+        /* unification is symmetric up to the names of variables */
+        u = ndt_unify(q, p, ctx);
+        if ((u == NULL) != (t->expected == NULL) ||
+            (u != NULL && (ndt_match(p, u, ctx) != 1 ||
+                           ndt_match(q, u, ctx) != 1))) {
+            fprintf(stderr, "test_unify: FAIL: \"%s\" with \"%s\"\n", t->q, t->p);
+            goto out;
+        }
+
+        ndt_del(u);
+        ndt_del(expected);
+        ndt_del(q);
+        ndt_del(p);
+        u = expected = q = p = NULL;
+    }
+
+    /* with a concrete candidate, unification is matching */
+    for (m = match_tests; m->pattern != NULL; m++) {
+        p = ndt_from_string(m->pattern, ctx);
+        q = ndt_from_string(m->candidate, ctx);
+        if (p == NULL || q == NULL) {
+            fprintf(stderr, "test_unify: FAIL: could not parse \"%s\"\n", m->pattern);
+            goto out;
+        }
+
+        if (ndt_is_concrete(q)) {
+            if (check_unify(p, q, m->expected ? q : NULL, ctx) < 0) {
+                fprintf(stderr, "test_unify: FAIL: pattern \"%s\" with \"%s\"\n",
+                        m->pattern, m->candidate);
+                goto out;
+            }
+            count++;
+        }
+
+        ndt_del(q);
+        ndt_del(p);
+        q = p = NULL;
+    }
+
+    fprintf(stderr, "test_unify (%d test cases)\n", count);
+    res = 0;
+
+out:
+    ndt_del(u);
+    ndt_del(expected);
+    ndt_del(q);
+    ndt_del(p);
+    ndt_context_del(ctx);
+    return res;
+}
@@ -0,0 +1,179 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "ndtypes.h"
+
+
+/*
+ * Compare trying ndt_match() on every registered signature with a lookup
+ * in a dispatch index.
+ */
+
+#define NRUNS 100000
+#define MAXSIGS 256
+
+static const char *dtypes[] = {
+  "int8", "int16", "int32", "int64", "uint8", "uint16", "uint32", "uint64",
+  "float32", "float64", "complex64", "complex128", NULL
+};
+
+static const char *templates[] = {
+  "(N * %s, N * %s) -> %s",
+  "(N * M * %s, M * P * %s) -> N * P * %s",
+  "(... * %s, ... * %s) -> ... * %s",
+  "(... * %s) -> ... * %s",
+  NULL
+};
+
+static const char *generic[] = {
+  "(... * T, ... * T) -> ... * T",
+  "(T) -> T",
+  NULL
+};
+
+static const char *queries[] = {
+  "(100 * float64, 100 * float64)",
+  "(10 * 20 * complex64, 20 * 30 * complex64)",
+  "(10 * 20 * 30 * uint16, 10 * 20 * 30 * uint16)",
+  "(10 * {a: int64, b: float32})",
+  NULL
+};
+
+int
+main(void)
+{
+    ndt_t *sigs[MAXSIGS];
+    ndt_dispatch_t *d;
+    ndt_context_t *ctx;
+    ndt_t *args;
+    char buf[256];
+    clock_t start, end;
+    int nsigs = 0;
+    int i, k, n, r, id1, id2;
+    int misses, rejected;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL || ndt_init(ctx) < 0) {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+
+    d = ndt_dispatch_new(ctx);
+    if (d == NULL) {
+        goto error;
+    }
+
+    for (k = 0; templates[k] != NULL; k++) {
+        for (i = 0; dtypes[i] != NULL; i++) {
+            snprintf(buf, sizeof buf, templates[k], dtypes[i], dtypes[i], dtypes[i]);
+            sigs[nsigs] = ndt_from_string(buf, ctx);
+            if (sigs[nsigs] == NULL || ndt_dispatch_add(d, sigs[nsigs], ctx) < 0) {
+                goto error;
+            }
+            nsigs++;
+        }
+    }
+    for (k = 0; generic[k] != NULL; k++) {
+        sigs[nsigs] = ndt_from_string(generic[k], ctx);
+        if (sigs[nsigs] == NULL || ndt_dispatch_add(d, sigs[nsigs], ctx) < 0) {
+            goto error;
+        }
+        nsigs++;
+    }
+
+    printf("%d signatures\n", nsigs);
+
+    for (k = 0; queries[k] != NULL; k++) {
+        args = ndt_from_string(queries[k], ctx);
+        if (args == NULL) {
+            goto error;
+        }
+
+        printf("%s\n", queries[k]);
+
+        id1 = -1;
+        start = clock();
+        for (r = 0; r < NRUNS; r++) {
+            for (n = 0; n < nsigs; n++) {
+                if (ndt_match(sigs[n]->Function.pos, args, ctx) == 1) {
+                    break;
+                }
+            }
+            id1 = n;
+        }
+        end = clock();
+        printf("    linear ndt_match: %f s\n", (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+        id2 = -1;
+        start = clock();
+        for (r = 0; r < NRUNS; r++) {
+            id2 = ndt_dispatch_find(d, args, ctx);
+        }
+        end = clock();
+        printf("    ndt_dispatch_find: %f s\n", (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+        misses = rejected = 0;
+        for (n = 0; n < nsigs; n++) {
+            if (ndt_match(sigs[n]->Function.pos, args, ctx) == 0) {
+                misses++;
+                rejected += !ndt_may_match(sigs[n]->Function.pos, args);
+            }
+        }
+        printf("    %d of %d non-matching signatures rejected by summaries\n",
+               rejected, misses);
+
+        if (id1 != id2) {
+            fprintf(stderr, "error: results differ\n");
+        }
+
+        ndt_del(args);
+    }
+
+    ndt_dispatch_del(d);
+    for (n = 0; n < nsigs; n++) {
+        ndt_del(sigs[n]);
+    }
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 0;
+
+error:
+    ndt_err_fprint(stderr, ctx);
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 1;
+}
@@ -0,0 +1,159 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "ndtypes.h"
+
+
+/*
+ * Compare ndt_match(), which builds a symbol table for every call, with
+ * the execution of a compiled pattern.
+ */
+
+#define NRUNS 1000000
+
+static int64_t nalloc = 0;
+
+static void *
+counting_malloc(size_t size)
+{
+    nalloc++;
+    return malloc(size);
+}
+
+const char *pairs[][2] = {
+  { "N * M * float64", "100 * 20 * float64" },
+  { "Dims... * N * T", "10 * 20 * 30 * int32" },
+  { "(N * M * T, M * P * T) -> N * P * T",
+    "(10 * 20 * float32, 20 * 30 * float32) -> 10 * 30 * float32" },
+  { "{a: int64, b: N * float64, c: (T, T)}",
+    "{a: int64, b: 10 * float64, c: (?uint8, ?uint8)}" },
+  { NULL, NULL }
+};
+
+
+static int
+bench(const char *ps, const char *cs, ndt_context_t *ctx)
+{
+    ndt_binding_t bindings[16];
+    ndt_pattern_t *m;
+    ndt_t *p, *c;
+    clock_t start, end;
+    int n1 = 0, n2 = 0;
+    int i;
+
+    p = ndt_from_string(ps, ctx);
+    if (p == NULL) {
+        return -1;
+    }
+
+    c = ndt_from_string(cs, ctx);
+    if (c == NULL) {
+        ndt_del(p);
+        return -1;
+    }
+
+    printf("%s\n%s\n", ps, cs);
+
+    nalloc = 0;
+    ndt_mallocfunc = counting_malloc;
+    start = clock();
+    for (i = 0; i < NRUNS; i++) {
+        n1 += ndt_match(p, c, ctx);
+    }
+    end = clock();
+    ndt_mallocfunc = malloc;
+    printf("    ndt_match: %f s, %.2f allocations per call\n",
+           (double)(end-start)/(double)CLOCKS_PER_SEC, (double)nalloc/NRUNS);
+
+    start = clock();
+    m = ndt_pattern_compile(p, ctx);
+    if (m == NULL || m->nslots > 16) {
+        ndt_pattern_del(m);
+        ndt_del(p);
+        ndt_del(c);
+        return -1;
+    }
+    for (i = 0; i < NRUNS; i++) {
+        n2 += ndt_pattern_match(m, c, bindings, ctx);
+    }
+    end = clock();
+    printf("    compiled pattern (%" PRIi64 " instructions): %f s\n", m->nops,
+           (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+    if (n1 != n2) {
+        fprintf(stderr, "error: results differ\n");
+    }
+
+    ndt_pattern_del(m);
+    ndt_del(p);
+    ndt_del(c);
+    return 0;
+}
+
+int
+main(void)
+{
+    ndt_context_t *ctx;
+    int i;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    if (ndt_init(ctx) < 0) {
+        ndt_err_fprint(stderr, ctx);
+        ndt_context_del(ctx);
+        return 1;
+    }
+
+    for (i = 0; pairs[i][0] != NULL; i++) {
+        if (bench(pairs[i][0], pairs[i][1], ctx) < 0) {
+            ndt_err_fprint(stderr, ctx);
+            ndt_context_del(ctx);
+            ndt_finalize();
+            return 1;
+        }
+    }
+
+    ndt_context_del(ctx);
+    ndt_finalize();
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "ndtypes.h"
+
+
+/*
+ * Compare a recursive walker that dispatches on the type tag for every
+ * element with the execution of a compiled traversal plan.
+ */
+
+const char *types[] = {
+  "1000 * 1000 * float64",
+  "1000 * 500 * {a: int64, b: float64, c: int8, d: 3 * int16}",
+  "1000 * 200 * (?int32, {x: float32, y: float32, z: 2 * 2 * float32})",
+  NULL
+};
+
+
+static int
+visit(const ndt_t *t, int64_t offset, int64_t size, void *arg)
+{
+    int64_t *sum = (int64_t *)arg;
+    (void)size;
+
+    if (t != NULL) {
+        *sum += offset;
+    }
+
+    return 0;
+}
+
+/* A generic recursive walker: the tag is dispatched for every element. */
+static int
+walk(const ndt_t *t, int64_t base, ndt_visit_f f, int64_t *sum)
+{
+    int64_t i;
+
+    switch (t->tag) {
+    case FixedDim:
+        for (i = 0; i < t->FixedDim.shape; i++) {
+            walk(t->FixedDim.type, base + i * t->Concrete.FixedDim.stride, f, sum);
+        }
+        return 0;
+    case Tuple:
+        for (i = 0; i < t->Tuple.shape; i++) {
+            walk(t->Tuple.types[i], base + t->Concrete.Tuple.offset[i], f, sum);
+            if (t->Concrete.Tuple.pad[i] > 0) {
+                f(NULL, base + t->Concrete.Tuple.offset[i], 0, sum);
+            }
+        }
+        return 0;
+    case Record:
+        for (i = 0; i < t->Record.shape; i++) {
+            walk(t->Record.types[i], base + t->Concrete.Record.offset[i], f, sum);
+            if (t->Concrete.Record.pad[i] > 0) {
+                f(NULL, base + t->Concrete.Record.offset[i], 0, sum);
+            }
+        }
+        return 0;
+    case Option:
+        return walk(t->Option.type, base, f, sum);
+    case Constr:
+        return walk(t->Constr.type, base, f, sum);
+    default:
+        return f(t, base, t->data_size, sum);
+    }
+}
+
+static int
+bench(const char *s, ndt_visit_f f, ndt_context_t *ctx)
+{
+    ndt_plan_t *plan;
+    ndt_t *t;
+    int64_t sum1 = 0, sum2 = 0;
+    clock_t start, end;
+    int i;
+
+    t = ndt_from_string(s, ctx);
+    if (t == NULL) {
+        return -1;
+    }
+
+    printf("%s\n", s);
+
+    start = clock();
+    for (i = 0; i < 10; i++) {
+        walk(t, 0, f, &sum1);
+    }
+    end = clock();
+    printf("    recursive walk: %f s\n", (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+    start = clock();
+    plan = ndt_compile_plan(t, ctx);
+    if (plan == NULL) {
+        ndt_del(t);
+        return -1;
+    }
+    for (i = 0; i < 10; i++) {
+        if (ndt_plan_exec(plan, 0, f, &sum2, ctx) < 0) {
+            ndt_plan_del(plan);
+            ndt_del(t);
+            return -1;
+        }
+    }
+    end = clock();
+    printf("    compiled plan (%" PRIi64 " instructions): %f s\n", plan->ninstr,
+           (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+    if (sum1 != sum2) {
+        fprintf(stderr, "error: results differ\n");
+    }
+
+    ndt_plan_del(plan);
+    ndt_del(t);
+    return 0;
+}
+
+int
+main(void)
+{
+    ndt_visit_f volatile f = visit;
+    ndt_context_t *ctx;
+    const char **c;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (c = types; *c != NULL; c++) {
+        if (bench(*c, f, ctx) < 0) {
+            ndt_err_fprint(stderr, ctx);
+            ndt_context_del(ctx);
+            return 1;
+        }
+    }
+
+    ndt_context_del(ctx);
+
+    return 0;
+}
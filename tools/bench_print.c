@@ -0,0 +1,196 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "ndtypes.h"
+
+
+/*
+ * Time the printers on the baseball schema from tools/bench.c and on a
+ * concrete ragged array.
+ */
+
+#define NRUNS 20000
+#define NROWS 20000
+
+static const char *schema = "{battingpost: var * {yearID: ?int32, round: ?string, playerID: ?string, teamID: ?string, lgID: (?string, int64, 5 * 10 * {a: complex128, b: ?int32}), G: ?int32, AB: ?int32, R: ?int32, H: (int32, ... * int32) -> int32, B: (int32, ...) -> int32, HR: {a: 10 * float64, b: var * int32, ...}, RBI: ?int32, SB: ?int32, CS: ?int32, BB: ?int32, SO: ?int32, IBB: ?int32, HBP: ?int32, SH: ?int32, SF: ?int32, GIDP: ?int32, AString: fixed_string(100,'utf32'), BString: fixed_string(100), CBytes: bytes(align=16), DBytes: fixed_bytes(size=1600, align=16)}, awardsmanagers: var * {managerID: ?string, awardID: ?string, yearID: ?int32, lgID: ?string, tie: ?string, notes: ?string}, hofold: var * {hofID: ?string, yearid: ?int32, votedBy: ?string, ballots: ?int32, votes: ?int32, inducted: ?string, category: ?string}, salaries: var * {yearID: ?int32, teamID: ?string, lgID: ?string, playerID: ?string, salary: ?float64}, pitchingpost: var * {playerID: ?string, yearID: ?int32, round: ?string, teamID: ?string, lgID: ?string, W: ?int32, L: ?int32, G: ?int32, GS: ?int32, CG: ?int32, SHO: ?int32, SV: ?int32, IPouts: ?int32, H: ?int32, ER: ?int32, HR: ?int32, BB: ?int32, SO: ?int32, BAOpp: ?float64, ERA: ?float64, IBB: ?int32, WP: ?int32, HBP: ?int32, BK: ?int32, BFP: ?int32, GF: ?int32, R: ?int32, SH: ?int32, SF: ?int32, GIDP: ?int32}, managers: var * {managerID: ?string, yearID: ?int32, teamID: ?string, lgID: ?string, inseason: ?int32, G: ?int32, W: ?int32, L: ?int32, rank: ?int32, plyrMgr: ?string}, teams: var * {yearID: ?int32, lgID: ?string, teamID: ?string, franchID: ?string, divID: ?string, Rank: ?int32, G: ?int32, Ghome: ?int32, W: ?int32, L: ?int32, DivWin: ?string, WCWin: ?string, LgWin: ?string, WSWin: ?string, R: ?int32, AB: ?int32, H: ?int32, B: ?int32, B: ?int32, HR: ?int32, BB: ?int32, SO: ?int32, SB: ?int32, CS: ?int32, HBP: ?int32, SF: ?int32, RA: ?int32, ER: ?int32, ERA: ?float64, CG: ?int32, SHO: ?int32, SV: ?int32, IPouts: ?int32, HA: ?int32, HRA: ?int32, BBA: ?int32, SOA: ?int32, E: ?int32, DP: ?int32, FP: ?float64, name: ?string, park: ?string, attendance: ?int32, BPF: ?int32, PPF: ?int32, teamIDBR: ?string, teamIDlahman45: ?string, teamIDretro: ?string}}";
+
+static int
+run(const char *name, char *(*f)(ndt_t *, ndt_context_t *), ndt_t *t,
+    int nruns, ndt_context_t *ctx)
+{
+    clock_t start, end;
+    size_t len = 0;
+    char *s;
+    int r;
+
+    start = clock();
+    for (r = 0; r < nruns; r++) {
+        s = f(t, ctx);
+        if (s == NULL) {
+            ndt_err_fprint(stderr, ctx);
+            return -1;
+        }
+        len = strlen(s);
+        ndt_free(s);
+    }
+    end = clock();
+
+    printf("    %s (%zu bytes): %f s\n", name, len,
+           (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+    return 0;
+}
+
+static int
+count(const char *s, size_t n, void *arg)
+{
+    (void)s;
+    *(size_t *)arg += n;
+    return 0;
+}
+
+static int
+stream(const char *name, ndt_t *t, int nruns, ndt_context_t *ctx)
+{
+    clock_t start, end;
+    size_t len = 0;
+    int r;
+
+    start = clock();
+    for (r = 0; r < nruns; r++) {
+        len = 0;
+        if (ndt_print_with_meta(t, count, &len, ctx) < 0) {
+            ndt_err_fprint(stderr, ctx);
+            return -1;
+        }
+    }
+    end = clock();
+
+    printf("    %s (%zu bytes): %f s\n", name, len,
+           (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+    return 0;
+}
+
+/* A log line: 200 bytes, 10 offsets per list. */
+static char *
+with_meta_limited(ndt_t *t, ndt_context_t *ctx)
+{
+    static const ndt_limits_t limits = {200, 10, 0};
+    return ndt_as_string_with_meta_limited(t, &limits, ctx);
+}
+
+/* var(shapes=[NROWS]) * var(shapes=[0, 1, ..., 99, 0, ...]) * float64 */
+static char *
+ragged(void)
+{
+    char *s;
+    size_t len = 0;
+    int i;
+
+    s = ndt_alloc(NROWS, 8);
+    if (s == NULL) {
+        return NULL;
+    }
+
+    len += sprintf(s+len, "var(shapes=[%d]) * var(shapes=[", NROWS);
+    for (i = 0; i < NROWS; i++) {
+        len += sprintf(s+len, "%s%d", i ? "," : "", i % 100);
+    }
+    sprintf(s+len, "]) * float64");
+
+    return s;
+}
+
+int
+main(void)
+{
+    ndt_context_t *ctx;
+    ndt_t *t = NULL;
+    char *s;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL || ndt_init(ctx) < 0) {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+
+    t = ndt_from_string(schema, ctx);
+    if (t == NULL) {
+        goto error;
+    }
+
+    printf("baseball schema, %d runs\n", NRUNS);
+    if (run("ndt_as_string", ndt_as_string, t, NRUNS, ctx) < 0 ||
+        run("ndt_indent", ndt_indent, t, NRUNS, ctx) < 0) {
+        goto error;
+    }
+    ndt_del(t);
+
+    s = ragged();
+    if (s == NULL) {
+        fprintf(stderr, "out of memory\n");
+        goto error;
+    }
+    t = ndt_from_string(s, ctx);
+    ndt_free(s);
+    if (t == NULL) {
+        goto error;
+    }
+
+    printf("ragged array with %d rows, %d runs\n", NROWS, NRUNS / 100);
+    if (run("ndt_as_string_with_meta", ndt_as_string_with_meta, t, NRUNS / 100,
+            ctx) < 0 ||
+        stream("ndt_print_with_meta", t, NRUNS / 100, ctx) < 0 ||
+        run("ndt_as_string_with_meta_limited", with_meta_limited, t, NRUNS / 100,
+            ctx) < 0) {
+        goto error;
+    }
+    ndt_del(t);
+
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 0;
+
+error:
+    if (t) ndt_del(t);
+    ndt_err_fprint(stderr, ctx);
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 1;
+}
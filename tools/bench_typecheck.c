@@ -0,0 +1,225 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include "ndtypes.h"
+
+
+/*
+ * Typecheck one signature against many argument tuples: one ndt_typecheck()
+ * call per tuple, one ndt_typecheck_batch() call, and the batch split
+ * across several threads.
+ */
+
+#define NARGS 12000
+#define NRUNS 20
+#define NTHREADS 4
+
+static const char *signature =
+  "(Dims... * M * N * T, Dims... * N * P * T) -> Dims... * M * P * T";
+
+static const char *dtypes[] = {
+  "int8", "int16", "int32", "int64", "uint8", "uint16", "uint32", "uint64",
+  "float32", "float64", "complex64", "complex128", NULL
+};
+
+static const char *templates[] = {
+  "(2 * 3 * %s, 3 * 10 * %s)",
+  "(400 * 2 * 3 * %s, 400 * 3 * 10 * %s)",
+  "(5 * 1 * 2 * 3 * %s, 4 * 3 * 10 * %s)",
+  "(2 * 3 * %s, 2 * 10 * %s)",
+  "(2 * 3 * %s, 3 * 10 * float16)",
+  NULL
+};
+
+typedef struct {
+    const ndt_t *f;
+    const ndt_t **args;
+    ndt_t **out;
+    int *outer_dims;
+    int64_t n;
+    int64_t matches;
+} slice_t;
+
+static ndt_t *out[NARGS];
+static int outer_dims[NARGS];
+
+static double
+now(void)
+{
+    struct timespec ts;
+    (void)timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void
+clear(int64_t n)
+{
+    int64_t i;
+
+    for (i = 0; i < n; i++) {
+        ndt_del(out[i]);
+        out[i] = NULL;
+    }
+}
+
+static void *
+run_slice(void *arg)
+{
+    slice_t *s = arg;
+    ndt_context_t *ctx;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        s->matches = -1;
+        return NULL;
+    }
+
+    s->matches = ndt_typecheck_batch(s->f, s->args, s->n, s->out,
+                                     s->outer_dims, ctx);
+    ndt_context_del(ctx);
+    return NULL;
+}
+
+int
+main(void)
+{
+    static const ndt_t *args[NARGS];
+    pthread_t tid[NTHREADS];
+    slice_t slices[NTHREADS];
+    ndt_context_t *ctx;
+    ndt_t *f;
+    char buf[256];
+    double start, end;
+    int64_t matches, m, chunk;
+    int i, k, r, n = 0;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL || ndt_init(ctx) < 0) {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+
+    f = ndt_from_string(signature, ctx);
+    if (f == NULL) {
+        goto error;
+    }
+
+    while (n < NARGS) {
+        for (k = 0; templates[k] != NULL && n < NARGS; k++) {
+            for (i = 0; dtypes[i] != NULL && n < NARGS; i++) {
+                snprintf(buf, sizeof buf, templates[k], dtypes[i], dtypes[i]);
+                args[n] = ndt_from_string(buf, ctx);
+                if (args[n] == NULL) {
+                    goto error;
+                }
+                n++;
+            }
+        }
+    }
+
+    printf("%s\n%d argument tuples\n", signature, n);
+
+    matches = 0;
+    start = now();
+    for (r = 0; r < NRUNS; r++) {
+        matches = 0;
+        for (i = 0; i < n; i++) {
+            out[i] = ndt_typecheck(f, args[i], &outer_dims[i], ctx);
+            if (out[i] != NULL) {
+                matches++;
+            }
+        }
+        clear(n);
+    }
+    end = now();
+    printf("    ndt_typecheck:            %f s  (%" PRIi64 " matches)\n",
+           end-start, matches);
+
+    start = now();
+    for (r = 0; r < NRUNS; r++) {
+        m = ndt_typecheck_batch(f, args, n, out, outer_dims, ctx);
+        if (m != matches) {
+            fprintf(stderr, "error: results differ\n");
+        }
+        clear(n);
+    }
+    end = now();
+    printf("    ndt_typecheck_batch:      %f s\n", end-start);
+
+    chunk = (n + NTHREADS - 1) / NTHREADS;
+    start = now();
+    for (r = 0; r < NRUNS; r++) {
+        for (k = 0; k < NTHREADS; k++) {
+            slices[k].f = f;
+            slices[k].args = args + k * chunk;
+            slices[k].out = out + k * chunk;
+            slices[k].outer_dims = outer_dims + k * chunk;
+            slices[k].n = (k+1) * chunk <= n ? chunk : n - k * chunk;
+            if (pthread_create(&tid[k], NULL, run_slice, &slices[k]) != 0) {
+                fprintf(stderr, "error: pthread_create\n");
+                return 1;
+            }
+        }
+        m = 0;
+        for (k = 0; k < NTHREADS; k++) {
+            pthread_join(tid[k], NULL);
+            m += slices[k].matches;
+        }
+        if (m != matches) {
+            fprintf(stderr, "error: results differ\n");
+        }
+        clear(n);
+    }
+    end = now();
+    printf("    ndt_typecheck_batch (%d threads): %f s\n", NTHREADS, end-start);
+
+    for (i = 0; i < n; i++) {
+        ndt_del((ndt_t *)args[i]);
+    }
+    ndt_del(f);
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 0;
+
+error:
+    ndt_err_fprint(stderr, ctx);
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 1;
+}
@@ -0,0 +1,396 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+#include "ndtypes.h"
+
+
+/*
+ * Compare the iterative ndt_equal() with a recursive version on wide and
+ * deep types, then run ndt_equal() and ndt_del() on a very deep type in a
+ * thread with a small stack.
+ */
+
+#define NRUNS 1000
+#define WIDTH 1000
+#define DEPTH 10000
+#define DEEP 1000000
+#define STACK_SIZE (64 * 1024)
+
+
+/* The recursive ndt_equal() that preceded the iterative version. */
+static int rec_equal(const ndt_t *p, const ndt_t *c);
+
+static inline int
+rec_common_equal(const ndt_t *p, const ndt_t *c)
+{
+    return c->ndim == p->ndim;
+}
+
+static int
+tuple_fields_equal(const ndt_t *p, const ndt_t *c)
+{
+    int64_t i;
+
+    assert(p->tag == Tuple && c->tag == Tuple);
+
+    if (p->Tuple.shape != c->Tuple.shape) {
+        return 0;
+    }
+
+    for (i = 0; i < p->Tuple.shape; i++) {
+        if (!rec_equal(p->Tuple.types[i], c->Tuple.types[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int
+record_fields_equal(const ndt_t *p, const ndt_t *c)
+{
+    int64_t i;
+
+    assert(p->tag == Record && c->tag == Record);
+
+    if (p->Record.shape != c->Record.shape) {
+        return 0;
+    }
+
+    for (i = 0; i < p->Record.shape; i++) {
+        if (strcmp(p->Record.names[i], c->Record.names[i]) != 0) {
+            return 0;
+        }
+
+        if (!rec_equal(p->Record.types[i], c->Record.types[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int
+categorical_equal(ndt_memory_t *p, size_t plen,
+                  ndt_memory_t *c, size_t clen)
+{
+    size_t i;
+
+    if (plen != clen) {
+        return 0;
+    }
+
+    for (i = 0; i < plen; i++) {
+        if (!ndt_memory_equal(&p[i], &c[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int
+rec_equal(const ndt_t *p, const ndt_t *c)
+{
+    if (p->fingerprint != c->fingerprint) {
+        return 0;
+    }
+
+    if (!rec_common_equal(p, c)) {
+        return 0;
+    }
+
+    switch (p->tag) {
+    case AnyKind:
+    case ScalarKind:
+    case SignedKind: case UnsignedKind: case FloatKind: case ComplexKind:
+    case FixedStringKind: case FixedBytesKind:
+    case Void: case Bool:
+    case Int8: case Int16: case Int32: case Int64:
+    case Uint8: case Uint16: case Uint32: case Uint64:
+    case Float16: case Float32: case Float64:
+    case Complex32: case Complex64: case Complex128:
+    case String:
+        return c->tag == p->tag;
+    case FixedString:
+        return c->tag == FixedString &&
+               c->FixedString.size == p->FixedString.size &&
+               c->FixedString.encoding == p->FixedString.encoding;
+    case FixedBytes:
+        return c->tag == FixedBytes &&
+               c->FixedBytes.size == p->FixedBytes.size &&
+               c->FixedBytes.align == p->FixedBytes.align;
+    case Char:
+        return c->tag == Char && c->Char.encoding == p->Char.encoding;
+    case Bytes:
+        return c->tag == Bytes && c->Bytes.target_align == p->Bytes.target_align;
+    case Categorical:
+        return c->tag == Categorical &&
+               categorical_equal(p->Categorical.types, p->Categorical.ntypes,
+                                 c->Categorical.types, c->Categorical.ntypes);
+    case Pointer:
+        if (c->tag != Pointer) return 0;
+        return rec_equal(p->Pointer.type, c->Pointer.type);
+    case FixedDim:
+        return c->tag == FixedDim &&
+               ndt_is_optional(c) == ndt_is_optional(p) &&
+               c->FixedDim.shape == p->FixedDim.shape &&
+               rec_equal(c->FixedDim.type, p->FixedDim.type);
+    case SymbolicDim:
+        return c->tag == SymbolicDim &&
+               ndt_is_optional(c) == ndt_is_optional(p) &&
+               strcmp(c->SymbolicDim.name, p->SymbolicDim.name) == 0 &&
+               rec_equal(c->SymbolicDim.type, p->SymbolicDim.type);
+    case VarDim:
+        return c->tag == VarDim &&
+               ndt_is_optional(c) == ndt_is_optional(p) &&
+               rec_equal(c->VarDim.type, p->VarDim.type);
+    case EllipsisDim:
+        return c->tag == EllipsisDim &&
+               ndt_is_optional(c) == ndt_is_optional(p) &&
+               rec_equal(c->EllipsisDim.type, p->EllipsisDim.type);
+    case Tuple:
+        if (c->tag != Tuple || c->Tuple.flag != p->Tuple.flag) return 0;
+        return tuple_fields_equal(p, c);
+    case Record:
+        if (c->tag != Record || c->Tuple.flag != p->Tuple.flag) return 0;
+        return record_fields_equal(p, c);
+    case Function:
+        return c->tag == Function &&
+               rec_equal(p->Function.ret, c->Function.ret) &&
+               rec_equal(p->Function.pos, c->Function.pos) &&
+               rec_equal(p->Function.kwds, c->Function.kwds);
+    case Typevar:
+        return c->tag == Typevar && strcmp(c->Typevar.name, p->Typevar.name) == 0;
+    case Option:
+        return c->tag == Option && rec_equal(p->Option.type, c->Option.type);
+    case OptionItem:
+        return c->tag == OptionItem && rec_equal(p->OptionItem.type, c->OptionItem.type);
+    case Nominal:
+        /* Assume that the type has been created through ndt_nominal(), in
+           which case the name is guaranteed to be unique and present in the
+           typedef table. */
+        return c->tag == Nominal && strcmp(p->Nominal.name, c->Nominal.name) == 0;
+    case Constr:
+        return c->tag == Constr && strcmp(p->Constr.name, c->Constr.name) == 0 &&
+               rec_equal(p->Constr.type, c->Constr.type);
+    default: /* NOT REACHED */
+        abort();
+    }
+}
+
+/*
+ * A record with 'width' fields of type 'field' nested 'depth' times.  The
+ * fields of a record share their type.
+ */
+static ndt_t *
+mk_type(const char *field, int64_t width, int64_t depth, ndt_context_t *ctx)
+{
+    uint16_opt_t none = {None, 0};
+    ndt_field_t *fields, *f;
+    ndt_t *t, *u;
+    char name[32];
+    char *s;
+    int64_t i, k;
+
+    t = ndt_from_string(field, ctx);
+    if (t == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < depth; i++) {
+        fields = ndt_alloc(width, sizeof *fields);
+        if (fields == NULL) {
+            ndt_del(t);
+            return ndt_memory_error(ctx);
+        }
+
+        for (k = 0; k < width; k++) {
+            snprintf(name, sizeof name, "f%" PRIi64, k);
+            s = ndt_strdup(name, ctx);
+            if (s == NULL) {
+                goto error;
+            }
+            if (k > 0) {
+                ndt_incref(t);
+            }
+            f = ndt_field(s, t, none, none, ctx);
+            if (f == NULL) {
+                goto error;
+            }
+            fields[k] = *f;
+            ndt_free(f);
+        }
+
+        u = ndt_record(Nonvariadic, fields, width, none, none, ctx);
+        if (u == NULL) {
+            return NULL;
+        }
+        t = u;
+        continue;
+
+    error:
+        ndt_field_array_del(fields, k);
+        if (k > 0) ndt_del(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+static void
+compare(const char *name, const ndt_t *t, const ndt_t *u)
+{
+    clock_t start, end;
+    int r, x = 0, y = 0;
+
+    printf("%s\n", name);
+
+    start = clock();
+    for (r = 0; r < NRUNS; r++) {
+        x += rec_equal(t, u);
+    }
+    end = clock();
+    printf("    recursive: %f s\n", (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+    start = clock();
+    for (r = 0; r < NRUNS; r++) {
+        y += ndt_equal(t, u);
+    }
+    end = clock();
+    printf("    ndt_equal: %f s\n", (double)(end-start)/(double)CLOCKS_PER_SEC);
+
+    if (x != NRUNS || y != NRUNS) {
+        fprintf(stderr, "error: results differ\n");
+    }
+}
+
+typedef struct {
+    ndt_t *t;
+    ndt_t *u;
+    int equal;
+} deep_t;
+
+static void *
+run_deep(void *arg)
+{
+    deep_t *d = arg;
+
+    d->equal = ndt_equal(d->t, d->u);
+    ndt_del(d->t);
+    ndt_del(d->u);
+
+    return NULL;
+}
+
+int
+main(void)
+{
+    ndt_context_t *ctx;
+    ndt_t *t = NULL, *u = NULL;
+    pthread_attr_t attr;
+    pthread_t tid;
+    deep_t d;
+    clock_t start, end;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL || ndt_init(ctx) < 0) {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+
+    /* wide */
+    t = mk_type("10 * int64", WIDTH, 1, ctx);
+    u = t ? mk_type("10 * int64", WIDTH, 1, ctx) : NULL;
+    if (u == NULL) goto error;
+    compare("{f0 : 10 * int64, ..., f999 : 10 * int64}", t, u);
+    ndt_del(t);
+    ndt_del(u);
+
+    /* deep */
+    t = mk_type("int64", 1, DEPTH, ctx);
+    u = t ? mk_type("int64", 1, DEPTH, ctx) : NULL;
+    if (u == NULL) goto error;
+    compare("{f0 : {f0 : ... int64}}, 10000 levels", t, u);
+    ndt_del(t);
+    ndt_del(u);
+
+    /* very deep, on a small stack */
+    d.t = mk_type("int64", 1, DEEP, ctx);
+    d.u = d.t ? mk_type("int64", 1, DEEP, ctx) : NULL;
+    if (d.u == NULL) {
+        if (d.t) ndt_del(d.t);
+        goto error;
+    }
+
+    if (pthread_attr_init(&attr) != 0 ||
+        pthread_attr_setstacksize(&attr, STACK_SIZE) != 0) {
+        fprintf(stderr, "error: pthread_attr\n");
+        return 1;
+    }
+
+    start = clock();
+    if (pthread_create(&tid, &attr, run_deep, &d) != 0) {
+        fprintf(stderr, "error: pthread_create\n");
+        return 1;
+    }
+    pthread_join(tid, NULL);
+    end = clock();
+    pthread_attr_destroy(&attr);
+
+    printf("{f0 : {f0 : ... int64}}, 1000000 levels, %d KB stack\n",
+           STACK_SIZE / 1024);
+    printf("    ndt_equal and ndt_del: %f s\n",
+           (double)(end-start)/(double)CLOCKS_PER_SEC);
+    if (!d.equal) {
+        fprintf(stderr, "error: results differ\n");
+    }
+
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 0;
+
+error:
+    ndt_err_fprint(stderr, ctx);
+    ndt_context_del(ctx);
+    ndt_finalize();
+    return 1;
+}
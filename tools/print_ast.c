@@ -47,7 +47,7 @@ main(int argc, char **argv)
 {
     ndt_context_t *ctx;
     ndt_t *t;
-    char *s;
+    int ret;
 
     if (argc != 2) {
         fprintf(stderr, "usage: ./parser file\n");
@@ -76,9 +76,9 @@ main(int argc, char **argv)
     }
     assert(ctx->err == NDT_Success);
 
-    s = ndt_as_string_with_meta(t, ctx);
+    ret = ndt_print_with_meta(t, ndt_write_file, stdout, ctx);
     ndt_del(t);
-    if (s == NULL) {
+    if (ret < 0) {
         ndt_err_fprint(stderr, ctx);
         assert(ctx->err != NDT_Success);
         ndt_context_del(ctx);
@@ -87,8 +87,7 @@ main(int argc, char **argv)
     }
     assert(ctx->err == NDT_Success);
 
-    printf("%s\n", s);
-    ndt_free(s);
+    printf("\n");
     ndt_context_del(ctx);
     ndt_finalize();
  
@@ -0,0 +1,145 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "ndtypes.h"
+
+
+/*
+ * Parse nominal types in several threads while another thread adds
+ * typedefs.  Every name that has been published must resolve.
+ */
+
+#define NTYPEDEFS 20000
+#define NREADERS 4
+
+static atomic_int published = 0;
+static atomic_int failures = 0;
+
+static void *
+writer(void *arg)
+{
+    ndt_context_t *ctx;
+    char name[32];
+    ndt_t *t;
+    int i;
+    (void)arg;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        atomic_fetch_add(&failures, 1);
+        return NULL;
+    }
+
+    for (i = 0; i < NTYPEDEFS; i++) {
+        snprintf(name, sizeof name, "stress_%d_t", i);
+        t = ndt_from_string("{a: int64, b: 10 * float32}", ctx);
+        if (t == NULL || ndt_typedef(name, t, ctx) < 0) {
+            ndt_err_fprint(stderr, ctx);
+            atomic_fetch_add(&failures, 1);
+            break;
+        }
+        atomic_store(&published, i+1);
+    }
+
+    ndt_context_del(ctx);
+    return NULL;
+}
+
+static void *
+reader(void *arg)
+{
+    unsigned int seed = (unsigned int)(size_t)arg;
+    ndt_context_t *ctx;
+    char name[32];
+    ndt_t *t;
+    int n;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL) {
+        atomic_fetch_add(&failures, 1);
+        return NULL;
+    }
+
+    while ((n = atomic_load(&published)) < NTYPEDEFS) {
+        if (n == 0) {
+            continue;
+        }
+        seed = seed * 1103515245 + 12345;
+        snprintf(name, sizeof name, "2 * stress_%u_t", seed % (unsigned int)n);
+        t = ndt_from_string(name, ctx);
+        if (t == NULL) {
+            ndt_err_fprint(stderr, ctx);
+            atomic_fetch_add(&failures, 1);
+            break;
+        }
+        ndt_del(t);
+    }
+
+    ndt_context_del(ctx);
+    return NULL;
+}
+
+int
+main(void)
+{
+    pthread_t threads[NREADERS+1];
+    ndt_context_t *ctx;
+    int i;
+
+    ctx = ndt_context_new();
+    if (ctx == NULL || ndt_init(ctx) < 0) {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+
+    for (i = 0; i < NREADERS; i++) {
+        pthread_create(&threads[i], NULL, reader, (void *)(size_t)(i+1));
+    }
+    pthread_create(&threads[NREADERS], NULL, writer, NULL);
+
+    for (i = 0; i <= NREADERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("%d typedefs, %d failures\n", atomic_load(&published),
+           atomic_load(&failures));
+
+    ndt_context_del(ctx);
+    ndt_finalize();
+
+    return atomic_load(&failures) != 0;
+}
@@ -0,0 +1,601 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                  Array of structs <-> struct of arrays                    */
+/*****************************************************************************/
+
+static int64_t
+nfields(const ndt_t *t)
+{
+    return t->tag == Tuple ? t->Tuple.shape : t->Record.shape;
+}
+
+static const ndt_t *
+field_type(const ndt_t *t, int64_t i)
+{
+    return t->tag == Tuple ? t->Tuple.types[i] : t->Record.types[i];
+}
+
+static const char *
+field_name(const ndt_t *t, int64_t i)
+{
+    return t->tag == Tuple ? NULL : t->Record.names[i];
+}
+
+static int64_t
+field_offset(const ndt_t *t, int64_t i)
+{
+    return t->tag == Tuple ? t->Concrete.Tuple.offset[i] :
+                             t->Concrete.Record.offset[i];
+}
+
+/*
+ * Return the dtype of the concrete array 't'.  The array must be C-contiguous.
+ * 'nitems' is set to the number of dtype elements in the data and 'base' to
+ * the offset of the first element.  Var dimensions always address a
+ * contiguous sequence of elements, so the number of elements is the last
+ * offset of the innermost var dimension.
+ */
+static const ndt_t *
+array_dtype(const ndt_t *t, int64_t *nitems, int64_t *base,
+            const char *fname, ndt_context_t *ctx)
+{
+    int64_t n = 1;
+
+    if (ndt_is_abstract(t)) {
+        ndt_err_format(ctx, NDT_ValueError, "%s: type must be concrete", fname);
+        return NULL;
+    }
+
+    if (t->tag == FixedDim && !ndt_is_c_contiguous(t)) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "%s: array must be C-contiguous", fname);
+        return NULL;
+    }
+
+    *base = t->tag == FixedDim ? t->Concrete.FixedDim.offset : 0;
+
+    while (1) {
+        switch (t->tag) {
+        case FixedDim:
+            n *= t->FixedDim.shape;
+            t = t->FixedDim.type;
+            break;
+        case VarDim:
+            if (t->VarDim.type->tag != VarDim) {
+                n = t->Concrete.VarDim.offsets[t->Concrete.VarDim.nshapes];
+            }
+            t = t->VarDim.type;
+            break;
+        default:
+            *nitems = n;
+            return t;
+        }
+    }
+}
+
+static int
+same_dims(const ndt_t *a, const ndt_t *b)
+{
+    int64_t n;
+
+    while (a->tag == FixedDim || a->tag == VarDim) {
+        if (b->tag != a->tag || ndt_is_optional(a) != ndt_is_optional(b)) {
+            return 0;
+        }
+
+        if (a->tag == FixedDim) {
+            if (a->FixedDim.shape != b->FixedDim.shape) {
+                return 0;
+            }
+            a = a->FixedDim.type;
+            b = b->FixedDim.type;
+            continue;
+        }
+
+        n = a->Concrete.VarDim.nshapes;
+        if (b->Concrete.VarDim.nshapes != n ||
+            memcmp(a->Concrete.VarDim.shapes, b->Concrete.VarDim.shapes,
+                   n * sizeof(int32_t)) != 0 ||
+            memcmp(a->Concrete.VarDim.offsets, b->Concrete.VarDim.offsets,
+                   (n + 1) * sizeof(int32_t)) != 0) {
+            return 0;
+        }
+
+        if ((a->Concrete.VarDim.bitmap == NULL) !=
+            (b->Concrete.VarDim.bitmap == NULL)) {
+            return 0;
+        }
+        if (a->Concrete.VarDim.bitmap &&
+            memcmp(a->Concrete.VarDim.bitmap, b->Concrete.VarDim.bitmap,
+                   (n + 7) / 8) != 0) {
+            return 0;
+        }
+
+        a = a->VarDim.type;
+        b = b->VarDim.type;
+    }
+
+    return b->tag != FixedDim && b->tag != VarDim;
+}
+
+/* Return a copy of the dimensions of 't' with 'dtype' as the new dtype.
+   'dtype' is consumed. */
+static ndt_t *
+copy_dims(const ndt_t *t, ndt_t *dtype, ndt_context_t *ctx)
+{
+    ndt_t *type;
+
+    switch (t->tag) {
+    case FixedDim:
+        type = copy_dims(t->FixedDim.type, dtype, ctx);
+        if (type == NULL) {
+            return NULL;
+        }
+        type = ndt_fixed_dim(t->FixedDim.shape, type, 'A', ctx);
+        if (type != NULL && t->FixedDim.align != 0) {
+            type = ndt_aligned_dim(type, t->FixedDim.align, ctx);
+        }
+        return type;
+    case VarDim:
+        type = copy_dims(t->VarDim.type, dtype, ctx);
+        if (type == NULL) {
+            return NULL;
+        }
+        return ndt_var_dim_like(t, type, ctx);
+    default:
+        return dtype;
+    }
+}
+
+/* Initialize fields[i].  'type' is consumed. */
+static int
+init_field(ndt_field_t *fields, int64_t i, const char *name, ndt_t *type,
+           ndt_context_t *ctx)
+{
+    uint16_opt_t none = {None, 0};
+    ndt_field_t *f;
+    char *s = NULL;
+
+    if (type == NULL) {
+        return -1;
+    }
+
+    if (name != NULL) {
+        s = ndt_strdup(name, ctx);
+        if (s == NULL) {
+            ndt_del(type);
+            return -1;
+        }
+    }
+
+    f = ndt_field(s, type, none, none, ctx);
+    if (f == NULL) {
+        return -1;
+    }
+
+    fields[i] = *f;
+    ndt_free(f);
+    return 0;
+}
+
+/* Create a tuple or record with the names of 'proto' from 'fields'. */
+static ndt_t *
+fields_like(const ndt_t *proto, ndt_field_t *fields, int64_t shape,
+            ndt_context_t *ctx)
+{
+    uint16_opt_t none = {None, 0};
+
+    if (proto->tag == Tuple) {
+        return ndt_tuple(Nonvariadic, fields, shape, none, none, ctx);
+    }
+
+    return ndt_record(Nonvariadic, fields, shape, none, none, ctx);
+}
+
+static ndt_soa_map_t *
+soa_map_new(int64_t nitems, int64_t nfields, ndt_context_t *ctx)
+{
+    ndt_soa_map_t *map;
+
+    map = ndt_alloc(1, offsetof(ndt_soa_map_t, fields) +
+                       nfields * sizeof(ndt_field_map_t));
+    if (map == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    map->nitems = nitems;
+    map->nfields = nfields;
+
+    return map;
+}
+
+void
+ndt_soa_map_del(ndt_soa_map_t *map)
+{
+    ndt_free(map);
+}
+
+static int
+check_nfields(const ndt_t *t, const char *fname, ndt_context_t *ctx)
+{
+    if (t->tag != Tuple && t->tag != Record) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "%s: expected a tuple or a record", fname);
+        return -1;
+    }
+
+    if (nfields(t) == 0) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "%s: tuple or record must have at least one field", fname);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Transform the array of tuples or records 't' into a tuple or record of
+ * arrays.  Each member of the result has the dimensions of 't' and the
+ * type of the corresponding field.  Var dimensions keep the offsets of
+ * the original.
+ *
+ * 'map' is set to the copy instructions for converting a data buffer of
+ * type 't' into a buffer of the result type.  Field attributes like 'align'
+ * or 'pack' are not carried over, the members of the result are naturally
+ * aligned.
+ */
+ndt_t *
+ndt_aos_to_soa(const ndt_t *t, ndt_soa_map_t **map, ndt_context_t *ctx)
+{
+    const ndt_t *dtype;
+    ndt_field_t *fields;
+    ndt_soa_map_t *m;
+    ndt_t *u, *type;
+    int64_t nitems, base, shape, i;
+
+    *map = NULL;
+
+    dtype = array_dtype(t, &nitems, &base, "ndt_aos_to_soa", ctx);
+    if (dtype == NULL || check_nfields(dtype, "ndt_aos_to_soa", ctx) < 0) {
+        return NULL;
+    }
+    shape = nfields(dtype);
+
+    fields = ndt_alloc(shape, sizeof *fields);
+    if (fields == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    for (i = 0; i < shape; i++) {
+        type = ndt_copy(field_type(dtype, i), ctx);
+        if (type != NULL) {
+            type = copy_dims(t, type, ctx);
+        }
+        if (init_field(fields, i, field_name(dtype, i), type, ctx) < 0) {
+            ndt_field_array_del(fields, i);
+            return NULL;
+        }
+    }
+
+    u = fields_like(dtype, fields, shape, ctx);
+    if (u == NULL) {
+        return NULL;
+    }
+
+    m = soa_map_new(nitems, shape, ctx);
+    if (m == NULL) {
+        ndt_del(u);
+        return NULL;
+    }
+
+    for (i = 0; i < shape; i++) {
+        ndt_field_map_t *f = &m->fields[i];
+        f->itemsize = field_type(dtype, i)->data_size;
+        f->src_offset = base + field_offset(dtype, i);
+        f->src_stride = dtype->data_size;
+        f->dst_offset = field_offset(u, i);
+        f->dst_stride = f->itemsize;
+    }
+
+    *map = m;
+    return u;
+}
+
+/*
+ * Inverse of ndt_aos_to_soa().  All members of the tuple or record 't'
+ * must be arrays with the same dimensions.  The result is an array with
+ * these dimensions whose dtype is a tuple or record of the member dtypes.
+ */
+ndt_t *
+ndt_soa_to_aos(const ndt_t *t, ndt_soa_map_t **map, ndt_context_t *ctx)
+{
+    const ndt_t *first, *member, *dtype;
+    ndt_field_t *fields;
+    ndt_soa_map_t *m;
+    ndt_t *u, *type;
+    int64_t nitems, base, shape, i;
+
+    *map = NULL;
+
+    if (ndt_is_abstract(t)) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_soa_to_aos: type must be concrete");
+        return NULL;
+    }
+
+    if (check_nfields(t, "ndt_soa_to_aos", ctx) < 0) {
+        return NULL;
+    }
+    shape = nfields(t);
+    first = field_type(t, 0);
+
+    if (array_dtype(first, &nitems, &base, "ndt_soa_to_aos", ctx) == NULL) {
+        return NULL;
+    }
+
+    m = soa_map_new(nitems, shape, ctx);
+    if (m == NULL) {
+        return NULL;
+    }
+
+    fields = ndt_alloc(shape, sizeof *fields);
+    if (fields == NULL) {
+        ndt_soa_map_del(m);
+        return ndt_memory_error(ctx);
+    }
+
+    for (i = 0; i < shape; i++) {
+        member = field_type(t, i);
+        if (!same_dims(first, member)) {
+            ndt_err_format(ctx, NDT_ValueError,
+                "ndt_soa_to_aos: all members must have the same dimensions");
+            goto error;
+        }
+
+        dtype = array_dtype(member, &nitems, &base, "ndt_soa_to_aos", ctx);
+        if (dtype == NULL) {
+            goto error;
+        }
+        m->fields[i].itemsize = dtype->data_size;
+        m->fields[i].src_offset = field_offset(t, i) + base;
+        m->fields[i].src_stride = dtype->data_size;
+
+        type = ndt_copy(dtype, ctx);
+        if (init_field(fields, i, field_name(t, i), type, ctx) < 0) {
+            goto error;
+        }
+    }
+
+    type = fields_like(t, fields, shape, ctx);
+    if (type == NULL) {
+        ndt_soa_map_del(m);
+        return NULL;
+    }
+
+    for (i = 0; i < shape; i++) {
+        m->fields[i].dst_offset = field_offset(type, i);
+        m->fields[i].dst_stride = type->data_size;
+    }
+
+    u = copy_dims(first, type, ctx);
+    if (u == NULL) {
+        ndt_soa_map_del(m);
+        return NULL;
+    }
+
+    *map = m;
+    return u;
+
+error:
+    ndt_field_array_del(fields, i);
+    ndt_soa_map_del(m);
+    return NULL;
+}
+
+
+/*****************************************************************************/
+/*                            Record projection                              */
+/*****************************************************************************/
+
+/*
+ * Give the record 'u' the layout of the selected fields 'index' of 't'.
+ * The offsets and the size are those of 't', the bytes of the remaining
+ * fields become padding after the preceding selected field.
+ */
+static int
+project_layout(ndt_t *u, const ndt_t *t, const int64_t *index, ndt_context_t *ctx)
+{
+    int64_t *offset = u->Concrete.Record.offset;
+    int64_t shape = u->Record.shape;
+    int64_t end, pad, i, k;
+
+    for (i = 0; i < shape; i++) {
+        offset[i] = t->Concrete.Record.offset[index[i]];
+        u->Concrete.Record.align[i] = t->Concrete.Record.align[index[i]];
+    }
+
+    for (i = 0; i < shape; i++) {
+        end = t->data_size;
+        for (k = 0; k < shape; k++) {
+            if (offset[k] > offset[i] && offset[k] < end) {
+                end = offset[k];
+            }
+        }
+
+        pad = end - offset[i] - u->Record.types[i]->data_size;
+        if (pad > UINT16_MAX) {
+            ndt_err_format(ctx, NDT_ValueError,
+                "ndt_record_project: gap after field '%s' is too large",
+                u->Record.names[i]);
+            return -1;
+        }
+        u->Concrete.Record.pad[i] = (uint16_t)pad;
+    }
+
+    u->data_size = t->data_size;
+    u->data_align = t->data_align;
+
+    return 0;
+}
+
+/* Like copy_dims(), but keep the strides and the offset of an ndarray. */
+static ndt_t *
+project_dims(const ndt_t *t, ndt_t *dtype, ndt_context_t *ctx)
+{
+    const ndt_t *dims[NDT_MAX_DIM];
+    const ndt_t *d;
+    int64_t strides[NDT_MAX_DIM];
+    int64_opt_t offset = {Some, 0};
+    int64_opt_t bufsize = {None, 0};
+    char_opt_t order = {None, 0};
+    ndt_t *u;
+    int ndim, i;
+
+    u = copy_dims(t, dtype, ctx);
+    if (u == NULL || !ndt_is_ndarray(t)) {
+        return u;
+    }
+
+    ndim = ndt_const_dims_dtype(dims, &d, t);
+    for (i = 0; i < ndim; i++) {
+        strides[i] = dims[i]->Concrete.FixedDim.stride;
+    }
+    offset.Some = t->Concrete.FixedDim.offset;
+
+    return ndt_array(u, strides, offset, bufsize, order, ctx);
+}
+
+/*
+ * Return a view type of the record 't' that contains only the fields
+ * 'names[0]' ... 'names[n-1]' in that order.  't' can also be an array
+ * of records with fixed or var dimensions.
+ *
+ * The fields keep their offsets and the record keeps the size of the
+ * original, so a buffer of type 't' can be read through the result in
+ * place.  The field types are shared with 't'.
+ */
+ndt_t *
+ndt_record_project(const ndt_t *t, const char *const names[], int64_t n,
+                   ndt_context_t *ctx)
+{
+    uint16_opt_t none = {None, 0};
+    const ndt_t *dtype;
+    ndt_field_t *fields;
+    int64_t *index;
+    ndt_t *u, *type;
+    int64_t i, k;
+
+    if (ndt_is_abstract(t)) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_record_project: type must be concrete");
+        return NULL;
+    }
+
+    for (dtype = t; dtype->tag == FixedDim || dtype->tag == VarDim;
+         dtype = dtype->tag == FixedDim ? dtype->FixedDim.type : dtype->VarDim.type)
+        ;
+
+    if (dtype->tag != Record) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_record_project: expected a record");
+        return NULL;
+    }
+
+    if (n <= 0) {
+        ndt_err_format(ctx, NDT_ValueError,
+                       "ndt_record_project: expected at least one field");
+        return NULL;
+    }
+
+    index = ndt_alloc(n, sizeof *index);
+    if (index == NULL) {
+        return ndt_memory_error(ctx);
+    }
+
+    for (i = 0; i < n; i++) {
+        index[i] = ndt_record_field(dtype, names[i]);
+        if (index[i] < 0) {
+            ndt_err_format(ctx, NDT_ValueError,
+                           "ndt_record_project: no field named '%s'", names[i]);
+            ndt_free(index);
+            return NULL;
+        }
+        for (k = 0; k < i; k++) {
+            if (index[k] == index[i]) {
+                ndt_err_format(ctx, NDT_ValueError,
+                               "ndt_record_project: duplicate field '%s'", names[i]);
+                ndt_free(index);
+                return NULL;
+            }
+        }
+    }
+
+    fields = ndt_alloc(n, sizeof *fields);
+    if (fields == NULL) {
+        ndt_free(index);
+        return ndt_memory_error(ctx);
+    }
+
+    for (i = 0; i < n; i++) {
+        type = (ndt_t *)ndt_incref(dtype->Record.types[index[i]]);
+        if (init_field(fields, i, names[i], type, ctx) < 0) {
+            ndt_field_array_del(fields, i);
+            ndt_free(index);
+            return NULL;
+        }
+    }
+
+    u = ndt_record(Nonvariadic, fields, n, none, none, ctx);
+    if (u == NULL) {
+        ndt_free(index);
+        return NULL;
+    }
+
+    if (project_layout(u, dtype, index, ctx) < 0) {
+        ndt_free(index);
+        ndt_del(u);
+        return NULL;
+    }
+    ndt_free(index);
+
+    return project_dims(t, u, ctx);
+}
@@ -0,0 +1,1392 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                                 Unifier                                   */
+/*****************************************************************************/
+
+/*
+ * Two-way unification of abstract datashapes.  Type variables, kinds,
+ * symbolic dimensions and ellipses on both sides are variables.  The two
+ * types are renamed apart: a variable is identified by its side (0 for 'p',
+ * 1 for 'q') and its name.  Kinds and unnamed ellipses are anonymous and are
+ * identified by their node, so a type must not share such a node between
+ * two positions.
+ *
+ * The first pass binds the variables, the second pass builds the unifier
+ * by walking both types in parallel.
+ */
+
+/* Type variables and kinds: the tag is the constraint of the variable. */
+#define TYPE_VAR_TAGS \
+  (NDT_TAG_BIT(Typevar) | NDT_TAG_BIT(AnyKind) | NDT_TAG_BIT(ScalarKind) | \
+   NDT_TAG_BIT(SignedKind) | NDT_TAG_BIT(UnsignedKind) |                  \
+   NDT_TAG_BIT(FloatKind) | NDT_TAG_BIT(ComplexKind) |                    \
+   NDT_TAG_BIT(FixedStringKind) | NDT_TAG_BIT(FixedBytesKind))
+
+/* Type variables, symbolic dimensions and ellipses */
+#define VAR_TAGS \
+  (TYPE_VAR_TAGS | NDT_TAG_BIT(SymbolicDim) | NDT_TAG_BIT(EllipsisDim))
+
+/* Status of var_of() if a name is used for different kinds of variables */
+#define KIND_MISMATCH (-2)
+
+/* Subtree of the type on 'side' */
+typedef struct {
+    const ndt_t *t;
+    int side;
+} term_t;
+
+enum var_kind { TypeVar, SizeVar, DimsVar };
+
+typedef struct {
+    enum var_kind kind;
+    bool anon;          /* identified by 'node' instead of 'side' and 'name' */
+    int side;
+    const char *name;   /* NULL for kinds and unnamed ellipses */
+    const ndt_t *node;  /* first occurrence */
+    int link;           /* representative or -1 */
+    bool bound;
+    term_t type;        /* value of a TypeVar */
+    int64_t size;       /* value of a SizeVar */
+    term_t *dims;       /* value of a DimsVar */
+    int ndims;
+    char *outname;      /* name in the unifier if renamed */
+} var_t;
+
+typedef struct {
+    var_t *vars;
+    int nvars;
+    int alloc;
+    ndt_t **fresh;      /* nodes of fresh ellipsis variables */
+    int nfresh;
+    const ndt_t *root[2];
+    ndt_context_t *ctx;
+} unifier_t;
+
+static void
+unifier_clear(unifier_t *u)
+{
+    int i;
+
+    for (i = 0; i < u->nvars; i++) {
+        ndt_free(u->vars[i].dims);
+        ndt_free(u->vars[i].outname);
+    }
+    for (i = 0; i < u->nfresh; i++) {
+        ndt_del(u->fresh[i]);
+    }
+
+    ndt_free(u->vars);
+    ndt_free(u->fresh);
+}
+
+static int
+add_var(unifier_t *u, enum var_kind kind, bool anon, int side,
+        const char *name, const ndt_t *node)
+{
+    var_t *v;
+
+    if (u->nvars == u->alloc) {
+        int alloc = u->alloc == 0 ? 8 : 2 * u->alloc;
+        v = ndt_realloc(u->vars, alloc, sizeof *v);
+        if (v == NULL) {
+            (void)ndt_memory_error(u->ctx);
+            return -1;
+        }
+        u->vars = v;
+        u->alloc = alloc;
+    }
+
+    v = &u->vars[u->nvars];
+    v->kind = kind;
+    v->anon = anon;
+    v->side = side;
+    v->name = name;
+    v->node = node;
+    v->link = -1;
+    v->bound = false;
+    v->type.t = NULL;
+    v->type.side = 0;
+    v->size = 0;
+    v->dims = NULL;
+    v->ndims = 0;
+    v->outname = NULL;
+
+    return u->nvars++;
+}
+
+static inline bool
+is_type_var(const ndt_t *t)
+{
+    return (NDT_TAG_BIT(t->tag) & TYPE_VAR_TAGS) != 0;
+}
+
+/*
+ * Concrete and free of variables.  Pointers are concrete even if their
+ * target type contains variables.
+ */
+static inline bool
+is_ground(const ndt_t *t)
+{
+    return ndt_is_concrete(t) && !(t->tags & VAR_TAGS);
+}
+
+/*
+ * Return the variable of the node 'x', creating it on first use.  Returns
+ * -1 on error and KIND_MISMATCH if the name already denotes another kind of
+ * variable.
+ */
+static int
+var_of(unifier_t *u, term_t x)
+{
+    const ndt_t *t = x.t;
+    enum var_kind kind;
+    const char *name;
+    int i;
+
+    switch (t->tag) {
+    case Typevar:
+        kind = TypeVar; name = t->Typevar.name;
+        break;
+    case SymbolicDim:
+        kind = SizeVar; name = t->SymbolicDim.name;
+        break;
+    case EllipsisDim:
+        kind = DimsVar; name = t->EllipsisDim.name;
+        break;
+    default:
+        kind = TypeVar; name = NULL;
+        break;
+    }
+
+    for (i = 0; i < u->nvars; i++) {
+        const var_t *v = &u->vars[i];
+        if (name == NULL) {
+            if (v->anon && v->node == t && v->side == x.side) {
+                return i;
+            }
+        }
+        else if (!v->anon && v->side == x.side && strcmp(v->name, name) == 0) {
+            return v->kind == kind ? i : KIND_MISMATCH;
+        }
+    }
+
+    return add_var(u, kind, name == NULL, x.side, name, t);
+}
+
+/* Map the status of var_of() to the result of a unification step. */
+static inline int
+var_error(int i)
+{
+    return i == KIND_MISMATCH ? 0 : -1;
+}
+
+static int
+find(const unifier_t *u, int i)
+{
+    while (u->vars[i].link >= 0) {
+        i = u->vars[i].link;
+    }
+
+    return i;
+}
+
+static inline enum ndt
+constraint(const var_t *v)
+{
+    return v->node->tag == Typevar ? AnyKind : v->node->tag;
+}
+
+/* The more specific of two kinds, or -1 if they are disjoint. */
+static int
+meet(enum ndt k, enum ndt l)
+{
+    if (k == l || l == AnyKind || (l == ScalarKind && k != AnyKind)) {
+        return k;
+    }
+    if (k == AnyKind || k == ScalarKind) {
+        return l;
+    }
+
+    return -1;
+}
+
+static int
+satisfies(enum ndt k, const ndt_t *t)
+{
+    switch (k) {
+    case AnyKind: return 1;
+    case ScalarKind: return ndt_is_scalar(t);
+    case SignedKind: return ndt_is_signed(t);
+    case UnsignedKind: return ndt_is_unsigned(t);
+    case FloatKind: return ndt_is_float(t);
+    case ComplexKind: return ndt_is_complex(t);
+    case FixedStringKind: return t->tag == FixedString;
+    case FixedBytesKind: return t->tag == FixedBytes;
+    default: /* NOT REACHED */ abort();
+    }
+}
+
+/*
+ * Follow bound type variables.  On return, '*var' is the representative of
+ * 'a' if 'a' is an unbound variable and -1 otherwise.
+ */
+static int
+resolve(unifier_t *u, term_t *a, int *var)
+{
+    int i;
+
+    while (is_type_var(a->t)) {
+        i = var_of(u, *a);
+        if (i < 0) {
+            return var_error(i);
+        }
+
+        i = find(u, i);
+        if (!u->vars[i].bound) {
+            a->t = u->vars[i].node;
+            a->side = u->vars[i].side;
+            *var = i;
+            return 1;
+        }
+
+        *a = u->vars[i].type;
+    }
+
+    *var = -1;
+    return 1;
+}
+
+
+/*****************************************************************************/
+/*                                Type terms                                 */
+/*****************************************************************************/
+
+static int unify_type(unifier_t *u, term_t a, term_t b);
+
+static inline term_t
+child(term_t a, const ndt_t *t)
+{
+    term_t c = { t, a.side };
+    return c;
+}
+
+/* Return 1 if the type variable 'v' occurs in 'x'. */
+static int
+occurs(unifier_t *u, int v, term_t x)
+{
+    const ndt_t *t;
+    int64_t i;
+    int w, n;
+
+    if (!(x.t->tags & TYPE_VAR_TAGS)) {
+        return 0;
+    }
+
+    n = resolve(u, &x, &w);
+    if (n <= 0) {
+        return n;
+    }
+    if (w >= 0) {
+        return w == v;
+    }
+
+    t = x.t;
+    switch (t->tag) {
+    case FixedDim: case SymbolicDim: case VarDim: case EllipsisDim:
+        return occurs(u, v, child(x, ndt_next_dim((ndt_t *)t)));
+    case Tuple:
+        for (i = 0; i < t->Tuple.shape; i++) {
+            n = occurs(u, v, child(x, t->Tuple.types[i]));
+            if (n != 0) return n;
+        }
+        return 0;
+    case Record:
+        for (i = 0; i < t->Record.shape; i++) {
+            n = occurs(u, v, child(x, t->Record.types[i]));
+            if (n != 0) return n;
+        }
+        return 0;
+    case Function:
+        n = occurs(u, v, child(x, t->Function.ret));
+        if (n != 0) return n;
+        n = occurs(u, v, child(x, t->Function.pos));
+        if (n != 0) return n;
+        return occurs(u, v, child(x, t->Function.kwds));
+    case Option:
+        return occurs(u, v, child(x, t->Option.type));
+    case OptionItem:
+        return occurs(u, v, child(x, t->OptionItem.type));
+    case Pointer:
+        return occurs(u, v, child(x, t->Pointer.type));
+    case Constr:
+        return occurs(u, v, child(x, t->Constr.type));
+    default:
+        return 0;
+    }
+}
+
+static int
+link_vars(unifier_t *u, int i, int j)
+{
+    var_t *v = &u->vars[i];
+    var_t *w = &u->vars[j];
+    int k;
+
+    if (i == j) {
+        return 1;
+    }
+
+    k = meet(constraint(v), constraint(w));
+    if (k < 0) {
+        return 0;
+    }
+
+    /* keep the more specific variable, prefer named type variables */
+    if ((int)constraint(w) == k &&
+        ((int)constraint(v) != k ||
+         (w->node->tag == Typevar && v->node->tag != Typevar))) {
+        v->link = j;
+    }
+    else {
+        w->link = i;
+    }
+
+    return 1;
+}
+
+static int
+bind_type(unifier_t *u, int i, term_t x)
+{
+    int n;
+
+    if (!satisfies(constraint(&u->vars[i]), x.t)) {
+        return 0;
+    }
+
+    n = occurs(u, i, x);
+    if (n != 0) {
+        return n < 0 ? -1 : 0;
+    }
+
+    u->vars[i].bound = true;
+    u->vars[i].type = x;
+    return 1;
+}
+
+
+/*****************************************************************************/
+/*                                Dimensions                                 */
+/*****************************************************************************/
+
+/*
+ * Append the dimensions 'dims' to 'out', replacing bound ellipses with
+ * their values and all variables with their representatives.  Returns the
+ * new length, -1 on error or KIND_MISMATCH if the result would exceed
+ * NDT_MAX_DIM.
+ */
+static int
+expand_dims(unifier_t *u, term_t out[NDT_MAX_DIM], int n,
+            const term_t *dims, int ndims)
+{
+    term_t d;
+    int i, k;
+
+    for (k = 0; k < ndims; k++) {
+        d = dims[k];
+
+        if (d.t->tag == EllipsisDim) {
+            i = var_of(u, d);
+            if (i < 0) {
+                return i;
+            }
+            i = find(u, i);
+
+            if (u->vars[i].bound) {
+                n = expand_dims(u, out, n, u->vars[i].dims, u->vars[i].ndims);
+                if (n < 0) {
+                    return n;
+                }
+                continue;
+            }
+
+            d.t = u->vars[i].node;
+            d.side = u->vars[i].side;
+        }
+
+        if (n == NDT_MAX_DIM) {
+            return KIND_MISMATCH;
+        }
+        out[n++] = d;
+    }
+
+    return n;
+}
+
+/* Split the array 'a' into its expanded dimensions and its dtype. */
+static int
+array_dims(unifier_t *u, term_t out[NDT_MAX_DIM], term_t *dtype, term_t a)
+{
+    const ndt_t *dims[NDT_MAX_DIM];
+    term_t terms[NDT_MAX_DIM];
+    int n, k;
+
+    n = ndt_const_dims_dtype(dims, &dtype->t, a.t);
+    dtype->side = a.side;
+
+    for (k = 0; k < n; k++) {
+        terms[k] = child(a, dims[k]);
+    }
+
+    return expand_dims(u, out, 0, terms, n);
+}
+
+static int
+find_ellipsis(const term_t dims[], int n)
+{
+    int k;
+
+    for (k = 0; k < n; k++) {
+        if (dims[k].t->tag == EllipsisDim) {
+            return k;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * The value of a single dimension: VarDim, FixedDim with '*size', or
+ * SymbolicDim with the unbound representative '*var'.  Returns -1 on error
+ * and KIND_MISMATCH for an inconsistent name.
+ */
+static int
+dim_value(unifier_t *u, term_t x, int64_t *size, int *var)
+{
+    int i;
+
+    *var = -1;
+
+    switch (x.t->tag) {
+    case FixedDim:
+        *size = x.t->FixedDim.shape;
+        return FixedDim;
+    case VarDim:
+        return VarDim;
+    case SymbolicDim:
+        i = var_of(u, x);
+        if (i < 0) {
+            return i;
+        }
+        i = find(u, i);
+        if (u->vars[i].bound) {
+            *size = u->vars[i].size;
+            return FixedDim;
+        }
+        *var = i;
+        return SymbolicDim;
+    default: /* NOT REACHED */
+        abort();
+    }
+}
+
+static int
+unify_dim(unifier_t *u, term_t x, term_t y)
+{
+    int64_t s = 0, t = 0;
+    int i, j, k, l;
+
+    if (ndt_is_optional(x.t) != ndt_is_optional(y.t)) {
+        return 0;
+    }
+
+    k = dim_value(u, x, &s, &i);
+    if (k < 0) {
+        return var_error(k);
+    }
+    l = dim_value(u, y, &t, &j);
+    if (l < 0) {
+        return var_error(l);
+    }
+
+    if (k == VarDim || l == VarDim) {
+        return k == l;
+    }
+
+    if (i < 0 && j < 0) {
+        return s == t;
+    }
+
+    if (i >= 0 && j >= 0) {
+        if (i != j) {
+            u->vars[j].link = i;
+        }
+        return 1;
+    }
+
+    if (i >= 0) {
+        u->vars[i].bound = true;
+        u->vars[i].size = t;
+    }
+    else {
+        u->vars[j].bound = true;
+        u->vars[j].size = s;
+    }
+
+    return 1;
+}
+
+static int
+unify_range(unifier_t *u, const term_t a[], const term_t b[], int n)
+{
+    int k, r;
+
+    for (k = 0; k < n; k++) {
+        r = unify_dim(u, a[k], b[k]);
+        if (r <= 0) {
+            return r;
+        }
+    }
+
+    return 1;
+}
+
+/* Bind the ellipsis 'e' to 'pre', 'mid' (if not NULL) and 'post'. */
+static int
+bind_dims(unifier_t *u, term_t e, const term_t *pre, int npre,
+          const term_t *mid, const term_t *post, int npost)
+{
+    term_t *dims = NULL;
+    int n = npre + (mid != NULL) + npost;
+    int i;
+
+    i = var_of(u, e);
+    if (i < 0) {
+        return -1;
+    }
+    i = find(u, i);
+
+    if (n > 0) {
+        dims = ndt_alloc(n, sizeof *dims);
+        if (dims == NULL) {
+            (void)ndt_memory_error(u->ctx);
+            return -1;
+        }
+        if (npre > 0) {
+            memcpy(dims, pre, npre * sizeof *dims);
+        }
+        if (mid != NULL) {
+            dims[npre] = *mid;
+        }
+        if (npost > 0) {
+            memcpy(dims + npre + (mid != NULL), post, npost * sizeof *dims);
+        }
+    }
+
+    u->vars[i].bound = true;
+    u->vars[i].dims = dims;
+    u->vars[i].ndims = n;
+    return 1;
+}
+
+/* A new ellipsis variable that is named after 'i' or 'j'. */
+static int
+fresh_ellipsis(unifier_t *u, int i, int j, term_t *e)
+{
+    const var_t *v = u->vars[i].name != NULL ? &u->vars[i] : &u->vars[j];
+    ndt_t **fresh;
+    ndt_t *t;
+    int k;
+
+    fresh = ndt_realloc(u->fresh, u->nfresh+1, sizeof *fresh);
+    if (fresh == NULL) {
+        (void)ndt_memory_error(u->ctx);
+        return -1;
+    }
+    u->fresh = fresh;
+
+    t = ndt_any_kind(u->ctx);
+    if (t == NULL) {
+        return -1;
+    }
+    t = ndt_ellipsis_dim(NULL, t, u->ctx);
+    if (t == NULL) {
+        return -1;
+    }
+    u->fresh[u->nfresh++] = t;
+
+    k = add_var(u, DimsVar, true, v->side, v->name, t);
+    if (k < 0) {
+        return -1;
+    }
+
+    e->t = t;
+    e->side = v->side;
+    return 1;
+}
+
+/* 'a' contains an ellipsis at 'ea', 'b' has no ellipsis. */
+static int
+unify_ellipsis(unifier_t *u, const term_t a[], int na, int ea,
+               const term_t b[], int nb)
+{
+    int post = na - ea - 1;
+    int n;
+
+    if (nb < ea + post) {
+        return 0;
+    }
+
+    n = unify_range(u, a, b, ea);
+    if (n <= 0) return n;
+
+    n = unify_range(u, a+ea+1, b+nb-post, post);
+    if (n <= 0) return n;
+
+    return bind_dims(u, a[ea], b+ea, nb-ea-post, NULL, NULL, 0);
+}
+
+/*
+ * Both 'a' and 'b' contain an ellipsis.  The common prefix and suffix are
+ * unified.  The remaining dimensions of one side go into the ellipsis of the
+ * other.  If both sides have remaining dimensions, the two ellipses share a
+ * fresh ellipsis in the middle.
+ */
+static int
+unify_ellipses(unifier_t *u, const term_t a[], int na, int ea,
+               const term_t b[], int nb, int eb)
+{
+    int apost = na - ea - 1;
+    int bpost = nb - eb - 1;
+    int pre = ea < eb ? ea : eb;
+    int post = apost < bpost ? apost : bpost;
+    int i, j, n;
+    term_t e;
+
+    i = var_of(u, a[ea]);
+    if (i < 0) {
+        return var_error(i);
+    }
+    j = var_of(u, b[eb]);
+    if (j < 0) {
+        return var_error(j);
+    }
+
+    i = find(u, i);
+    j = find(u, j);
+    if (i == j) {
+        if (ea != eb || apost != bpost) {
+            return 0;
+        }
+        n = unify_range(u, a, b, ea);
+        if (n <= 0) return n;
+        return unify_range(u, a+ea+1, b+eb+1, apost);
+    }
+
+    n = unify_range(u, a, b, pre);
+    if (n <= 0) return n;
+
+    n = unify_range(u, a+na-post, b+nb-post, post);
+    if (n <= 0) return n;
+
+    if (eb == pre && bpost == post) {
+        return bind_dims(u, b[eb], a+pre, ea-pre, &a[ea], a+ea+1, apost-post);
+    }
+
+    if (ea == pre && apost == post) {
+        return bind_dims(u, a[ea], b+pre, eb-pre, &b[eb], b+eb+1, bpost-post);
+    }
+
+    if (fresh_ellipsis(u, i, j, &e) < 0) {
+        return -1;
+    }
+
+    n = bind_dims(u, a[ea], b+pre, eb-pre, &e, b+eb+1, bpost-post);
+    if (n <= 0) return n;
+
+    return bind_dims(u, b[eb], a+pre, ea-pre, &e, a+ea+1, apost-post);
+}
+
+static int
+unify_arrays(unifier_t *u, term_t a, term_t b)
+{
+    term_t adims[NDT_MAX_DIM];
+    term_t bdims[NDT_MAX_DIM];
+    term_t adtype, bdtype;
+    int na, nb, ea, eb, n;
+
+    if (!ndt_is_array(a.t) || !ndt_is_array(b.t) ||
+        ndt_is_column_major(a.t) != ndt_is_column_major(b.t)) {
+        return 0;
+    }
+
+    na = array_dims(u, adims, &adtype, a);
+    if (na < 0) {
+        return var_error(na);
+    }
+    nb = array_dims(u, bdims, &bdtype, b);
+    if (nb < 0) {
+        return var_error(nb);
+    }
+
+    ea = find_ellipsis(adims, na);
+    eb = find_ellipsis(bdims, nb);
+
+    if (ea < 0 && eb < 0) {
+        n = na == nb ? unify_range(u, adims, bdims, na) : 0;
+    }
+    else if (eb < 0) {
+        n = unify_ellipsis(u, adims, na, ea, bdims, nb);
+    }
+    else if (ea < 0) {
+        n = unify_ellipsis(u, bdims, nb, eb, adims, na);
+    }
+    else {
+        n = unify_ellipses(u, adims, na, ea, bdims, nb, eb);
+    }
+
+    if (n <= 0) {
+        return n;
+    }
+
+    return unify_type(u, adtype, bdtype);
+}
+
+
+/*****************************************************************************/
+/*                               Unification                                 */
+/*****************************************************************************/
+
+static inline bool
+is_variadic(const ndt_t *t)
+{
+    return t->tag == Tuple ? t->Tuple.flag == Variadic : t->Record.flag == Variadic;
+}
+
+static inline int64_t
+nfields(const ndt_t *t)
+{
+    return t->tag == Tuple ? t->Tuple.shape : t->Record.shape;
+}
+
+static inline ndt_t * const *
+field_types(const ndt_t *t)
+{
+    return t->tag == Tuple ? t->Tuple.types : t->Record.types;
+}
+
+/*
+ * Field of 'y' that corresponds to field 'i' of 'x', or -1.  Tuple fields
+ * correspond by position.  Record fields correspond by name, which is the
+ * same as by position if both records are non-variadic and unify.
+ */
+static int64_t
+partner(const ndt_t *x, int64_t i, const ndt_t *y)
+{
+    if (x->tag == Tuple) {
+        return i < y->Tuple.shape ? i : -1;
+    }
+
+    return ndt_record_field(y, x->Record.names[i]);
+}
+
+/*
+ * A variadic tuple stands for all tuples that start with its fields and a
+ * variadic record for all records that contain its fields.  Non-variadic
+ * records must have the same field names in the same order.
+ */
+static int
+unify_fields(unifier_t *u, term_t a, term_t b)
+{
+    const ndt_t *s = a.t;
+    const ndt_t *t = b.t;
+    bool sv = is_variadic(s);
+    bool tv = is_variadic(t);
+    int64_t i, k;
+    int n;
+
+    if (!sv && !tv) {
+        if (nfields(s) != nfields(t)) return 0;
+        if (s->tag == Record) {
+            for (i = 0; i < s->Record.shape; i++) {
+                if (strcmp(s->Record.names[i], t->Record.names[i]) != 0) return 0;
+            }
+        }
+    }
+
+    for (i = 0; i < nfields(s); i++) {
+        k = partner(s, i, t);
+        if (k < 0) {
+            if (!tv) return 0;
+            continue;
+        }
+        n = unify_type(u, child(a, field_types(s)[i]), child(b, field_types(t)[k]));
+        if (n <= 0) return n;
+    }
+
+    if (!sv) {
+        for (k = 0; k < nfields(t); k++) {
+            if (partner(t, k, s) < 0) return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int
+unify_type(unifier_t *u, term_t a, term_t b)
+{
+    const ndt_t *s, *t;
+    int i, j, n;
+
+    n = resolve(u, &a, &i);
+    if (n <= 0) return n;
+
+    n = resolve(u, &b, &j);
+    if (n <= 0) return n;
+
+    if (i >= 0 && j >= 0) {
+        return link_vars(u, i, j);
+    }
+    if (i >= 0) {
+        return bind_type(u, i, b);
+    }
+    if (j >= 0) {
+        return bind_type(u, j, a);
+    }
+
+    s = a.t;
+    t = b.t;
+
+    if (ndt_is_array(s) || ndt_is_array(t)) {
+        return unify_arrays(u, a, b);
+    }
+
+    if (s->tag != t->tag) {
+        return 0;
+    }
+
+    switch (s->tag) {
+    case Tuple: case Record:
+        return unify_fields(u, a, b);
+    case Function:
+        n = unify_type(u, child(a, s->Function.ret), child(b, t->Function.ret));
+        if (n <= 0) return n;
+        n = unify_type(u, child(a, s->Function.pos), child(b, t->Function.pos));
+        if (n <= 0) return n;
+        return unify_type(u, child(a, s->Function.kwds), child(b, t->Function.kwds));
+    case Option:
+        return unify_type(u, child(a, s->Option.type), child(b, t->Option.type));
+    case OptionItem:
+        return unify_type(u, child(a, s->OptionItem.type), child(b, t->OptionItem.type));
+    case Pointer:
+        return unify_type(u, child(a, s->Pointer.type), child(b, t->Pointer.type));
+    case Constr:
+        if (strcmp(s->Constr.name, t->Constr.name) != 0) return 0;
+        return unify_type(u, child(a, s->Constr.type), child(b, t->Constr.type));
+    default:
+        return ndt_equal(s, t);
+    }
+}
+
+
+/*****************************************************************************/
+/*                               Construction                                */
+/*****************************************************************************/
+
+static ndt_t *build(unifier_t *u, term_t a, term_t b);
+
+static bool
+name_in(const ndt_t *t, const char *name)
+{
+    int64_t i;
+
+    switch (t->tag) {
+    case FixedDim: case VarDim:
+        return name_in(ndt_next_dim((ndt_t *)t), name);
+    case SymbolicDim:
+        return strcmp(t->SymbolicDim.name, name) == 0 ||
+               name_in(t->SymbolicDim.type, name);
+    case EllipsisDim:
+        return (t->EllipsisDim.name != NULL &&
+                strcmp(t->EllipsisDim.name, name) == 0) ||
+               name_in(t->EllipsisDim.type, name);
+    case Typevar:
+        return strcmp(t->Typevar.name, name) == 0;
+    case Tuple:
+        for (i = 0; i < t->Tuple.shape; i++) {
+            if (name_in(t->Tuple.types[i], name)) return true;
+        }
+        return false;
+    case Record:
+        for (i = 0; i < t->Record.shape; i++) {
+            if (name_in(t->Record.types[i], name)) return true;
+        }
+        return false;
+    case Function:
+        return name_in(t->Function.ret, name) || name_in(t->Function.pos, name) ||
+               name_in(t->Function.kwds, name);
+    case Option:
+        return name_in(t->Option.type, name);
+    case OptionItem:
+        return name_in(t->OptionItem.type, name);
+    case Pointer:
+        return name_in(t->Pointer.type, name);
+    case Constr:
+        return name_in(t->Constr.type, name);
+    default:
+        return false;
+    }
+}
+
+static bool
+name_taken(const unifier_t *u, const char *name)
+{
+    int i;
+
+    for (i = 0; i < u->nvars; i++) {
+        if (u->vars[i].outname != NULL && strcmp(u->vars[i].outname, name) == 0) {
+            return true;
+        }
+    }
+
+    return name_in(u->root[0], name) || name_in(u->root[1], name);
+}
+
+/*
+ * Set '*name' to a copy of the name of the unbound variable 'i' in the
+ * unifier.  Variables of 'q' whose name is also used in 'p' get a numeric
+ * suffix.  '*name' is NULL for unnamed variables.
+ */
+static int
+out_name(unifier_t *u, int i, char **name)
+{
+    var_t *v = &u->vars[i];
+    char *s;
+    int k;
+
+    *name = NULL;
+    if (v->name == NULL) {
+        return 0;
+    }
+
+    if (v->outname == NULL && v->side != 0 && name_in(u->root[0], v->name)) {
+        for (k = 1; ; k++) {
+            s = ndt_asprintf(u->ctx, "%s%d", v->name, k);
+            if (s == NULL) {
+                return -1;
+            }
+            if (!name_taken(u, s)) {
+                break;
+            }
+            ndt_free(s);
+        }
+        v->outname = s;
+    }
+
+    *name = ndt_strdup(v->outname != NULL ? v->outname : v->name, u->ctx);
+    return *name == NULL ? -1 : 0;
+}
+
+static ndt_t *
+inconsistent(ndt_context_t *ctx)
+{
+    ndt_err_format(ctx, NDT_RuntimeError, "ndt_unify: inconsistent bindings");
+    return NULL;
+}
+
+/* 'u' is the unchanged child of 't': share 't' instead. */
+static ndt_t *
+unchanged(const ndt_t *t, ndt_t *u)
+{
+    ndt_del(u);
+    return (ndt_t *)ndt_incref(t);
+}
+
+static ndt_t *
+build_var(unifier_t *u, int i)
+{
+    const ndt_t *t = u->vars[i].node;
+    char *name;
+
+    if (t->tag != Typevar) {
+        return (ndt_t *)ndt_incref(t);
+    }
+
+    if (out_name(u, i, &name) < 0) {
+        return NULL;
+    }
+
+    return ndt_typevar(name, u->ctx);
+}
+
+static ndt_t *
+build_dim(unifier_t *u, term_t x, term_t y, ndt_t *type)
+{
+    char *name;
+    ndt_t *t;
+    int64_t m = 0, n = 0;
+    int i, j, k, l;
+
+    if (x.t->tag == EllipsisDim || y.t->tag == EllipsisDim) {
+        i = x.t->tag == EllipsisDim ? var_of(u, x) : -1;
+        j = y.t->tag == EllipsisDim ? var_of(u, y) : -1;
+        if (i < 0 || j < 0 || find(u, i) != find(u, j)) {
+            ndt_del(type);
+            return u->ctx->err != NDT_Success ? NULL : inconsistent(u->ctx);
+        }
+        if (out_name(u, find(u, i), &name) < 0) {
+            ndt_del(type);
+            return NULL;
+        }
+        t = ndt_ellipsis_dim(name, type, u->ctx);
+        if (t == NULL) {
+            ndt_free(name); /* not consumed on error */
+        }
+        return t;
+    }
+
+    k = dim_value(u, x, &m, &i);
+    l = dim_value(u, y, &n, &j);
+    if (k < 0 || l < 0) {
+        ndt_del(type);
+        return k == -1 || l == -1 ? NULL : inconsistent(u->ctx);
+    }
+
+    if (k == VarDim) {
+        type = ndt_var_dim(type, false, Void, 0, NULL, NULL, NULL, u->ctx);
+        if (type != NULL && ndt_is_optional(x.t)) {
+            type = ndt_dim_option(type, u->ctx);
+        }
+        return type;
+    }
+
+    if (k == FixedDim || l == FixedDim) {
+        return ndt_fixed_dim(k == FixedDim ? m : n, type, ndt_order(type), u->ctx);
+    }
+
+    if (out_name(u, i, &name) < 0) {
+        ndt_del(type);
+        return NULL;
+    }
+
+    return ndt_symbolic_dim(name, type, u->ctx);
+}
+
+static ndt_t *
+build_array(unifier_t *u, term_t a, term_t b)
+{
+    term_t adims[NDT_MAX_DIM];
+    term_t bdims[NDT_MAX_DIM];
+    term_t adtype, bdtype;
+    ndt_t *type;
+    int na, nb, k;
+
+    na = array_dims(u, adims, &adtype, a);
+    nb = array_dims(u, bdims, &bdtype, b);
+    if (na == -1 || nb == -1) {
+        return NULL;
+    }
+    if (na < 0 || na != nb) {
+        return inconsistent(u->ctx);
+    }
+
+    type = build(u, adtype, bdtype);
+
+    for (k = na-1; k >= 0 && type != NULL; k--) {
+        type = build_dim(u, adims[k], bdims[k], type);
+    }
+
+    return type;
+}
+
+/*
+ * The fields of a non-variadic side come first, otherwise those of 'a'.
+ * If both sides are variadic, the fields that only 'b' has are appended.
+ */
+static ndt_t *
+build_fields(unifier_t *u, term_t a, term_t b)
+{
+    uint16_opt_t none = {None, 0};
+    term_t x = a, y = b;
+    enum ndt_variadic flag;
+    ndt_field_t *fields = NULL;
+    ndt_field_t *field;
+    ndt_t * const *xtypes;
+    ndt_t * const *ytypes;
+    char *name = NULL;
+    ndt_t *type;
+    int64_t xshape, yshape, shape, i, j, k;
+    bool same_x, same_y;
+
+    if (is_variadic(a.t) && !is_variadic(b.t)) {
+        x = b;
+        y = a;
+    }
+
+    flag = is_variadic(x.t) ? Variadic : Nonvariadic;
+    xshape = nfields(x.t);
+    yshape = nfields(y.t);
+    xtypes = field_types(x.t);
+    ytypes = field_types(y.t);
+
+    shape = xshape;
+    if (flag == Variadic) {
+        for (j = 0; j < yshape; j++) {
+            shape += partner(y.t, j, x.t) < 0;
+        }
+    }
+
+    same_x = shape == xshape;
+    same_y = shape == yshape && is_variadic(y.t) == (flag == Variadic);
+
+    if (shape == 0 && (same_x || same_y)) {
+        return (ndt_t *)ndt_incref(same_x ? x.t : y.t);
+    }
+
+    fields = ndt_calloc(shape, sizeof *fields);
+    if (fields == NULL && shape > 0) {
+        return ndt_memory_error(u->ctx);
+    }
+
+    for (i = 0, j = 0; i < shape; i++) {
+        if (i < xshape) {
+            k = partner(x.t, i, y.t);
+            if (k < 0) {
+                type = build(u, child(x, xtypes[i]), child(x, xtypes[i]));
+            }
+            else {
+                type = build(u, child(x, xtypes[i]), child(y, ytypes[k]));
+            }
+            if (type == NULL) {
+                goto error;
+            }
+            same_x &= type == xtypes[i];
+            same_y &= k == i && type == ytypes[i];
+            k = i;
+        }
+        else {
+            while (partner(y.t, j, x.t) >= 0) {
+                j++;
+            }
+            k = j++;
+            type = build(u, child(y, ytypes[k]), child(y, ytypes[k]));
+            if (type == NULL) {
+                goto error;
+            }
+            same_x = false;
+            same_y &= k == i && type == ytypes[i];
+        }
+
+        if (x.t->tag == Record) {
+            name = ndt_strdup(i < xshape ? x.t->Record.names[k] : y.t->Record.names[k],
+                              u->ctx);
+            if (name == NULL) {
+                ndt_del(type);
+                goto error;
+            }
+        }
+
+        field = ndt_field(name, type, none, none, u->ctx);
+        if (field == NULL) {
+            goto error;
+        }
+
+        fields[i] = *field;
+        ndt_free(field);
+    }
+
+    if (same_x || same_y) {
+        /* keep the layout of fields without variables */
+        ndt_field_array_del(fields, shape);
+        return (ndt_t *)ndt_incref(same_x ? x.t : y.t);
+    }
+
+    if (x.t->tag == Tuple) {
+        return ndt_tuple(flag, fields, shape, none, none, u->ctx);
+    }
+
+    return ndt_record(flag, fields, shape, none, none, u->ctx);
+
+error:
+    ndt_field_array_del(fields, i);
+    return NULL;
+}
+
+static ndt_t *
+build_function(unifier_t *u, term_t a, term_t b)
+{
+    const ndt_t *s = a.t;
+    const ndt_t *t = b.t;
+    ndt_t *ret, *pos, *kwds;
+
+    ret = build(u, child(a, s->Function.ret), child(b, t->Function.ret));
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    pos = build(u, child(a, s->Function.pos), child(b, t->Function.pos));
+    if (pos == NULL) {
+        ndt_del(ret);
+        return NULL;
+    }
+
+    kwds = build(u, child(a, s->Function.kwds), child(b, t->Function.kwds));
+    if (kwds == NULL) {
+        ndt_del(ret);
+        ndt_del(pos);
+        return NULL;
+    }
+
+    if (ret == s->Function.ret && pos == s->Function.pos && kwds == s->Function.kwds) {
+        ndt_del(ret);
+        ndt_del(pos);
+        return unchanged(s, kwds);
+    }
+
+    return ndt_function(ret, pos, kwds, u->ctx);
+}
+
+/*
+ * Build the unifier of the subtrees 'a' and 'b' after a successful
+ * unification.  Unchanged subtrees of either side are shared.
+ */
+static ndt_t *
+build(unifier_t *u, term_t a, term_t b)
+{
+    const ndt_t *s, *t;
+    ndt_t *c;
+    int i, j;
+
+    if (resolve(u, &a, &i) <= 0 || resolve(u, &b, &j) <= 0) {
+        return u->ctx->err != NDT_Success ? NULL : inconsistent(u->ctx);
+    }
+
+    if (i >= 0 && j >= 0) {
+        return i == j ? build_var(u, i) : inconsistent(u->ctx);
+    }
+    if (i >= 0) {
+        a = b;
+    }
+    else if (j >= 0) {
+        b = a;
+    }
+
+    s = a.t;
+    t = b.t;
+
+    if (is_ground(t)) {
+        return (ndt_t *)ndt_incref(t);
+    }
+    if (is_ground(s)) {
+        return (ndt_t *)ndt_incref(s);
+    }
+
+    if (ndt_is_array(s)) {
+        return build_array(u, a, b);
+    }
+
+    switch (s->tag) {
+    case Tuple: case Record:
+        return build_fields(u, a, b);
+    case Function:
+        return build_function(u, a, b);
+    case Option:
+        c = build(u, child(a, s->Option.type), child(b, t->Option.type));
+        if (c == NULL) return NULL;
+        if (c == s->Option.type) return unchanged(s, c);
+        if (c == t->Option.type) return unchanged(t, c);
+        return ndt_option(c, u->ctx);
+    case OptionItem:
+        c = build(u, child(a, s->OptionItem.type), child(b, t->OptionItem.type));
+        if (c == NULL) return NULL;
+        if (c == s->OptionItem.type) return unchanged(s, c);
+        if (c == t->OptionItem.type) return unchanged(t, c);
+        return ndt_item_option(c, u->ctx);
+    case Pointer:
+        c = build(u, child(a, s->Pointer.type), child(b, t->Pointer.type));
+        if (c == NULL) return NULL;
+        if (c == s->Pointer.type) return unchanged(s, c);
+        if (c == t->Pointer.type) return unchanged(t, c);
+        return ndt_pointer(c, u->ctx);
+    case Constr: {
+        char *name;
+        c = build(u, child(a, s->Constr.type), child(b, t->Constr.type));
+        if (c == NULL) return NULL;
+        if (c == s->Constr.type) return unchanged(s, c);
+        if (c == t->Constr.type) return unchanged(t, c);
+        name = ndt_strdup(s->Constr.name, u->ctx);
+        if (name == NULL) {
+            ndt_del(c);
+            return NULL;
+        }
+        return ndt_constr(name, c, u->ctx);
+    }
+    default:
+        return (ndt_t *)ndt_incref(s);
+    }
+}
+
+/*
+ * Return the most general type that matches both 'p' and 'q', i.e. both
+ * ndt_match(p, result) and ndt_match(q, result) succeed.  Type variables,
+ * kinds, symbolic dimensions and ellipses on both sides are bound; the
+ * variables of 'p' and 'q' are distinct even if they have the same name.
+ * Unbound variables of 'q' whose names are also used in 'p' are renamed in
+ * the result.
+ *
+ * If the types do not unify, NULL is returned without setting an error.
+ */
+ndt_t *
+ndt_unify(const ndt_t *p, const ndt_t *q, ndt_context_t *ctx)
+{
+    unifier_t u = { NULL, 0, 0, NULL, 0, {p, q}, ctx };
+    term_t a = { p, 0 };
+    term_t b = { q, 1 };
+    ndt_t *t = NULL;
+
+    if (unify_type(&u, a, b) == 1) {
+        t = build(&u, a, b);
+    }
+
+    unifier_clear(&u);
+    return t;
+}
@@ -0,0 +1,293 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2017, plures
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef WALK_H
+#define WALK_H
+
+
+#include <stdint.h>
+#include <string.h>
+#include "ndtypes.h"
+
+
+/*****************************************************************************/
+/*                      Iterative traversal of types                         */
+/*****************************************************************************/
+
+/*
+ * Visit the nodes of one type or of two types in parallel.  The traversal
+ * keeps its own stack, so the native stack use does not depend on the depth
+ * of the type.  The functions are inline, so that the callbacks can be
+ * inlined into the loop.
+ *
+ * 'pre' is called before the children of a node and 'post' after them,
+ * either callback can be NULL.  In a parallel walk the i-th child of 't' is
+ * visited together with the i-th child of 'u', so 'pre' must check that the
+ * nodes have the same children.  In a single walk 'u' is NULL.  'parent'
+ * is the parent of 't' or NULL for the root, 'index' is the position of the
+ * node in its parent or -1 for the root.  The children of a function are
+ * visited in the order pos, kwds, ret.  Missing children of partially
+ * constructed types are skipped.
+ *
+ * A callback returns WalkContinue, WalkSkip to skip the children and the
+ * 'post' call of the node, or any other value to stop the walk, which is
+ * then returned by walk().  'pre' can also return WalkSkipSiblings to skip
+ * the node and its remaining siblings; the 'post' call of the parent still
+ * takes place.  WalkNoPost visits the children but not 'post' for the node,
+ * chains of such nodes with a single child do not need frames.
+ */
+enum walk_action { WalkContinue, WalkSkip, WalkSkipSiblings, WalkNoPost, WalkStop };
+
+typedef int (*walk_f)(const ndt_t *t, const ndt_t *u, const ndt_t *parent,
+                      int64_t index, void *arg);
+
+/* Number of frames that are stored without allocating. */
+#define WALK_INLINE 64
+
+typedef struct {
+    const ndt_t *t;
+    const ndt_t *u;
+    const ndt_t *parent;
+    ndt_t *const *tc; /* children of 't', NULL for functions */
+    ndt_t *const *uc;
+    int64_t index;
+    int64_t next;
+    int64_t nchildren;
+    int post;         /* call 'post' for 't' */
+} frame_t;
+
+/*
+ * Return the array of child types of 't' and set 'n' to their number.  The
+ * children of a function are not stored in an array, in that case the
+ * return value is NULL.  The values of a categorical are data.
+ */
+static inline ndt_t *const *
+children(const ndt_t *t, int64_t *n)
+{
+    *n = 1;
+
+    switch (t->tag) {
+    case FixedDim: return &t->FixedDim.type;
+    case SymbolicDim: return &t->SymbolicDim.type;
+    case VarDim: return &t->VarDim.type;
+    case EllipsisDim: return &t->EllipsisDim.type;
+    case Option: return &t->Option.type;
+    case OptionItem: return &t->OptionItem.type;
+    case Pointer: return &t->Pointer.type;
+    case Constr: return &t->Constr.type;
+    case Tuple: *n = t->Tuple.shape; return t->Tuple.types;
+    case Record: *n = t->Record.shape; return t->Record.types;
+    case Function: *n = 3; return NULL;
+    default: *n = 0; return NULL;
+    }
+}
+
+static inline const ndt_t *
+child(ndt_t *const *c, const ndt_t *t, int64_t i)
+{
+    if (c != NULL) {
+        return c[i];
+    }
+
+    return i == 0 ? t->Function.pos : i == 1 ? t->Function.kwds : t->Function.ret;
+}
+
+static inline int
+visit(walk_f f, const ndt_t *t, const ndt_t *u, const ndt_t *parent,
+      int64_t index, void *arg)
+{
+    return f == NULL ? WalkContinue : f(t, u, parent, index, arg);
+}
+
+/*
+ * Walk the children of 't' and call 'post' for 't'.  'pre' has already
+ * been called for 't' and returned 'action'.  If the stack cannot grow, the
+ * subtree is walked with a new stack, so a walk never fails for lack of
+ * memory.
+ */
+static inline int
+walk_from(const ndt_t *t, const ndt_t *u, const ndt_t *parent, int64_t index,
+          int action, walk_f pre, walk_f post, void *arg)
+{
+    frame_t frames[WALK_INLINE];
+    frame_t *stack = frames;
+    frame_t *f, *s;
+    ndt_t *const *tc, *const *uc;
+    const ndt_t *ct, *cu;
+    int64_t alloc = WALK_INLINE;
+    int64_t len = 1;
+    int64_t i, n, m;
+    int r = WalkContinue;
+
+    f = &stack[0];
+    f->t = t;
+    f->u = u;
+    f->parent = parent;
+    f->tc = children(t, &f->nchildren);
+    f->uc = u == NULL ? NULL : children(u, &m);
+    f->index = index;
+    f->next = 0;
+    f->post = action == WalkContinue;
+
+    while (len > 0) {
+        f = &stack[len-1];
+
+        if (f->next == f->nchildren) {
+            len--;
+            if (f->post) {
+                r = visit(post, f->t, f->u, f->parent, f->index, arg);
+                if (r != WalkContinue && r != WalkSkip) {
+                    break;
+                }
+            }
+            r = WalkContinue;
+            continue;
+        }
+
+        i = f->next++;
+        ct = child(f->tc, f->t, i);
+        cu = f->u == NULL ? NULL : child(f->uc, f->u, i);
+        if (ct == NULL) {
+            continue;
+        }
+
+        r = visit(pre, ct, cu, f->t, i, arg);
+        if (r == WalkSkip) {
+            r = WalkContinue;
+            continue;
+        }
+        if (r == WalkSkipSiblings) {
+            f->next = f->nchildren;
+            r = WalkContinue;
+            continue;
+        }
+        if (r != WalkContinue && r != WalkNoPost) {
+            break;
+        }
+
+        parent = f->t;
+        tc = children(ct, &n);
+        uc = cu == NULL ? NULL : children(cu, &m);
+
+        /* without 'post', chains of single children do not need frames */
+        while (n == 1 && (post == NULL || r == WalkNoPost)) {
+            t = tc[0];
+            u = cu == NULL ? NULL : uc[0];
+            if (t == NULL) {
+                n = 0;
+                break;
+            }
+            r = visit(pre, t, u, ct, 0, arg);
+            if (r == WalkSkip || r == WalkSkipSiblings) {
+                r = WalkNoPost;
+                n = 0;
+                break;
+            }
+            if (r != WalkContinue && r != WalkNoPost) {
+                goto out;
+            }
+            parent = ct;
+            ct = t;
+            cu = u;
+            i = 0;
+            tc = children(ct, &n);
+            uc = cu == NULL ? NULL : children(cu, &m);
+        }
+
+        /* leaves do not need a frame */
+        if (n == 0) {
+            if (r == WalkContinue) {
+                r = visit(post, ct, cu, parent, i, arg);
+                if (r != WalkContinue && r != WalkSkip) {
+                    break;
+                }
+            }
+            r = WalkContinue;
+            continue;
+        }
+
+        if (len == alloc) {
+            s = stack == frames ? ndt_alloc(2 * alloc, sizeof *s)
+                                : ndt_realloc(stack, 2 * alloc, sizeof *s);
+            if (s == NULL) {
+                r = walk_from(ct, cu, parent, i, r, pre, post, arg);
+                if (r != WalkContinue) {
+                    break;
+                }
+                continue;
+            }
+            if (stack == frames) {
+                memcpy(s, frames, sizeof frames);
+            }
+            stack = s;
+            alloc *= 2;
+        }
+
+        f = &stack[len++];
+        f->t = ct;
+        f->u = cu;
+        f->parent = parent;
+        f->tc = tc;
+        f->uc = uc;
+        f->index = i;
+        f->next = 0;
+        f->nchildren = n;
+        f->post = r == WalkContinue;
+    }
+
+out:
+    if (stack != frames) {
+        ndt_free(stack);
+    }
+
+    return r;
+}
+
+static inline int
+walk(const ndt_t *t, const ndt_t *u, walk_f pre, walk_f post, void *arg)
+{
+    int r;
+
+    r = visit(pre, t, u, NULL, -1, arg);
+    if (r == WalkSkip || r == WalkSkipSiblings) {
+        return WalkContinue;
+    }
+    if (r != WalkContinue && r != WalkNoPost) {
+        return r;
+    }
+
+    return walk_from(t, u, NULL, -1, r, pre, post, arg);
+}
+
+
+#endif /* WALK_H */